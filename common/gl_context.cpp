@@ -0,0 +1,405 @@
+#include "gl_context.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+
+#include <X11/Xlib.h>
+#include <GL/gl.h>
+#include <GL/glx.h>
+#include <GL/glxext.h>
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#include "gl_trace.h"
+#include "stage_timer.h"
+
+struct GLContext {
+    GLBackend backend;
+    int width;
+    int height;
+    double creationMs;
+    bool shared;    // created by createSharedGLContext, doesn't own the display
+
+    // GLX
+    Display* dpy;
+    XVisualInfo* vi;
+    Colormap cmap;
+    Window win;
+    GLXContext glc;
+
+    // EGL
+    EGLDisplay eglDpy;
+    EGLConfig eglConfig;
+    EGLSurface eglSurface;
+    EGLContext eglContext;
+};
+
+//-----------------------------------------------------------------------------------
+// Backend names
+//-----------------------------------------------------------------------------------
+
+bool parseBackend(const char* name, GLBackend* backend) {
+    if (!strcmp(name, "glx")) {
+        *backend = BACKEND_GLX;
+    } else if (!strcmp(name, "egl-pbuffer")) {
+        *backend = BACKEND_EGL_PBUFFER;
+    } else if (!strcmp(name, "egl-surfaceless")) {
+        *backend = BACKEND_EGL_SURFACELESS;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+const char* backendToString(GLBackend backend) {
+    switch (backend) {
+        case BACKEND_GLX: return "glx";
+        case BACKEND_EGL_PBUFFER: return "egl-pbuffer";
+        case BACKEND_EGL_SURFACELESS: return "egl-surfaceless";
+        default: return "unknown backend!";
+    }
+}
+
+//-----------------------------------------------------------------------------------
+// GLX
+//-----------------------------------------------------------------------------------
+
+static void createGLXContext(GLContext* ctx, const GLContextOptions& options) {
+    // 1. Open a connection to the X server. Shared contexts may be made current
+    // on other threads so Xlib has to be thread safe.
+    beginStage("open display");
+    XInitThreads();
+    ctx->dpy = XOpenDisplay(NULL);
+    if (ctx->dpy == NULL) {
+        printf("Cannot connect to X server\n");
+        exit(1);
+    }
+
+    // 2. Choose a suitable visual
+    beginStage("choose visual");
+    static int visual_attribs[] = {
+        GLX_RGBA,
+        GLX_DEPTH_SIZE, 24,
+        GLX_DOUBLEBUFFER,
+        None
+    };
+    ctx->vi = glXChooseVisual(ctx->dpy, DefaultScreen(ctx->dpy), visual_attribs);
+    if (ctx->vi == NULL) {
+        printf("No appropriate visual found\n");
+        exit(1);
+    }
+
+    // 3. Create a window
+    beginStage("create window");
+    Display* dpy = ctx->dpy;
+    XVisualInfo* vi = ctx->vi;
+    ctx->cmap = XCreateColormap(dpy, DefaultRootWindow(dpy), vi->visual, AllocNone);
+    XSetWindowAttributes swa;
+    swa.colormap = ctx->cmap;
+    swa.event_mask = ExposureMask | KeyPressMask;
+    ctx->win = XCreateWindow(dpy, DefaultRootWindow(dpy), 0, 0, options.width, options.height, 0, vi->depth, InputOutput, vi->visual, CWColormap | CWEventMask, &swa);
+    XMapWindow(dpy, ctx->win);
+    XStoreName(dpy, ctx->win, options.title);
+
+    // 4. Create an OpenGL context and make it current
+    beginStage("create context");
+    ctx->glc = glXCreateContext(dpy, vi, NULL, GL_TRUE);
+    if (ctx->glc == NULL) {
+        printf("Failed to create GLX context\n");
+        exit(1);
+    }
+    glXMakeCurrent(dpy, ctx->win, ctx->glc);
+}
+
+static void destroyGLXContext(GLContext* ctx) {
+    if (ctx->shared) {
+        // Its thread should have released it. The parent may still be current here.
+        glXDestroyContext(ctx->dpy, ctx->glc);
+        return;
+    }
+    glXMakeCurrent(ctx->dpy, None, NULL);
+    glXDestroyContext(ctx->dpy, ctx->glc);
+    XDestroyWindow(ctx->dpy, ctx->win);
+    XFreeColormap(ctx->dpy, ctx->cmap);
+    XFree(ctx->vi);
+    XCloseDisplay(ctx->dpy);
+}
+
+//-----------------------------------------------------------------------------------
+// EGL
+//-----------------------------------------------------------------------------------
+
+static bool hasExtension(const char* extensions, const char* name) {
+    if (extensions == NULL) {
+        return false;
+    }
+    size_t len = strlen(name);
+    for (const char* p = extensions; (p = strstr(p, name)) != NULL; p += len) {
+        if ((p == extensions || p[-1] == ' ') && (p[len] == ' ' || p[len] == '\0')) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void createEGLContext(GLContext* ctx, const GLContextOptions& options) {
+    bool surfaceless = options.backend == BACKEND_EGL_SURFACELESS;
+
+    // 1. Get a display. Prefer the surfaceless platform so no X server is touched.
+    beginStage("open display");
+    const char* clientExtensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+    if (hasExtension(clientExtensions, "EGL_MESA_platform_surfaceless")) {
+        PFNEGLGETPLATFORMDISPLAYEXTPROC eglGetPlatformDisplayEXT =
+            (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+        if (eglGetPlatformDisplayEXT) {
+            ctx->eglDpy = eglGetPlatformDisplayEXT(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+        }
+    } else if (surfaceless) {
+        printf("EGL_MESA_platform_surfaceless not supported\n");
+        exit(1);
+    }
+    if (ctx->eglDpy == EGL_NO_DISPLAY) {
+        ctx->eglDpy = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    }
+    EGLint major, minor;
+    if (ctx->eglDpy == EGL_NO_DISPLAY || !eglInitialize(ctx->eglDpy, &major, &minor)) {
+        printf("Cannot initialize EGL display: %x\n", eglGetError());
+        exit(1);
+    }
+    if (surfaceless && !hasExtension(eglQueryString(ctx->eglDpy, EGL_EXTENSIONS), "EGL_KHR_surfaceless_context")) {
+        printf("EGL_KHR_surfaceless_context not supported\n");
+        exit(1);
+    }
+
+    // 2. Choose a config
+    beginStage("choose config");
+    static const EGLint config_attribs[] = {
+        EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+        EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+        EGL_RED_SIZE, 8,
+        EGL_GREEN_SIZE, 8,
+        EGL_BLUE_SIZE, 8,
+        EGL_ALPHA_SIZE, 8,
+        EGL_DEPTH_SIZE, 24,
+        EGL_NONE
+    };
+    EGLint numConfigs = 0;
+    if (!eglChooseConfig(ctx->eglDpy, config_attribs, &ctx->eglConfig, 1, &numConfigs) || numConfigs == 0) {
+        printf("No appropriate EGL config found\n");
+        exit(1);
+    }
+
+    // 3. Create a pbuffer unless we're running surfaceless
+    beginStage("create surface");
+    ctx->eglSurface = EGL_NO_SURFACE;
+    if (!surfaceless) {
+        const EGLint pbuffer_attribs[] = {
+            EGL_WIDTH, options.width,
+            EGL_HEIGHT, options.height,
+            EGL_NONE
+        };
+        ctx->eglSurface = eglCreatePbufferSurface(ctx->eglDpy, ctx->eglConfig, pbuffer_attribs);
+        if (ctx->eglSurface == EGL_NO_SURFACE) {
+            printf("Failed to create pbuffer: %x\n", eglGetError());
+            exit(1);
+        }
+    }
+
+    // 4. Create an OpenGL context and make it current
+    beginStage("create context");
+    eglBindAPI(EGL_OPENGL_API);
+    ctx->eglContext = eglCreateContext(ctx->eglDpy, ctx->eglConfig, EGL_NO_CONTEXT, NULL);
+    if (ctx->eglContext == EGL_NO_CONTEXT) {
+        printf("Failed to create EGL context: %x\n", eglGetError());
+        exit(1);
+    }
+    if (!eglMakeCurrent(ctx->eglDpy, ctx->eglSurface, ctx->eglSurface, ctx->eglContext)) {
+        printf("Failed to make EGL context current: %x\n", eglGetError());
+        exit(1);
+    }
+}
+
+static void destroyEGLContext(GLContext* ctx) {
+    if (!ctx->shared) {
+        eglMakeCurrent(ctx->eglDpy, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    }
+    eglDestroyContext(ctx->eglDpy, ctx->eglContext);
+    if (ctx->eglSurface != EGL_NO_SURFACE) {
+        eglDestroySurface(ctx->eglDpy, ctx->eglSurface);
+    }
+    if (!ctx->shared) {
+        eglTerminate(ctx->eglDpy);
+    }
+}
+
+//-----------------------------------------------------------------------------------
+// Public interface
+//-----------------------------------------------------------------------------------
+
+GLContext* createGLContext(const GLContextOptions& options) {
+    GLContext* ctx = (GLContext*)calloc(1, sizeof(GLContext));
+    ctx->backend = options.backend;
+    ctx->width = options.width;
+    ctx->height = options.height;
+
+    auto start = std::chrono::steady_clock::now();
+    if (options.backend == BACKEND_GLX) {
+        createGLXContext(ctx, options);
+    } else {
+        createEGLContext(ctx, options);
+    }
+    endStage();
+    auto end = std::chrono::steady_clock::now();
+    ctx->creationMs = std::chrono::duration<double, std::milli>(end - start).count();
+    return ctx;
+}
+
+void destroyGLContext(GLContext* ctx) {
+    if (ctx->backend == BACKEND_GLX) {
+        destroyGLXContext(ctx);
+    } else {
+        destroyEGLContext(ctx);
+    }
+    free(ctx);
+}
+
+GLContext* createSharedGLContext(const GLContext* parent) {
+    GLContext* ctx = (GLContext*)malloc(sizeof(GLContext));
+    *ctx = *parent;
+    ctx->shared = true;
+
+    if (parent->backend == BACKEND_GLX) {
+        // Worker contexts never draw to the window, they only need a drawable to
+        // be current, so they bind the parent's window.
+        ctx->glc = glXCreateContext(parent->dpy, parent->vi, parent->glc, GL_TRUE);
+        if (ctx->glc == NULL) {
+            printf("Failed to create shared GLX context\n");
+            exit(1);
+        }
+        return ctx;
+    }
+
+    ctx->eglContext = eglCreateContext(parent->eglDpy, parent->eglConfig, parent->eglContext, NULL);
+    if (ctx->eglContext == EGL_NO_CONTEXT) {
+        printf("Failed to create shared EGL context: %x\n", eglGetError());
+        exit(1);
+    }
+    ctx->eglSurface = EGL_NO_SURFACE;
+    if (!hasExtension(eglQueryString(parent->eglDpy, EGL_EXTENSIONS), "EGL_KHR_surfaceless_context")) {
+        const EGLint pbuffer_attribs[] = {
+            EGL_WIDTH, 1,
+            EGL_HEIGHT, 1,
+            EGL_NONE
+        };
+        ctx->eglSurface = eglCreatePbufferSurface(parent->eglDpy, parent->eglConfig, pbuffer_attribs);
+        if (ctx->eglSurface == EGL_NO_SURFACE) {
+            printf("Failed to create pbuffer for shared context: %x\n", eglGetError());
+            exit(1);
+        }
+    }
+    return ctx;
+}
+
+void makeCurrent(GLContext* ctx) {
+    bool ok;
+    if (ctx->backend == BACKEND_GLX) {
+        ok = glXMakeCurrent(ctx->dpy, ctx->win, ctx->glc);
+    } else {
+        ok = eglMakeCurrent(ctx->eglDpy, ctx->eglSurface, ctx->eglSurface, ctx->eglContext);
+    }
+    if (!ok) {
+        printf("Failed to make context current\n");
+        exit(1);
+    }
+}
+
+void releaseCurrent(GLContext* ctx) {
+    if (ctx->backend == BACKEND_GLX) {
+        glXMakeCurrent(ctx->dpy, None, NULL);
+    } else {
+        eglMakeCurrent(ctx->eglDpy, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    }
+}
+
+GLBackend getBackend(const GLContext* ctx) {
+    return ctx->backend;
+}
+
+bool hasDefaultFramebuffer(const GLContext* ctx) {
+    return ctx->backend != BACKEND_EGL_SURFACELESS;
+}
+
+bool hasWindow(const GLContext* ctx) {
+    return ctx->backend == BACKEND_GLX;
+}
+
+double getContextCreationMs(const GLContext* ctx) {
+    return ctx->creationMs;
+}
+
+static GLContextEvent translateEvent(const XEvent& xev) {
+    switch (xev.type) {
+        case Expose: return EVENT_EXPOSE;
+        case KeyPress: return EVENT_KEY_PRESS;
+        default: return EVENT_NONE;
+    }
+}
+
+GLContextEvent waitEvent(GLContext* ctx) {
+    if (!hasWindow(ctx)) {
+        return EVENT_NONE;
+    }
+    XEvent xev;
+    XNextEvent(ctx->dpy, &xev);
+    return translateEvent(xev);
+}
+
+GLContextEvent pollEvent(GLContext* ctx) {
+    if (!hasWindow(ctx) || !XPending(ctx->dpy)) {
+        return EVENT_NONE;
+    }
+    XEvent xev;
+    XNextEvent(ctx->dpy, &xev);
+    return translateEvent(xev);
+}
+
+bool setSwapInterval(GLContext* ctx, int interval) {
+    if (ctx->backend != BACKEND_GLX) {
+        return ctx->eglSurface != EGL_NO_SURFACE && eglSwapInterval(ctx->eglDpy, interval);
+    }
+    const char* extensions = glXQueryExtensionsString(ctx->dpy, DefaultScreen(ctx->dpy));
+    if (hasExtension(extensions, "GLX_EXT_swap_control")) {
+        PFNGLXSWAPINTERVALEXTPROC glXSwapIntervalEXT =
+            (PFNGLXSWAPINTERVALEXTPROC)glXGetProcAddress((const GLubyte*)"glXSwapIntervalEXT");
+        if (glXSwapIntervalEXT) {
+            glXSwapIntervalEXT(ctx->dpy, ctx->win, interval);
+            return true;
+        }
+    }
+    if (hasExtension(extensions, "GLX_MESA_swap_control")) {
+        PFNGLXSWAPINTERVALMESAPROC glXSwapIntervalMESA =
+            (PFNGLXSWAPINTERVALMESAPROC)glXGetProcAddress((const GLubyte*)"glXSwapIntervalMESA");
+        if (glXSwapIntervalMESA) {
+            return glXSwapIntervalMESA(interval) == 0;
+        }
+    }
+    return false;
+}
+
+void swapBuffers(GLContext* ctx) {
+    traceSwapBuffers();
+    if (ctx->backend == BACKEND_GLX) {
+        glXSwapBuffers(ctx->dpy, ctx->win);
+    } else if (ctx->eglSurface != EGL_NO_SURFACE) {
+        eglSwapBuffers(ctx->eglDpy, ctx->eglSurface);
+    }
+}
+
+void* getProcAddress(const GLContext* ctx, const char* name) {
+    if (ctx->backend == BACKEND_GLX) {
+        return (void*)glXGetProcAddress((const GLubyte*)name);
+    }
+    return (void*)eglGetProcAddress(name);
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+//-----------------------------------------------------------------------------------
+// Context creation shared by the examples
+//
+// GLX opens an X window. The EGL backends need no X server at all: egl-pbuffer
+// renders into an EGL pbuffer and egl-surfaceless makes the context current with
+// no surface (EGL_MESA_platform_surfaceless + EGL_KHR_surfaceless_context) so the
+// example has to render into its own framebuffer objects.
+//
+// The window system types stay inside gl_context.cpp so the examples don't need
+// to include X11, GLX or EGL headers.
+//-----------------------------------------------------------------------------------
+
+enum GLBackend {
+    BACKEND_GLX,
+    BACKEND_EGL_PBUFFER,
+    BACKEND_EGL_SURFACELESS,
+};
+
+struct GLContextOptions {
+    GLBackend backend = BACKEND_GLX;
+    int width = 256;
+    int height = 256;
+    const char* title = "OpenGL";
+};
+
+enum GLContextEvent {
+    EVENT_NONE,
+    EVENT_EXPOSE,
+    EVENT_KEY_PRESS,
+};
+
+struct GLContext;
+
+// Parses "glx", "egl-pbuffer" or "egl-surfaceless". Returns false for anything else.
+bool parseBackend(const char* name, GLBackend* backend);
+const char* backendToString(GLBackend backend);
+
+// Creates the context and makes it current. Prints a message and exits on failure.
+GLContext* createGLContext(const GLContextOptions& options);
+void destroyGLContext(GLContext* ctx);
+
+// Creates a context that shares textures, buffers and other objects with parent,
+// for use on another thread. It isn't made current; call makeCurrent() on the
+// thread that will use it. Destroy it before the parent.
+GLContext* createSharedGLContext(const GLContext* parent);
+
+void makeCurrent(GLContext* ctx);
+void releaseCurrent(GLContext* ctx);
+
+GLBackend getBackend(const GLContext* ctx);
+
+// True when there is a default framebuffer (a window or a pbuffer) to render into.
+bool hasDefaultFramebuffer(const GLContext* ctx);
+
+// True when there is a window that produces events.
+bool hasWindow(const GLContext* ctx);
+
+// Wall time spent in createGLContext, from opening the display to making the
+// context current.
+double getContextCreationMs(const GLContext* ctx);
+
+// Blocks until the next window event. Returns EVENT_NONE for events the
+// examples don't care about and always returns EVENT_NONE without a window.
+GLContextEvent waitEvent(GLContext* ctx);
+
+// Returns the next pending window event without blocking, or EVENT_NONE.
+GLContextEvent pollEvent(GLContext* ctx);
+
+void swapBuffers(GLContext* ctx);
+
+// Sets the swap interval through GLX_EXT_swap_control, GLX_MESA_swap_control or
+// eglSwapInterval. Returns false if none of them is available.
+bool setSwapInterval(GLContext* ctx, int interval);
+
+// Looks up a GL entry point through glXGetProcAddress or eglGetProcAddress.
+void* getProcAddress(const GLContext* ctx, const char* name);
@@ -0,0 +1,220 @@
+#include "gl_debug.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <atomic>
+
+namespace {
+
+const int maxMessages = 256;
+const int maxText = 256;
+
+struct MessageSlot {
+    std::atomic<uint64_t> key;      // 0 while free
+    std::atomic<uint64_t> count;
+    uint64_t reported;              // count at the last report, only touched by reportGLDebugMessages()
+    GLenum source;
+    GLenum type;
+    GLenum severity;
+    GLuint id;
+    char text[maxText];
+};
+
+// Slots are found by hashing the key; arrivals lists them, plus one, in the
+// order their first message came in, so reports follow the order things went
+// wrong. A 0 in arrivals is an entry claimed but not written yet.
+MessageSlot slots[maxMessages];
+std::atomic<int> arrivals[maxMessages];
+std::atomic<int> numArrivals(0);
+std::atomic<uint64_t> numMessages(0);
+std::atomic<uint64_t> numDropped(0);
+
+GLErrorMode errorMode = GL_ERRORS_POLL;
+bool debugOutput = false;
+uint64_t numChecks = 0;
+double checkMs = 0.0;
+
+uint64_t messageKey(GLenum source, GLenum type, GLuint id, GLenum severity, GLsizei length, const GLchar* message) {
+    uint64_t hash = 14695981039346656037ull;
+    auto mix = [&hash](const void* data, size_t size) {
+        for (size_t i = 0; i < size; ++i) {
+            hash = (hash ^ ((const uint8_t*)data)[i]) * 1099511628211ull;
+        }
+    };
+    mix(&source, sizeof(source));
+    mix(&type, sizeof(type));
+    mix(&id, sizeof(id));
+    mix(&severity, sizeof(severity));
+    mix(message, length);
+    return hash ? hash : 1;
+}
+
+void APIENTRY onDebugMessage(GLenum source, GLenum type, GLuint id, GLenum severity, GLsizei length,
+                             const GLchar* message, const void*) {
+    ++numMessages;
+    if (length < 0) {
+        length = GLsizei(strlen(message));
+    }
+    uint64_t key = messageKey(source, type, id, severity, length, message);
+    for (int probe = 0; probe < maxMessages; ++probe) {
+        int index = (key + probe) % maxMessages;
+        MessageSlot& slot = slots[index];
+        uint64_t expected = 0;
+        if (slot.key.compare_exchange_strong(expected, key)) {
+            slot.source = source;
+            slot.type = type;
+            slot.id = id;
+            slot.severity = severity;
+            int n = length < maxText - 1 ? length : maxText - 1;
+            memcpy(slot.text, message, n);
+            slot.text[n] = '\0';
+            ++slot.count;
+            arrivals[numArrivals++].store(index + 1, std::memory_order_release);
+            return;
+        }
+        if (expected == key) {
+            ++slot.count;
+            return;
+        }
+    }
+    ++numDropped;
+}
+
+const char* severityName(GLenum severity) {
+    switch (severity) {
+        case GL_DEBUG_SEVERITY_HIGH: return "high";
+        case GL_DEBUG_SEVERITY_MEDIUM: return "medium";
+        case GL_DEBUG_SEVERITY_LOW: return "low";
+        default: return "notification";
+    }
+}
+
+const char* typeName(GLenum type) {
+    switch (type) {
+        case GL_DEBUG_TYPE_ERROR: return "error";
+        case GL_DEBUG_TYPE_DEPRECATED_BEHAVIOR: return "deprecated";
+        case GL_DEBUG_TYPE_UNDEFINED_BEHAVIOR: return "undefined behavior";
+        case GL_DEBUG_TYPE_PORTABILITY: return "portability";
+        case GL_DEBUG_TYPE_PERFORMANCE: return "performance";
+        default: return "other";
+    }
+}
+
+}  // namespace
+
+bool parseGLErrorMode(const char* name, GLErrorMode* mode) {
+    if (!strcmp(name, "poll")) {
+        *mode = GL_ERRORS_POLL;
+    } else if (!strcmp(name, "strict")) {
+        *mode = GL_ERRORS_STRICT;
+    } else if (!strcmp(name, "release")) {
+        *mode = GL_ERRORS_RELEASE;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+const char* glErrorModeToString(GLErrorMode mode) {
+    switch (mode) {
+        case GL_ERRORS_POLL: return "poll";
+        case GL_ERRORS_STRICT: return "strict";
+        case GL_ERRORS_RELEASE: return "release";
+    }
+    return "unknown";
+}
+
+bool parseGLDebugSeverity(const char* name, GLenum* severity) {
+    if (!strcmp(name, "high")) {
+        *severity = GL_DEBUG_SEVERITY_HIGH;
+    } else if (!strcmp(name, "medium")) {
+        *severity = GL_DEBUG_SEVERITY_MEDIUM;
+    } else if (!strcmp(name, "low")) {
+        *severity = GL_DEBUG_SEVERITY_LOW;
+    } else if (!strcmp(name, "notification")) {
+        *severity = GL_DEBUG_SEVERITY_NOTIFICATION;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+void setGLErrorMode(GLErrorMode mode, GLenum minSeverity) {
+    errorMode = mode;
+    if (mode == GL_ERRORS_POLL) {
+        if (debugOutput) {
+            glDisable(GL_DEBUG_OUTPUT);
+            debugOutput = false;
+        }
+        return;
+    }
+    glDebugMessageCallback(onDebugMessage, nullptr);
+    // From least to most severe; everything before minSeverity is turned off.
+    const GLenum severities[] = {
+        GL_DEBUG_SEVERITY_NOTIFICATION,
+        GL_DEBUG_SEVERITY_LOW,
+        GL_DEBUG_SEVERITY_MEDIUM,
+        GL_DEBUG_SEVERITY_HIGH,
+    };
+    bool enabled = false;
+    for (GLenum severity : severities) {
+        enabled = enabled || severity == minSeverity;
+        glDebugMessageControl(GL_DONT_CARE, GL_DONT_CARE, severity, 0, nullptr, enabled ? GL_TRUE : GL_FALSE);
+    }
+    glEnable(GL_DEBUG_OUTPUT);
+    debugOutput = true;
+}
+
+GLErrorMode getGLErrorMode() {
+    return errorMode;
+}
+
+int reportGLDebugMessages(const char* stage) {
+    int errors = 0;
+    int n = numArrivals.load();
+    for (int i = 0; i < n; ++i) {
+        int index = arrivals[i].load(std::memory_order_acquire) - 1;
+        // The next report picks up an entry that isn't written yet.
+        if (index < 0) {
+            continue;
+        }
+        MessageSlot& slot = slots[index];
+        uint64_t count = slot.count.load();
+        if (count == slot.reported) {
+            continue;
+        }
+        printf("debug   : %s: %s %s 0x%x: %s", stage, severityName(slot.severity), typeName(slot.type), slot.id, slot.text);
+        if (count - slot.reported > 1) {
+            printf(" (%llu times)", (unsigned long long)(count - slot.reported));
+        }
+        printf("\n");
+        slot.reported = count;
+        if (slot.type == GL_DEBUG_TYPE_ERROR || slot.severity == GL_DEBUG_SEVERITY_HIGH) {
+            ++errors;
+        }
+    }
+    return errors;
+}
+
+GLErrorStats getGLErrorStats() {
+    GLErrorStats stats;
+    stats.checks = numChecks;
+    stats.checkMs = checkMs;
+    stats.messages = numMessages;
+    stats.unique = numArrivals;
+    stats.dropped = numDropped;
+    return stats;
+}
+
+void printGLErrorStats() {
+    GLErrorStats stats = getGLErrorStats();
+    printf("errors  : %s, %llu checks in %.3f ms (%.2f us each), %llu debug messages, %llu distinct, %llu dropped\n",
+           glErrorModeToString(errorMode), (unsigned long long)stats.checks, stats.checkMs,
+           stats.checks ? stats.checkMs * 1000.0 / stats.checks : 0.0, (unsigned long long)stats.messages,
+           (unsigned long long)stats.unique, (unsigned long long)stats.dropped);
+}
+
+void addGLErrorCheck(double ms) {
+    ++numChecks;
+    checkMs += ms;
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "gl_loader.h"
+
+//-----------------------------------------------------------------------------------
+// How checkError() finds GL errors
+//
+// GL_ERRORS_POLL calls glGetError() at every check, which on many drivers is a
+// round trip to the driver thread. The other two modes never call it. They
+// register a KHR_debug callback instead, which may run on any thread, and which
+// only bumps a counter for a message it has seen before. The first of each
+// distinct message (source, type, id, severity and text) is copied into a fixed
+// table without taking a lock. Each check reports what arrived since the last one
+// in arrival order, with repeat counts. GL_ERRORS_STRICT then exits if any of it
+// was an error or of high severity, like polling did; GL_ERRORS_RELEASE only
+// reports.
+//
+// Messages below the minimum severity are turned off in the driver with
+// glDebugMessageControl, so they cost nothing. Debug output isn't synchronous, so
+// a message is reported at the first check after the driver gets to it.
+//-----------------------------------------------------------------------------------
+
+enum GLErrorMode {
+    GL_ERRORS_POLL,
+    GL_ERRORS_STRICT,
+    GL_ERRORS_RELEASE,
+};
+
+struct GLErrorStats {
+    uint64_t checks;        // checkError() calls
+    double checkMs;         // time spent in them
+    uint64_t messages;      // debug messages received, repeats included
+    uint64_t unique;        // distinct messages kept
+    uint64_t dropped;       // distinct messages that didn't fit in the table
+};
+
+// Parses "poll", "strict" or "release". Returns false for anything else.
+bool parseGLErrorMode(const char* name, GLErrorMode* mode);
+const char* glErrorModeToString(GLErrorMode mode);
+
+// Parses "high", "medium", "low" or "notification" into a GL_DEBUG_SEVERITY_*.
+bool parseGLDebugSeverity(const char* name, GLenum* severity);
+
+// Call with the context current, after init_gl_functions(). Debug output is
+// enabled on that context only.
+void setGLErrorMode(GLErrorMode mode, GLenum minSeverity = GL_DEBUG_SEVERITY_MEDIUM);
+GLErrorMode getGLErrorMode();
+
+// Prints the debug messages that arrived since the last call, prefixed with
+// stage. Returns the number of them that were errors or of high severity.
+int reportGLDebugMessages(const char* stage);
+
+GLErrorStats getGLErrorStats();
+void printGLErrorStats();
+
+// checkError() records its own time here.
+void addGLErrorCheck(double ms);
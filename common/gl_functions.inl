@@ -0,0 +1,109 @@
+// List of the GL entry points the examples use. Each entry expands GL_FUNCTION(type, name).
+// Include it with GL_FUNCTION defined; add new entry points here, not in the examples.
+
+// OpenGL 1.x
+GL_FUNCTION(PFNGLGETERRORPROC, glGetError)
+GL_FUNCTION(PFNGLGETSTRINGPROC, glGetString)
+GL_FUNCTION(PFNGLGETSTRINGIPROC, glGetStringi)
+GL_FUNCTION(PFNGLGETINTEGERVPROC, glGetIntegerv)
+GL_FUNCTION(PFNGLGETINTEGER64VPROC, glGetInteger64v)
+GL_FUNCTION(PFNGLENABLEPROC, glEnable)
+GL_FUNCTION(PFNGLDISABLEPROC, glDisable)
+GL_FUNCTION(PFNGLVIEWPORTPROC, glViewport)
+GL_FUNCTION(PFNGLSCISSORPROC, glScissor)
+GL_FUNCTION(PFNGLCLEARPROC, glClear)
+GL_FUNCTION(PFNGLCLEARCOLORPROC, glClearColor)
+GL_FUNCTION(PFNGLCLEARDEPTHPROC, glClearDepth)
+GL_FUNCTION(PFNGLDRAWARRAYSPROC, glDrawArrays)
+GL_FUNCTION(PFNGLREADPIXELSPROC, glReadPixels)
+GL_FUNCTION(PFNGLGENTEXTURESPROC, glGenTextures)
+GL_FUNCTION(PFNGLDELETETEXTURESPROC, glDeleteTextures)
+GL_FUNCTION(PFNGLBINDTEXTUREPROC, glBindTexture)
+GL_FUNCTION(PFNGLTEXIMAGE2DPROC, glTexImage2D)
+GL_FUNCTION(PFNGLTEXSUBIMAGE2DPROC, glTexSubImage2D)
+GL_FUNCTION(PFNGLTEXPARAMETERIPROC, glTexParameteri)
+GL_FUNCTION(PFNGLTEXPARAMETERIVPROC, glTexParameteriv)
+GL_FUNCTION(PFNGLTEXPARAMETERFVPROC, glTexParameterfv)
+GL_FUNCTION(PFNGLPIXELSTOREIPROC, glPixelStorei)
+GL_FUNCTION(PFNGLFLUSHPROC, glFlush)
+GL_FUNCTION(PFNGLFINISHPROC, glFinish)
+
+// Shaders and programs
+GL_FUNCTION(PFNGLCREATESHADERPROC, glCreateShader)
+GL_FUNCTION(PFNGLDELETESHADERPROC, glDeleteShader)
+GL_FUNCTION(PFNGLSHADERSOURCEPROC, glShaderSource)
+GL_FUNCTION(PFNGLCOMPILESHADERPROC, glCompileShader)
+GL_FUNCTION(PFNGLGETSHADERIVPROC, glGetShaderiv)
+GL_FUNCTION(PFNGLGETSHADERINFOLOGPROC, glGetShaderInfoLog)
+GL_FUNCTION(PFNGLCREATEPROGRAMPROC, glCreateProgram)
+GL_FUNCTION(PFNGLDELETEPROGRAMPROC, glDeleteProgram)
+GL_FUNCTION(PFNGLATTACHSHADERPROC, glAttachShader)
+GL_FUNCTION(PFNGLDETACHSHADERPROC, glDetachShader)
+GL_FUNCTION(PFNGLLINKPROGRAMPROC, glLinkProgram)
+GL_FUNCTION(PFNGLGETPROGRAMIVPROC, glGetProgramiv)
+GL_FUNCTION(PFNGLGETPROGRAMINFOLOGPROC, glGetProgramInfoLog)
+GL_FUNCTION(PFNGLUSEPROGRAMPROC, glUseProgram)
+GL_FUNCTION(PFNGLBINDATTRIBLOCATIONPROC, glBindAttribLocation)
+GL_FUNCTION(PFNGLPROGRAMPARAMETERIPROC, glProgramParameteri)
+GL_FUNCTION(PFNGLPROGRAMBINARYPROC, glProgramBinary)
+GL_FUNCTION(PFNGLGETPROGRAMBINARYPROC, glGetProgramBinary)
+GL_FUNCTION(PFNGLMAXSHADERCOMPILERTHREADSKHRPROC, glMaxShaderCompilerThreadsKHR)
+GL_FUNCTION(PFNGLUNIFORM4FPROC, glUniform4f)
+GL_FUNCTION(PFNGLUNIFORM2IPROC, glUniform2i)
+
+// Vertex arrays and buffers
+GL_FUNCTION(PFNGLGENVERTEXARRAYSPROC, glGenVertexArrays)
+GL_FUNCTION(PFNGLDELETEVERTEXARRAYSPROC, glDeleteVertexArrays)
+GL_FUNCTION(PFNGLBINDVERTEXARRAYPROC, glBindVertexArray)
+GL_FUNCTION(PFNGLGENBUFFERSPROC, glGenBuffers)
+GL_FUNCTION(PFNGLDELETEBUFFERSPROC, glDeleteBuffers)
+GL_FUNCTION(PFNGLBINDBUFFERPROC, glBindBuffer)
+GL_FUNCTION(PFNGLBINDBUFFERBASEPROC, glBindBufferBase)
+GL_FUNCTION(PFNGLBUFFERDATAPROC, glBufferData)
+GL_FUNCTION(PFNGLBUFFERSUBDATAPROC, glBufferSubData)
+GL_FUNCTION(PFNGLBUFFERSTORAGEPROC, glBufferStorage)
+GL_FUNCTION(PFNGLMAPBUFFERRANGEPROC, glMapBufferRange)
+GL_FUNCTION(PFNGLUNMAPBUFFERPROC, glUnmapBuffer)
+GL_FUNCTION(PFNGLENABLEVERTEXATTRIBARRAYPROC, glEnableVertexAttribArray)
+GL_FUNCTION(PFNGLVERTEXATTRIBPOINTERPROC, glVertexAttribPointer)
+GL_FUNCTION(PFNGLVERTEXATTRIBDIVISORPROC, glVertexAttribDivisor)
+GL_FUNCTION(PFNGLMULTIDRAWARRAYSINDIRECTPROC, glMultiDrawArraysIndirect)
+
+// Textures
+GL_FUNCTION(PFNGLACTIVETEXTUREPROC, glActiveTexture)
+GL_FUNCTION(PFNGLTEXSTORAGE2DPROC, glTexStorage2D)
+GL_FUNCTION(PFNGLTEXTUREVIEWPROC, glTextureView)
+GL_FUNCTION(PFNGLCOMPRESSEDTEXSUBIMAGE2DPROC, glCompressedTexSubImage2D)
+GL_FUNCTION(PFNGLGENSAMPLERSPROC, glGenSamplers)
+GL_FUNCTION(PFNGLDELETESAMPLERSPROC, glDeleteSamplers)
+GL_FUNCTION(PFNGLBINDSAMPLERPROC, glBindSampler)
+GL_FUNCTION(PFNGLSAMPLERPARAMETERIPROC, glSamplerParameteri)
+GL_FUNCTION(PFNGLSAMPLERPARAMETERFVPROC, glSamplerParameterfv)
+
+// Compute
+GL_FUNCTION(PFNGLDISPATCHCOMPUTEPROC, glDispatchCompute)
+GL_FUNCTION(PFNGLMEMORYBARRIERPROC, glMemoryBarrier)
+
+// Framebuffers
+GL_FUNCTION(PFNGLGENFRAMEBUFFERSPROC, glGenFramebuffers)
+GL_FUNCTION(PFNGLDELETEFRAMEBUFFERSPROC, glDeleteFramebuffers)
+GL_FUNCTION(PFNGLBINDFRAMEBUFFERPROC, glBindFramebuffer)
+GL_FUNCTION(PFNGLFRAMEBUFFERTEXTURE2DPROC, glFramebufferTexture2D)
+GL_FUNCTION(PFNGLCHECKFRAMEBUFFERSTATUSPROC, glCheckFramebufferStatus)
+
+// Queries
+GL_FUNCTION(PFNGLGENQUERIESPROC, glGenQueries)
+GL_FUNCTION(PFNGLDELETEQUERIESPROC, glDeleteQueries)
+GL_FUNCTION(PFNGLQUERYCOUNTERPROC, glQueryCounter)
+GL_FUNCTION(PFNGLGETQUERYOBJECTIVPROC, glGetQueryObjectiv)
+GL_FUNCTION(PFNGLGETQUERYOBJECTUI64VPROC, glGetQueryObjectui64v)
+
+// Sync objects
+GL_FUNCTION(PFNGLFENCESYNCPROC, glFenceSync)
+GL_FUNCTION(PFNGLCLIENTWAITSYNCPROC, glClientWaitSync)
+GL_FUNCTION(PFNGLWAITSYNCPROC, glWaitSync)
+GL_FUNCTION(PFNGLDELETESYNCPROC, glDeleteSync)
+
+// Debug output
+GL_FUNCTION(PFNGLDEBUGMESSAGECALLBACKPROC, glDebugMessageCallback)
+GL_FUNCTION(PFNGLDEBUGMESSAGECONTROLPROC, glDebugMessageControl)
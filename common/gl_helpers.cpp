@@ -0,0 +1,57 @@
+#include "gl_helpers.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+
+#include "gl_debug.h"
+
+void checkError(const char *msg) {
+  auto start = std::chrono::steady_clock::now();
+  GLErrorMode mode = getGLErrorMode();
+  if (mode == GL_ERRORS_POLL) {
+      GLenum err = glGetError();
+      if (err) {
+          printf("Err %s: %x\n", msg, err);
+          exit(1);
+      }
+  } else if (reportGLDebugMessages(msg) > 0 && mode == GL_ERRORS_STRICT) {
+      printf("Err %s: GL reported errors\n", msg);
+      exit(1);
+  }
+  addGLErrorCheck(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+}
+
+GLint compileShader(GLenum type, const char* src)
+{
+    auto shader = glCreateShader(type);
+    glShaderSource(shader, 1, &src, nullptr);
+    glCompileShader(shader);
+    GLint success = 0;
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+    if (!success) {
+        GLint len;
+        glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &len);
+        GLchar *log = (GLchar*)malloc(len);
+        glGetShaderInfoLog(shader, len, nullptr, log);
+        printf("Failed to compile!: %s\n", log);
+        free(log);
+    }
+    checkError("compiling");
+    return shader;
+}
+
+void linkProgram(GLuint program) {
+  glLinkProgram(program);
+  GLint success = 0;
+  glGetProgramiv(program, GL_LINK_STATUS, &success);
+  if (!success) {
+      GLint len;
+      glGetProgramiv(program, GL_INFO_LOG_LENGTH, &len);
+      GLchar *log = (GLchar*)malloc(len);
+      glGetProgramInfoLog(program, len, &len, log);
+      printf("Failed to link!: %s\n", log);
+      free(log);
+      exit(1);
+  }
+}
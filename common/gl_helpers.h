@@ -0,0 +1,17 @@
+#pragma once
+
+#include "gl_loader.h"
+
+//-----------------------------------------------------------------------------------
+// OpenGL Helpers
+//-----------------------------------------------------------------------------------
+
+// Exits if glGetError reports an error. With debug output on (see gl_debug.h)
+// reports the messages that arrived since the last check instead, and exits on
+// an error only in GL_ERRORS_STRICT.
+void checkError(const char *msg);
+
+GLint compileShader(GLenum type, const char* src);
+
+// Exits if linking fails.
+void linkProgram(GLuint program);
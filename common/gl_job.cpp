@@ -0,0 +1,300 @@
+#include "gl_job.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace {
+
+const size_t headerSize = 8;
+// Anything bigger is a corrupt stream rather than a job.
+const uint32_t maxMessageSize = 256u << 20;
+
+class Writer {
+public:
+    Writer(std::vector<uint8_t>* out, uint32_t type) : out_(out), start_(out->size()) {
+        put(uint32_t(0));
+        put(type);
+    }
+    // Fills in the length.
+    ~Writer() {
+        uint32_t size = uint32_t(out_->size() - start_);
+        memcpy(out_->data() + start_, &size, sizeof(size));
+    }
+
+    template <typename T>
+    void put(T value) {
+        bytes(&value, sizeof(value));
+    }
+    void string(const std::string& s) {
+        put(uint32_t(s.size()));
+        bytes(s.data(), s.size());
+    }
+    void blob(const std::vector<uint8_t>& data) {
+        put(uint32_t(data.size()));
+        bytes(data.data(), data.size());
+    }
+
+private:
+    void bytes(const void* data, size_t size) {
+        const uint8_t* p = (const uint8_t*)data;
+        out_->insert(out_->end(), p, p + size);
+    }
+
+    std::vector<uint8_t>* out_;
+    size_t start_;
+};
+
+// Reads fields until one runs past the end, after which ok() is false.
+class Reader {
+public:
+    Reader(const uint8_t* message, size_t size) : p_(message + headerSize), end_(message + size) {}
+
+    template <typename T>
+    T get() {
+        T value = T();
+        bytes(&value, sizeof(value));
+        return value;
+    }
+    std::string string() {
+        uint32_t size = get<uint32_t>();
+        if (!ok_ || size > size_t(end_ - p_)) {
+            ok_ = false;
+            return std::string();
+        }
+        std::string s((const char*)p_, size);
+        p_ += size;
+        return s;
+    }
+    void blob(std::vector<uint8_t>* data) {
+        uint32_t size = get<uint32_t>();
+        if (!ok_ || size > size_t(end_ - p_)) {
+            ok_ = false;
+            return;
+        }
+        data->assign(p_, p_ + size);
+        p_ += size;
+    }
+    bool ok() const { return ok_; }
+    // Every field read and nothing left over.
+    bool done() const { return ok_ && p_ == end_; }
+
+private:
+    void bytes(void* data, size_t size) {
+        if (!ok_ || size > size_t(end_ - p_)) {
+            ok_ = false;
+            return;
+        }
+        memcpy(data, p_, size);
+        p_ += size;
+    }
+
+    const uint8_t* p_;
+    const uint8_t* end_;
+    bool ok_ = true;
+};
+
+}  // namespace
+
+void encodeGLJob(const GLJob& job, std::vector<uint8_t>* out) {
+    Writer w(out, GL_JOB_SUBMIT);
+    w.put(job.id);
+    w.string(job.vertexShader);
+    w.string(job.fragmentShader);
+    w.put(job.internalFormat);
+    w.put(job.textureWidth);
+    w.put(job.textureHeight);
+    w.put(job.format);
+    w.put(job.type);
+    w.blob(job.texels);
+    w.put(uint32_t(job.params.size()));
+    for (const GLJobParam& param : job.params) {
+        w.put(param.pname);
+        w.put(param.value);
+    }
+    w.put(job.targetWidth);
+    w.put(job.targetHeight);
+    w.put(job.readX);
+    w.put(job.readY);
+    w.put(job.readWidth);
+    w.put(job.readHeight);
+}
+
+void encodeGLJobResult(const GLJobResult& result, std::vector<uint8_t>* out) {
+    Writer w(out, GL_JOB_RESULT);
+    w.put(result.id);
+    w.put(uint8_t(result.ok));
+    w.put(uint8_t(result.programCached));
+    w.put(uint8_t(result.textureCached));
+    w.put(result.daemonMs);
+    w.string(result.error);
+    w.blob(result.pixels);
+}
+
+void encodeGLJobHello(const GLJobHello& hello, std::vector<uint8_t>* out) {
+    Writer w(out, GL_JOB_HELLO);
+    w.string(hello.renderer);
+    w.string(hello.version);
+    w.put(hello.profileMask);
+}
+
+size_t completeGLJobMessage(const uint8_t* data, size_t size) {
+    if (size < headerSize) {
+        return 0;
+    }
+    uint32_t length;
+    memcpy(&length, data, sizeof(length));
+    if (length < headerSize || length > maxMessageSize) {
+        // Hand it over anyway so the decoder rejects it.
+        return headerSize;
+    }
+    return size >= length ? length : 0;
+}
+
+uint32_t glJobMessageType(const uint8_t* message) {
+    uint32_t type;
+    memcpy(&type, message + 4, sizeof(type));
+    return type;
+}
+
+bool decodeGLJob(const uint8_t* message, size_t size, GLJob* job) {
+    if (glJobMessageType(message) != GL_JOB_SUBMIT) {
+        return false;
+    }
+    Reader r(message, size);
+    job->id = r.get<uint64_t>();
+    job->vertexShader = r.string();
+    job->fragmentShader = r.string();
+    job->internalFormat = r.get<uint32_t>();
+    job->textureWidth = r.get<int32_t>();
+    job->textureHeight = r.get<int32_t>();
+    job->format = r.get<uint32_t>();
+    job->type = r.get<uint32_t>();
+    r.blob(&job->texels);
+    uint32_t numParams = r.get<uint32_t>();
+    job->params.clear();
+    for (uint32_t i = 0; i < numParams && r.ok(); ++i) {
+        GLJobParam param;
+        param.pname = r.get<uint32_t>();
+        param.value = r.get<int32_t>();
+        job->params.push_back(param);
+    }
+    job->targetWidth = r.get<int32_t>();
+    job->targetHeight = r.get<int32_t>();
+    job->readX = r.get<int32_t>();
+    job->readY = r.get<int32_t>();
+    job->readWidth = r.get<int32_t>();
+    job->readHeight = r.get<int32_t>();
+    return r.done();
+}
+
+bool decodeGLJobResult(const uint8_t* message, size_t size, GLJobResult* result) {
+    if (glJobMessageType(message) != GL_JOB_RESULT) {
+        return false;
+    }
+    Reader r(message, size);
+    result->id = r.get<uint64_t>();
+    result->ok = r.get<uint8_t>();
+    result->programCached = r.get<uint8_t>();
+    result->textureCached = r.get<uint8_t>();
+    result->daemonMs = r.get<double>();
+    result->error = r.string();
+    r.blob(&result->pixels);
+    return r.done();
+}
+
+bool decodeGLJobHello(const uint8_t* message, size_t size, GLJobHello* hello) {
+    if (glJobMessageType(message) != GL_JOB_HELLO) {
+        return false;
+    }
+    Reader r(message, size);
+    hello->renderer = r.string();
+    hello->version = r.string();
+    hello->profileMask = r.get<int32_t>();
+    return r.done();
+}
+
+//-----------------------------------------------------------------------------------
+// Client
+//-----------------------------------------------------------------------------------
+
+GLJobClient::~GLJobClient() {
+    if (fd_ >= 0) {
+        close(fd_);
+    }
+}
+
+bool GLJobClient::connect(const char* socketPath) {
+    sockaddr_un addr = {};
+    addr.sun_family = AF_UNIX;
+    if (strlen(socketPath) >= sizeof(addr.sun_path)) {
+        printf("Socket path too long: %s\n", socketPath);
+        return false;
+    }
+    strcpy(addr.sun_path, socketPath);
+    fd_ = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd_ < 0 || ::connect(fd_, (const sockaddr*)&addr, sizeof(addr)) != 0) {
+        printf("Cannot connect to %s: %s\n", socketPath, strerror(errno));
+        return false;
+    }
+    std::vector<uint8_t> message;
+    if (!readMessage(&message)) {
+        return false;
+    }
+    if (!decodeGLJobHello(message.data(), message.size(), &hello_)) {
+        printf("%s: not a gl-testd socket\n", socketPath);
+        return false;
+    }
+    return true;
+}
+
+bool GLJobClient::submit(const GLJob& job) {
+    out_.clear();
+    encodeGLJob(job, &out_);
+    for (size_t sent = 0; sent < out_.size(); ) {
+        ssize_t n = send(fd_, out_.data() + sent, out_.size() - sent, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            printf("gl-testd: send failed: %s\n", strerror(errno));
+            return false;
+        }
+        sent += n;
+    }
+    return true;
+}
+
+bool GLJobClient::receive(GLJobResult* result) {
+    std::vector<uint8_t> message;
+    if (!readMessage(&message)) {
+        return false;
+    }
+    if (!decodeGLJobResult(message.data(), message.size(), result)) {
+        printf("gl-testd: malformed result\n");
+        return false;
+    }
+    return true;
+}
+
+bool GLJobClient::readMessage(std::vector<uint8_t>* message) {
+    size_t size;
+    while ((size = completeGLJobMessage(in_.data(), in_.size())) == 0) {
+        uint8_t buffer[65536];
+        ssize_t n = recv(fd_, buffer, sizeof(buffer), 0);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            printf("gl-testd: connection closed\n");
+            return false;
+        }
+        in_.insert(in_.end(), buffer, buffer + n);
+    }
+    message->assign(in_.begin(), in_.begin() + size);
+    in_.erase(in_.begin(), in_.begin() + size);
+    return true;
+}
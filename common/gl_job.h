@@ -0,0 +1,110 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+//-----------------------------------------------------------------------------------
+// Test jobs for the gl-testd daemon, and the client side of its socket
+//
+// A job is a program, a 2D texture and its parameters, a render target size and
+// the region to read back. The daemon draws a quad covering the target with the
+// texture on unit 0 and returns the region as RGBA8, rows bottom first. The
+// quad's only attribute is "p", a vec2 in clip space.
+//
+// Every message is a 32-bit length and a 32-bit type followed by the fields in
+// host byte order; the socket is local, so both ends are the same machine.
+// Clients may send any number of jobs before reading results. Results come back
+// in the order the jobs were sent.
+//
+// GL enums are plain uint32_t here so this header doesn't need GL.
+//-----------------------------------------------------------------------------------
+
+enum GLJobMessage {
+    GL_JOB_HELLO = 1,     // daemon to client on connect: renderer, version, profile
+    GL_JOB_SUBMIT = 2,    // client to daemon: a GLJob
+    GL_JOB_RESULT = 3,    // daemon to client: a GLJobResult
+};
+
+struct GLJobParam {
+    uint32_t pname;
+    int32_t value;
+};
+
+struct GLJob {
+    uint64_t id = 0;
+    std::string vertexShader;
+    std::string fragmentShader;
+
+    // glTexImage2D arguments. No texture is bound when width is 0.
+    uint32_t internalFormat = 0;
+    int32_t textureWidth = 0;
+    int32_t textureHeight = 0;
+    uint32_t format = 0;
+    uint32_t type = 0;
+    std::vector<uint8_t> texels;
+    // glTexParameteri calls, applied in order on top of GL_NEAREST filtering.
+    std::vector<GLJobParam> params;
+
+    int32_t targetWidth = 1;
+    int32_t targetHeight = 1;
+    int32_t readX = 0;
+    int32_t readY = 0;
+    int32_t readWidth = 1;
+    int32_t readHeight = 1;
+};
+
+struct GLJobResult {
+    uint64_t id = 0;
+    bool ok = false;
+    bool programCached = false;   // the daemon already had the program linked
+    bool textureCached = false;   // and the texture uploaded
+    double daemonMs = 0.0;        // from reading the job to having the pixels
+    std::string error;            // info logs when the program didn't link
+    std::vector<uint8_t> pixels;  // readWidth * readHeight RGBA8
+};
+
+struct GLJobHello {
+    std::string renderer;
+    std::string version;
+    int32_t profileMask = 0;      // GL_CONTEXT_PROFILE_MASK
+};
+
+// Appends a whole message to out.
+void encodeGLJob(const GLJob& job, std::vector<uint8_t>* out);
+void encodeGLJobResult(const GLJobResult& result, std::vector<uint8_t>* out);
+void encodeGLJobHello(const GLJobHello& hello, std::vector<uint8_t>* out);
+
+// Length of the first message in data once it has fully arrived, or 0.
+size_t completeGLJobMessage(const uint8_t* data, size_t size);
+uint32_t glJobMessageType(const uint8_t* message);
+
+// Decode one complete message. Return false if it's malformed.
+bool decodeGLJob(const uint8_t* message, size_t size, GLJob* job);
+bool decodeGLJobResult(const uint8_t* message, size_t size, GLJobResult* result);
+bool decodeGLJobHello(const uint8_t* message, size_t size, GLJobHello* hello);
+
+// Blocking client. Every method prints a message and returns false on failure.
+class GLJobClient {
+public:
+    GLJobClient() {}
+    ~GLJobClient();
+
+    // Connects and waits for the daemon's hello.
+    bool connect(const char* socketPath);
+    const GLJobHello& hello() const { return hello_; }
+
+    // Sends without waiting for the result.
+    bool submit(const GLJob& job);
+    // Waits for the next result.
+    bool receive(GLJobResult* result);
+
+private:
+    bool readMessage(std::vector<uint8_t>* message);
+
+    int fd_ = -1;
+    GLJobHello hello_;
+    std::vector<uint8_t> in_;
+    std::vector<uint8_t> out_;
+};
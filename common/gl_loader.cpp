@@ -0,0 +1,86 @@
+#include "gl_loader.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <atomic>
+#include <chrono>
+
+#include "gl_context.h"
+
+namespace {
+
+enum GLFunctionIndex {
+#define GL_FUNCTION(type, name) GLFN_##name,
+#include "gl_functions.inl"
+#undef GL_FUNCTION
+    GLFN_COUNT
+};
+
+const char* const functionNames[] = {
+#define GL_FUNCTION(type, name) #name,
+#include "gl_functions.inl"
+#undef GL_FUNCTION
+};
+
+const GLContext* loaderContext = nullptr;
+std::atomic<bool> resolved[GLFN_COUNT];
+std::atomic<int> numResolved(0);
+std::atomic<long long> resolveNs(0);
+
+void* resolve(int index) {
+    if (loaderContext == nullptr) {
+        printf("GL function %s called before init_gl_functions()\n", functionNames[index]);
+        exit(1);
+    }
+    auto start = std::chrono::steady_clock::now();
+    void* proc = getProcAddress(loaderContext, functionNames[index]);
+    auto end = std::chrono::steady_clock::now();
+    if (proc == nullptr) {
+        printf("Failed to load GL function %s\n", functionNames[index]);
+        exit(1);
+    }
+    if (!resolved[index].exchange(true)) {
+        ++numResolved;
+        resolveNs += std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+    }
+    return proc;
+}
+
+// The trampoline each pointer starts out with. The first call swaps in the real
+// function and forwards to it.
+template <typename T> struct Lazy;
+template <typename R, typename... Args> struct Lazy<R (APIENTRYP)(Args...)> {
+    template <R (APIENTRYP* Slot)(Args...), int Index>
+    static R APIENTRY call(Args... args) {
+        *Slot = (R (APIENTRYP)(Args...))resolve(Index);
+        return (*Slot)(args...);
+    }
+};
+
+}  // namespace
+
+#define GL_FUNCTION(type, name) type name = &Lazy<type>::call<&name, GLFN_##name>;
+#include "gl_functions.inl"
+#undef GL_FUNCTION
+
+void init_gl_functions(const GLContext* ctx, GLLoadMode mode) {
+    loaderContext = ctx;
+    if (mode == GL_LOAD_EAGER) {
+#define GL_FUNCTION(type, name) if (!resolved[GLFN_##name]) name = (type)resolve(GLFN_##name);
+#include "gl_functions.inl"
+#undef GL_FUNCTION
+    }
+}
+
+GLLoaderStats getGLLoaderStats() {
+    GLLoaderStats stats;
+    stats.total = GLFN_COUNT;
+    stats.resolved = numResolved;
+    stats.resolveMs = resolveNs / 1e6;
+    return stats;
+}
+
+void printGLLoaderStats() {
+    GLLoaderStats stats = getGLLoaderStats();
+    printf("loader  : %d of %d GL functions resolved in %.3f ms\n", stats.resolved, stats.total, stats.resolveMs);
+}
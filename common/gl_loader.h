@@ -0,0 +1,40 @@
+#pragma once
+
+//-----------------------------------------------------------------------------------
+// Shared GL function loader
+//
+// Every entry point in gl_functions.inl is a global function pointer named after
+// the GL function. Each starts out pointing at a trampoline that resolves the
+// real function on its first call, stores it and forwards the call, so a run only
+// pays for the functions it actually uses. GL_LOAD_EAGER resolves them all up front.
+// A missing entry point prints its name and exits. The resolved pointers are the
+// same for every context, so threads with shared contexts use them as well; use
+// GL_LOAD_EAGER before starting such threads so they never race on a trampoline.
+//
+// This header replaces <GL/gl.h>. Don't include both in the same file.
+//-----------------------------------------------------------------------------------
+
+#include <GL/glcorearb.h>
+
+#define GL_FUNCTION(type, name) extern type name;
+#include "gl_functions.inl"
+#undef GL_FUNCTION
+
+struct GLContext;
+
+enum GLLoadMode {
+    GL_LOAD_LAZY,
+    GL_LOAD_EAGER,
+};
+
+struct GLLoaderStats {
+    int total;            // entry points in the table
+    int resolved;         // entry points resolved so far
+    double resolveMs;     // time spent inside getProcAddress
+};
+
+// Must be called with ctx current before any GL function is used.
+void init_gl_functions(const GLContext* ctx, GLLoadMode mode = GL_LOAD_LAZY);
+
+GLLoaderStats getGLLoaderStats();
+void printGLLoaderStats();
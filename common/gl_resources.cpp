@@ -0,0 +1,425 @@
+#include "gl_resources.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <map>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+
+#include "gl_state.h"
+
+namespace {
+
+const uint64_t maxPooledBytes = 256ull << 20;
+
+const char* const typeNames[GLR_NUM_TYPES] = {
+    "texture", "framebuffer", "buffer", "vertex array", "sampler", "shader", "program",
+};
+
+// Format and size. Textures have GL_NONE for the depth format.
+typedef std::tuple<GLenum, GLenum, int, int> PoolKey;
+
+struct Object {
+    const char* label;
+    uint64_t bytes;
+    bool pooled;    // belongs to a pool, released or not
+    PoolKey key;    // of a pooled texture
+};
+
+struct Registry {
+    std::unordered_map<GLuint, Object> objects[GLR_NUM_TYPES];
+    GLResourceStats stats;
+    std::map<PoolKey, std::vector<GLuint>> textures;
+    std::map<PoolKey, std::vector<GLRenderTarget>> targets;
+};
+
+thread_local Registry registry;
+
+void add(GLResourceType type, GLuint name, const char* label, bool pooled) {
+    registry.objects[type][name] = { label, 0, pooled, PoolKey() };
+    GLResourceTypeStats& stats = registry.stats.types[type];
+    ++stats.created;
+    ++stats.live;
+}
+
+void setBytes(GLResourceType type, Object* object, uint64_t bytes) {
+    GLResourceStats& stats = registry.stats;
+    GLResourceTypeStats& typeStats = stats.types[type];
+    typeStats.bytes = typeStats.bytes - object->bytes + bytes;
+    typeStats.peakBytes = std::max(typeStats.peakBytes, typeStats.bytes);
+    stats.bytes = stats.bytes - object->bytes + bytes;
+    stats.peakBytes = std::max(stats.peakBytes, stats.bytes);
+    object->bytes = bytes;
+}
+
+Object* find(GLResourceType type, GLuint name) {
+    auto found = registry.objects[type].find(name);
+    return found == registry.objects[type].end() ? nullptr : &found->second;
+}
+
+void remove(GLResourceType type, GLuint name) {
+    Object* object = find(type, name);
+    if (object == nullptr) {
+        return;
+    }
+    setBytes(type, object, 0);
+    registry.objects[type].erase(name);
+    GLResourceTypeStats& stats = registry.stats.types[type];
+    ++stats.deleted;
+    --stats.live;
+}
+
+void deleteObject(GLResourceType type, GLuint name) {
+    switch (type) {
+    case GLR_TEXTURE:      glsDeleteTextures(1, &name); break;
+    case GLR_FRAMEBUFFER:  glsDeleteFramebuffers(1, &name); break;
+    case GLR_BUFFER:       glsDeleteBuffers(1, &name); break;
+    case GLR_VERTEX_ARRAY: glsDeleteVertexArrays(1, &name); break;
+    case GLR_SAMPLER:      glsDeleteSamplers(1, &name); break;
+    case GLR_SHADER:       glDeleteShader(name); break;
+    case GLR_PROGRAM:      glDeleteProgram(name); break;
+    default: break;
+    }
+    remove(type, name);
+}
+
+// Bytes per texel, or per 4x4 block for the compressed formats. Formats not
+// listed are taken to be 4 bytes per texel.
+int formatBytes(GLenum internalFormat, bool* block) {
+    *block = false;
+    switch (internalFormat) {
+    case GL_R8: case GL_R8I: case GL_R8UI: case GL_R8_SNORM: case GL_STENCIL_INDEX8:
+        return 1;
+    case GL_RG8: case GL_RG8I: case GL_RG8UI: case GL_RG8_SNORM: case GL_R16: case GL_R16F: case GL_R16I:
+    case GL_R16UI: case GL_RGB565: case GL_RGBA4: case GL_RGB5_A1: case GL_DEPTH_COMPONENT16:
+        return 2;
+    case GL_RGBA16: case GL_RGBA16F: case GL_RGBA16I: case GL_RGBA16UI: case GL_RG32F: case GL_RG32I:
+    case GL_RG32UI: case GL_DEPTH32F_STENCIL8:
+        return 8;
+    case GL_RGB16F: case GL_RGB16: case GL_RGB16I: case GL_RGB16UI:
+        return 6;
+    case GL_RGB32F: case GL_RGB32I: case GL_RGB32UI:
+        return 12;
+    case GL_RGBA32F: case GL_RGBA32I: case GL_RGBA32UI:
+        return 16;
+    case GL_COMPRESSED_RED_RGTC1: case GL_COMPRESSED_SIGNED_RED_RGTC1: case GL_COMPRESSED_RGB8_ETC2:
+    case GL_COMPRESSED_SRGB8_ETC2: case GL_COMPRESSED_RGB8_PUNCHTHROUGH_ALPHA1_ETC2:
+    case GL_COMPRESSED_SRGB8_PUNCHTHROUGH_ALPHA1_ETC2: case GL_COMPRESSED_R11_EAC:
+    case GL_COMPRESSED_SIGNED_R11_EAC:
+        *block = true;
+        return 8;
+    case GL_COMPRESSED_RG_RGTC2: case GL_COMPRESSED_SIGNED_RG_RGTC2: case GL_COMPRESSED_RGBA_BPTC_UNORM:
+    case GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM: case GL_COMPRESSED_RGB_BPTC_SIGNED_FLOAT:
+    case GL_COMPRESSED_RGB_BPTC_UNSIGNED_FLOAT: case GL_COMPRESSED_RGBA8_ETC2_EAC:
+    case GL_COMPRESSED_SRGB8_ALPHA8_ETC2_EAC: case GL_COMPRESSED_RG11_EAC: case GL_COMPRESSED_SIGNED_RG11_EAC:
+        *block = true;
+        return 16;
+    default:
+        // Including RGB8, which drivers pad to 4 bytes.
+        return 4;
+    }
+}
+
+GLuint createTexture(GLenum internalFormat, int width, int height, const char* label) {
+    GLuint texture = glrCreate(GLR_TEXTURE, label);
+    Object* object = find(GLR_TEXTURE, texture);
+    object->pooled = true;
+    object->key = PoolKey(internalFormat, GL_NONE, width, height);
+    glsBindTexture(GL_TEXTURE_2D, texture);
+    glTexStorage2D(GL_TEXTURE_2D, 1, internalFormat, width, height);
+    glrSetBytes(GLR_TEXTURE, texture, glrTextureBytes(internalFormat, width, height));
+    return texture;
+}
+
+void relabel(GLResourceType type, GLuint name, const char* label) {
+    if (name) {
+        find(type, name)->label = label;
+    }
+}
+
+uint64_t targetBytes(const GLRenderTarget& target) {
+    uint64_t bytes = 0;
+    for (GLuint texture : { target.color, target.depth }) {
+        if (texture) {
+            bytes += find(GLR_TEXTURE, texture)->bytes;
+        }
+    }
+    return bytes;
+}
+
+void deleteTarget(const GLRenderTarget& target) {
+    deleteObject(GLR_FRAMEBUFFER, target.framebuffer);
+    if (target.color) {
+        deleteObject(GLR_TEXTURE, target.color);
+    }
+    if (target.depth) {
+        deleteObject(GLR_TEXTURE, target.depth);
+    }
+}
+
+// Whether the object is waiting in a pool rather than held by a user.
+bool isWaiting(GLResourceType type, GLuint name) {
+    if (type == GLR_TEXTURE) {
+        for (const auto& entry : registry.textures) {
+            if (std::find(entry.second.begin(), entry.second.end(), name) != entry.second.end()) {
+                return true;
+            }
+        }
+    }
+    for (const auto& entry : registry.targets) {
+        for (const GLRenderTarget& target : entry.second) {
+            if ((type == GLR_FRAMEBUFFER && target.framebuffer == name) ||
+                (type == GLR_TEXTURE && (target.color == name || target.depth == name))) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+void printBytes(const char* prefix, uint64_t bytes) {
+    if (bytes >= (1u << 20)) {
+        printf("%s%.1f MB", prefix, bytes / 1048576.0);
+    } else if (bytes >= 1024) {
+        printf("%s%.1f KB", prefix, bytes / 1024.0);
+    } else {
+        printf("%s%llu B", prefix, (unsigned long long)bytes);
+    }
+}
+
+}  // namespace
+
+GLuint glrCreate(GLResourceType type, const char* label) {
+    GLuint name = 0;
+    switch (type) {
+    case GLR_TEXTURE:      glGenTextures(1, &name); break;
+    case GLR_FRAMEBUFFER:  glGenFramebuffers(1, &name); break;
+    case GLR_BUFFER:       glGenBuffers(1, &name); break;
+    case GLR_VERTEX_ARRAY: glGenVertexArrays(1, &name); break;
+    case GLR_SAMPLER:      glGenSamplers(1, &name); break;
+    case GLR_PROGRAM:      name = glCreateProgram(); break;
+    default:
+        printf("glrCreate: use glrCreateShader for shaders\n");
+        exit(1);
+    }
+    add(type, name, label, false);
+    return name;
+}
+
+GLuint glrCreateShader(GLenum shaderType, const char* label) {
+    GLuint shader = glCreateShader(shaderType);
+    add(GLR_SHADER, shader, label, false);
+    return shader;
+}
+
+void glrAdopt(GLResourceType type, GLuint name, const char* label) {
+    if (find(type, name) == nullptr) {
+        add(type, name, label, false);
+    }
+}
+
+void glrSetBytes(GLResourceType type, GLuint name, uint64_t bytes) {
+    Object* object = find(type, name);
+    if (object) {
+        setBytes(type, object, bytes);
+    }
+}
+
+uint64_t glrTextureBytes(GLenum internalFormat, int width, int height, int depth, int levels) {
+    bool block;
+    uint64_t unit = formatBytes(internalFormat, &block);
+    if (levels == 0) {
+        int largest = std::max(width, std::max(height, depth));
+        while (largest >> levels) {
+            ++levels;
+        }
+    }
+    uint64_t bytes = 0;
+    for (int level = 0; level < levels; ++level) {
+        uint64_t w = std::max(width >> level, 1);
+        uint64_t h = std::max(height >> level, 1);
+        uint64_t d = std::max(depth >> level, 1);
+        bytes += block ? (w + 3) / 4 * ((h + 3) / 4) * d * unit : w * h * d * unit;
+    }
+    return bytes;
+}
+
+void glrDelete(GLResourceType type, GLuint name) {
+    Object* object = find(type, name);
+    if (object && object->pooled) {
+        printf("glrDelete: %s %u \"%s\" belongs to a pool, release it instead\n", typeNames[type], name,
+               object->label);
+        exit(1);
+    }
+    deleteObject(type, name);
+}
+
+GLuint glrAcquireTexture(GLenum internalFormat, int width, int height, const char* label) {
+    std::vector<GLuint>& pool = registry.textures[PoolKey(internalFormat, GL_NONE, width, height)];
+    if (pool.empty()) {
+        ++registry.stats.poolMisses;
+        return createTexture(internalFormat, width, height, label);
+    }
+    GLuint texture = pool.back();
+    pool.pop_back();
+    ++registry.stats.poolHits;
+    --registry.stats.pooled;
+    registry.stats.pooledBytes -= find(GLR_TEXTURE, texture)->bytes;
+    relabel(GLR_TEXTURE, texture, label);
+    glsBindTexture(GL_TEXTURE_2D, texture);
+    return texture;
+}
+
+void glrReleaseTexture(GLuint texture) {
+    Object* object = find(GLR_TEXTURE, texture);
+    if (object == nullptr || !object->pooled) {
+        printf("glrReleaseTexture: texture %u wasn't acquired\n", texture);
+        exit(1);
+    }
+    if (registry.stats.pooledBytes + object->bytes > maxPooledBytes) {
+        deleteObject(GLR_TEXTURE, texture);
+        return;
+    }
+    registry.textures[object->key].push_back(texture);
+    ++registry.stats.pooled;
+    registry.stats.pooledBytes += object->bytes;
+}
+
+GLRenderTarget glrAcquireRenderTarget(GLenum colorFormat, GLenum depthFormat, int width, int height,
+                                      const char* label) {
+    std::vector<GLRenderTarget>& pool = registry.targets[PoolKey(colorFormat, depthFormat, width, height)];
+    if (!pool.empty()) {
+        GLRenderTarget target = pool.back();
+        pool.pop_back();
+        ++registry.stats.poolHits;
+        --registry.stats.pooled;
+        registry.stats.pooledBytes -= targetBytes(target);
+        relabel(GLR_FRAMEBUFFER, target.framebuffer, label);
+        relabel(GLR_TEXTURE, target.color, label);
+        relabel(GLR_TEXTURE, target.depth, label);
+        glsBindFramebuffer(GL_FRAMEBUFFER, target.framebuffer);
+        return target;
+    }
+
+    ++registry.stats.poolMisses;
+    GLRenderTarget target = { 0, 0, 0, colorFormat, depthFormat, width, height };
+    target.framebuffer = glrCreate(GLR_FRAMEBUFFER, label);
+    find(GLR_FRAMEBUFFER, target.framebuffer)->pooled = true;
+    glsBindFramebuffer(GL_FRAMEBUFFER, target.framebuffer);
+    if (colorFormat != GL_NONE) {
+        target.color = createTexture(colorFormat, width, height, label);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, target.color, 0);
+    }
+    if (depthFormat != GL_NONE) {
+        bool stencil = depthFormat == GL_DEPTH24_STENCIL8 || depthFormat == GL_DEPTH32F_STENCIL8;
+        target.depth = createTexture(depthFormat, width, height, label);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, stencil ? GL_DEPTH_STENCIL_ATTACHMENT : GL_DEPTH_ATTACHMENT,
+                               GL_TEXTURE_2D, target.depth, 0);
+    }
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        printf("%s: %dx%d framebuffer incomplete\n", label, width, height);
+        exit(1);
+    }
+    return target;
+}
+
+void glrReleaseRenderTarget(const GLRenderTarget& target) {
+    Object* object = find(GLR_FRAMEBUFFER, target.framebuffer);
+    if (object == nullptr || !object->pooled) {
+        printf("glrReleaseRenderTarget: framebuffer %u wasn't acquired\n", target.framebuffer);
+        exit(1);
+    }
+    uint64_t bytes = targetBytes(target);
+    if (registry.stats.pooledBytes + bytes > maxPooledBytes) {
+        deleteTarget(target);
+        return;
+    }
+    registry.targets[PoolKey(target.colorFormat, target.depthFormat, target.width, target.height)].push_back(target);
+    ++registry.stats.pooled;
+    registry.stats.pooledBytes += bytes;
+}
+
+void glrTrimPools() {
+    for (auto& entry : registry.textures) {
+        for (GLuint texture : entry.second) {
+            deleteObject(GLR_TEXTURE, texture);
+        }
+    }
+    for (auto& entry : registry.targets) {
+        for (const GLRenderTarget& target : entry.second) {
+            deleteTarget(target);
+        }
+    }
+    registry.textures.clear();
+    registry.targets.clear();
+    registry.stats.pooled = 0;
+    registry.stats.pooledBytes = 0;
+}
+
+GLResourceStats getGLResourceStats() {
+    return registry.stats;
+}
+
+void printGLResourceReport() {
+    const GLResourceStats& stats = registry.stats;
+    uint64_t created = 0;
+    uint64_t deleted = 0;
+    for (int type = 0; type < GLR_NUM_TYPES; ++type) {
+        created += stats.types[type].created;
+        deleted += stats.types[type].deleted;
+    }
+    printf("objects : %llu created, %llu deleted", (unsigned long long)created, (unsigned long long)deleted);
+    printBytes(", peak ", stats.peakBytes);
+    printf("\n");
+    for (int type = 0; type < GLR_NUM_TYPES; ++type) {
+        const GLResourceTypeStats& typeStats = stats.types[type];
+        if (typeStats.created == 0) {
+            continue;
+        }
+        printf("  %-12s: %llu created, %llu deleted", typeNames[type], (unsigned long long)typeStats.created,
+               (unsigned long long)typeStats.deleted);
+        if (typeStats.peakBytes > 0) {
+            printBytes(", peak ", typeStats.peakBytes);
+        }
+        printf("\n");
+    }
+    uint64_t acquires = stats.poolHits + stats.poolMisses;
+    if (acquires > 0) {
+        printf("pools   : %llu acquires, %llu reused (%.1f%%), %llu waiting", (unsigned long long)acquires,
+               (unsigned long long)stats.poolHits, 100.0 * stats.poolHits / acquires,
+               (unsigned long long)stats.pooled);
+        printBytes(" holding ", stats.pooledBytes);
+        printf("\n");
+    }
+
+    // Whatever is alive and not waiting in a pool hasn't been deleted by its user.
+    uint64_t leaked = 0;
+    uint64_t leakedBytes = 0;
+    for (int type = 0; type < GLR_NUM_TYPES; ++type) {
+        std::vector<std::pair<GLuint, const Object*>> alive;
+        for (const auto& entry : registry.objects[type]) {
+            if (!isWaiting(GLResourceType(type), entry.first)) {
+                alive.push_back({ entry.first, &entry.second });
+            }
+        }
+        std::sort(alive.begin(), alive.end());
+        for (const auto& entry : alive) {
+            printf("leaked  : %s %u \"%s\"", typeNames[type], entry.first, entry.second->label);
+            if (entry.second->bytes > 0) {
+                printBytes(", ", entry.second->bytes);
+            }
+            printf("\n");
+            ++leaked;
+            leakedBytes += entry.second->bytes;
+        }
+    }
+    if (leaked == 0) {
+        printf("leaked  : nothing\n");
+    } else {
+        printf("leaked  : %llu objects", (unsigned long long)leaked);
+        printBytes(", ", leakedBytes);
+        printf("\n");
+    }
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "gl_loader.h"
+
+//-----------------------------------------------------------------------------------
+// Registry of GL objects with memory accounting and pools
+//
+// Objects made with glrCreate() are recorded under their type and a label, with an
+// estimate of the GPU memory behind them set by glrSetBytes(). Objects made
+// elsewhere, like createCachedProgram()'s programs, are recorded with glrAdopt().
+// glrDelete() deletes through the gls* functions, so the state cache forgets the
+// object too. printGLResourceReport() lists per type how many objects were made and
+// deleted and the most memory they held at once, and every object still alive by
+// label: call it just before the context is destroyed and whatever it lists leaked.
+//
+// Textures and framebuffers that are only needed for a while come from pools
+// keyed on format and size. A released object waits in its pool, still
+// counted, until an acquire with the same key takes it again, so a run that
+// needs thousands of same-sized targets makes only as many as it holds at once.
+// Pooled textures have immutable storage so a user can't change their key; they
+// keep whatever parameters the last user set. The pools hold at most 256 MB
+// between them, beyond that released objects are deleted.
+//
+// Labels must outlive the objects; string literals do. Like the state cache the
+// registry is per thread, for the context current on it. An object shared with
+// another context is adopted by the thread that ends up deleting it.
+//-----------------------------------------------------------------------------------
+
+enum GLResourceType {
+    GLR_TEXTURE,
+    GLR_FRAMEBUFFER,
+    GLR_BUFFER,
+    GLR_VERTEX_ARRAY,
+    GLR_SAMPLER,
+    GLR_SHADER,
+    GLR_PROGRAM,
+    GLR_NUM_TYPES,
+};
+
+// Makes one object. For GLR_SHADER use glrCreateShader().
+GLuint glrCreate(GLResourceType type, const char* label);
+GLuint glrCreateShader(GLenum shaderType, const char* label);
+void glrAdopt(GLResourceType type, GLuint name, const char* label);
+// Replaces the object's memory estimate.
+void glrSetBytes(GLResourceType type, GLuint name, uint64_t bytes);
+// Estimated size of a texture's storage. levels 0 is the full mip chain.
+uint64_t glrTextureBytes(GLenum internalFormat, int width, int height, int depth = 1, int levels = 1);
+// Deletes and forgets the object. Objects that aren't recorded are deleted too.
+void glrDelete(GLResourceType type, GLuint name);
+
+struct GLRenderTarget {
+    GLuint framebuffer;
+    GLuint color;           // a texture, 0 when colorFormat is GL_NONE
+    GLuint depth;           // a texture, 0 when depthFormat is GL_NONE
+    GLenum colorFormat;
+    GLenum depthFormat;
+    int width;
+    int height;
+};
+
+// A 2D texture with one level of immutable storage. Leaves it bound to
+// GL_TEXTURE_2D on the active unit.
+GLuint glrAcquireTexture(GLenum internalFormat, int width, int height, const char* label);
+void glrReleaseTexture(GLuint texture);
+// A complete framebuffer with the textures attached. Leaves it bound to
+// GL_FRAMEBUFFER and, when it was just made, its last texture to GL_TEXTURE_2D.
+// Exits if the driver can't render to the formats.
+GLRenderTarget glrAcquireRenderTarget(GLenum colorFormat, GLenum depthFormat, int width, int height,
+                                      const char* label);
+void glrReleaseRenderTarget(const GLRenderTarget& target);
+// Deletes everything waiting in the pools.
+void glrTrimPools();
+
+struct GLResourceTypeStats {
+    uint64_t created;       // including adopted objects
+    uint64_t deleted;
+    uint64_t live;
+    uint64_t bytes;         // estimated, of the live objects
+    uint64_t peakBytes;
+};
+
+struct GLResourceStats {
+    GLResourceTypeStats types[GLR_NUM_TYPES];
+    uint64_t bytes;
+    uint64_t peakBytes;
+    uint64_t poolHits;      // acquires served from a pool
+    uint64_t poolMisses;    // acquires that made new objects
+    uint64_t pooled;        // objects waiting in the pools
+    uint64_t pooledBytes;
+};
+
+// Totals for this thread since it started.
+GLResourceStats getGLResourceStats();
+void printGLResourceReport();
@@ -0,0 +1,419 @@
+#include "gl_state.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace {
+
+const GLuint unknown = 0xFFFFFFFFu;
+const int maxUnits = 32;
+
+const GLenum textureTargets[] = {
+    GL_TEXTURE_1D, GL_TEXTURE_2D, GL_TEXTURE_3D, GL_TEXTURE_1D_ARRAY, GL_TEXTURE_2D_ARRAY,
+    GL_TEXTURE_RECTANGLE, GL_TEXTURE_CUBE_MAP, GL_TEXTURE_CUBE_MAP_ARRAY, GL_TEXTURE_BUFFER,
+    GL_TEXTURE_2D_MULTISAMPLE, GL_TEXTURE_2D_MULTISAMPLE_ARRAY,
+};
+const int numTextureTargets = sizeof(textureTargets) / sizeof(textureTargets[0]);
+
+const GLenum bufferTargets[] = {
+    GL_ARRAY_BUFFER, GL_PIXEL_PACK_BUFFER, GL_PIXEL_UNPACK_BUFFER, GL_DRAW_INDIRECT_BUFFER,
+    GL_DISPATCH_INDIRECT_BUFFER, GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, GL_UNIFORM_BUFFER,
+    GL_SHADER_STORAGE_BUFFER, GL_ATOMIC_COUNTER_BUFFER, GL_TEXTURE_BUFFER, GL_QUERY_BUFFER,
+    GL_TRANSFORM_FEEDBACK_BUFFER,
+};
+const int numBufferTargets = sizeof(bufferTargets) / sizeof(bufferTargets[0]);
+
+template <size_t N>
+int indexOf(const GLenum (&list)[N], GLenum value) {
+    for (size_t i = 0; i < N; ++i) {
+        if (list[i] == value) {
+            return (int)i;
+        }
+    }
+    return -1;
+}
+
+// The parameters set on one texture or sampler. An integer and a float value
+// for the same pname never coexist; setting one drops the other.
+struct ObjectParams {
+    std::vector<std::pair<GLenum, GLint>> ints;
+    std::vector<std::pair<GLenum, std::vector<GLfloat>>> floats;
+};
+
+struct State {
+    GLuint program;
+    GLuint vertexArray;
+    GLuint drawFramebuffer;
+    GLuint readFramebuffer;
+    int activeUnit;
+    GLuint textures[maxUnits][numTextureTargets];
+    GLuint samplers[maxUnits];
+    GLuint buffers[numBufferTargets];
+    bool viewportKnown;
+    GLint viewport[4];
+    bool scissorKnown;
+    GLint scissor[4];
+    std::vector<std::pair<GLenum, bool>> caps;
+    std::unordered_map<GLuint, ObjectParams> textureParams;
+    std::unordered_map<GLuint, ObjectParams> samplerParams;
+    GLStateStats stats = {};
+
+    State() { reset(); }
+
+    void reset() {
+        program = unknown;
+        vertexArray = unknown;
+        drawFramebuffer = unknown;
+        readFramebuffer = unknown;
+        // GL's default. Nothing in the examples changes it without glsActiveTexture().
+        activeUnit = 0;
+        for (int unit = 0; unit < maxUnits; ++unit) {
+            for (int target = 0; target < numTextureTargets; ++target) {
+                textures[unit][target] = unknown;
+            }
+            samplers[unit] = unknown;
+        }
+        for (int target = 0; target < numBufferTargets; ++target) {
+            buffers[target] = unknown;
+        }
+        viewportKnown = false;
+        scissorKnown = false;
+        caps.clear();
+        textureParams.clear();
+        samplerParams.clear();
+    }
+};
+
+thread_local State state;
+
+// Counts the call and returns true if it has to be issued.
+bool changed(bool differs) {
+    if (differs) {
+        ++state.stats.issued;
+    } else {
+        ++state.stats.elided;
+    }
+    return differs;
+}
+
+// Updates a shadowed value and returns true if the call has to be issued.
+bool update(GLuint* shadow, GLuint value) {
+    if (!changed(*shadow != value)) {
+        return false;
+    }
+    *shadow = value;
+    return true;
+}
+
+// The texture bound to target on the active unit, or null when it isn't known.
+GLuint* boundTexture(GLenum target) {
+    int index = indexOf(textureTargets, target);
+    if (index < 0 || state.activeUnit < 0 || state.activeUnit >= maxUnits) {
+        return nullptr;
+    }
+    return &state.textures[state.activeUnit][index];
+}
+
+// The parameters of the texture bound to target, or null when it isn't known.
+ObjectParams* boundTextureParams(GLenum target) {
+    GLuint* texture = boundTexture(target);
+    if (texture == nullptr || *texture == unknown) {
+        return nullptr;
+    }
+    return &state.textureParams[*texture];
+}
+
+bool updateInt(ObjectParams* params, GLenum pname, GLint value) {
+    if (params == nullptr) {
+        return changed(true);
+    }
+    for (size_t i = 0; i < params->floats.size(); ++i) {
+        if (params->floats[i].first == pname) {
+            params->floats.erase(params->floats.begin() + i);
+            break;
+        }
+    }
+    for (std::pair<GLenum, GLint>& param : params->ints) {
+        if (param.first == pname) {
+            if (!changed(param.second != value)) {
+                return false;
+            }
+            param.second = value;
+            return true;
+        }
+    }
+    params->ints.push_back({ pname, value });
+    return changed(true);
+}
+
+bool updateFloats(ObjectParams* params, GLenum pname, const GLfloat* values) {
+    if (params == nullptr) {
+        return changed(true);
+    }
+    for (size_t i = 0; i < params->ints.size(); ++i) {
+        if (params->ints[i].first == pname) {
+            params->ints.erase(params->ints.begin() + i);
+            break;
+        }
+    }
+    size_t count = pname == GL_TEXTURE_BORDER_COLOR ? 4 : 1;
+    for (std::pair<GLenum, std::vector<GLfloat>>& param : params->floats) {
+        if (param.first == pname) {
+            if (!changed(memcmp(param.second.data(), values, count * sizeof(GLfloat)) != 0)) {
+                return false;
+            }
+            param.second.assign(values, values + count);
+            return true;
+        }
+    }
+    params->floats.push_back({ pname, std::vector<GLfloat>(values, values + count) });
+    return changed(true);
+}
+
+void setCap(GLenum cap, bool enabled) {
+    for (std::pair<GLenum, bool>& known : state.caps) {
+        if (known.first == cap) {
+            if (changed(known.second != enabled)) {
+                known.second = enabled;
+                enabled ? glEnable(cap) : glDisable(cap);
+            }
+            return;
+        }
+    }
+    state.caps.push_back({ cap, enabled });
+    changed(true);
+    enabled ? glEnable(cap) : glDisable(cap);
+}
+
+bool updateRect(bool* known, GLint* shadow, GLint x, GLint y, GLsizei width, GLsizei height) {
+    GLint rect[4] = { x, y, width, height };
+    if (!changed(!*known || memcmp(shadow, rect, sizeof(rect)) != 0)) {
+        return false;
+    }
+    *known = true;
+    memcpy(shadow, rect, sizeof(rect));
+    return true;
+}
+
+}  // namespace
+
+void glsUseProgram(GLuint program) {
+    if (update(&state.program, program)) {
+        glUseProgram(program);
+    }
+}
+
+void glsBindVertexArray(GLuint array) {
+    if (update(&state.vertexArray, array)) {
+        glBindVertexArray(array);
+    }
+}
+
+void glsBindBuffer(GLenum target, GLuint buffer) {
+    int index = indexOf(bufferTargets, target);
+    if (index < 0) {
+        changed(true);
+        glBindBuffer(target, buffer);
+    } else if (update(&state.buffers[index], buffer)) {
+        glBindBuffer(target, buffer);
+    }
+}
+
+void glsBindBufferBase(GLenum target, GLuint index, GLuint buffer) {
+    int slot = indexOf(bufferTargets, target);
+    if (slot >= 0) {
+        state.buffers[slot] = buffer;
+    }
+    changed(true);
+    glBindBufferBase(target, index, buffer);
+}
+
+void glsBindFramebuffer(GLenum target, GLuint framebuffer) {
+    bool draw = target == GL_FRAMEBUFFER || target == GL_DRAW_FRAMEBUFFER;
+    bool read = target == GL_FRAMEBUFFER || target == GL_READ_FRAMEBUFFER;
+    bool differs = (draw && state.drawFramebuffer != framebuffer) || (read && state.readFramebuffer != framebuffer);
+    if (changed(differs)) {
+        if (draw) {
+            state.drawFramebuffer = framebuffer;
+        }
+        if (read) {
+            state.readFramebuffer = framebuffer;
+        }
+        glBindFramebuffer(target, framebuffer);
+    }
+}
+
+void glsActiveTexture(GLenum texture) {
+    int unit = int(texture - GL_TEXTURE0);
+    if (changed(state.activeUnit != unit)) {
+        state.activeUnit = unit;
+        glActiveTexture(texture);
+    }
+}
+
+void glsBindTexture(GLenum target, GLuint texture) {
+    GLuint* bound = boundTexture(target);
+    if (bound == nullptr) {
+        changed(true);
+        glBindTexture(target, texture);
+    } else if (update(bound, texture)) {
+        glBindTexture(target, texture);
+    }
+}
+
+void glsBindSampler(GLuint unit, GLuint sampler) {
+    if (unit >= (GLuint)maxUnits) {
+        changed(true);
+        glBindSampler(unit, sampler);
+    } else if (update(&state.samplers[unit], sampler)) {
+        glBindSampler(unit, sampler);
+    }
+}
+
+void glsViewport(GLint x, GLint y, GLsizei width, GLsizei height) {
+    if (updateRect(&state.viewportKnown, state.viewport, x, y, width, height)) {
+        glViewport(x, y, width, height);
+    }
+}
+
+void glsScissor(GLint x, GLint y, GLsizei width, GLsizei height) {
+    if (updateRect(&state.scissorKnown, state.scissor, x, y, width, height)) {
+        glScissor(x, y, width, height);
+    }
+}
+
+void glsEnable(GLenum cap) {
+    setCap(cap, true);
+}
+
+void glsDisable(GLenum cap) {
+    setCap(cap, false);
+}
+
+void glsTexParameteri(GLenum target, GLenum pname, GLint param) {
+    if (updateInt(boundTextureParams(target), pname, param)) {
+        glTexParameteri(target, pname, param);
+    }
+}
+
+void glsTexParameterfv(GLenum target, GLenum pname, const GLfloat* params) {
+    if (updateFloats(boundTextureParams(target), pname, params)) {
+        glTexParameterfv(target, pname, params);
+    }
+}
+
+void glsTexSwizzle(GLenum target, GLint r, GLint g, GLint b, GLint a) {
+    const GLint swizzle[4] = { r, g, b, a };
+    ObjectParams* params = boundTextureParams(target);
+    bool differs = params == nullptr;
+    for (int c = 0; c < 4 && !differs; ++c) {
+        differs = true;
+        for (const std::pair<GLenum, GLint>& param : params->ints) {
+            if (param.first == GLenum(GL_TEXTURE_SWIZZLE_R + c)) {
+                differs = param.second != swizzle[c];
+                break;
+            }
+        }
+    }
+    if (!changed(differs)) {
+        return;
+    }
+    if (params) {
+        // Record the components without counting them as calls of their own.
+        GLStateStats stats = state.stats;
+        for (int c = 0; c < 4; ++c) {
+            updateInt(params, GL_TEXTURE_SWIZZLE_R + c, swizzle[c]);
+        }
+        state.stats = stats;
+    }
+    glTexParameteriv(target, GL_TEXTURE_SWIZZLE_RGBA, swizzle);
+}
+
+void glsSamplerParameteri(GLuint sampler, GLenum pname, GLint param) {
+    if (updateInt(&state.samplerParams[sampler], pname, param)) {
+        glSamplerParameteri(sampler, pname, param);
+    }
+}
+
+void glsSamplerParameterfv(GLuint sampler, GLenum pname, const GLfloat* params) {
+    if (updateFloats(&state.samplerParams[sampler], pname, params)) {
+        glSamplerParameterfv(sampler, pname, params);
+    }
+}
+
+void glsDeleteTextures(GLsizei n, const GLuint* textures) {
+    for (GLsizei i = 0; i < n; ++i) {
+        for (int unit = 0; unit < maxUnits; ++unit) {
+            for (int target = 0; target < numTextureTargets; ++target) {
+                if (state.textures[unit][target] == textures[i]) {
+                    state.textures[unit][target] = 0;
+                }
+            }
+        }
+        state.textureParams.erase(textures[i]);
+    }
+    glDeleteTextures(n, textures);
+}
+
+void glsDeleteSamplers(GLsizei n, const GLuint* samplers) {
+    for (GLsizei i = 0; i < n; ++i) {
+        for (int unit = 0; unit < maxUnits; ++unit) {
+            if (state.samplers[unit] == samplers[i]) {
+                state.samplers[unit] = 0;
+            }
+        }
+        state.samplerParams.erase(samplers[i]);
+    }
+    glDeleteSamplers(n, samplers);
+}
+
+void glsDeleteBuffers(GLsizei n, const GLuint* buffers) {
+    for (GLsizei i = 0; i < n; ++i) {
+        for (int target = 0; target < numBufferTargets; ++target) {
+            if (state.buffers[target] == buffers[i]) {
+                state.buffers[target] = 0;
+            }
+        }
+    }
+    glDeleteBuffers(n, buffers);
+}
+
+void glsDeleteVertexArrays(GLsizei n, const GLuint* arrays) {
+    for (GLsizei i = 0; i < n; ++i) {
+        if (state.vertexArray == arrays[i]) {
+            state.vertexArray = 0;
+        }
+    }
+    glDeleteVertexArrays(n, arrays);
+}
+
+void glsDeleteFramebuffers(GLsizei n, const GLuint* framebuffers) {
+    for (GLsizei i = 0; i < n; ++i) {
+        if (state.drawFramebuffer == framebuffers[i]) {
+            state.drawFramebuffer = 0;
+        }
+        if (state.readFramebuffer == framebuffers[i]) {
+            state.readFramebuffer = 0;
+        }
+    }
+    glDeleteFramebuffers(n, framebuffers);
+}
+
+void invalidateGLState() {
+    state.reset();
+}
+
+GLStateStats getGLStateStats() {
+    return state.stats;
+}
+
+void printGLStateStats() {
+    GLStateStats stats = getGLStateStats();
+    uint64_t total = stats.issued + stats.elided;
+    printf("state   : %llu of %llu state calls issued, %llu elided (%.1f%%)\n",
+           (unsigned long long)stats.issued, (unsigned long long)total, (unsigned long long)stats.elided,
+           total ? 100.0 * stats.elided / total : 0.0);
+}
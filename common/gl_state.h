@@ -0,0 +1,63 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "gl_loader.h"
+
+//-----------------------------------------------------------------------------------
+// Shadow state cache over the loaded GL functions
+//
+// Each gls* function takes the same arguments as the GL call it wraps and drops
+// the call when the state already has that value. The cache covers the current
+// program, vertex array, buffer, framebuffer, texture and sampler bindings, the
+// active texture unit, viewport, scissor, enable caps, and texture and sampler
+// parameters. glsTexSwizzle() sets all four swizzles with one
+// GL_TEXTURE_SWIZZLE_RGBA call.
+//
+// State starts out unknown, so the first call for any of it is always issued,
+// except the active texture unit which is taken to be GL_TEXTURE0. The
+// cache only sees changes made through it. Code that changes the same state with
+// the plain GL calls must call invalidateGLState() before the next gls* call.
+// Each thread has its own cache, for the one context current on it.
+//-----------------------------------------------------------------------------------
+
+struct GLStateStats {
+    uint64_t issued;    // calls passed on to GL
+    uint64_t elided;    // calls dropped because nothing would have changed
+};
+
+void glsUseProgram(GLuint program);
+void glsBindVertexArray(GLuint array);
+// GL_ELEMENT_ARRAY_BUFFER belongs to the vertex array and is never elided.
+void glsBindBuffer(GLenum target, GLuint buffer);
+// Always issued; indexed bindings aren't shadowed. Like GL, it also binds buffer to target.
+void glsBindBufferBase(GLenum target, GLuint index, GLuint buffer);
+void glsBindFramebuffer(GLenum target, GLuint framebuffer);
+void glsActiveTexture(GLenum texture);
+void glsBindTexture(GLenum target, GLuint texture);
+void glsBindSampler(GLuint unit, GLuint sampler);
+void glsViewport(GLint x, GLint y, GLsizei width, GLsizei height);
+void glsScissor(GLint x, GLint y, GLsizei width, GLsizei height);
+void glsEnable(GLenum cap);
+void glsDisable(GLenum cap);
+
+// Parameters of the texture bound to target on the active unit.
+void glsTexParameteri(GLenum target, GLenum pname, GLint param);
+void glsTexParameterfv(GLenum target, GLenum pname, const GLfloat* params);
+void glsTexSwizzle(GLenum target, GLint r, GLint g, GLint b, GLint a);
+void glsSamplerParameteri(GLuint sampler, GLenum pname, GLint param);
+void glsSamplerParameterfv(GLuint sampler, GLenum pname, const GLfloat* params);
+
+// Delete the objects and forget them. Bindings to them revert to 0, as in GL.
+void glsDeleteTextures(GLsizei n, const GLuint* textures);
+void glsDeleteSamplers(GLsizei n, const GLuint* samplers);
+void glsDeleteBuffers(GLsizei n, const GLuint* buffers);
+void glsDeleteVertexArrays(GLsizei n, const GLuint* arrays);
+void glsDeleteFramebuffers(GLsizei n, const GLuint* framebuffers);
+
+// Forgets everything, so every piece of state is issued again on its next call.
+void invalidateGLState();
+
+// Totals for this thread since it started.
+GLStateStats getGLStateStats();
+void printGLStateStats();
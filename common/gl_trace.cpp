@@ -0,0 +1,720 @@
+#include "gl_trace.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "gl_loader.h"
+
+namespace {
+
+enum GLFunctionIndex {
+#define GL_FUNCTION(type, name) GLFN_##name,
+#include "gl_functions.inl"
+#undef GL_FUNCTION
+    GLFN_COUNT
+};
+
+const char* const functionNames[] = {
+#define GL_FUNCTION(type, name) #name,
+#include "gl_functions.inl"
+#undef GL_FUNCTION
+};
+
+size_t align8(size_t n) {
+    return (n + 7) & ~size_t(7);
+}
+
+size_t blobSize(size_t n) {
+    return sizeof(uint64_t) + align8(n);
+}
+
+struct Tracer {
+    const char* path;
+    int fd;
+    uint8_t* file;
+    size_t reserved;
+    size_t dataOffset;
+    GLContextOptions options;
+    std::chrono::steady_clock::time_point start;
+    // Offset into the data of the next record, and of the first record that
+    // didn't fit. Everything before the smaller of the two is complete.
+    std::atomic<uint64_t> tail;
+    std::atomic<uint64_t> overflowAt;
+    std::atomic<uint64_t> records;
+    std::atomic<uint64_t> dropped;
+    std::atomic<uint64_t> mapWriteBytes;
+    std::atomic<int> threads;
+};
+
+Tracer* tracer = nullptr;
+GLTraceStats lastStats = {};
+void* realFunctions[GLFN_COUNT];
+
+thread_local int traceThread = -1;
+
+// Claims the bytes for one record and fills them in as the call goes. When the
+// record doesn't fit every write is dropped, but the call still goes through.
+class RecordWriter {
+public:
+    RecordWriter(int opcode, size_t payload) {
+        size_ = align8(sizeof(GLTraceRecord) + payload);
+        uint64_t offset = tracer->tail.fetch_add(size_);
+        if (size_ > UINT32_MAX || tracer->dataOffset + offset + size_ > tracer->reserved) {
+            uint64_t first = tracer->overflowAt.load();
+            while (offset < first && !tracer->overflowAt.compare_exchange_weak(first, offset)) {
+            }
+            ++tracer->dropped;
+            return;
+        }
+        if (traceThread < 0) {
+            traceThread = tracer->threads++;
+        }
+        p_ = tracer->file + tracer->dataOffset + offset;
+        GLTraceRecord record = {};
+        record.size = uint32_t(size_);
+        record.opcode = uint16_t(opcode);
+        record.thread = uint8_t(traceThread < 255 ? traceThread : 255);
+        record.timeNs = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - tracer->start).count();
+        memcpy(p_, &record, sizeof(record));
+        pos_ = sizeof(record);
+        ++tracer->records;
+    }
+
+    template <typename T> void put(const T& value) {
+        putAt(pos_, value);
+        pos_ += sizeof(T);
+    }
+
+    template <typename T> void putAt(size_t pos, const T& value) {
+        if (p_) {
+            memcpy(p_ + pos, &value, sizeof(T));
+        }
+    }
+
+    // Returns where the skipped bytes start.
+    size_t skip(size_t n) {
+        size_t pos = pos_;
+        pos_ += n;
+        return pos;
+    }
+
+    void blob(const void* data, size_t n) {
+        put(uint64_t(n));
+        if (p_ && n) {
+            memcpy(p_ + pos_, data, n);
+        }
+        pos_ += align8(n);
+    }
+
+    void noBlob() {
+        put(GL_TRACE_NO_BLOB);
+    }
+
+private:
+    uint8_t* p_ = nullptr;
+    size_t pos_ = 0;
+    size_t size_;
+};
+
+//-----------------------------------------------------------------------------------
+// What each thread has bound, per context
+//-----------------------------------------------------------------------------------
+
+struct BoundBuffer {
+    GLenum target;
+    GLuint buffer;
+};
+
+thread_local std::vector<BoundBuffer> boundBuffers;
+thread_local int unpackAlignment = 4;
+thread_local int packAlignment = 4;
+thread_local int packRowLength = 0;
+
+GLuint boundBuffer(GLenum target) {
+    for (const BoundBuffer& bound : boundBuffers) {
+        if (bound.target == target) {
+            return bound.buffer;
+        }
+    }
+    return 0;
+}
+
+//-----------------------------------------------------------------------------------
+// Write mappings
+//
+// GL can't read a buffer through an ordinary mapping until it's unmapped, so the
+// whole mapped range is stored then. Persistent mappings are left to
+// traceMappedWrite(). Mapping is rare, so the list takes a lock.
+//-----------------------------------------------------------------------------------
+
+struct Mapping {
+    GLuint buffer;
+    uint8_t* data;
+    size_t length;
+};
+
+std::mutex mappingsLock;
+std::vector<Mapping> mappings;
+std::atomic<int> numMappings(0);
+
+void recordMapWrite(const void* mapping, size_t offset, size_t size) {
+    RecordWriter w(GL_TRACE_MAP_WRITE, 2 * sizeof(uint64_t) + blobSize(size));
+    w.put(uint64_t(uintptr_t(mapping)));
+    w.put(uint64_t(offset));
+    w.blob((const uint8_t*)mapping + offset, size);
+    tracer->mapWriteBytes += size;
+}
+
+// Records the mapping of buffer, if any, and forgets it.
+void endMapping(GLuint buffer) {
+    if (numMappings == 0) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(mappingsLock);
+    for (size_t i = 0; i < mappings.size(); ++i) {
+        if (mappings[i].buffer == buffer) {
+            recordMapWrite(mappings[i].data, 0, mappings[i].length);
+            mappings.erase(mappings.begin() + i);
+            --numMappings;
+            return;
+        }
+    }
+}
+
+//-----------------------------------------------------------------------------------
+// What each call stores beyond its arguments and return value
+//
+// size() is the number of extra bytes, prepare() runs before the record is
+// claimed, before() writes blobs before the call and after() after it. result
+// points at the return value, or is null for void calls.
+//-----------------------------------------------------------------------------------
+
+struct NoPayload {
+    template <typename... A> static size_t size(A...) { return 0; }
+    template <typename... A> static void prepare(A...) {}
+    template <typename... A> static void before(RecordWriter&, A...) {}
+    template <typename... A> static void after(RecordWriter&, const void*, A...) {}
+};
+
+template <int Index> struct Payload : NoPayload {};
+
+#define TRACE_GEN_PAYLOAD(name)                                                           \
+    template <> struct Payload<GLFN_##name> : NoPayload {                                 \
+        static size_t size(GLsizei n, GLuint*) { return blobSize(n * sizeof(GLuint)); }   \
+        static void after(RecordWriter& w, const void*, GLsizei n, GLuint* names) {       \
+            w.blob(names, n * sizeof(GLuint));                                            \
+        }                                                                                 \
+    };
+
+#define TRACE_DELETE_PAYLOAD(name)                                                             \
+    template <> struct Payload<GLFN_##name> : NoPayload {                                      \
+        static size_t size(GLsizei n, const GLuint*) { return blobSize(n * sizeof(GLuint)); }  \
+        static void before(RecordWriter& w, GLsizei n, const GLuint* names) {                  \
+            w.blob(names, n * sizeof(GLuint));                                                 \
+        }                                                                                      \
+    };
+
+TRACE_GEN_PAYLOAD(glGenTextures)
+TRACE_GEN_PAYLOAD(glGenVertexArrays)
+TRACE_GEN_PAYLOAD(glGenBuffers)
+TRACE_GEN_PAYLOAD(glGenSamplers)
+TRACE_GEN_PAYLOAD(glGenFramebuffers)
+TRACE_GEN_PAYLOAD(glGenQueries)
+TRACE_DELETE_PAYLOAD(glDeleteTextures)
+TRACE_DELETE_PAYLOAD(glDeleteVertexArrays)
+TRACE_DELETE_PAYLOAD(glDeleteSamplers)
+TRACE_DELETE_PAYLOAD(glDeleteFramebuffers)
+TRACE_DELETE_PAYLOAD(glDeleteQueries)
+
+#undef TRACE_GEN_PAYLOAD
+#undef TRACE_DELETE_PAYLOAD
+
+template <> struct Payload<GLFN_glDeleteBuffers> : NoPayload {
+    static size_t size(GLsizei n, const GLuint*) { return blobSize(n * sizeof(GLuint)); }
+    static void prepare(GLsizei n, const GLuint* buffers) {
+        // Deleting a buffer unmaps and unbinds it.
+        for (GLsizei i = 0; i < n; ++i) {
+            endMapping(buffers[i]);
+            for (BoundBuffer& bound : boundBuffers) {
+                if (bound.buffer == buffers[i]) {
+                    bound.buffer = 0;
+                }
+            }
+        }
+    }
+    static void before(RecordWriter& w, GLsizei n, const GLuint* buffers) {
+        w.blob(buffers, n * sizeof(GLuint));
+    }
+};
+
+template <> struct Payload<GLFN_glBindBuffer> : NoPayload {
+    static void prepare(GLenum target, GLuint buffer) {
+        for (BoundBuffer& bound : boundBuffers) {
+            if (bound.target == target) {
+                bound.buffer = buffer;
+                return;
+            }
+        }
+        boundBuffers.push_back({target, buffer});
+    }
+};
+
+template <> struct Payload<GLFN_glPixelStorei> : NoPayload {
+    static void prepare(GLenum pname, GLint param) {
+        if (pname == GL_UNPACK_ALIGNMENT) {
+            unpackAlignment = param;
+        } else if (pname == GL_PACK_ALIGNMENT) {
+            packAlignment = param;
+        } else if (pname == GL_PACK_ROW_LENGTH) {
+            packRowLength = param;
+        }
+    }
+};
+
+// Pixels come from client memory unless a pixel unpack buffer is bound.
+bool unpacksFromClient(const void* pixels) {
+    return pixels != nullptr && boundBuffer(GL_PIXEL_UNPACK_BUFFER) == 0;
+}
+
+template <> struct Payload<GLFN_glTexImage2D> : NoPayload {
+    static size_t size(GLenum, GLint, GLint, GLsizei width, GLsizei height, GLint, GLenum format, GLenum type,
+                       const void* pixels) {
+        return unpacksFromClient(pixels) ? blobSize(glTraceImageSize(width, height, format, type, unpackAlignment))
+                                         : sizeof(uint64_t);
+    }
+    static void before(RecordWriter& w, GLenum, GLint, GLint, GLsizei width, GLsizei height, GLint, GLenum format,
+                       GLenum type, const void* pixels) {
+        if (unpacksFromClient(pixels)) {
+            w.blob(pixels, glTraceImageSize(width, height, format, type, unpackAlignment));
+        } else {
+            w.noBlob();
+        }
+    }
+};
+
+template <> struct Payload<GLFN_glTexSubImage2D> : NoPayload {
+    static size_t size(GLenum, GLint, GLint, GLint, GLsizei width, GLsizei height, GLenum format, GLenum type,
+                       const void* pixels) {
+        return unpacksFromClient(pixels) ? blobSize(glTraceImageSize(width, height, format, type, unpackAlignment))
+                                         : sizeof(uint64_t);
+    }
+    static void before(RecordWriter& w, GLenum, GLint, GLint, GLint, GLsizei width, GLsizei height, GLenum format,
+                       GLenum type, const void* pixels) {
+        if (unpacksFromClient(pixels)) {
+            w.blob(pixels, glTraceImageSize(width, height, format, type, unpackAlignment));
+        } else {
+            w.noBlob();
+        }
+    }
+};
+
+template <> struct Payload<GLFN_glCompressedTexSubImage2D> : NoPayload {
+    static size_t size(GLenum, GLint, GLint, GLint, GLsizei, GLsizei, GLenum, GLsizei imageSize, const void* data) {
+        return unpacksFromClient(data) ? blobSize(imageSize) : sizeof(uint64_t);
+    }
+    static void before(RecordWriter& w, GLenum, GLint, GLint, GLint, GLsizei, GLsizei, GLenum, GLsizei imageSize,
+                       const void* data) {
+        if (unpacksFromClient(data)) {
+            w.blob(data, imageSize);
+        } else {
+            w.noBlob();
+        }
+    }
+};
+
+template <> struct Payload<GLFN_glReadPixels> : NoPayload {
+    static size_t size(GLint, GLint, GLsizei, GLsizei, GLenum, GLenum, void*) { return sizeof(uint64_t); }
+    static void before(RecordWriter& w, GLint, GLint, GLsizei width, GLsizei height, GLenum format, GLenum type,
+                       void*) {
+        if (boundBuffer(GL_PIXEL_PACK_BUFFER) == 0) {
+            // With a row length set, the last row is shorter than this. The replay
+            // only needs somewhere big enough to write to.
+            int rowLength = packRowLength > 0 ? packRowLength : width;
+            w.put(uint64_t(glTraceImageSize(rowLength, height, format, type, packAlignment)));
+        } else {
+            w.noBlob();
+        }
+    }
+};
+
+template <> struct Payload<GLFN_glBufferData> : NoPayload {
+    static size_t size(GLenum, GLsizeiptr size, const void* data, GLenum) {
+        return data ? blobSize(size) : sizeof(uint64_t);
+    }
+    static void before(RecordWriter& w, GLenum, GLsizeiptr size, const void* data, GLenum) {
+        if (data) {
+            w.blob(data, size);
+        } else {
+            w.noBlob();
+        }
+    }
+};
+
+template <> struct Payload<GLFN_glBufferSubData> : NoPayload {
+    static size_t size(GLenum, GLintptr, GLsizeiptr size, const void*) {
+        return blobSize(size);
+    }
+    static void before(RecordWriter& w, GLenum, GLintptr, GLsizeiptr size, const void* data) {
+        w.blob(data, size);
+    }
+};
+
+template <> struct Payload<GLFN_glBufferStorage> : NoPayload {
+    static size_t size(GLenum, GLsizeiptr size, const void* data, GLbitfield) {
+        return data ? blobSize(size) : sizeof(uint64_t);
+    }
+    static void before(RecordWriter& w, GLenum, GLsizeiptr size, const void* data, GLbitfield) {
+        if (data) {
+            w.blob(data, size);
+        } else {
+            w.noBlob();
+        }
+    }
+};
+
+template <> struct Payload<GLFN_glMapBufferRange> : NoPayload {
+    static void after(RecordWriter&, const void* result, GLenum target, GLintptr, GLsizeiptr length,
+                      GLbitfield access) {
+        uint8_t* data = *(uint8_t* const*)result;
+        if (data == nullptr || !(access & GL_MAP_WRITE_BIT) || (access & GL_MAP_PERSISTENT_BIT)) {
+            return;
+        }
+        std::lock_guard<std::mutex> lock(mappingsLock);
+        mappings.push_back({boundBuffer(target), data, size_t(length)});
+        ++numMappings;
+    }
+};
+
+template <> struct Payload<GLFN_glUnmapBuffer> : NoPayload {
+    static void prepare(GLenum target) {
+        endMapping(boundBuffer(target));
+    }
+};
+
+template <> struct Payload<GLFN_glMultiDrawArraysIndirect> : NoPayload {
+    static size_t commandBytes(GLsizei drawcount, GLsizei stride) {
+        return size_t(drawcount) * (stride ? stride : 4 * sizeof(GLuint));
+    }
+    static size_t size(GLenum, const void*, GLsizei drawcount, GLsizei stride) {
+        return boundBuffer(GL_DRAW_INDIRECT_BUFFER) ? sizeof(uint64_t) : blobSize(commandBytes(drawcount, stride));
+    }
+    static void before(RecordWriter& w, GLenum, const void* indirect, GLsizei drawcount, GLsizei stride) {
+        if (boundBuffer(GL_DRAW_INDIRECT_BUFFER)) {
+            w.noBlob();
+        } else {
+            w.blob(indirect, commandBytes(drawcount, stride));
+        }
+    }
+};
+
+template <> struct Payload<GLFN_glShaderSource> : NoPayload {
+    static size_t length(const GLchar* const* strings, const GLint* lengths, GLsizei i) {
+        return lengths && lengths[i] >= 0 ? size_t(lengths[i]) : strlen(strings[i]);
+    }
+    static size_t size(GLuint, GLsizei count, const GLchar* const* strings, const GLint* lengths) {
+        size_t total = 0;
+        for (GLsizei i = 0; i < count; ++i) {
+            total += blobSize(length(strings, lengths, i));
+        }
+        return total;
+    }
+    static void before(RecordWriter& w, GLuint, GLsizei count, const GLchar* const* strings, const GLint* lengths) {
+        for (GLsizei i = 0; i < count; ++i) {
+            w.blob(strings[i], length(strings, lengths, i));
+        }
+    }
+};
+
+template <> struct Payload<GLFN_glBindAttribLocation> : NoPayload {
+    static size_t size(GLuint, GLuint, const GLchar* name) { return blobSize(strlen(name) + 1); }
+    static void before(RecordWriter& w, GLuint, GLuint, const GLchar* name) {
+        w.blob(name, strlen(name) + 1);
+    }
+};
+
+template <> struct Payload<GLFN_glProgramBinary> : NoPayload {
+    static size_t size(GLuint, GLenum, const void*, GLsizei length) { return blobSize(length); }
+    static void before(RecordWriter& w, GLuint, GLenum, const void* binary, GLsizei length) {
+        w.blob(binary, length);
+    }
+};
+
+template <> struct Payload<GLFN_glDebugMessageControl> : NoPayload {
+    static size_t size(GLenum, GLenum, GLenum, GLsizei count, const GLuint*, GLboolean) {
+        return blobSize(count * sizeof(GLuint));
+    }
+    static void before(RecordWriter& w, GLenum, GLenum, GLenum, GLsizei count, const GLuint* ids, GLboolean) {
+        w.blob(ids, count * sizeof(GLuint));
+    }
+};
+
+size_t parameterCount(GLenum pname) {
+    return pname == GL_TEXTURE_BORDER_COLOR || pname == GL_TEXTURE_SWIZZLE_RGBA ? 4 : 1;
+}
+
+template <> struct Payload<GLFN_glTexParameteriv> : NoPayload {
+    static size_t size(GLenum, GLenum pname, const GLint*) { return blobSize(parameterCount(pname) * sizeof(GLint)); }
+    static void before(RecordWriter& w, GLenum, GLenum pname, const GLint* params) {
+        w.blob(params, parameterCount(pname) * sizeof(GLint));
+    }
+};
+
+template <> struct Payload<GLFN_glTexParameterfv> : NoPayload {
+    static size_t size(GLenum, GLenum pname, const GLfloat*) { return blobSize(parameterCount(pname) * sizeof(GLfloat)); }
+    static void before(RecordWriter& w, GLenum, GLenum pname, const GLfloat* params) {
+        w.blob(params, parameterCount(pname) * sizeof(GLfloat));
+    }
+};
+
+template <> struct Payload<GLFN_glSamplerParameterfv> : NoPayload {
+    static size_t size(GLuint, GLenum pname, const GLfloat*) { return blobSize(parameterCount(pname) * sizeof(GLfloat)); }
+    static void before(RecordWriter& w, GLuint, GLenum pname, const GLfloat* params) {
+        w.blob(params, parameterCount(pname) * sizeof(GLfloat));
+    }
+};
+
+//-----------------------------------------------------------------------------------
+// The recording wrapper every entry point points at while tracing
+//-----------------------------------------------------------------------------------
+
+template <typename R> struct ReturnSize { static const size_t value = sizeof(R); };
+template <> struct ReturnSize<void> { static const size_t value = 0; };
+
+template <typename T> struct Traced;
+template <typename R, typename... Args> struct Traced<R (APIENTRYP)(Args...)> {
+    template <int Index>
+    static R APIENTRY call(Args... args) {
+        typedef Payload<Index> P;
+        typedef R (APIENTRYP Function)(Args...);
+        const size_t returnSize = ReturnSize<R>::value;
+
+        P::prepare(args...);
+        RecordWriter w(Index, (sizeof(Args) + ... + 0) + returnSize + P::size(args...));
+        (w.put(args), ...);
+        size_t returnAt = w.skip(returnSize);
+        P::before(w, args...);
+        if constexpr (std::is_void<R>::value) {
+            ((Function)realFunctions[Index])(args...);
+            P::after(w, nullptr, args...);
+        } else {
+            R result = ((Function)realFunctions[Index])(args...);
+            w.putAt(returnAt, result);
+            P::after(w, &result, args...);
+            return result;
+        }
+    }
+};
+
+void writeHeader() {
+    GLTraceHeader header = {};
+    memcpy(header.magic, "GLTRACE1", 8);
+    header.numFunctions = GLFN_COUNT;
+    header.backend = tracer->options.backend;
+    header.width = tracer->options.width;
+    header.height = tracer->options.height;
+    header.dataOffset = tracer->dataOffset;
+    uint64_t end = tracer->tail.load();
+    header.dataSize = end < tracer->overflowAt ? end : tracer->overflowAt.load();
+    header.records = tracer->records;
+    header.dropped = tracer->dropped;
+    memcpy(tracer->file, &header, sizeof(header));
+}
+
+}  // namespace
+
+size_t glTraceImageSize(int width, int height, unsigned format, unsigned type, int alignment) {
+    size_t components;
+    switch (format) {
+        case GL_RG:
+        case GL_RG_INTEGER:
+            components = 2;
+            break;
+        case GL_RGB:
+        case GL_BGR:
+        case GL_RGB_INTEGER:
+            components = 3;
+            break;
+        case GL_RGBA:
+        case GL_BGRA:
+        case GL_RGBA_INTEGER:
+            components = 4;
+            break;
+        default:
+            // GL_RED, GL_DEPTH_COMPONENT, GL_STENCIL_INDEX and GL_DEPTH_STENCIL,
+            // which only comes with a packed type.
+            components = 1;
+            break;
+    }
+    size_t pixelSize;
+    switch (type) {
+        case GL_UNSIGNED_BYTE:
+        case GL_BYTE:
+            pixelSize = components;
+            break;
+        case GL_UNSIGNED_SHORT:
+        case GL_SHORT:
+        case GL_HALF_FLOAT:
+            pixelSize = components * 2;
+            break;
+        case GL_UNSIGNED_SHORT_5_6_5:
+        case GL_UNSIGNED_SHORT_4_4_4_4:
+        case GL_UNSIGNED_SHORT_5_5_5_1:
+            pixelSize = 2;
+            break;
+        case GL_UNSIGNED_INT_8_8_8_8:
+        case GL_UNSIGNED_INT_8_8_8_8_REV:
+        case GL_UNSIGNED_INT_10_10_10_2:
+        case GL_UNSIGNED_INT_2_10_10_10_REV:
+        case GL_UNSIGNED_INT_24_8:
+        case GL_UNSIGNED_INT_10F_11F_11F_REV:
+        case GL_UNSIGNED_INT_5_9_9_9_REV:
+            pixelSize = 4;
+            break;
+        case GL_FLOAT_32_UNSIGNED_INT_24_8_REV:
+            pixelSize = 8;
+            break;
+        default:
+            // GL_UNSIGNED_INT, GL_INT and GL_FLOAT
+            pixelSize = components * 4;
+            break;
+    }
+    if (width <= 0 || height <= 0) {
+        return 0;
+    }
+    size_t row = width * pixelSize;
+    size_t stride = (row + alignment - 1) / alignment * alignment;
+    return stride * (height - 1) + row;
+}
+
+void startGLTrace(const GLContext* ctx, const GLContextOptions& options, const char* path, size_t reserveBytes) {
+    if (tracer) {
+        printf("startGLTrace: already tracing to %s\n", tracer->path);
+        exit(1);
+    }
+    // Every pointer has to hold the real function, not a trampoline that would
+    // replace the recording wrapper on its first call.
+    init_gl_functions(ctx, GL_LOAD_EAGER);
+
+    size_t namesSize = 0;
+    for (int i = 0; i < GLFN_COUNT; ++i) {
+        namesSize += sizeof(uint16_t) + strlen(functionNames[i]);
+    }
+    size_t dataOffset = align8(sizeof(GLTraceHeader) + namesSize);
+    if (reserveBytes < dataOffset) {
+        reserveBytes = dataOffset;
+    }
+
+    int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0 || ftruncate(fd, reserveBytes) != 0) {
+        printf("Cannot create trace %s\n", path);
+        exit(1);
+    }
+    void* file = mmap(nullptr, reserveBytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (file == MAP_FAILED) {
+        printf("Cannot map %zu bytes of trace %s\n", reserveBytes, path);
+        exit(1);
+    }
+
+    tracer = new Tracer;
+    tracer->path = path;
+    tracer->fd = fd;
+    tracer->file = (uint8_t*)file;
+    tracer->reserved = reserveBytes;
+    tracer->dataOffset = dataOffset;
+    tracer->options = options;
+    tracer->start = std::chrono::steady_clock::now();
+    tracer->tail = 0;
+    tracer->overflowAt = ~0ull;
+    tracer->records = 0;
+    tracer->dropped = 0;
+    tracer->mapWriteBytes = 0;
+    tracer->threads = 0;
+
+    uint8_t* names = tracer->file + sizeof(GLTraceHeader);
+    for (int i = 0; i < GLFN_COUNT; ++i) {
+        uint16_t length = uint16_t(strlen(functionNames[i]));
+        memcpy(names, &length, sizeof(length));
+        memcpy(names + sizeof(length), functionNames[i], length);
+        names += sizeof(length) + length;
+    }
+    writeHeader();
+
+#define GL_FUNCTION(type, name) \
+    realFunctions[GLFN_##name] = (void*)name; \
+    name = &Traced<type>::call<GLFN_##name>;
+#include "gl_functions.inl"
+#undef GL_FUNCTION
+}
+
+void stopGLTrace() {
+    if (!tracer) {
+        return;
+    }
+#define GL_FUNCTION(type, name) name = (type)realFunctions[GLFN_##name];
+#include "gl_functions.inl"
+#undef GL_FUNCTION
+
+    writeHeader();
+    GLTraceHeader header;
+    memcpy(&header, tracer->file, sizeof(header));
+    lastStats.records = header.records;
+    lastStats.bytes = header.dataSize;
+    lastStats.dropped = header.dropped;
+    lastStats.mapWriteBytes = tracer->mapWriteBytes;
+
+    munmap(tracer->file, tracer->reserved);
+    if (ftruncate(tracer->fd, header.dataOffset + header.dataSize) != 0) {
+        printf("Cannot truncate trace %s\n", tracer->path);
+    }
+    close(tracer->fd);
+    mappings.clear();
+    numMappings = 0;
+    delete tracer;
+    tracer = nullptr;
+}
+
+bool isGLTracing() {
+    return tracer != nullptr;
+}
+
+void traceSwapBuffers() {
+    if (tracer) {
+        RecordWriter w(GL_TRACE_SWAP, 0);
+    }
+}
+
+void traceMappedWrite(const void* mapping, size_t offset, size_t size) {
+    if (tracer && size) {
+        recordMapWrite(mapping, offset, size);
+    }
+}
+
+GLTraceStats getGLTraceStats() {
+    if (!tracer) {
+        return lastStats;
+    }
+    GLTraceStats stats;
+    stats.records = tracer->records;
+    stats.bytes = tracer->tail;
+    stats.dropped = tracer->dropped;
+    stats.mapWriteBytes = tracer->mapWriteBytes;
+    return stats;
+}
+
+void printGLTraceStats() {
+    GLTraceStats stats = getGLTraceStats();
+    printf("trace   : %llu records, %.1f MB, %.1f MB from mappings, %llu dropped\n",
+           (unsigned long long)stats.records, stats.bytes / 1e6, stats.mapWriteBytes / 1e6,
+           (unsigned long long)stats.dropped);
+}
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "gl_context.h"
+
+//-----------------------------------------------------------------------------------
+// Binary trace of every call made through the loaded GL functions
+//
+// startGLTrace() resolves the whole table and points every entry at a recording
+// wrapper that appends one record and then calls the real function. Records go
+// straight into a MAP_SHARED file reserved up front, each thread claiming its
+// bytes with one atomic add, so recording a call never takes a lock; only
+// glMapBufferRange and glUnmapBuffer, which are rare, lock the list of mappings.
+// A trace that outgrows the reservation keeps running but drops the records
+// that don't fit.
+//
+// Arguments are stored as their raw bytes, pointers included. Pointers to data
+// the call reads (buffer and texture data, shader sources, parameter arrays,
+// names to delete) are followed by a copy of that data. Names written by glGen*
+// and return values are stored after the call. Other output pointers are left
+// to the replayer, except that glReadPixels stores how many bytes it writes.
+//
+// Writes through a mapped buffer don't go through GL at all. An ordinary write
+// mapping is stored whole when it's unmapped. Writes through a persistent
+// mapping must be recorded with traceMappedWrite() before GL reads them;
+// StreamRing does this.
+//
+// The gl-replay example reads the file back and issues the same calls.
+//-----------------------------------------------------------------------------------
+
+// File layout: a GLTraceHeader, then the name of every function in the
+// recording table as a uint16_t length and the characters, then the records
+// from dataOffset. Opcodes index that name table, so a trace stays readable
+// after the table changes.
+struct GLTraceHeader {
+    char magic[8];              // "GLTRACE1"
+    uint32_t numFunctions;
+    uint32_t backend;           // GLBackend of the recorded context
+    int32_t width;
+    int32_t height;
+    uint64_t dataOffset;
+    uint64_t dataSize;
+    uint64_t records;
+    uint64_t dropped;           // records that didn't fit in the reservation
+};
+
+// Every record starts with this and is padded to a multiple of 8 bytes. A call
+// is followed by its arguments, its return value and then its data blobs.
+struct GLTraceRecord {
+    uint32_t size;              // whole record including this header
+    uint16_t opcode;
+    uint8_t thread;             // order in which the recording threads made their first call
+    uint8_t pad;
+    uint64_t timeNs;            // since startGLTrace()
+};
+
+// Opcodes that aren't GL calls.
+enum GLTraceMarker {
+    // swapBuffers(). No payload.
+    GL_TRACE_SWAP = 0xff00,
+    // Bytes written through a mapping: the uint64_t pointer the mapping
+    // returned, a uint64_t offset into it and a blob with the bytes.
+    GL_TRACE_MAP_WRITE = 0xff01,
+};
+
+// A blob is a uint64_t length followed by that many bytes padded to 8. This
+// length means the pointer argument was an offset into a bound buffer and no
+// data was copied.
+const uint64_t GL_TRACE_NO_BLOB = ~0ull;
+
+struct GLTraceStats {
+    uint64_t records;
+    uint64_t bytes;
+    uint64_t dropped;
+    uint64_t mapWriteBytes;     // bytes copied out of write mappings
+};
+
+// Call with ctx current after init_gl_functions(). reserveBytes is the most the
+// trace may hold. Prints a message and exits if the file can't be created.
+void startGLTrace(const GLContext* ctx, const GLContextOptions& options, const char* path,
+                  size_t reserveBytes = size_t(4) << 30);
+
+// Puts the real functions back, truncates the file to what was recorded and
+// closes it. Call with no other thread making GL calls.
+void stopGLTrace();
+
+bool isGLTracing();
+
+// Records a GL_TRACE_SWAP. swapBuffers() calls it.
+void traceSwapBuffers();
+
+// Records size bytes written at offset into a persistent mapping, where mapping
+// is the pointer glMapBufferRange returned. Call before anything makes GL read
+// them. Does nothing when not tracing.
+void traceMappedWrite(const void* mapping, size_t offset, size_t size);
+
+GLTraceStats getGLTraceStats();
+void printGLTraceStats();
+
+// Bytes of client memory glTexImage2D and friends read for a width x height
+// image of format and type with the given GL_UNPACK_ALIGNMENT.
+size_t glTraceImageSize(int width, int height, unsigned format, unsigned type, int alignment);
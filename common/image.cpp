@@ -0,0 +1,317 @@
+#include "image.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+
+namespace {
+
+bool endsWith(const char* s, const char* suffix) {
+    size_t n = strlen(s);
+    size_t m = strlen(suffix);
+    return n >= m && !strcmp(s + n - m, suffix);
+}
+
+//-----------------------------------------------------------------------------------
+// PPM
+//-----------------------------------------------------------------------------------
+
+bool writePPM(FILE* f, const Image& image) {
+    fprintf(f, "P6\n%d %d\n255\n", image.width, image.height);
+    std::vector<uint8_t> rgb(size_t(image.width) * 3);
+    for (int y = 0; y < image.height; ++y) {
+        const uint8_t* src = image.row(y);
+        for (int x = 0; x < image.width; ++x) {
+            rgb[x * 3 + 0] = src[x * 4 + 0];
+            rgb[x * 3 + 1] = src[x * 4 + 1];
+            rgb[x * 3 + 2] = src[x * 4 + 2];
+        }
+        if (fwrite(rgb.data(), 1, rgb.size(), f) != rgb.size()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Skips whitespace and # comments, then reads one header number.
+bool readPPMNumber(FILE* f, int* value) {
+    int c = fgetc(f);
+    while (c == '#' || c == ' ' || c == '\t' || c == '\r' || c == '\n') {
+        if (c == '#') {
+            while (c != '\n' && c != EOF) {
+                c = fgetc(f);
+            }
+        }
+        c = fgetc(f);
+    }
+    ungetc(c, f);
+    return fscanf(f, "%d", value) == 1;
+}
+
+bool readPPM(FILE* f, const char* path, Image* image) {
+    int width, height, maxValue;
+    if (fgetc(f) != 'P' || fgetc(f) != '6' || !readPPMNumber(f, &width) || !readPPMNumber(f, &height) ||
+        !readPPMNumber(f, &maxValue) || maxValue != 255 || width <= 0 || height <= 0) {
+        printf("%s: not an 8-bit binary PPM\n", path);
+        return false;
+    }
+    fgetc(f);
+    image->resize(width, height);
+    image->channels = 3;
+    std::vector<uint8_t> rgb(size_t(width) * 3);
+    for (int y = 0; y < height; ++y) {
+        if (fread(rgb.data(), 1, rgb.size(), f) != rgb.size()) {
+            printf("%s: truncated\n", path);
+            return false;
+        }
+        uint8_t* dst = image->row(y);
+        for (int x = 0; x < width; ++x) {
+            dst[x * 4 + 0] = rgb[x * 3 + 0];
+            dst[x * 4 + 1] = rgb[x * 3 + 1];
+            dst[x * 4 + 2] = rgb[x * 3 + 2];
+            dst[x * 4 + 3] = 255;
+        }
+    }
+    return true;
+}
+
+//-----------------------------------------------------------------------------------
+// PNG
+//-----------------------------------------------------------------------------------
+
+const uint8_t pngSignature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+
+uint32_t crcTable[256];
+
+uint32_t crc32(uint32_t crc, const uint8_t* data, size_t size) {
+    if (crcTable[1] == 0) {
+        for (uint32_t n = 0; n < 256; ++n) {
+            uint32_t c = n;
+            for (int k = 0; k < 8; ++k) {
+                c = c & 1 ? 0xedb88320u ^ (c >> 1) : c >> 1;
+            }
+            crcTable[n] = c;
+        }
+    }
+    crc = ~crc;
+    for (size_t i = 0; i < size; ++i) {
+        crc = crcTable[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+void putBE32(std::vector<uint8_t>& out, uint32_t v) {
+    out.push_back(uint8_t(v >> 24));
+    out.push_back(uint8_t(v >> 16));
+    out.push_back(uint8_t(v >> 8));
+    out.push_back(uint8_t(v));
+}
+
+uint32_t getBE32(const uint8_t* p) {
+    return uint32_t(p[0]) << 24 | uint32_t(p[1]) << 16 | uint32_t(p[2]) << 8 | p[3];
+}
+
+bool writeChunk(FILE* f, const char* type, const uint8_t* data, size_t size) {
+    std::vector<uint8_t> header;
+    putBE32(header, uint32_t(size));
+    header.insert(header.end(), type, type + 4);
+    uint32_t crc = crc32(crc32(0, header.data() + 4, 4), data, size);
+    std::vector<uint8_t> trailer;
+    putBE32(trailer, crc);
+    return fwrite(header.data(), 1, 8, f) == 8 && fwrite(data, 1, size, f) == size &&
+           fwrite(trailer.data(), 1, 4, f) == 4;
+}
+
+bool writePNG(FILE* f, const Image& image) {
+    std::vector<uint8_t> ihdr;
+    putBE32(ihdr, image.width);
+    putBE32(ihdr, image.height);
+    ihdr.insert(ihdr.end(), {8, 6, 0, 0, 0});   // 8 bits, RGBA, deflate, no filter method, no interlace
+
+    // Each row is a 0 filter byte and the pixels. The zlib stream holds them in
+    // stored blocks of at most 65535 bytes.
+    size_t rowSize = size_t(image.width) * 4 + 1;
+    size_t rawSize = rowSize * image.height;
+    std::vector<uint8_t> raw(rawSize);
+    for (int y = 0; y < image.height; ++y) {
+        raw[y * rowSize] = 0;
+        memcpy(&raw[y * rowSize + 1], image.row(y), rowSize - 1);
+    }
+    std::vector<uint8_t> zlib;
+    zlib.reserve(rawSize + rawSize / 65535 * 5 + 16);
+    zlib.push_back(0x78);
+    zlib.push_back(0x01);
+    for (size_t pos = 0; pos < rawSize || pos == 0; ) {
+        size_t n = std::min<size_t>(rawSize - pos, 65535);
+        bool last = pos + n == rawSize;
+        zlib.push_back(last ? 1 : 0);
+        zlib.push_back(uint8_t(n));
+        zlib.push_back(uint8_t(n >> 8));
+        zlib.push_back(uint8_t(~n));
+        zlib.push_back(uint8_t(~n >> 8));
+        zlib.insert(zlib.end(), raw.begin() + pos, raw.begin() + pos + n);
+        pos += n;
+        if (last) {
+            break;
+        }
+    }
+    // Adler-32. 5552 bytes is the most that can be summed before b could overflow.
+    uint32_t a = 1, b = 0;
+    for (size_t pos = 0; pos < rawSize; pos += 5552) {
+        size_t end = std::min<size_t>(pos + 5552, rawSize);
+        for (size_t i = pos; i < end; ++i) {
+            a += raw[i];
+            b += a;
+        }
+        a %= 65521;
+        b %= 65521;
+    }
+    putBE32(zlib, b << 16 | a);
+
+    return fwrite(pngSignature, 1, 8, f) == 8 && writeChunk(f, "IHDR", ihdr.data(), ihdr.size()) &&
+           writeChunk(f, "IDAT", zlib.data(), zlib.size()) && writeChunk(f, "IEND", nullptr, 0);
+}
+
+uint8_t paeth(int a, int b, int c) {
+    int p = a + b - c;
+    int pa = abs(p - a), pb = abs(p - b), pc = abs(p - c);
+    return uint8_t(pa <= pb && pa <= pc ? a : pb <= pc ? b : c);
+}
+
+bool readPNG(FILE* f, const char* path, Image* image) {
+    // The signature has already been read, so the chunks start at 0.
+    std::vector<uint8_t> file;
+    uint8_t buffer[65536];
+    size_t n;
+    while ((n = fread(buffer, 1, sizeof(buffer), f)) > 0) {
+        file.insert(file.end(), buffer, buffer + n);
+    }
+
+    int width = 0, height = 0, channels = 0;
+    std::vector<uint8_t> zlib;
+    for (size_t pos = 0; pos + 12 <= file.size(); ) {
+        uint32_t size = getBE32(&file[pos]);
+        const char* type = (const char*)&file[pos + 4];
+        const uint8_t* data = &file[pos + 8];
+        if (pos + 12 + size > file.size()) {
+            break;
+        }
+        if (!memcmp(type, "IHDR", 4) && size >= 13) {
+            width = getBE32(data);
+            height = getBE32(data + 4);
+            channels = data[9] == 6 ? 4 : data[9] == 2 ? 3 : 0;
+            if (data[8] != 8 || data[12] != 0) {
+                channels = 0;
+            }
+        } else if (!memcmp(type, "IDAT", 4)) {
+            zlib.insert(zlib.end(), data, data + size);
+        }
+        pos += 12 + size;
+    }
+    if (width <= 0 || height <= 0 || channels == 0) {
+        printf("%s: only 8-bit RGB and RGBA PNGs without interlacing are supported\n", path);
+        return false;
+    }
+
+    // Only stored blocks, which is what writePNG() makes.
+    std::vector<uint8_t> raw;
+    size_t pos = 2;
+    for (bool last = false; !last; ) {
+        if (pos + 5 > zlib.size() || (zlib[pos] & 6) != 0) {
+            printf("%s: compressed PNGs aren't supported, only ones this program wrote\n", path);
+            return false;
+        }
+        last = zlib[pos] & 1;
+        size_t size = zlib[pos + 1] | zlib[pos + 2] << 8;
+        pos += 5;
+        if (pos + size > zlib.size()) {
+            printf("%s: truncated\n", path);
+            return false;
+        }
+        raw.insert(raw.end(), zlib.begin() + pos, zlib.begin() + pos + size);
+        pos += size;
+    }
+
+    size_t stride = size_t(width) * channels;
+    if (raw.size() < (stride + 1) * height) {
+        printf("%s: truncated\n", path);
+        return false;
+    }
+    image->resize(width, height);
+    image->channels = channels;
+    std::vector<uint8_t> previous(stride, 0);
+    std::vector<uint8_t> current(stride);
+    for (int y = 0; y < height; ++y) {
+        const uint8_t* src = &raw[y * (stride + 1)];
+        uint8_t filter = src[0];
+        ++src;
+        for (size_t i = 0; i < stride; ++i) {
+            int left = i >= size_t(channels) ? current[i - channels] : 0;
+            int up = previous[i];
+            int upLeft = i >= size_t(channels) ? previous[i - channels] : 0;
+            switch (filter) {
+                case 1: current[i] = uint8_t(src[i] + left); break;
+                case 2: current[i] = uint8_t(src[i] + up); break;
+                case 3: current[i] = uint8_t(src[i] + (left + up) / 2); break;
+                case 4: current[i] = uint8_t(src[i] + paeth(left, up, upLeft)); break;
+                default: current[i] = src[i]; break;
+            }
+        }
+        uint8_t* dst = image->row(y);
+        for (int x = 0; x < width; ++x) {
+            dst[x * 4 + 0] = current[x * channels + 0];
+            dst[x * 4 + 1] = current[x * channels + 1];
+            dst[x * 4 + 2] = current[x * channels + 2];
+            dst[x * 4 + 3] = channels == 4 ? current[x * channels + 3] : 255;
+        }
+        std::swap(previous, current);
+    }
+    return true;
+}
+
+}  // namespace
+
+bool writeImage(const char* path, const Image& image) {
+    FILE* f = fopen(path, "wb");
+    if (!f) {
+        printf("Cannot write %s\n", path);
+        return false;
+    }
+    bool ok = endsWith(path, ".png") ? writePNG(f, image) : writePPM(f, image);
+    if (fclose(f) != 0 || !ok) {
+        printf("Cannot write %s\n", path);
+        return false;
+    }
+    return true;
+}
+
+bool readImage(const char* path, Image* image) {
+    FILE* f = fopen(path, "rb");
+    if (!f) {
+        printf("Cannot open %s\n", path);
+        return false;
+    }
+    uint8_t signature[8] = {};
+    size_t n = fread(signature, 1, sizeof(signature), f);
+    bool ok;
+    if (n == sizeof(signature) && !memcmp(signature, pngSignature, 8)) {
+        ok = readPNG(f, path, image);
+    } else {
+        rewind(f);
+        ok = readPPM(f, path, image);
+    }
+    fclose(f);
+    return ok;
+}
+
+void flipRows(Image* image) {
+    std::vector<uint8_t> tmp(size_t(image->width) * 4);
+    for (int y = 0; y < image->height / 2; ++y) {
+        uint8_t* a = image->row(y);
+        uint8_t* b = image->row(image->height - 1 - y);
+        memcpy(tmp.data(), a, tmp.size());
+        memcpy(a, b, tmp.size());
+        memcpy(b, tmp.data(), tmp.size());
+    }
+}
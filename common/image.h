@@ -0,0 +1,38 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+//-----------------------------------------------------------------------------------
+// RGBA8 images and the PPM and PNG files they're kept in
+//
+// Rows are stored top first. PPM files are binary P6 with no alpha, so alpha
+// reads back as 255. PNG files are written uncompressed, as stored deflate
+// blocks, so no zlib is needed; only such PNGs, 8-bit RGB or RGBA, can be read
+// back. Use PPM for goldens written by other tools.
+//-----------------------------------------------------------------------------------
+
+struct Image {
+    int width = 0;
+    int height = 0;
+    int channels = 4;               // 3 when read from a file without alpha
+    std::vector<uint8_t> pixels;    // width * height * 4, alpha 255 when channels is 3
+
+    void resize(int w, int h) {
+        width = w;
+        height = h;
+        channels = 4;
+        pixels.resize(size_t(w) * h * 4);
+    }
+    uint8_t* row(int y) { return pixels.data() + size_t(y) * width * 4; }
+    const uint8_t* row(int y) const { return pixels.data() + size_t(y) * width * 4; }
+};
+
+// Picks PNG for paths ending in ".png" and PPM otherwise. Both print a message
+// and return false on failure.
+bool writeImage(const char* path, const Image& image);
+bool readImage(const char* path, Image* image);
+
+// GL reads rows bottom first.
+void flipRows(Image* image);
@@ -0,0 +1,211 @@
+#include "image_diff.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+
+#if defined(__SSE2__)
+#define IMAGE_DIFF_X86 1
+#include <immintrin.h>
+#endif
+
+namespace {
+
+struct DiffSums {
+    uint64_t failed;
+    uint8_t maxError[4];
+    uint64_t sse[4];
+};
+
+// Heatmap pixel for the largest channel error of a pixel.
+uint32_t heatPixel(int error, bool failed) {
+    uint32_t v = std::min(error * 16, 255);
+    return v | (failed ? 0 : v << 8) | 0xff000000u;
+}
+
+void diffScalar(const uint8_t* a, const uint8_t* b, size_t first, size_t count, int channels,
+                const uint8_t tolerance[4], uint32_t* heat, DiffSums* sums) {
+    for (size_t i = first; i < first + count; ++i) {
+        int largest = 0;
+        bool failed = false;
+        for (int c = 0; c < channels; ++c) {
+            int error = abs(a[i * 4 + c] - b[i * 4 + c]);
+            sums->maxError[c] = std::max<uint8_t>(sums->maxError[c], error);
+            sums->sse[c] += error * error;
+            failed = failed || error > tolerance[c];
+            largest = std::max(largest, error);
+        }
+        sums->failed += failed;
+        if (heat) {
+            heat[i] = heatPixel(largest, failed);
+        }
+    }
+}
+
+#if IMAGE_DIFF_X86
+
+//-----------------------------------------------------------------------------------
+// AVX2, eight pixels at a time. Built for AVX2 regardless of the compiler flags and
+// only called when the CPU has it.
+//-----------------------------------------------------------------------------------
+
+#define IMAGE_DIFF_AVX2 __attribute__((target("avx2,popcnt")))
+
+IMAGE_DIFF_AVX2 void diffAVX2(const uint8_t* a, const uint8_t* b, size_t count, int channels,
+                              const uint8_t tolerance[4], uint32_t* heat, DiffSums* sums) {
+    uint32_t tol;
+    memcpy(&tol, tolerance, 4);
+    const __m256i tolv = _mm256_set1_epi32(int(tol));
+    // Clears the alpha differences when only RGB is compared.
+    const __m256i channelMask = _mm256_set1_epi32(channels == 3 ? 0x00ffffff : -1);
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i byteMask = _mm256_set1_epi32(0xff);
+    const __m256i v255 = _mm256_set1_epi32(255);
+    const __m256i alpha = _mm256_set1_epi32(int(0xff000000u));
+    __m256i maxv = zero;
+    // Each 32-bit lane sums one channel, R G B A R G B A. A step adds at most
+    // 4 * 255^2, so they're moved into 64-bit totals well before they can wrap.
+    __m256i sse = zero;
+    uint64_t failed = 0;
+
+    size_t n = 0;
+    size_t flushAt = 4096;
+    for (; n + 8 <= count; n += 8) {
+        __m256i va = _mm256_loadu_si256((const __m256i*)(a + n * 4));
+        __m256i vb = _mm256_loadu_si256((const __m256i*)(b + n * 4));
+        __m256i d = _mm256_or_si256(_mm256_subs_epu8(va, vb), _mm256_subs_epu8(vb, va));
+        d = _mm256_and_si256(d, channelMask);
+        maxv = _mm256_max_epu8(maxv, d);
+
+        __m256i pass = _mm256_cmpeq_epi32(_mm256_subs_epu8(d, tolv), zero);
+        failed += 8 - _mm_popcnt_u32(_mm256_movemask_ps(_mm256_castsi256_ps(pass)));
+
+        __m256i lo = _mm256_unpacklo_epi8(d, zero);
+        __m256i hi = _mm256_unpackhi_epi8(d, zero);
+        lo = _mm256_mullo_epi16(lo, lo);
+        hi = _mm256_mullo_epi16(hi, hi);
+        sse = _mm256_add_epi32(sse, _mm256_add_epi32(
+            _mm256_add_epi32(_mm256_unpacklo_epi16(lo, zero), _mm256_unpackhi_epi16(lo, zero)),
+            _mm256_add_epi32(_mm256_unpacklo_epi16(hi, zero), _mm256_unpackhi_epi16(hi, zero))));
+        if (n >= flushAt) {
+            alignas(32) uint32_t lanes[8];
+            _mm256_store_si256((__m256i*)lanes, sse);
+            for (int i = 0; i < 8; ++i) {
+                sums->sse[i & 3] += lanes[i];
+            }
+            sse = zero;
+            flushAt += 4096;
+        }
+
+        if (heat) {
+            __m256i m = _mm256_max_epu8(d, _mm256_srli_epi32(d, 8));
+            m = _mm256_and_si256(_mm256_max_epu8(m, _mm256_srli_epi32(m, 16)), byteMask);
+            __m256i v = _mm256_min_epi32(_mm256_slli_epi32(m, 4), v255);
+            __m256i g = _mm256_slli_epi32(_mm256_and_si256(pass, v), 8);
+            _mm256_storeu_si256((__m256i*)(heat + n), _mm256_or_si256(_mm256_or_si256(v, g), alpha));
+        }
+    }
+
+    alignas(32) uint8_t maxBytes[32];
+    _mm256_store_si256((__m256i*)maxBytes, maxv);
+    for (int i = 0; i < 32; ++i) {
+        sums->maxError[i & 3] = std::max(sums->maxError[i & 3], maxBytes[i]);
+    }
+    alignas(32) uint32_t lanes[8];
+    _mm256_store_si256((__m256i*)lanes, sse);
+    for (int i = 0; i < 8; ++i) {
+        sums->sse[i & 3] += lanes[i];
+    }
+    sums->failed += failed;
+    diffScalar(a, b, n, count - n, channels, tolerance, heat, sums);
+}
+
+#endif  // IMAGE_DIFF_X86
+
+bool haveAVX2() {
+#if IMAGE_DIFF_X86
+    return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt");
+#else
+    return false;
+#endif
+}
+
+double psnr(uint64_t sse, uint64_t samples) {
+    if (sse == 0) {
+        return INFINITY;
+    }
+    return 10.0 * log10(255.0 * 255.0 * samples / sse);
+}
+
+}  // namespace
+
+bool diffImages(const Image& actual, const Image& golden, const uint8_t tolerance[4], ImageDiff* diff,
+                Image* heatmap) {
+    if (actual.width != golden.width || actual.height != golden.height) {
+        printf("Image is %dx%d but the golden is %dx%d\n", actual.width, actual.height, golden.width, golden.height);
+        return false;
+    }
+    auto start = std::chrono::steady_clock::now();
+    // Alpha is only compared when both images have it.
+    int channels = std::min(actual.channels, golden.channels);
+    size_t count = size_t(actual.width) * actual.height;
+    uint32_t* heat = nullptr;
+    if (heatmap) {
+        heatmap->resize(actual.width, actual.height);
+        heat = (uint32_t*)heatmap->pixels.data();
+    }
+
+    DiffSums sums = {};
+#if IMAGE_DIFF_X86
+    if (haveAVX2()) {
+        diffAVX2(actual.pixels.data(), golden.pixels.data(), count, channels, tolerance, heat, &sums);
+    } else
+#endif
+    {
+        diffScalar(actual.pixels.data(), golden.pixels.data(), 0, count, channels, tolerance, heat, &sums);
+    }
+
+    diff->pixels = count;
+    diff->failed = sums.failed;
+    uint64_t total = 0;
+    for (int c = 0; c < 4; ++c) {
+        diff->maxError[c] = sums.maxError[c];
+        diff->psnr[c] = psnr(sums.sse[c], count);
+        total += sums.sse[c];
+    }
+    diff->psnrRGBA = psnr(total, count * channels);
+    diff->ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    return true;
+}
+
+bool parseTolerance(const char* s, uint8_t tolerance[4]) {
+    int v[4];
+    char end;
+    int n = sscanf(s, "%d,%d,%d,%d%c", &v[0], &v[1], &v[2], &v[3], &end);
+    if (n == 1) {
+        v[1] = v[2] = v[3] = v[0];
+    } else if (n != 4) {
+        return false;
+    }
+    for (int c = 0; c < 4; ++c) {
+        if (v[c] < 0 || v[c] > 255) {
+            return false;
+        }
+        tolerance[c] = uint8_t(v[c]);
+    }
+    return true;
+}
+
+const char* imageDiffImpl() {
+    return haveAVX2() ? "avx2" : "scalar";
+}
+
+void printImageDiff(const char* label, const ImageDiff& diff) {
+    printf("%s: %llu of %llu pixels over tolerance, max error %d %d %d %d, PSNR %.2f dB (%.2f %.2f %.2f %.2f), %.3f ms (%s)\n",
+           label, (unsigned long long)diff.failed, (unsigned long long)diff.pixels,
+           diff.maxError[0], diff.maxError[1], diff.maxError[2], diff.maxError[3], diff.psnrRGBA,
+           diff.psnr[0], diff.psnr[1], diff.psnr[2], diff.psnr[3], diff.ms, imageDiffImpl());
+}
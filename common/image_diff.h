@@ -0,0 +1,36 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "image.h"
+
+//-----------------------------------------------------------------------------------
+// Comparing a rendered image against a golden
+//
+// A pixel fails when any channel differs by more than that channel's tolerance.
+// Alpha is left out when either image has none, as with PPM goldens.
+// The diff also reports the largest error and the PSNR per channel and overall,
+// and can write a heatmap: black where the images match, yellow where they
+// differ within tolerance, red where a pixel fails, brighter for larger errors.
+// The AVX2 version handles 8 pixels per step and is used whenever the CPU has
+// it; the scalar one is the one to read and gives the same results.
+//-----------------------------------------------------------------------------------
+
+struct ImageDiff {
+    uint64_t pixels;
+    uint64_t failed;            // pixels over tolerance in any channel
+    uint8_t maxError[4];        // per channel
+    double psnr[4];             // per channel, in dB; infinity when identical
+    double psnrRGBA;            // over the channels compared
+    double ms;
+};
+
+// Prints a message and returns false when the sizes differ.
+bool diffImages(const Image& actual, const Image& golden, const uint8_t tolerance[4], ImageDiff* diff,
+                Image* heatmap = nullptr);
+
+// Parses "N" for every channel or "R,G,B,A".
+bool parseTolerance(const char* s, uint8_t tolerance[4]);
+
+const char* imageDiffImpl();
+void printImageDiff(const char* label, const ImageDiff& diff);
@@ -0,0 +1,81 @@
+#include "offscreen.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <chrono>
+
+#include "gl_resources.h"
+#include "gl_state.h"
+
+OffscreenRenderer::OffscreenRenderer(int width, int height, int maxTile) : width_(width), height_(height) {
+    GLint maxTexture = 0, maxRenderbuffer = 0, maxViewport[2] = {};
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxTexture);
+    glGetIntegerv(GL_MAX_RENDERBUFFER_SIZE, &maxRenderbuffer);
+    glGetIntegerv(GL_MAX_VIEWPORT_DIMS, maxViewport);
+    if (width <= 0 || height <= 0 || width > maxViewport[0] || height > maxViewport[1]) {
+        printf("OffscreenRenderer: %dx%d, the largest viewport is %dx%d\n", width, height, maxViewport[0],
+               maxViewport[1]);
+        exit(1);
+    }
+    tileSize_ = std::min(maxTexture, maxRenderbuffer);
+    if (maxTile > 0) {
+        tileSize_ = std::min(tileSize_, maxTile);
+    }
+    tilesX_ = (width + tileSize_ - 1) / tileSize_;
+    tilesY_ = (height + tileSize_ - 1) / tileSize_;
+
+    GLint previous = 0;
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &previous);
+    texture_ = glrCreate(GLR_TEXTURE, "offscreen tile");
+    glsBindTexture(GL_TEXTURE_2D, texture_);
+    glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, std::min(width, tileSize_), std::min(height, tileSize_));
+    glrSetBytes(GLR_TEXTURE, texture_,
+                glrTextureBytes(GL_RGBA8, std::min(width, tileSize_), std::min(height, tileSize_)));
+    framebuffer_ = glrCreate(GLR_FRAMEBUFFER, "offscreen tile");
+    glsBindFramebuffer(GL_FRAMEBUFFER, framebuffer_);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture_, 0);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        printf("OffscreenRenderer: framebuffer incomplete\n");
+        exit(1);
+    }
+    glsBindFramebuffer(GL_FRAMEBUFFER, previous);
+}
+
+OffscreenRenderer::~OffscreenRenderer() {
+    glrDelete(GLR_FRAMEBUFFER, framebuffer_);
+    glrDelete(GLR_TEXTURE, texture_);
+}
+
+void OffscreenRenderer::render(const std::function<void()>& draw, Image* image) {
+    GLint previous = 0;
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &previous);
+    glsBindFramebuffer(GL_FRAMEBUFFER, framebuffer_);
+    image->resize(width_, height_);
+
+    // GL counts rows from the bottom, so tile (x, y) reads into rows y up of an
+    // image that is flipped once at the end.
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    glPixelStorei(GL_PACK_ROW_LENGTH, width_);
+    for (int ty = 0; ty < tilesY_; ++ty) {
+        for (int tx = 0; tx < tilesX_; ++tx) {
+            int x = tx * tileSize_;
+            int y = ty * tileSize_;
+            auto start = std::chrono::steady_clock::now();
+            glsViewport(-x, -y, width_, height_);
+            draw();
+            auto drawn = std::chrono::steady_clock::now();
+            glReadPixels(0, 0, std::min(tileSize_, width_ - x), std::min(tileSize_, height_ - y), GL_RGBA,
+                         GL_UNSIGNED_BYTE, image->row(y) + x * 4);
+            auto read = std::chrono::steady_clock::now();
+            stats_.drawMs += std::chrono::duration<double, std::milli>(drawn - start).count();
+            stats_.readbackMs += std::chrono::duration<double, std::milli>(read - drawn).count();
+            ++stats_.tiles;
+        }
+    }
+    glPixelStorei(GL_PACK_ROW_LENGTH, 0);
+    flipRows(image);
+    ++stats_.frames;
+
+    glsBindFramebuffer(GL_FRAMEBUFFER, previous);
+}
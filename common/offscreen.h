@@ -0,0 +1,53 @@
+#pragma once
+
+#include <stdint.h>
+#include <functional>
+
+#include "gl_loader.h"
+#include "image.h"
+
+//-----------------------------------------------------------------------------------
+// Offscreen rendering at any size
+//
+// Renders into a framebuffer object instead of the window, so the image can be
+// bigger than the screen. When it's bigger than the largest texture the driver
+// allows, or than maxTile, it's rendered in tiles: each tile has the viewport
+// set to the whole image, shifted so the tile's part lands in the framebuffer,
+// and the scene is drawn once per tile. The draw function must not set the
+// viewport itself. Each tile is read straight into its place in the image.
+//-----------------------------------------------------------------------------------
+
+class OffscreenRenderer {
+public:
+    struct Stats {
+        uint64_t frames = 0;
+        uint64_t tiles = 0;
+        double drawMs = 0.0;        // CPU time in the draw function
+        double readbackMs = 0.0;    // glReadPixels, which waits for the GPU
+    };
+
+    // Exits if the size is bigger than the largest viewport. maxTile 0 uses
+    // the largest framebuffer the driver allows.
+    OffscreenRenderer(int width, int height, int maxTile = 0);
+    ~OffscreenRenderer();
+
+    // Draws and reads the whole image back, top row first. Leaves the
+    // framebuffer that was bound before bound again.
+    void render(const std::function<void()>& draw, Image* image);
+
+    int width() const { return width_; }
+    int height() const { return height_; }
+    int tileSize() const { return tileSize_; }
+    int numTiles() const { return tilesX_ * tilesY_; }
+    const Stats& stats() const { return stats_; }
+
+private:
+    int width_;
+    int height_;
+    int tileSize_;
+    int tilesX_;
+    int tilesY_;
+    GLuint texture_ = 0;
+    GLuint framebuffer_ = 0;
+    Stats stats_;
+};
@@ -0,0 +1,253 @@
+#include "program_cache.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "gl_helpers.h"
+
+namespace {
+
+struct CacheHeader {
+    char magic[8];
+    uint32_t format;
+    uint32_t length;
+    double compileMs;
+};
+
+const char cacheMagic[8] = "GLPROG1";
+
+bool cacheEnabled = true;
+ProgramCacheStats stats;
+
+uint64_t fnv1a(uint64_t hash, const char* str) {
+    // Include the terminator so "ab" + "c" and "a" + "bc" hash differently.
+    const unsigned char* p = (const unsigned char*)str;
+    do {
+        hash ^= *p;
+        hash *= 1099511628211ull;
+    } while (*p++);
+    return hash;
+}
+
+double msSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Creates dir and any missing parents.
+bool makeDirs(const std::string& dir) {
+    for (size_t pos = 1; pos <= dir.size(); ++pos) {
+        if (pos == dir.size() || dir[pos] == '/') {
+            std::string partial = dir.substr(0, pos);
+            if (mkdir(partial.c_str(), 0755) != 0 && errno != EEXIST) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+std::string cacheDir() {
+    if (const char* dir = getenv("GL_PROGRAM_CACHE_DIR")) {
+        return dir;
+    }
+    if (const char* xdg = getenv("XDG_CACHE_HOME")) {
+        return std::string(xdg) + "/linux-opengl-examples";
+    }
+    if (const char* home = getenv("HOME")) {
+        return std::string(home) + "/.cache/linux-opengl-examples";
+    }
+    return "";
+}
+
+bool driverSupportsBinaries() {
+    GLint numFormats = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &numFormats);
+    return numFormats > 0;
+}
+
+// Appends the info log of a shader or program to log.
+void appendInfoLog(GLuint object, bool isProgram, std::string* log) {
+    GLint length = 0;
+    if (isProgram) {
+        glGetProgramiv(object, GL_INFO_LOG_LENGTH, &length);
+    } else {
+        glGetShaderiv(object, GL_INFO_LOG_LENGTH, &length);
+    }
+    std::vector<char> text(length + 1, '\0');
+    if (isProgram) {
+        glGetProgramInfoLog(object, length, nullptr, text.data());
+    } else {
+        glGetShaderInfoLog(object, length, nullptr, text.data());
+    }
+    *log += text.data();
+}
+
+// With log null, exits if linking fails. Otherwise returns 0 and fills log.
+GLuint compileAndLink(const char* vsSrc, const char* fsSrc, const char* const* attribs, int numAttribs, bool retrievable,
+                      std::string* log) {
+    GLuint program = glCreateProgram();
+    GLuint vs = compileShader(GL_VERTEX_SHADER, vsSrc);
+    GLuint fs = compileShader(GL_FRAGMENT_SHADER, fsSrc);
+    glAttachShader(program, vs);
+    glAttachShader(program, fs);
+    for (int i = 0; i < numAttribs; ++i) {
+        glBindAttribLocation(program, i, attribs[i]);
+    }
+    if (retrievable) {
+        glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    }
+    if (log) {
+        glLinkProgram(program);
+        GLint success = 0;
+        glGetProgramiv(program, GL_LINK_STATUS, &success);
+        if (!success) {
+            appendInfoLog(vs, false, log);
+            appendInfoLog(fs, false, log);
+            appendInfoLog(program, true, log);
+            glDeleteProgram(program);
+            program = 0;
+        }
+    } else {
+        linkProgram(program);
+    }
+    glDeleteShader(vs);
+    glDeleteShader(fs);
+    return program;
+}
+
+GLuint loadBinary(const std::string& path, double* compileMs) {
+    FILE* f = fopen(path.c_str(), "rb");
+    if (f == nullptr) {
+        return 0;
+    }
+    CacheHeader header;
+    std::vector<char> binary;
+    bool ok = fread(&header, sizeof(header), 1, f) == 1 &&
+              memcmp(header.magic, cacheMagic, sizeof(cacheMagic)) == 0;
+    if (ok) {
+        binary.resize(header.length);
+        ok = fread(binary.data(), 1, binary.size(), f) == binary.size();
+    }
+    fclose(f);
+    if (!ok) {
+        unlink(path.c_str());
+        ++stats.invalidated;
+        return 0;
+    }
+
+    GLuint program = glCreateProgram();
+    glProgramBinary(program, header.format, binary.data(), header.length);
+    GLint success = 0;
+    glGetProgramiv(program, GL_LINK_STATUS, &success);
+    if (!success) {
+        // Usually a driver update. Drop the stale binary and compile again.
+        glDeleteProgram(program);
+        unlink(path.c_str());
+        ++stats.invalidated;
+        return 0;
+    }
+    *compileMs = header.compileMs;
+    return program;
+}
+
+void storeBinary(const std::string& dir, const std::string& path, GLuint program, double compileMs) {
+    GLint length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0 || !makeDirs(dir)) {
+        return;
+    }
+    CacheHeader header;
+    memcpy(header.magic, cacheMagic, sizeof(cacheMagic));
+    std::vector<char> binary(length);
+    GLenum format = 0;
+    glGetProgramBinary(program, length, nullptr, &format, binary.data());
+    header.format = format;
+    header.length = length;
+    header.compileMs = compileMs;
+
+    // Write to a temporary file and rename so a concurrent run never sees half a binary.
+    std::string tmpPath = path + "." + std::to_string(getpid());
+    FILE* f = fopen(tmpPath.c_str(), "wb");
+    if (f == nullptr) {
+        return;
+    }
+    bool ok = fwrite(&header, sizeof(header), 1, f) == 1 &&
+              fwrite(binary.data(), 1, binary.size(), f) == binary.size();
+    ok = fclose(f) == 0 && ok;
+    if (!ok || rename(tmpPath.c_str(), path.c_str()) != 0) {
+        unlink(tmpPath.c_str());
+    }
+}
+
+}  // namespace
+
+namespace {
+
+GLuint createProgram(const char* vsSrc, const char* fsSrc, const char* const* attribs, int numAttribs,
+                     std::string* log) {
+    std::string dir = cacheDir();
+    if (!cacheEnabled || dir.empty() || !driverSupportsBinaries()) {
+        return compileAndLink(vsSrc, fsSrc, attribs, numAttribs, false, log);
+    }
+
+    uint64_t hash = 14695981039346656037ull;
+    hash = fnv1a(hash, vsSrc);
+    hash = fnv1a(hash, fsSrc);
+    for (int i = 0; i < numAttribs; ++i) {
+        hash = fnv1a(hash, attribs[i]);
+    }
+    hash = fnv1a(hash, (const char*)glGetString(GL_RENDERER));
+    hash = fnv1a(hash, (const char*)glGetString(GL_VERSION));
+    char name[32];
+    snprintf(name, sizeof(name), "/%016llx.bin", (unsigned long long)hash);
+    std::string path = dir + name;
+
+    auto start = std::chrono::steady_clock::now();
+    double compileMs = 0.0;
+    GLuint program = loadBinary(path, &compileMs);
+    if (program) {
+        ++stats.hits;
+        stats.savedMs += compileMs - msSince(start);
+        return program;
+    }
+
+    ++stats.misses;
+    start = std::chrono::steady_clock::now();
+    program = compileAndLink(vsSrc, fsSrc, attribs, numAttribs, true, log);
+    if (program) {
+        storeBinary(dir, path, program, msSince(start));
+    }
+    return program;
+}
+
+}  // namespace
+
+GLuint createCachedProgram(const char* vsSrc, const char* fsSrc, const char* const* attribs, int numAttribs) {
+    return createProgram(vsSrc, fsSrc, attribs, numAttribs, nullptr);
+}
+
+GLuint tryCreateCachedProgram(const char* vsSrc, const char* fsSrc, const char* const* attribs, int numAttribs,
+                              std::string* log) {
+    log->clear();
+    return createProgram(vsSrc, fsSrc, attribs, numAttribs, log);
+}
+
+void setProgramCacheEnabled(bool enabled) {
+    cacheEnabled = enabled;
+}
+
+ProgramCacheStats getProgramCacheStats() {
+    return stats;
+}
+
+void printProgramCacheStats() {
+    printf("programs: %d cache hits, %d misses, %d invalidated, %.3f ms saved\n",
+           stats.hits, stats.misses, stats.invalidated, stats.savedMs);
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <string>
+
+#include "gl_loader.h"
+
+//-----------------------------------------------------------------------------------
+// On-disk program binary cache
+//
+// Programs are keyed on a hash of their sources, attribute bindings, GL_RENDERER
+// and GL_VERSION and stored as glGetProgramBinary blobs in
+//   $GL_PROGRAM_CACHE_DIR, or $XDG_CACHE_HOME/linux-opengl-examples,
+//   or ~/.cache/linux-opengl-examples
+// A binary the driver rejects is deleted and the program is compiled again.
+//-----------------------------------------------------------------------------------
+
+// Compiles and links a program from vertex and fragment shader sources, binding
+// attribs[i] to location i, or loads it from the cache. Exits if linking fails.
+GLuint createCachedProgram(const char* vsSrc, const char* fsSrc, const char* const* attribs, int numAttribs);
+
+// The same, but returns 0 with the shader and program info logs in log when
+// compiling or linking fails, for callers that must keep running.
+GLuint tryCreateCachedProgram(const char* vsSrc, const char* fsSrc, const char* const* attribs, int numAttribs,
+                              std::string* log);
+
+// Turns the cache off so createCachedProgram always compiles.
+void setProgramCacheEnabled(bool enabled);
+
+struct ProgramCacheStats {
+    int hits;
+    int misses;
+    int invalidated;    // binaries the driver rejected
+    double savedMs;     // compile time recorded with each hit minus the time to load it
+};
+
+ProgramCacheStats getProgramCacheStats();
+void printProgramCacheStats();
@@ -0,0 +1,128 @@
+#include "readback_ring.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+
+#include "gl_resources.h"
+#include "gl_state.h"
+
+static size_t bytesPerPixel(GLenum format, GLenum type) {
+    size_t components = 0;
+    switch (format) {
+        case GL_RED: case GL_DEPTH_COMPONENT: components = 1; break;
+        case GL_RG: components = 2; break;
+        case GL_RGB: components = 3; break;
+        case GL_RGBA: components = 4; break;
+    }
+    size_t size = 0;
+    switch (type) {
+        case GL_UNSIGNED_BYTE: size = 1; break;
+        case GL_UNSIGNED_SHORT: size = 2; break;
+        case GL_UNSIGNED_INT: case GL_FLOAT: size = 4; break;
+    }
+    if (!components || !size) {
+        printf("ReadbackRing: unsupported format %x / type %x\n", format, type);
+        exit(1);
+    }
+    return components * size;
+}
+
+ReadbackRing::ReadbackRing(int numSlots, size_t slotSize, Consumer consumer)
+    : slots_(numSlots), slotSize_(slotSize), consumer_(consumer) {
+    for (Slot& slot : slots_) {
+        slot.buffer = glrCreate(GLR_BUFFER, "readback ring");
+        glsBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+        glBufferData(GL_PIXEL_PACK_BUFFER, slotSize, nullptr, GL_STREAM_READ);
+        glrSetBytes(GLR_BUFFER, slot.buffer, slotSize);
+        slot.fence = nullptr;
+    }
+    glsBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
+
+ReadbackRing::~ReadbackRing() {
+    drain();
+    for (Slot& slot : slots_) {
+        glrDelete(GLR_BUFFER, slot.buffer);
+    }
+}
+
+void ReadbackRing::read(int x, int y, int w, int h, GLenum format, GLenum type, uint32_t tag) {
+    size_t size = size_t(w) * size_t(h) * bytesPerPixel(format, type);
+    if (size > slotSize_) {
+        printf("ReadbackRing: read of %zu bytes doesn't fit in %zu byte slot\n", size, slotSize_);
+        exit(1);
+    }
+
+    if (count_ == (int)slots_.size()) {
+        auto start = std::chrono::steady_clock::now();
+        waitOldest(GL_TIMEOUT_IGNORED);
+        deliverOldest();
+        auto end = std::chrono::steady_clock::now();
+        ++stats_.fullStalls;
+        stats_.stallMs += std::chrono::duration<double, std::milli>(end - start).count();
+    }
+
+    Slot& slot = slots_[(head_ + count_) % slots_.size()];
+    glsBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+    glReadPixels(x, y, w, h, format, type, nullptr);
+    glsBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    slot.tag = tag;
+    slot.size = size;
+    ++count_;
+    ++stats_.reads;
+}
+
+int ReadbackRing::poll() {
+    int delivered = 0;
+    while (count_ > 0 && waitOldest(0)) {
+        deliverOldest();
+        ++delivered;
+    }
+    return delivered;
+}
+
+void ReadbackRing::drain() {
+    while (count_ > 0) {
+        waitOldest(GL_TIMEOUT_IGNORED);
+        deliverOldest();
+    }
+}
+
+bool ReadbackRing::waitOldest(GLuint64 timeout) {
+    GLsync fence = slots_[head_].fence;
+    if (timeout != GL_TIMEOUT_IGNORED) {
+        GLenum status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, timeout);
+        return status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED;
+    }
+    for (;;) {
+        GLenum status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+        if (status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED) {
+            return true;
+        }
+        if (status == GL_WAIT_FAILED) {
+            printf("ReadbackRing: glClientWaitSync failed\n");
+            exit(1);
+        }
+    }
+}
+
+void ReadbackRing::deliverOldest() {
+    Slot& slot = slots_[head_];
+    glDeleteSync(slot.fence);
+    slot.fence = nullptr;
+
+    glsBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+    const void* data = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, slot.size, GL_MAP_READ_BIT);
+    if (data == nullptr) {
+        printf("ReadbackRing: failed to map pixel pack buffer\n");
+        exit(1);
+    }
+    consumer_(slot.tag, data, slot.size);
+    glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    glsBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    head_ = (head_ + 1) % slots_.size();
+    --count_;
+}
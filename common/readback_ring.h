@@ -0,0 +1,61 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <functional>
+#include <vector>
+
+#include "gl_loader.h"
+
+//-----------------------------------------------------------------------------------
+// Asynchronous readback through a ring of pixel pack buffers
+//
+// read() queues a glReadPixels into the next free buffer and puts a fence behind
+// it. The consumer only sees the pixels once that fence has signaled, either from
+// poll() or, when every buffer is in flight, from the next read() which then has
+// to wait for the oldest one. Those waits are counted in the stats.
+//-----------------------------------------------------------------------------------
+
+class ReadbackRing {
+public:
+    // data is only valid for the duration of the call.
+    typedef std::function<void(uint32_t tag, const void* data, size_t size)> Consumer;
+
+    struct Stats {
+        uint64_t reads = 0;
+        uint64_t fullStalls = 0;   // read() found every slot in flight
+        double stallMs = 0.0;      // time read() spent waiting for a slot
+    };
+
+    ReadbackRing(int numSlots, size_t slotSize, Consumer consumer);
+    ~ReadbackRing();
+
+    // Reads from the current read framebuffer. w * h * bytes-per-pixel must fit in slotSize.
+    void read(int x, int y, int w, int h, GLenum format, GLenum type, uint32_t tag);
+
+    // Delivers every completed read without blocking. Returns how many were delivered.
+    int poll();
+
+    // Blocks until every queued read has been delivered.
+    void drain();
+
+    const Stats& stats() const { return stats_; }
+
+private:
+    struct Slot {
+        GLuint buffer;
+        GLsync fence;
+        uint32_t tag;
+        size_t size;
+    };
+
+    bool waitOldest(GLuint64 timeout);
+    void deliverOldest();
+
+    std::vector<Slot> slots_;
+    size_t slotSize_;
+    int head_ = 0;    // oldest read in flight
+    int count_ = 0;   // reads in flight
+    Consumer consumer_;
+    Stats stats_;
+};
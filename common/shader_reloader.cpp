@@ -0,0 +1,283 @@
+#include "shader_reloader.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#include "gl_context.h"
+#include "gl_resources.h"
+
+namespace {
+
+double msSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+bool hasGLExtension(const char* name) {
+    GLint count = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+    for (GLint i = 0; i < count; ++i) {
+        if (!strcmp((const char*)glGetStringi(GL_EXTENSIONS, i), name)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool readFile(const std::string& path, std::string* text) {
+    FILE* f = fopen(path.c_str(), "rb");
+    if (f == nullptr) {
+        return false;
+    }
+    text->clear();
+    char buffer[4096];
+    size_t n;
+    while ((n = fread(buffer, 1, sizeof(buffer), f)) > 0) {
+        text->append(buffer, n);
+    }
+    bool ok = !ferror(f);
+    fclose(f);
+    return ok;
+}
+
+void appendInfoLog(GLuint object, bool isProgram, std::string* log) {
+    GLint length = 0;
+    if (isProgram) {
+        glGetProgramiv(object, GL_INFO_LOG_LENGTH, &length);
+    } else {
+        glGetShaderiv(object, GL_INFO_LOG_LENGTH, &length);
+    }
+    std::vector<char> text(length + 1, '\0');
+    if (isProgram) {
+        glGetProgramInfoLog(object, length, nullptr, text.data());
+    } else {
+        glGetShaderInfoLog(object, length, nullptr, text.data());
+    }
+    *log += text.data();
+}
+
+}  // namespace
+
+ShaderReloader::ShaderReloader(GLContext* ctx, const char* vsPath, const char* fsPath, const char* const* attribs,
+                               int numAttribs)
+    : vsPath_(vsPath), fsPath_(fsPath), attribs_(attribs, attribs + numAttribs) {
+    parallel_ = hasGLExtension("GL_KHR_parallel_shader_compile");
+
+    // Watched from here rather than the thread so no save after the constructor returns is missed.
+    inotifyFd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    const std::string* paths[2] = { &vsPath_, &fsPath_ };
+    for (int i = 0; i < 2; ++i) {
+        size_t slash = paths[i]->find_last_of('/');
+        std::string dir = slash == std::string::npos ? "." : paths[i]->substr(0, slash + 1);
+        names_[i] = slash == std::string::npos ? *paths[i] : paths[i]->substr(slash + 1);
+        watches_[i] = inotifyFd_ < 0 ? -1 : inotify_add_watch(inotifyFd_, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+        if (watches_[i] < 0) {
+            printf("Cannot watch %s: %s\n", dir.c_str(), strerror(errno));
+            exit(1);
+        }
+    }
+    quitFd_ = eventfd(0, EFD_CLOEXEC);
+
+    workerCtx_ = createSharedGLContext(ctx);
+    thread_ = std::thread(&ShaderReloader::run, this);
+}
+
+ShaderReloader::~ShaderReloader() {
+    uint64_t one = 1;
+    if (write(quitFd_, &one, sizeof(one)) != sizeof(one)) {
+        printf("ShaderReloader: cannot stop the watcher thread\n");
+        exit(1);
+    }
+    thread_.join();
+    destroyGLContext(workerCtx_);
+    close(quitFd_);
+    close(inotifyFd_);
+
+    for (Finished& finished : finished_) {
+        glDeleteSync(finished.fence);
+        glrDelete(GLR_PROGRAM, finished.program);
+    }
+}
+
+bool ShaderReloader::poll(Reload* reload) {
+    Finished finished;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (finished_.empty()) {
+            return false;
+        }
+        // Only the newest program is worth swapping in.
+        while (finished_.size() > 1) {
+            glDeleteSync(finished_.front().fence);
+            glrDelete(GLR_PROGRAM, finished_.front().program);
+            finished_.pop_front();
+        }
+        finished = finished_.front();
+        finished_.pop_front();
+        ++stats_.reloads;
+    }
+    glWaitSync(finished.fence, 0, GL_TIMEOUT_IGNORED);
+    glDeleteSync(finished.fence);
+    glrAdopt(GLR_PROGRAM, finished.program, "reloaded program");
+    reload->program = finished.program;
+    reload->compileMs = finished.compileMs;
+    reload->latencyMs = msSince(finished.savedAt);
+    return true;
+}
+
+ShaderReloader::Stats ShaderReloader::stats() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
+
+void ShaderReloader::run() {
+    makeCurrent(workerCtx_);
+    if (parallel_) {
+        // Let the driver pick how many threads to compile on.
+        glMaxShaderCompilerThreadsKHR(0xffffffffu);
+    }
+
+    Compile compile;
+    for (;;) {
+        // While a compile is in flight on the driver's threads, wake up to check on it.
+        pollfd fds[2] = { { quitFd_, POLLIN, 0 }, { inotifyFd_, POLLIN, 0 } };
+        int ready = ::poll(fds, 2, compile.program ? 1 : -1);
+        if (ready < 0 && errno != EINTR) {
+            printf("ShaderReloader: poll failed: %s\n", strerror(errno));
+            break;
+        }
+        if (fds[0].revents & POLLIN) {
+            break;
+        }
+
+        if ((fds[1].revents & POLLIN) && readEvents() > 0) {
+            if (compile.program) {
+                deleteCompile(&compile);
+                std::lock_guard<std::mutex> lock(mutex_);
+                ++stats_.abandoned;
+            }
+            compile.savedAt = std::chrono::steady_clock::now();
+            if (!startCompile(&compile)) {
+                continue;
+            }
+        }
+        if (compile.program && compileDone(compile)) {
+            finishCompile(&compile);
+        }
+    }
+
+    if (compile.program) {
+        deleteCompile(&compile);
+    }
+    releaseCurrent(workerCtx_);
+}
+
+// Reads every pending event. Returns how many were saves of the watched files.
+int ShaderReloader::readEvents() {
+    int saves = 0;
+    alignas(inotify_event) char buffer[4096];
+    ssize_t n;
+    while ((n = read(inotifyFd_, buffer, sizeof(buffer))) > 0) {
+        for (char* p = buffer; p < buffer + n; p += sizeof(inotify_event) + ((inotify_event*)p)->len) {
+            const inotify_event* event = (const inotify_event*)p;
+            for (int i = 0; i < 2; ++i) {
+                if (event->wd == watches_[i] && event->len > 0 && names_[i] == event->name) {
+                    ++saves;
+                    break;
+                }
+            }
+        }
+    }
+    if (saves > 0) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stats_.saves += saves;
+    }
+    return saves;
+}
+
+// Issues the compile and link. Without parallel compile the driver finishes them
+// here; with it they may still be running when this returns.
+bool ShaderReloader::startCompile(Compile* compile) {
+    compile->startedAt = std::chrono::steady_clock::now();
+    std::string sources[2];
+    const std::string* paths[2] = { &vsPath_, &fsPath_ };
+    for (int i = 0; i < 2; ++i) {
+        // Saved halfway through the other file being written, the next event catches up.
+        if (!readFile(*paths[i], &sources[i])) {
+            printf("reload       : cannot read %s, keeping the current program\n", paths[i]->c_str());
+            return false;
+        }
+    }
+
+    // The registry is per thread. The shaders never leave this thread and are
+    // recorded here; the program is recorded by poll() on the render thread,
+    // which ends up deleting it.
+    static const GLenum types[2] = { GL_VERTEX_SHADER, GL_FRAGMENT_SHADER };
+    compile->program = glCreateProgram();
+    for (int i = 0; i < 2; ++i) {
+        const char* src = sources[i].c_str();
+        compile->shaders[i] = glrCreateShader(types[i], "reload shader");
+        glShaderSource(compile->shaders[i], 1, &src, nullptr);
+        glCompileShader(compile->shaders[i]);
+        glAttachShader(compile->program, compile->shaders[i]);
+    }
+    for (size_t i = 0; i < attribs_.size(); ++i) {
+        glBindAttribLocation(compile->program, (GLuint)i, attribs_[i].c_str());
+    }
+    glLinkProgram(compile->program);
+    return true;
+}
+
+bool ShaderReloader::compileDone(const Compile& compile) {
+    if (!parallel_) {
+        return true;
+    }
+    GLint done = GL_FALSE;
+    glGetProgramiv(compile.program, GL_COMPLETION_STATUS_KHR, &done);
+    return done == GL_TRUE;
+}
+
+void ShaderReloader::finishCompile(Compile* compile) {
+    GLint linked = GL_FALSE;
+    glGetProgramiv(compile->program, GL_LINK_STATUS, &linked);
+    double compileMs = msSince(compile->startedAt);
+    if (!linked) {
+        std::string log;
+        appendInfoLog(compile->shaders[0], false, &log);
+        appendInfoLog(compile->shaders[1], false, &log);
+        appendInfoLog(compile->program, true, &log);
+        printf("reload       : failed after %.3f ms, keeping the current program\n%s\n", compileMs, log.c_str());
+        deleteCompile(compile);
+        std::lock_guard<std::mutex> lock(mutex_);
+        ++stats_.failed;
+        return;
+    }
+
+    for (int i = 0; i < 2; ++i) {
+        glDetachShader(compile->program, compile->shaders[i]);
+        glrDelete(GLR_SHADER, compile->shaders[i]);
+    }
+    GLsync fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    // The render context can only wait on a fence that has been flushed.
+    glFlush();
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        finished_.push_back({ compile->program, fence, compileMs, compile->savedAt });
+        ++stats_.linked;
+        stats_.compileMs += compileMs;
+    }
+    *compile = Compile();
+}
+
+void ShaderReloader::deleteCompile(Compile* compile) {
+    for (int i = 0; i < 2; ++i) {
+        glrDelete(GLR_SHADER, compile->shaders[i]);
+    }
+    glrDelete(GLR_PROGRAM, compile->program);
+    *compile = Compile();
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <stdint.h>
+#include <chrono>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "gl_loader.h"
+
+struct GLContext;
+
+//-----------------------------------------------------------------------------------
+// Shader hot reload
+//
+// A watcher thread owns a context shared with the render context and watches a
+// vertex and a fragment shader file with inotify. The directories are watched
+// rather than the files, so editors that save by renaming a new file over the old
+// one are seen too. After each save both files are read, compiled and linked on
+// the watcher's context. With GL_KHR_parallel_shader_compile the thread polls
+// GL_COMPLETION_STATUS_KHR instead of blocking in the driver, so a save made while
+// an older one is still compiling abandons the older program. Programs that fail
+// print their info logs and are never handed over.
+//
+// The render thread picks up linked programs with poll(), which never blocks: as
+// with TextureUploader it only queues a glWaitSync on the link's fence.
+//-----------------------------------------------------------------------------------
+
+class ShaderReloader {
+public:
+    struct Reload {
+        GLuint program;
+        double compileMs;     // reading the files, compiling and linking
+        double latencyMs;     // from the save being seen to poll() handing it over
+    };
+
+    struct Stats {
+        uint64_t saves = 0;       // changes to either file
+        uint64_t linked = 0;
+        uint64_t reloads = 0;     // programs handed to poll(), newer ones replace older ones still waiting
+        uint64_t failed = 0;      // programs that didn't compile or link
+        uint64_t abandoned = 0;   // compiles superseded by a later save
+        double compileMs = 0.0;   // total over every program that linked
+    };
+
+    // ctx must be current on the calling thread, which is the render thread, and
+    // the GL functions loaded with GL_LOAD_EAGER. attribs[i] is bound to location
+    // i. The strings are copied.
+    ShaderReloader(GLContext* ctx, const char* vsPath, const char* fsPath, const char* const* attribs,
+                   int numAttribs);
+    ~ShaderReloader();
+
+    // Whether the driver has GL_KHR_parallel_shader_compile.
+    bool parallelCompile() const { return parallel_; }
+
+    // Returns the newest linked program, or false if there is none yet. Older
+    // ones still waiting are deleted. The caller owns the program, which this
+    // thread's registry has adopted.
+    bool poll(Reload* reload);
+
+    Stats stats();
+
+private:
+    typedef std::chrono::steady_clock::time_point TimePoint;
+
+    struct Finished {
+        GLuint program;
+        GLsync fence;
+        double compileMs;
+        TimePoint savedAt;
+    };
+
+    // A program whose compile and link have been issued but may not be done.
+    struct Compile {
+        GLuint program = 0;
+        GLuint shaders[2] = {0, 0};
+        TimePoint savedAt;
+        TimePoint startedAt;
+    };
+
+    void run();
+    int readEvents();
+    bool startCompile(Compile* compile);
+    bool compileDone(const Compile& compile);
+    void finishCompile(Compile* compile);
+    void deleteCompile(Compile* compile);
+
+    GLContext* workerCtx_;
+    std::string vsPath_;
+    std::string fsPath_;
+    std::vector<std::string> attribs_;
+    bool parallel_ = false;
+    int inotifyFd_ = -1;
+    int watches_[2];          // watch descriptors of the two files' directories
+    std::string names_[2];    // and the files' names in them
+    int quitFd_ = -1;
+    std::thread thread_;
+    std::mutex mutex_;
+    std::deque<Finished> finished_;
+    Stats stats_;
+};
@@ -0,0 +1,136 @@
+#include "stage_timer.h"
+
+#include <string.h>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "gl_loader.h"
+
+namespace {
+
+struct Stage {
+    const char* name;
+    double cpuStartMs;
+    double cpuEndMs;
+    GLuint queries[2];   // GL_TIMESTAMP at begin and end, 0 when GPU timing is off
+    double gpuMs;        // < 0 until resolved
+};
+
+std::vector<Stage> stages;
+bool stageOpen = false;
+bool gpuTimers = false;
+std::string renderer;
+std::string version;
+
+double nowMs() {
+    static const auto start = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+}  // namespace
+
+void writeJSONString(FILE* f, const char* str) {
+    fputc('"', f);
+    for (const char* p = str; *p; ++p) {
+        if (*p == '"' || *p == '\\') {
+            fprintf(f, "\\%c", *p);
+        } else if ((unsigned char)*p < 0x20) {
+            fprintf(f, "\\u%04x", *p);
+        } else {
+            fputc(*p, f);
+        }
+    }
+    fputc('"', f);
+}
+
+void beginStage(const char* name) {
+    endStage();
+    Stage stage;
+    stage.name = name;
+    stage.queries[0] = 0;
+    stage.queries[1] = 0;
+    stage.gpuMs = -1.0;
+    if (gpuTimers) {
+        glGenQueries(2, stage.queries);
+        glQueryCounter(stage.queries[0], GL_TIMESTAMP);
+    }
+    stage.cpuStartMs = nowMs();
+    stages.push_back(stage);
+    stageOpen = true;
+}
+
+void endStage() {
+    if (!stageOpen) {
+        return;
+    }
+    Stage& stage = stages.back();
+    stage.cpuEndMs = nowMs();
+    if (stage.queries[1]) {
+        glQueryCounter(stage.queries[1], GL_TIMESTAMP);
+    }
+    stageOpen = false;
+}
+
+void enableGPUStageTimers() {
+    gpuTimers = true;
+    renderer = (const char*)glGetString(GL_RENDERER);
+    version = (const char*)glGetString(GL_VERSION);
+}
+
+void resolveStageTimers() {
+    endStage();
+    for (Stage& stage : stages) {
+        if (!stage.queries[0]) {
+            continue;
+        }
+        GLuint64 begin = 0;
+        GLuint64 end = 0;
+        glGetQueryObjectui64v(stage.queries[0], GL_QUERY_RESULT, &begin);
+        glGetQueryObjectui64v(stage.queries[1], GL_QUERY_RESULT, &end);
+        glDeleteQueries(2, stage.queries);
+        stage.queries[0] = 0;
+        stage.queries[1] = 0;
+        stage.gpuMs = (end - begin) / 1e6;
+    }
+    gpuTimers = false;
+}
+
+void writeStageTimingsJSON(FILE* f, const char* example, const char* backend) {
+    endStage();
+    fprintf(f, "{\"example\":");
+    writeJSONString(f, example);
+    fprintf(f, ",\"backend\":");
+    writeJSONString(f, backend);
+    fprintf(f, ",\"renderer\":");
+    writeJSONString(f, renderer.c_str());
+    fprintf(f, ",\"version\":");
+    writeJSONString(f, version.c_str());
+    fprintf(f, ",\"stages\":[");
+    for (size_t i = 0; i < stages.size(); ++i) {
+        const Stage& stage = stages[i];
+        fprintf(f, "%s\n  {\"name\":", i ? "," : "");
+        writeJSONString(f, stage.name);
+        fprintf(f, ",\"cpu_ms\":%.6f,\"gpu_ms\":", stage.cpuEndMs - stage.cpuStartMs);
+        if (stage.gpuMs >= 0.0) {
+            fprintf(f, "%.6f}", stage.gpuMs);
+        } else {
+            fprintf(f, "null}");
+        }
+    }
+    fprintf(f, "\n]}\n");
+}
+
+bool writeStageTimingsJSON(const char* path, const char* example, const char* backend) {
+    if (!strcmp(path, "-")) {
+        writeStageTimingsJSON(stdout, example, backend);
+        return true;
+    }
+    FILE* f = fopen(path, "w");
+    if (f == nullptr) {
+        return false;
+    }
+    writeStageTimingsJSON(f, example, backend);
+    fclose(f);
+    return true;
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <stdio.h>
+
+//-----------------------------------------------------------------------------------
+// Per-stage CPU and GPU timing
+//
+// beginStage() starts a named stage and ends the previous one, so the numbered
+// steps in the examples can each be timed with a single line. Once a context is
+// current and the GL functions are loaded, enableGPUStageTimers() makes every
+// later stage also bracket itself with GL_TIMESTAMP queries. Their results are
+// only fetched by resolveStageTimers() so timing never stalls the pipeline.
+//-----------------------------------------------------------------------------------
+
+void beginStage(const char* name);
+void endStage();
+
+// Times the enclosing scope as one stage, so a stage in an optional block ends
+// with the block.
+class ScopedStage {
+public:
+    explicit ScopedStage(const char* name) { beginStage(name); }
+    ~ScopedStage() { endStage(); }
+};
+
+// Call with the context current, after init_gl_functions().
+void enableGPUStageTimers();
+
+// Fetches the GPU query results. Call before the context is destroyed; later
+// stages are CPU only.
+void resolveStageTimers();
+
+// Writes every stage as JSON:
+// {"example":..., "backend":..., "renderer":..., "version":...,
+//  "stages":[{"name":..., "cpu_ms":..., "gpu_ms":...}, ...]}
+// gpu_ms is null for stages without GPU timing.
+void writeStageTimingsJSON(FILE* f, const char* example, const char* backend);
+
+// Writes to path, or stdout when path is "-". Returns false if the file can't be opened.
+bool writeStageTimingsJSON(const char* path, const char* example, const char* backend);
+
+// Writes str as a JSON string, quoted and escaped.
+void writeJSONString(FILE* f, const char* str);
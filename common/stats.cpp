@@ -0,0 +1,62 @@
+#include "stats.h"
+
+#include <math.h>
+#include <algorithm>
+
+double percentile(const std::vector<double>& sorted, double p) {
+    if (sorted.empty()) {
+        return 0.0;
+    }
+    double rank = p / 100.0 * (sorted.size() - 1);
+    size_t lower = (size_t)rank;
+    size_t upper = std::min(lower + 1, sorted.size() - 1);
+    double t = rank - lower;
+    return sorted[lower] * (1.0 - t) + sorted[upper] * t;
+}
+
+SampleSummary summarize(std::vector<double> samples) {
+    SampleSummary summary = {};
+    summary.count = (int)samples.size();
+    if (samples.empty()) {
+        return summary;
+    }
+    std::sort(samples.begin(), samples.end());
+    double sum = 0.0;
+    for (double sample : samples) {
+        sum += sample;
+    }
+    summary.mean = sum / samples.size();
+    summary.min = samples.front();
+    summary.max = samples.back();
+    summary.p50 = percentile(samples, 50);
+    summary.p95 = percentile(samples, 95);
+    summary.p99 = percentile(samples, 99);
+    return summary;
+}
+
+RobustSummary summarizeRobust(std::vector<double> samples) {
+    RobustSummary summary = {};
+    int n = (int)samples.size();
+    summary.count = n;
+    if (samples.empty()) {
+        return summary;
+    }
+    std::sort(samples.begin(), samples.end());
+    summary.median = percentile(samples, 50);
+    summary.min = samples.front();
+    summary.max = samples.back();
+
+    // The number of samples below the median is Binomial(n, 1/2), so the
+    // samples j from either end hold it between them about 95% of the time.
+    int j = std::max(int(floor((n - 1.96 * sqrt(n)) / 2.0)), 0);
+    int k = n - 1 - j;
+    summary.ciLow = n < 6 ? summary.min : samples[j];
+    summary.ciHigh = n < 6 ? summary.max : samples[k];
+
+    for (double& sample : samples) {
+        sample = fabs(sample - summary.median);
+    }
+    std::sort(samples.begin(), samples.end());
+    summary.mad = percentile(samples, 50);
+    return summary;
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <vector>
+
+//-----------------------------------------------------------------------------------
+// Summary statistics for benchmark samples
+//-----------------------------------------------------------------------------------
+
+struct SampleSummary {
+    int count;
+    double mean;
+    double min;
+    double max;
+    double p50;
+    double p95;
+    double p99;
+};
+
+// Linearly interpolated percentile, p in [0, 100]. sorted must be in ascending order.
+double percentile(const std::vector<double>& sorted, double p);
+
+// samples doesn't need to be sorted.
+SampleSummary summarize(std::vector<double> samples);
+
+// For comparing runs whose samples have outliers, like a repetition that
+// caught a page fault or another process. mad is the median absolute
+// deviation, unscaled. The 95% confidence interval of the median comes from
+// the order statistics, so it assumes nothing about the distribution; below 6
+// samples it is the whole range.
+struct RobustSummary {
+    int count;
+    double median;
+    double mad;
+    double ciLow;
+    double ciHigh;
+    double min;
+    double max;
+};
+
+RobustSummary summarizeRobust(std::vector<double> samples);
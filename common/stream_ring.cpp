@@ -0,0 +1,72 @@
+#include "stream_ring.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+
+#include "gl_resources.h"
+#include "gl_state.h"
+#include "gl_trace.h"
+
+StreamRing::StreamRing(GLenum target, size_t segmentSize, int numSegments)
+    : target_(target), segmentSize_(segmentSize), numSegments_(numSegments) {
+    if (numSegments < 1 || numSegments > maxSegments) {
+        printf("StreamRing: %d segments, must be 1 to %d\n", numSegments, maxSegments);
+        exit(1);
+    }
+    const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    GLsizeiptr size = segmentSize * numSegments;
+    buffer_ = glrCreate(GLR_BUFFER, "stream ring");
+    glsBindBuffer(target_, buffer_);
+    glBufferStorage(target_, size, nullptr, flags);
+    glrSetBytes(GLR_BUFFER, buffer_, size);
+    mapped_ = (uint8_t*)glMapBufferRange(target_, 0, size, flags);
+    if (mapped_ == nullptr) {
+        printf("StreamRing: failed to map %lld bytes persistently\n", (long long)size);
+        exit(1);
+    }
+}
+
+StreamRing::~StreamRing() {
+    for (int i = 0; i < numSegments_; ++i) {
+        if (fences_[i]) {
+            glClientWaitSync(fences_[i], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+            glDeleteSync(fences_[i]);
+        }
+    }
+    glsBindBuffer(target_, buffer_);
+    glUnmapBuffer(target_);
+    glrDelete(GLR_BUFFER, buffer_);
+}
+
+void* StreamRing::beginSegment() {
+    current_ = (current_ + 1) % numSegments_;
+    GLsync& fence = fences_[current_];
+    if (fence) {
+        GLenum status = glClientWaitSync(fence, 0, 0);
+        if (status == GL_TIMEOUT_EXPIRED) {
+            auto start = std::chrono::steady_clock::now();
+            do {
+                status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+            } while (status == GL_TIMEOUT_EXPIRED);
+            ++stats_.waits;
+            stats_.waitMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        }
+        if (status == GL_WAIT_FAILED) {
+            printf("StreamRing: glClientWaitSync failed\n");
+            exit(1);
+        }
+        glDeleteSync(fence);
+        fence = nullptr;
+    }
+    ++stats_.segments;
+    return mapped_ + segmentOffset();
+}
+
+void StreamRing::segmentWritten(size_t bytes) {
+    traceMappedWrite(mapped_, segmentOffset(), bytes);
+}
+
+void StreamRing::endSegment() {
+    fences_[current_] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
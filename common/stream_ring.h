@@ -0,0 +1,59 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "gl_loader.h"
+
+//-----------------------------------------------------------------------------------
+// Persistently mapped streaming buffer
+//
+// One glBufferStorage allocation, mapped once with GL_MAP_PERSISTENT_BIT, split
+// into segments that are written in turn. Each segment is fenced after the draws
+// that read it, and beginSegment() waits on that fence before handing the segment
+// out again, so with three segments the CPU can fill one while the GPU reads the
+// other two.
+//-----------------------------------------------------------------------------------
+
+class StreamRing {
+public:
+    struct Stats {
+        uint64_t segments = 0;    // segments handed out
+        uint64_t waits = 0;       // beginSegment() had to wait for the GPU
+        double waitMs = 0.0;
+    };
+
+    StreamRing(GLenum target, size_t segmentSize, int numSegments = 3);
+    ~StreamRing();
+
+    // Waits until the next segment is no longer read by the GPU and returns
+    // where to write it.
+    void* beginSegment();
+
+    // Tells a GL trace that the first bytes of the current segment were
+    // written. Call before the draws that read them.
+    void segmentWritten(size_t bytes);
+
+    // Fences the current segment. Call once the draws reading it are submitted.
+    void endSegment();
+
+    GLuint buffer() const { return buffer_; }
+    size_t segmentSize() const { return segmentSize_; }
+    int segmentIndex() const { return current_; }
+    // Byte offset of the current segment in buffer().
+    size_t segmentOffset() const { return current_ * segmentSize_; }
+
+    const Stats& stats() const { return stats_; }
+
+private:
+    static const int maxSegments = 8;
+
+    GLenum target_;
+    GLuint buffer_;
+    size_t segmentSize_;
+    int numSegments_;
+    int current_ = -1;
+    uint8_t* mapped_;
+    GLsync fences_[maxSegments] = {};
+    Stats stats_;
+};
@@ -0,0 +1,642 @@
+#include "texture_file.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+
+#include "gl_resources.h"
+#include "gl_state.h"
+
+// S3TC isn't part of core GL so glcorearb.h doesn't have these.
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#define GL_COMPRESSED_RGBA_S3TC_DXT1_EXT 0x83F1
+#define GL_COMPRESSED_RGBA_S3TC_DXT3_EXT 0x83F2
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+#ifndef GL_COMPRESSED_SRGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_SRGB_S3TC_DXT1_EXT 0x8C4C
+#define GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT 0x8C4D
+#define GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT3_EXT 0x8C4E
+#define GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT 0x8C4F
+#endif
+
+namespace {
+
+enum Transcoder {
+    TRANSCODE_NONE,
+    TRANSCODE_BC1,
+    TRANSCODE_BC1_ALPHA,
+    TRANSCODE_BC2,
+    TRANSCODE_BC3,
+    TRANSCODE_BC4,
+    TRANSCODE_BC5,
+    TRANSCODE_ETC2_RGB,
+};
+
+#define FOURCC(a, b, c, d) ((uint32_t)(a) | ((uint32_t)(b) << 8) | ((uint32_t)(c) << 16) | ((uint32_t)(d) << 24))
+
+struct FormatInfo {
+    const char* name;
+    GLenum glFormat;
+    int blockBytes;
+    Transcoder transcoder;
+    bool srgb;
+    uint32_t vkFormat;     // KTX2
+    uint32_t dxgiFormat;   // DDS DX10 header
+    uint32_t fourCC;       // DDS legacy header
+    uint32_t fourCC2;
+};
+
+const FormatInfo formats[] = {
+    { "BC1 RGB",         GL_COMPRESSED_RGB_S3TC_DXT1_EXT,         8, TRANSCODE_BC1, false, 131,  0, 0, 0 },
+    { "BC1 sRGB",        GL_COMPRESSED_SRGB_S3TC_DXT1_EXT,        8, TRANSCODE_BC1, true,  132,  0, 0, 0 },
+    { "BC1 RGBA",        GL_COMPRESSED_RGBA_S3TC_DXT1_EXT,        8, TRANSCODE_BC1_ALPHA, false, 133, 71, FOURCC('D','X','T','1'), 0 },
+    { "BC1 sRGB alpha",  GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT,  8, TRANSCODE_BC1_ALPHA, true,  134, 72, 0, 0 },
+    { "BC2",             GL_COMPRESSED_RGBA_S3TC_DXT3_EXT,       16, TRANSCODE_BC2, false, 135, 74, FOURCC('D','X','T','3'), 0 },
+    { "BC2 sRGB",        GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT3_EXT, 16, TRANSCODE_BC2, true,  136, 75, 0, 0 },
+    { "BC3",             GL_COMPRESSED_RGBA_S3TC_DXT5_EXT,       16, TRANSCODE_BC3, false, 137, 77, FOURCC('D','X','T','5'), 0 },
+    { "BC3 sRGB",        GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT, 16, TRANSCODE_BC3, true,  138, 78, 0, 0 },
+    { "BC4",             GL_COMPRESSED_RED_RGTC1,                 8, TRANSCODE_BC4, false, 139, 80, FOURCC('A','T','I','1'), FOURCC('B','C','4','U') },
+    { "BC4 signed",      GL_COMPRESSED_SIGNED_RED_RGTC1,          8, TRANSCODE_NONE, false, 140, 81, FOURCC('B','C','4','S'), 0 },
+    { "BC5",             GL_COMPRESSED_RG_RGTC2,                 16, TRANSCODE_BC5, false, 141, 83, FOURCC('A','T','I','2'), FOURCC('B','C','5','U') },
+    { "BC5 signed",      GL_COMPRESSED_SIGNED_RG_RGTC2,          16, TRANSCODE_NONE, false, 142, 84, FOURCC('B','C','5','S'), 0 },
+    { "BC6H unsigned",   GL_COMPRESSED_RGB_BPTC_UNSIGNED_FLOAT,  16, TRANSCODE_NONE, false, 143, 95, 0, 0 },
+    { "BC6H signed",     GL_COMPRESSED_RGB_BPTC_SIGNED_FLOAT,    16, TRANSCODE_NONE, false, 144, 96, 0, 0 },
+    { "BC7",             GL_COMPRESSED_RGBA_BPTC_UNORM,          16, TRANSCODE_NONE, false, 145, 98, 0, 0 },
+    { "BC7 sRGB",        GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM,    16, TRANSCODE_NONE, false, 146, 99, 0, 0 },
+    { "ETC2 RGB8",       GL_COMPRESSED_RGB8_ETC2,                 8, TRANSCODE_ETC2_RGB, false, 147, 0, 0, 0 },
+    { "ETC2 sRGB8",      GL_COMPRESSED_SRGB8_ETC2,                8, TRANSCODE_ETC2_RGB, true,  148, 0, 0, 0 },
+    { "ETC2 RGB8A1",     GL_COMPRESSED_RGB8_PUNCHTHROUGH_ALPHA1_ETC2,  8, TRANSCODE_NONE, false, 149, 0, 0, 0 },
+    { "ETC2 sRGB8A1",    GL_COMPRESSED_SRGB8_PUNCHTHROUGH_ALPHA1_ETC2, 8, TRANSCODE_NONE, true, 150, 0, 0, 0 },
+    { "ETC2 RGBA8",      GL_COMPRESSED_RGBA8_ETC2_EAC,           16, TRANSCODE_NONE, false, 151, 0, 0, 0 },
+    { "ETC2 sRGB8A8",    GL_COMPRESSED_SRGB8_ALPHA8_ETC2_EAC,    16, TRANSCODE_NONE, true,  152, 0, 0, 0 },
+    { "EAC R11",         GL_COMPRESSED_R11_EAC,                   8, TRANSCODE_NONE, false, 153, 0, 0, 0 },
+    { "EAC R11 signed",  GL_COMPRESSED_SIGNED_R11_EAC,            8, TRANSCODE_NONE, false, 154, 0, 0, 0 },
+    { "EAC RG11",        GL_COMPRESSED_RG11_EAC,                 16, TRANSCODE_NONE, false, 155, 0, 0, 0 },
+    { "EAC RG11 signed", GL_COMPRESSED_SIGNED_RG11_EAC,          16, TRANSCODE_NONE, false, 156, 0, 0, 0 },
+};
+
+const int numFormats = sizeof(formats) / sizeof(formats[0]);
+
+uint32_t read32(const uint8_t* p) {
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return v;
+}
+
+uint64_t read64(const uint8_t* p) {
+    uint64_t v;
+    memcpy(&v, p, 8);
+    return v;
+}
+
+size_t levelSize(const FormatInfo& format, int width, int height) {
+    return ((size_t(width) + 3) / 4) * ((size_t(height) + 3) / 4) * format.blockBytes;
+}
+
+// Sizes are read into ints and halved once per mip level, so anything past
+// 32 levels or outside 1..INT_MAX comes from a corrupt header.
+const uint32_t maxLevels = 32;
+
+bool checkDimensions(const char* path, const TextureFile* file, uint32_t levelCount) {
+    if (file->width <= 0 || file->height <= 0) {
+        printf("%s: bad size %dx%d\n", path, file->width, file->height);
+        return false;
+    }
+    if (levelCount > maxLevels) {
+        printf("%s: too many mip levels (%u)\n", path, levelCount);
+        return false;
+    }
+    return true;
+}
+
+//-----------------------------------------------------------------------------------
+// Container parsing. Both fill in formatIndex, width, height and levels with
+// pointers into data.
+//-----------------------------------------------------------------------------------
+
+bool parseDDS(const char* path, const uint8_t* data, size_t size, TextureFile* file) {
+    const size_t headerSize = 128;
+    if (size < headerSize || read32(data + 4) != 124) {
+        printf("%s: bad DDS header\n", path);
+        return false;
+    }
+    const uint32_t DDSD_MIPMAPCOUNT = 0x20000;
+    const uint32_t DDPF_FOURCC = 0x4;
+    uint32_t flags = read32(data + 8);
+    file->height = read32(data + 12);
+    file->width = read32(data + 16);
+    uint32_t mipCount = (flags & DDSD_MIPMAPCOUNT) ? read32(data + 28) : 1;
+    uint32_t pfFlags = read32(data + 80);
+    uint32_t fourCC = read32(data + 84);
+    if (!(pfFlags & DDPF_FOURCC)) {
+        printf("%s: uncompressed DDS files aren't supported\n", path);
+        return false;
+    }
+    if (!checkDimensions(path, file, mipCount)) {
+        return false;
+    }
+
+    size_t offset = headerSize;
+    file->formatIndex = -1;
+    if (fourCC == FOURCC('D','X','1','0')) {
+        if (size < headerSize + 20) {
+            printf("%s: truncated DX10 header\n", path);
+            return false;
+        }
+        uint32_t dxgiFormat = read32(data + headerSize);
+        uint32_t arraySize = read32(data + headerSize + 12);
+        if (arraySize > 1) {
+            printf("%s: texture arrays aren't supported\n", path);
+            return false;
+        }
+        for (int i = 0; i < numFormats; ++i) {
+            if (formats[i].dxgiFormat == dxgiFormat) {
+                file->formatIndex = i;
+            }
+        }
+        offset += 20;
+    } else {
+        for (int i = 0; i < numFormats; ++i) {
+            if (formats[i].fourCC == fourCC || (formats[i].fourCC2 && formats[i].fourCC2 == fourCC)) {
+                file->formatIndex = i;
+            }
+        }
+    }
+    if (file->formatIndex < 0) {
+        printf("%s: unsupported DDS format\n", path);
+        return false;
+    }
+
+    const FormatInfo& format = formats[file->formatIndex];
+    for (uint32_t level = 0; level < std::max(mipCount, 1u); ++level) {
+        int w = std::max(file->width >> level, 1);
+        int h = std::max(file->height >> level, 1);
+        size_t bytes = levelSize(format, w, h);
+        if (bytes > size - offset) {
+            printf("%s: truncated at mip level %u\n", path, level);
+            return false;
+        }
+        file->levels.push_back({ data + offset, bytes, w, h });
+        offset += bytes;
+    }
+    return true;
+}
+
+bool parseKTX2(const char* path, const uint8_t* data, size_t size, TextureFile* file) {
+    const size_t headerSize = 80;
+    if (size < headerSize) {
+        printf("%s: bad KTX2 header\n", path);
+        return false;
+    }
+    uint32_t vkFormat = read32(data + 12);
+    file->width = read32(data + 20);
+    file->height = read32(data + 24);
+    uint32_t depth = read32(data + 28);
+    uint32_t layerCount = read32(data + 32);
+    uint32_t faceCount = read32(data + 36);
+    uint32_t levelCount = std::max(read32(data + 40), 1u);
+    uint32_t supercompression = read32(data + 44);
+    if (depth > 0 || layerCount > 0 || faceCount != 1) {
+        printf("%s: only plain 2D KTX2 textures are supported\n", path);
+        return false;
+    }
+    if (supercompression != 0) {
+        printf("%s: KTX2 supercompression scheme %u isn't supported\n", path, supercompression);
+        return false;
+    }
+    if (!checkDimensions(path, file, levelCount)) {
+        return false;
+    }
+
+    file->formatIndex = -1;
+    for (int i = 0; i < numFormats; ++i) {
+        if (formats[i].vkFormat == vkFormat) {
+            file->formatIndex = i;
+        }
+    }
+    if (file->formatIndex < 0) {
+        printf("%s: unsupported KTX2 vkFormat %u\n", path, vkFormat);
+        return false;
+    }
+
+    const FormatInfo& format = formats[file->formatIndex];
+    if (levelCount > (size - headerSize) / 24) {
+        printf("%s: truncated level index\n", path);
+        return false;
+    }
+    for (uint32_t level = 0; level < levelCount; ++level) {
+        const uint8_t* entry = data + headerSize + level * 24;
+        uint64_t offset = read64(entry);
+        uint64_t length = read64(entry + 8);
+        int w = std::max(file->width >> level, 1);
+        int h = std::max(file->height >> level, 1);
+        if (length != levelSize(format, w, h) || offset > size || length > size - offset) {
+            printf("%s: bad mip level %u\n", path, level);
+            return false;
+        }
+        file->levels.push_back({ data + offset, (size_t)length, w, h });
+    }
+    return true;
+}
+
+//-----------------------------------------------------------------------------------
+// CPU transcoding to RGBA8, one 4x4 block at a time
+//-----------------------------------------------------------------------------------
+
+void rgb565(uint16_t c, uint8_t* out) {
+    out[0] = ((c >> 11) & 31) * 255 / 31;
+    out[1] = ((c >> 5) & 63) * 255 / 63;
+    out[2] = (c & 31) * 255 / 31;
+}
+
+// BC1 color block. BC2 and BC3 always use the four color mode. Index 3 of the
+// three color mode is transparent black only for the RGBA variants.
+void decodeBC1Colors(const uint8_t* block, bool alwaysFourColors, bool punchThrough, uint8_t* out) {
+    uint16_t c0 = block[0] | (block[1] << 8);
+    uint16_t c1 = block[2] | (block[3] << 8);
+    uint8_t palette[4][4];
+    rgb565(c0, palette[0]);
+    rgb565(c1, palette[1]);
+    palette[0][3] = palette[1][3] = palette[2][3] = palette[3][3] = 255;
+    for (int i = 0; i < 3; ++i) {
+        if (c0 > c1 || alwaysFourColors) {
+            palette[2][i] = (2 * palette[0][i] + palette[1][i]) / 3;
+            palette[3][i] = (palette[0][i] + 2 * palette[1][i]) / 3;
+        } else {
+            palette[2][i] = (palette[0][i] + palette[1][i]) / 2;
+            palette[3][i] = 0;
+        }
+    }
+    if (!(c0 > c1 || alwaysFourColors) && punchThrough) {
+        palette[3][3] = 0;
+    }
+    uint32_t indices = read32(block + 4);
+    for (int i = 0; i < 16; ++i) {
+        memcpy(out + i * 4, palette[(indices >> (i * 2)) & 3], 4);
+    }
+}
+
+// The 8 byte interpolated single channel block shared by BC3 alpha, BC4 and BC5.
+void decodeBC4Channel(const uint8_t* block, uint8_t* out, int channel) {
+    uint8_t a0 = block[0];
+    uint8_t a1 = block[1];
+    uint8_t values[8] = { a0, a1 };
+    if (a0 > a1) {
+        for (int i = 1; i < 7; ++i) {
+            values[i + 1] = ((7 - i) * a0 + i * a1) / 7;
+        }
+    } else {
+        for (int i = 1; i < 5; ++i) {
+            values[i + 1] = ((5 - i) * a0 + i * a1) / 5;
+        }
+        values[6] = 0;
+        values[7] = 255;
+    }
+    uint64_t indices = 0;
+    for (int i = 0; i < 6; ++i) {
+        indices |= (uint64_t)block[2 + i] << (i * 8);
+    }
+    for (int i = 0; i < 16; ++i) {
+        out[i * 4 + channel] = values[(indices >> (i * 3)) & 7];
+    }
+}
+
+uint8_t clamp255(int v) {
+    return (uint8_t)std::min(std::max(v, 0), 255);
+}
+
+// ETC1 and the ETC2 T, H and planar modes.
+void decodeETC2RGB(const uint8_t* src, uint8_t* out) {
+    static const int modifiers[8][2] = {
+        { 2, 8 }, { 5, 17 }, { 9, 29 }, { 13, 42 }, { 18, 60 }, { 24, 80 }, { 33, 106 }, { 47, 183 },
+    };
+    static const int distances[8] = { 3, 6, 11, 16, 23, 32, 41, 64 };
+
+    uint32_t pixelBits = ((uint32_t)src[4] << 24) | (src[5] << 16) | (src[6] << 8) | src[7];
+    auto pixelIndex = [&](int x, int y) {
+        int i = x * 4 + y;
+        return (((pixelBits >> (16 + i)) & 1) << 1) | ((pixelBits >> i) & 1);
+    };
+    auto extend4 = [](int v) { return v * 17; };
+    auto extend5 = [](int v) { return (v << 3) | (v >> 2); };
+    auto extend6 = [](int v) { return (v << 2) | (v >> 4); };
+    auto extend7 = [](int v) { return (v << 1) | (v >> 6); };
+
+    bool diff = src[3] & 2;
+    bool flip = src[3] & 1;
+    int base[2][3];
+    if (!diff) {
+        for (int c = 0; c < 3; ++c) {
+            base[0][c] = extend4(src[c] >> 4);
+            base[1][c] = extend4(src[c] & 15);
+        }
+    } else {
+        int b[3], d[3];
+        for (int c = 0; c < 3; ++c) {
+            b[c] = src[c] >> 3;
+            d[c] = src[c] & 7;
+            if (d[c] >= 4) {
+                d[c] -= 8;
+            }
+        }
+        if (b[0] + d[0] < 0 || b[0] + d[0] > 31 || b[1] + d[1] < 0 || b[1] + d[1] > 31) {
+            // T mode on red overflow, H mode on green overflow
+            bool tMode = b[0] + d[0] < 0 || b[0] + d[0] > 31;
+            int c1[3], c2[3], dist;
+            if (tMode) {
+                c1[0] = extend4(((src[0] & 0x18) >> 1) | (src[0] & 3));
+                c1[1] = extend4(src[1] >> 4);
+                c1[2] = extend4(src[1] & 15);
+                c2[0] = extend4(src[2] >> 4);
+                c2[1] = extend4(src[2] & 15);
+                c2[2] = extend4(src[3] >> 4);
+                dist = distances[(((src[3] >> 2) & 3) << 1) | (src[3] & 1)];
+            } else {
+                int r1 = (src[0] >> 3) & 15;
+                int g1 = ((src[0] & 7) << 1) | ((src[1] >> 4) & 1);
+                int b1 = (src[1] & 8) | ((src[1] & 3) << 1) | (src[2] >> 7);
+                int r2 = (src[2] >> 3) & 15;
+                int g2 = ((src[2] & 7) << 1) | (src[3] >> 7);
+                int b2 = (src[3] >> 3) & 15;
+                int order = ((r1 << 8) | (g1 << 4) | b1) >= ((r2 << 8) | (g2 << 4) | b2) ? 1 : 0;
+                c1[0] = extend4(r1); c1[1] = extend4(g1); c1[2] = extend4(b1);
+                c2[0] = extend4(r2); c2[1] = extend4(g2); c2[2] = extend4(b2);
+                dist = distances[(src[3] & 4) | ((src[3] & 1) << 1) | order];
+            }
+            uint8_t paint[4][3];
+            for (int c = 0; c < 3; ++c) {
+                if (tMode) {
+                    paint[0][c] = c1[c];
+                    paint[1][c] = clamp255(c2[c] + dist);
+                    paint[2][c] = c2[c];
+                    paint[3][c] = clamp255(c2[c] - dist);
+                } else {
+                    paint[0][c] = clamp255(c1[c] + dist);
+                    paint[1][c] = clamp255(c1[c] - dist);
+                    paint[2][c] = clamp255(c2[c] + dist);
+                    paint[3][c] = clamp255(c2[c] - dist);
+                }
+            }
+            for (int y = 0; y < 4; ++y) {
+                for (int x = 0; x < 4; ++x) {
+                    uint8_t* p = out + (y * 4 + x) * 4;
+                    memcpy(p, paint[pixelIndex(x, y)], 3);
+                    p[3] = 255;
+                }
+            }
+            return;
+        }
+        if (b[2] + d[2] < 0 || b[2] + d[2] > 31) {
+            // Planar mode
+            int ro = extend6((src[0] >> 1) & 0x3f);
+            int go = extend7(((src[0] & 1) << 6) | ((src[1] & 0x7e) >> 1));
+            int bo = extend6(((src[1] & 1) << 5) | (src[2] & 0x18) | ((src[2] & 3) << 1) | (src[3] >> 7));
+            int rh = extend6((((src[3] >> 2) & 0x1f) << 1) | (src[3] & 1));
+            int gh = extend7(src[4] >> 1);
+            int bh = extend6(((src[4] & 1) << 5) | (src[5] >> 3));
+            int rv = extend6(((src[5] & 7) << 3) | (src[6] >> 5));
+            int gv = extend7(((src[6] & 0x1f) << 2) | (src[7] >> 6));
+            int bv = extend6(src[7] & 0x3f);
+            for (int y = 0; y < 4; ++y) {
+                for (int x = 0; x < 4; ++x) {
+                    uint8_t* p = out + (y * 4 + x) * 4;
+                    p[0] = clamp255((x * (rh - ro) + y * (rv - ro) + 4 * ro + 2) >> 2);
+                    p[1] = clamp255((x * (gh - go) + y * (gv - go) + 4 * go + 2) >> 2);
+                    p[2] = clamp255((x * (bh - bo) + y * (bv - bo) + 4 * bo + 2) >> 2);
+                    p[3] = 255;
+                }
+            }
+            return;
+        }
+        for (int c = 0; c < 3; ++c) {
+            base[0][c] = extend5(b[c]);
+            base[1][c] = extend5(b[c] + d[c]);
+        }
+    }
+
+    // Individual and differential modes: two sub-blocks, each with a base color
+    // and a modifier table.
+    const int* table[2] = { modifiers[src[3] >> 5], modifiers[(src[3] >> 2) & 7] };
+    for (int y = 0; y < 4; ++y) {
+        for (int x = 0; x < 4; ++x) {
+            int sub = flip ? (y >= 2) : (x >= 2);
+            int index = pixelIndex(x, y);
+            int modifier = table[sub][index & 1];
+            if (index & 2) {
+                modifier = -modifier;
+            }
+            uint8_t* p = out + (y * 4 + x) * 4;
+            for (int c = 0; c < 3; ++c) {
+                p[c] = clamp255(base[sub][c] + modifier);
+            }
+            p[3] = 255;
+        }
+    }
+}
+
+void decodeBlock(Transcoder transcoder, const uint8_t* block, uint8_t* out) {
+    switch (transcoder) {
+        case TRANSCODE_BC1:
+        case TRANSCODE_BC1_ALPHA:
+            decodeBC1Colors(block, false, transcoder == TRANSCODE_BC1_ALPHA, out);
+            break;
+        case TRANSCODE_BC2:
+            decodeBC1Colors(block + 8, true, false, out);
+            for (int i = 0; i < 16; ++i) {
+                out[i * 4 + 3] = ((block[i / 2] >> ((i & 1) * 4)) & 15) * 17;
+            }
+            break;
+        case TRANSCODE_BC3:
+            decodeBC1Colors(block + 8, true, false, out);
+            decodeBC4Channel(block, out, 3);
+            break;
+        case TRANSCODE_BC4:
+        case TRANSCODE_BC5:
+            for (int i = 0; i < 16; ++i) {
+                out[i * 4 + 0] = 0;
+                out[i * 4 + 1] = 0;
+                out[i * 4 + 2] = 0;
+                out[i * 4 + 3] = 255;
+            }
+            decodeBC4Channel(block, out, 0);
+            if (transcoder == TRANSCODE_BC5) {
+                decodeBC4Channel(block + 8, out, 1);
+            }
+            break;
+        case TRANSCODE_ETC2_RGB:
+            decodeETC2RGB(block, out);
+            break;
+        case TRANSCODE_NONE:
+            break;
+    }
+}
+
+void transcodeLevel(const FormatInfo& format, const TextureFileLevel& level, std::vector<uint8_t>* rgba) {
+    rgba->resize(size_t(level.width) * level.height * 4);
+    int blocksWide = (level.width + 3) / 4;
+    int blocksHigh = (level.height + 3) / 4;
+    uint8_t texels[16 * 4];
+    for (int by = 0; by < blocksHigh; ++by) {
+        for (int bx = 0; bx < blocksWide; ++bx) {
+            decodeBlock(format.transcoder, level.data + (by * blocksWide + bx) * format.blockBytes, texels);
+            for (int y = 0; y < 4 && by * 4 + y < level.height; ++y) {
+                int w = std::min(4, level.width - bx * 4);
+                memcpy(&(*rgba)[((by * 4 + y) * level.width + bx * 4) * 4], texels + y * 16, w * 4);
+            }
+        }
+    }
+}
+
+// RGTC, BPTC and ETC2/EAC are core in the GL 4.6 contexts the examples create,
+// and core profiles don't have to list them in GL_COMPRESSED_TEXTURE_FORMATS.
+// S3TC is an extension so it has to be listed.
+bool driverSupports(GLenum glFormat) {
+    bool s3tc = (glFormat >= GL_COMPRESSED_RGB_S3TC_DXT1_EXT && glFormat <= GL_COMPRESSED_RGBA_S3TC_DXT5_EXT) ||
+                (glFormat >= GL_COMPRESSED_SRGB_S3TC_DXT1_EXT && glFormat <= GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT);
+    if (!s3tc) {
+        return true;
+    }
+    static std::vector<GLint> supported;
+    if (supported.empty()) {
+        GLint count = 0;
+        glGetIntegerv(GL_NUM_COMPRESSED_TEXTURE_FORMATS, &count);
+        supported.resize(count + 1, 0);
+        glGetIntegerv(GL_COMPRESSED_TEXTURE_FORMATS, supported.data());
+    }
+    return std::find(supported.begin(), supported.end(), (GLint)glFormat) != supported.end();
+}
+
+}  // namespace
+
+bool openTextureFile(const char* path, bool useHeap, TextureFile* file) {
+    file->mapping = nullptr;
+    file->mappingSize = 0;
+    file->heap.clear();
+    file->levels.clear();
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        printf("Cannot open %s\n", path);
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < 16) {
+        printf("%s: too small to be a texture\n", path);
+        close(fd);
+        return false;
+    }
+    size_t size = st.st_size;
+
+    const uint8_t* data;
+    if (useHeap) {
+        file->heap.resize(size);
+        size_t done = 0;
+        while (done < size) {
+            ssize_t n = read(fd, file->heap.data() + done, size - done);
+            if (n <= 0) {
+                printf("Cannot read %s\n", path);
+                close(fd);
+                return false;
+            }
+            done += n;
+        }
+        data = file->heap.data();
+    } else {
+        file->mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (file->mapping == MAP_FAILED) {
+            file->mapping = nullptr;
+            printf("Cannot map %s\n", path);
+            close(fd);
+            return false;
+        }
+        file->mappingSize = size;
+        // The upload reads the mip chain front to back.
+        madvise(file->mapping, size, MADV_SEQUENTIAL);
+        data = (const uint8_t*)file->mapping;
+    }
+    close(fd);
+
+    static const uint8_t ktx2Identifier[12] = { 0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n' };
+    bool ok;
+    if (memcmp(data, "DDS ", 4) == 0) {
+        ok = parseDDS(path, data, size, file);
+    } else if (memcmp(data, ktx2Identifier, sizeof(ktx2Identifier)) == 0) {
+        ok = parseKTX2(path, data, size, file);
+    } else {
+        printf("%s: not a DDS or KTX2 file\n", path);
+        ok = false;
+    }
+    if (!ok) {
+        closeTextureFile(file);
+        return false;
+    }
+    file->formatName = formats[file->formatIndex].name;
+    file->internalFormat = formats[file->formatIndex].glFormat;
+    return true;
+}
+
+void closeTextureFile(TextureFile* file) {
+    if (file->mapping) {
+        munmap(file->mapping, file->mappingSize);
+        file->mapping = nullptr;
+    }
+    file->heap.clear();
+    file->heap.shrink_to_fit();
+    file->levels.clear();
+}
+
+GLuint uploadTextureFile(const TextureFile& file, bool forceTranscode, bool* transcoded) {
+    const FormatInfo& format = formats[file.formatIndex];
+    int numLevels = (int)file.levels.size();
+    *transcoded = forceTranscode || !driverSupports(format.glFormat);
+    if (*transcoded && format.transcoder == TRANSCODE_NONE) {
+        printf("%s isn't supported by the driver and can't be transcoded\n", format.name);
+        return 0;
+    }
+
+    GLuint tex = glrCreate(GLR_TEXTURE, "texture file");
+    glsBindTexture(GL_TEXTURE_2D, tex);
+    if (!*transcoded) {
+        glTexStorage2D(GL_TEXTURE_2D, numLevels, format.glFormat, file.width, file.height);
+        glrSetBytes(GLR_TEXTURE, tex, glrTextureBytes(format.glFormat, file.width, file.height, 1, numLevels));
+        for (int i = 0; i < numLevels; ++i) {
+            const TextureFileLevel& level = file.levels[i];
+            glCompressedTexSubImage2D(GL_TEXTURE_2D, i, 0, 0, level.width, level.height,
+                                      format.glFormat, (GLsizei)level.size, level.data);
+        }
+    } else {
+        glTexStorage2D(GL_TEXTURE_2D, numLevels, format.srgb ? GL_SRGB8_ALPHA8 : GL_RGBA8, file.width, file.height);
+        glrSetBytes(GLR_TEXTURE, tex, glrTextureBytes(GL_RGBA8, file.width, file.height, 1, numLevels));
+        std::vector<uint8_t> rgba;
+        for (int i = 0; i < numLevels; ++i) {
+            const TextureFileLevel& level = file.levels[i];
+            transcodeLevel(format, level, &rgba);
+            glTexSubImage2D(GL_TEXTURE_2D, i, 0, 0, level.width, level.height, GL_RGBA, GL_UNSIGNED_BYTE, rgba.data());
+        }
+    }
+    glsTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glsTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, numLevels > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+    glsTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, numLevels - 1);
+    return tex;
+}
+
+size_t residentBytes() {
+    FILE* f = fopen("/proc/self/statm", "r");
+    if (f == nullptr) {
+        return 0;
+    }
+    unsigned long pages = 0;
+    unsigned long resident = 0;
+    if (fscanf(f, "%lu %lu", &pages, &resident) != 2) {
+        resident = 0;
+    }
+    fclose(f);
+    return resident * (size_t)sysconf(_SC_PAGESIZE);
+}
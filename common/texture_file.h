@@ -0,0 +1,55 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+#include "gl_loader.h"
+
+//-----------------------------------------------------------------------------------
+// Compressed texture files (DDS and KTX2)
+//
+// openTextureFile() mmaps the file and points each mip level straight at its
+// blocks inside the mapping, so nothing is copied before the upload. Passing
+// useHeap reads the whole file into memory instead, which is what the mapping
+// gets compared against.
+//
+// Supported: BC1-BC7 (DDS FourCC and DX10 headers, KTX2) and ETC2/EAC (KTX2).
+// KTX2 supercompression isn't supported. BC1-BC3 need the driver to list them
+// in GL_COMPRESSED_TEXTURE_FORMATS; the other formats are core. When a format
+// can't be uploaded as is, BC1-BC5 and ETC1/ETC2 RGB are transcoded to RGBA8 on
+// the CPU.
+//-----------------------------------------------------------------------------------
+
+struct TextureFileLevel {
+    const uint8_t* data;
+    size_t size;
+    int width;
+    int height;
+};
+
+struct TextureFile {
+    const char* formatName;
+    GLenum internalFormat;
+    int width;
+    int height;
+    std::vector<TextureFileLevel> levels;
+
+    // Where the data lives: either a mapping or a heap copy.
+    void* mapping;
+    size_t mappingSize;
+    std::vector<uint8_t> heap;
+    int formatIndex;
+};
+
+// Prints a message and returns false if the file can't be read or parsed.
+bool openTextureFile(const char* path, bool useHeap, TextureFile* file);
+void closeTextureFile(TextureFile* file);
+
+// Creates an immutable texture with the file's full mip chain. Transcodes on the
+// CPU if the driver lacks the format or forceTranscode is set. Returns 0 if the
+// format can't be uploaded either way. The texture is recorded with glrCreate().
+GLuint uploadTextureFile(const TextureFile& file, bool forceTranscode, bool* transcoded);
+
+// Resident set size of this process in bytes, from /proc/self/statm.
+size_t residentBytes();
@@ -0,0 +1,150 @@
+#include "texture_uploader.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+
+#include "gl_context.h"
+#include "gl_resources.h"
+
+namespace {
+
+double msSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+}  // namespace
+
+TextureUploader::TextureUploader(GLContext* ctx) {
+    // Made here so the render thread's registry sees it. Buffers are shared with
+    // the loader's context.
+    staging_ = glrCreate(GLR_BUFFER, "texture staging");
+    workerCtx_ = createSharedGLContext(ctx);
+    thread_ = std::thread(&TextureUploader::run, this);
+}
+
+TextureUploader::~TextureUploader() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        quit_ = true;
+    }
+    wake_.notify_one();
+    thread_.join();
+    destroyGLContext(workerCtx_);
+
+    for (Finished& finished : finished_) {
+        glWaitSync(finished.fence, 0, GL_TIMEOUT_IGNORED);
+        glDeleteSync(finished.fence);
+        glrDelete(GLR_TEXTURE, finished.texture);
+    }
+    glrDelete(GLR_BUFFER, staging_);
+}
+
+uint32_t TextureUploader::request(int width, int height, Generator generate) {
+    uint32_t id;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        id = nextId_++;
+        jobs_.push_back({ id, width, height, generate });
+        ++stats_.requested;
+        ++stats_.queueDepth;
+        if (stats_.queueDepth > stats_.maxQueueDepth) {
+            stats_.maxQueueDepth = stats_.queueDepth;
+        }
+    }
+    wake_.notify_one();
+    return id;
+}
+
+bool TextureUploader::poll(uint32_t* id, GLuint* texture) {
+    Finished finished;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (finished_.empty()) {
+            return false;
+        }
+        finished = finished_.front();
+        finished_.pop_front();
+        --stats_.queueDepth;
+    }
+    // Make this context's command stream wait for the upload without blocking the CPU.
+    glWaitSync(finished.fence, 0, GL_TIMEOUT_IGNORED);
+    glDeleteSync(finished.fence);
+    glrAdopt(GLR_TEXTURE, finished.texture, "uploaded texture");
+    glrSetBytes(GLR_TEXTURE, finished.texture, finished.bytes);
+    // The staging buffer was last sized for this texture.
+    glrSetBytes(GLR_BUFFER, staging_, finished.bytes);
+    *id = finished.id;
+    *texture = finished.texture;
+    return true;
+}
+
+TextureUploader::Stats TextureUploader::stats() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
+
+void TextureUploader::run() {
+    makeCurrent(workerCtx_);
+
+    for (;;) {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            wake_.wait(lock, [this]() { return quit_ || !jobs_.empty(); });
+            if (quit_) {
+                break;
+            }
+            job = jobs_.front();
+            jobs_.pop_front();
+        }
+
+        size_t size = size_t(job.width) * job.height * 4;
+
+        // Orphan the staging buffer so the driver can hand out fresh storage
+        // while the previous upload may still be reading the old one.
+        auto start = std::chrono::steady_clock::now();
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, staging_);
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, size, nullptr, GL_STREAM_DRAW);
+        uint8_t* pixels = (uint8_t*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size,
+                                                     GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+        if (pixels == nullptr) {
+            printf("TextureUploader: failed to map staging buffer\n");
+            exit(1);
+        }
+        double mapMs = msSince(start);
+
+        start = std::chrono::steady_clock::now();
+        job.generate(pixels, job.width, job.height);
+        double generateMs = msSince(start);
+
+        start = std::chrono::steady_clock::now();
+        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+        // The registry is per thread: poll() records the texture on the render
+        // thread, which deletes it.
+        GLuint texture;
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, job.width, job.height);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, job.width, job.height, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        GLsync fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        // The render context can only wait on a fence that has been flushed.
+        glFlush();
+        double uploadMs = mapMs + msSince(start);
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            finished_.push_back({ job.id, texture, fence, glrTextureBytes(GL_RGBA8, job.width, job.height) });
+            ++stats_.completed;
+            stats_.bytes += size;
+            stats_.generateMs += generateMs;
+            stats_.uploadMs += uploadMs;
+        }
+    }
+
+    releaseCurrent(workerCtx_);
+}
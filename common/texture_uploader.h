@@ -0,0 +1,80 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+#include "gl_loader.h"
+
+struct GLContext;
+
+//-----------------------------------------------------------------------------------
+// Background texture streaming
+//
+// A loader thread owns a context shared with the render context. For each request
+// it generates the pixels straight into a mapped pixel unpack buffer, uploads them
+// into a new texture, fences the upload and hands the texture back. The render
+// thread picks finished textures up with poll(), which never blocks: it only queues
+// a glWaitSync so the GPU, not the CPU, waits for the upload to land.
+//-----------------------------------------------------------------------------------
+
+class TextureUploader {
+public:
+    // Fills width * height RGBA8 pixels, rows bottom to top.
+    typedef std::function<void(uint8_t* pixels, int width, int height)> Generator;
+
+    struct Stats {
+        uint64_t requested = 0;
+        uint64_t completed = 0;
+        int queueDepth = 0;       // requests not yet picked up by poll()
+        int maxQueueDepth = 0;
+        uint64_t bytes = 0;
+        double generateMs = 0.0;  // loader thread time spent producing pixels
+        double uploadMs = 0.0;    // loader thread time spent in GL upload calls
+    };
+
+    // ctx must be current on the calling thread, which is the render thread.
+    explicit TextureUploader(GLContext* ctx);
+    ~TextureUploader();
+
+    // Queues a width x height RGBA8 texture. Never blocks. Returns the request id.
+    uint32_t request(int width, int height, Generator generate);
+
+    // Returns the next finished texture, or false if none is ready. The caller
+    // owns the texture, which this thread's registry has adopted.
+    bool poll(uint32_t* id, GLuint* texture);
+
+    Stats stats();
+
+private:
+    struct Job {
+        uint32_t id;
+        int width;
+        int height;
+        Generator generate;
+    };
+
+    struct Finished {
+        uint32_t id;
+        GLuint texture;
+        GLsync fence;
+        uint64_t bytes;
+    };
+
+    void run();
+
+    GLContext* workerCtx_;
+    GLuint staging_;
+    std::thread thread_;
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::deque<Job> jobs_;
+    std::deque<Finished> finished_;
+    bool quit_ = false;
+    uint32_t nextId_ = 1;
+    Stats stats_;
+};
@@ -0,0 +1,131 @@
+#include "worker_pool.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <new>
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "shared queue needs lock free 64-bit atomics");
+
+void* allocShared(size_t size) {
+    void* p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED) {
+        printf("Cannot map %zu bytes of shared memory\n", size);
+        exit(1);
+    }
+    return p;
+}
+
+void freeShared(void* p, size_t size) {
+    munmap(p, size);
+}
+
+SharedWorkQueue* SharedWorkQueue::create(int numWorkers, uint64_t numItems, uint64_t itemsPerChunk) {
+    if (numWorkers < 1 || numWorkers > maxWorkers) {
+        printf("SharedWorkQueue: %d workers, must be 1 to %d\n", numWorkers, maxWorkers);
+        exit(1);
+    }
+    uint64_t numChunks = (numItems + itemsPerChunk - 1) / itemsPerChunk;
+    if (numChunks >= UINT32_MAX) {
+        printf("SharedWorkQueue: %llu chunks is too many\n", (unsigned long long)numChunks);
+        exit(1);
+    }
+
+    SharedWorkQueue* queue = new (allocShared(sizeof(SharedWorkQueue))) SharedWorkQueue;
+    queue->numWorkers_ = numWorkers;
+    queue->numItems_ = numItems;
+    queue->itemsPerChunk_ = itemsPerChunk;
+    queue->numChunks_ = numChunks;
+    for (int i = 0; i < numWorkers; ++i) {
+        queue->shares_[i].store(pack(uint32_t(numChunks * i / numWorkers), uint32_t(numChunks * (i + 1) / numWorkers)));
+    }
+    return queue;
+}
+
+void SharedWorkQueue::destroy(SharedWorkQueue* queue) {
+    queue->~SharedWorkQueue();
+    freeShared(queue, sizeof(SharedWorkQueue));
+}
+
+bool SharedWorkQueue::take(int worker, uint64_t* begin, uint64_t* end) {
+    std::atomic<uint64_t>& own = shares_[worker];
+    for (;;) {
+        uint64_t share = own.load();
+        uint32_t first = uint32_t(share);
+        uint32_t last = uint32_t(share >> 32);
+        if (first < last) {
+            if (!own.compare_exchange_weak(share, pack(first + 1, last))) {
+                continue;
+            }
+            *begin = first * itemsPerChunk_;
+            *end = first + 1 == numChunks_ ? numItems_ : *begin + itemsPerChunk_;
+            ++stats_[worker].chunks;
+            return true;
+        }
+
+        // Out of work. Steal the back half of the largest share left, at least one chunk.
+        int victim = -1;
+        uint64_t victimShare = 0;
+        uint32_t most = 0;
+        for (int i = 0; i < numWorkers_; ++i) {
+            uint64_t other = shares_[i].load();
+            uint32_t left = uint32_t(other >> 32) - uint32_t(other);
+            if (i != worker && left > most) {
+                victim = i;
+                victimShare = other;
+                most = left;
+            }
+        }
+        if (victim < 0) {
+            return false;
+        }
+        uint32_t victimFirst = uint32_t(victimShare);
+        uint32_t victimLast = uint32_t(victimShare >> 32);
+        uint32_t split = victimLast - (most + 1) / 2;
+        if (!shares_[victim].compare_exchange_strong(victimShare, pack(victimFirst, split))) {
+            continue;
+        }
+        // Only this worker refills its own share, and only once it is empty,
+        // so a plain store can't lose anything.
+        own.store(pack(split, victimLast));
+        stats_[worker].stolen += victimLast - split;
+    }
+}
+
+int runWorkerProcesses(int numWorkers, int (*fn)(int worker, void* user), void* user) {
+    // Anything still buffered would otherwise be written once per process.
+    fflush(stdout);
+    fflush(stderr);
+
+    pid_t pids[SharedWorkQueue::maxWorkers];
+    int failed = 0;
+    for (int i = 0; i < numWorkers; ++i) {
+        pids[i] = fork();
+        if (pids[i] == 0) {
+            int status = fn(i, user);
+            fflush(stdout);
+            fflush(stderr);
+            _exit(status);
+        }
+        if (pids[i] < 0) {
+            printf("worker %d: fork failed\n", i);
+            ++failed;
+        }
+    }
+    for (int i = 0; i < numWorkers; ++i) {
+        int status;
+        if (pids[i] < 0 || waitpid(pids[i], &status, 0) < 0) {
+            continue;
+        }
+        if (WIFSIGNALED(status)) {
+            printf("worker %d: killed by signal %d\n", i, WTERMSIG(status));
+            ++failed;
+        } else if (WEXITSTATUS(status) != 0) {
+            printf("worker %d: exited with status %d\n", i, WEXITSTATUS(status));
+            ++failed;
+        }
+    }
+    return failed;
+}
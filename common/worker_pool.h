@@ -0,0 +1,64 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+
+//-----------------------------------------------------------------------------------
+// Forked worker processes pulling from a shared work queue
+//
+// A context, and the driver threads behind it, don't survive fork(), so parallel
+// runs use whole processes that each create their own context. Fork them before
+// this process creates a context of its own.
+//
+// The work is items [0, numItems) cut into fixed size chunks. Each worker starts
+// with an equal contiguous share and takes chunks from its front. A worker whose
+// share runs out steals the back half of the largest remaining share, so uneven
+// chunks still keep every worker busy until the end. The queue and anything
+// else from allocShared() is MAP_SHARED and visible to every process.
+//-----------------------------------------------------------------------------------
+
+// Zeroed shared anonymous memory. Prints a message and exits on failure.
+void* allocShared(size_t size);
+void freeShared(void* p, size_t size);
+
+class SharedWorkQueue {
+public:
+    static const int maxWorkers = 64;
+
+    struct WorkerStats {
+        uint64_t chunks;        // chunks taken
+        uint64_t stolen;        // of those, chunks stolen from another worker
+    };
+
+    // Creates the queue in shared memory. Destroy it with destroy().
+    static SharedWorkQueue* create(int numWorkers, uint64_t numItems, uint64_t itemsPerChunk);
+    static void destroy(SharedWorkQueue* queue);
+
+    // Takes the next chunk for worker. Returns false once every chunk is taken.
+    bool take(int worker, uint64_t* begin, uint64_t* end);
+
+    int numWorkers() const { return numWorkers_; }
+    uint64_t numChunks() const { return numChunks_; }
+    uint64_t chunkIndex(uint64_t begin) const { return begin / itemsPerChunk_; }
+    // Only read these once the workers have finished.
+    const WorkerStats& workerStats(int worker) const { return stats_[worker]; }
+
+private:
+    SharedWorkQueue() = default;
+
+    // Each share is [first, last) in chunks, packed as first | last << 32 so a
+    // single compare-and-swap moves either end.
+    static uint64_t pack(uint32_t first, uint32_t last) { return first | (uint64_t)last << 32; }
+
+    int numWorkers_;
+    uint64_t numItems_;
+    uint64_t itemsPerChunk_;
+    uint64_t numChunks_;
+    std::atomic<uint64_t> shares_[maxWorkers];
+    WorkerStats stats_[maxWorkers];
+};
+
+// Forks numWorkers processes that each run fn(worker, user) and exit with its
+// return value. Waits for all of them and returns how many failed.
+int runWorkerProcesses(int numWorkers, int (*fn)(int worker, void* user), void* user);
@@ -0,0 +1,396 @@
+#include "benchmarks.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <chrono>
+#include <functional>
+#include <string>
+
+#include "../common/gl_helpers.h"
+#include "../common/gl_resources.h"
+#include "../common/gl_state.h"
+#include "../common/program_cache.h"
+#include "../common/readback_ring.h"
+#include "../common/stream_ring.h"
+
+const char* const benchGroups[] = { "draw", "state", "fbo", "upload", "readback", "compile" };
+const int numBenchGroups = sizeof(benchGroups) / sizeof(benchGroups[0]);
+
+// A triangle of about one pixel in the corner of the target, as two floats per vertex.
+const float triangle[] = { -1.0f, -1.0f, -0.96f, -1.0f, -1.0f, -0.96f };
+const uint64_t minUploadBytes = sizeof(triangle);
+
+namespace {
+
+const int targetSize = 64;
+const int drawsPerRep = 1000;
+const int uploadsPerRep = 32;
+const int readbacksPerRep = 16;
+const int compilesPerRep = 4;
+
+double nowNs() {
+    return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+const char* vertexShader =
+R"RAW(#version 330 core
+in vec2 p;
+void main() {
+  gl_Position = vec4(p, 0, 1);
+}
+)RAW";
+
+// Two programs that differ in a constant, so switching between them is a real
+// program change.
+const char* fragmentShaders[2] = {
+R"RAW(#version 330 core
+uniform sampler2D u_tex;
+out vec4 fragColor;
+void main() {
+  fragColor = texture(u_tex, vec2(0.5));
+}
+)RAW",
+R"RAW(#version 330 core
+uniform sampler2D u_tex;
+out vec4 fragColor;
+void main() {
+  fragColor = texture(u_tex, vec2(0.5)) * 0.5;
+}
+)RAW",
+};
+
+// Two of everything a state change benchmark switches between. Index 0 is
+// bound when a benchmark starts.
+struct Scene {
+    GLuint programs[2];
+    GLuint textures[2];
+    GLuint vertexArrays[2];
+    GLuint buffer;
+    GLRenderTarget targets[2];
+};
+
+void createScene(Scene* scene) {
+    static const char* const attribs[] = { "p" };
+    for (int i = 0; i < 2; ++i) {
+        scene->programs[i] = createCachedProgram(vertexShader, fragmentShaders[i], attribs, 1);
+        glrAdopt(GLR_PROGRAM, scene->programs[i], "bench");
+    }
+
+    static const uint8_t texels[4 * 4 * 4] = { 255, 128, 64, 255 };
+    for (int i = 0; i < 2; ++i) {
+        scene->textures[i] = glrCreate(GLR_TEXTURE, "bench");
+        glBindTexture(GL_TEXTURE_2D, scene->textures[i]);
+        glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, 4, 4);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 4, 4, GL_RGBA, GL_UNSIGNED_BYTE, texels);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glrSetBytes(GLR_TEXTURE, scene->textures[i], glrTextureBytes(GL_RGBA8, 4, 4));
+    }
+
+    scene->buffer = glrCreate(GLR_BUFFER, "bench triangle");
+    glBindBuffer(GL_ARRAY_BUFFER, scene->buffer);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(triangle), triangle, GL_STATIC_DRAW);
+    glrSetBytes(GLR_BUFFER, scene->buffer, sizeof(triangle));
+    for (int i = 0; i < 2; ++i) {
+        scene->vertexArrays[i] = glrCreate(GLR_VERTEX_ARRAY, "bench");
+        glBindVertexArray(scene->vertexArrays[i]);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, nullptr);
+    }
+
+    // The render target pool binds through the state cache; everything else here is plain GL.
+    invalidateGLState();
+    for (int i = 0; i < 2; ++i) {
+        scene->targets[i] = glrAcquireRenderTarget(GL_RGBA8, GL_NONE, targetSize, targetSize, "bench target");
+    }
+    invalidateGLState();
+}
+
+void bindScene(const Scene& scene) {
+    glBindFramebuffer(GL_FRAMEBUFFER, scene.targets[0].framebuffer);
+    glViewport(0, 0, targetSize, targetSize);
+    glUseProgram(scene.programs[0]);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, scene.textures[0]);
+    glBindVertexArray(scene.vertexArrays[0]);
+}
+
+void deleteScene(const Scene& scene) {
+    glUseProgram(0);
+    glBindVertexArray(0);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    invalidateGLState();
+    for (int i = 0; i < 2; ++i) {
+        glrDelete(GLR_PROGRAM, scene.programs[i]);
+        glrDelete(GLR_TEXTURE, scene.textures[i]);
+        glrDelete(GLR_VERTEX_ARRAY, scene.vertexArrays[i]);
+        glrReleaseRenderTarget(scene.targets[i]);
+    }
+    glrDelete(GLR_BUFFER, scene.buffer);
+}
+
+// Times config.warmup + config.reps calls of rep(), each followed by glFinish,
+// and keeps the last config.reps as nanoseconds per operation.
+BenchResult measure(const BenchConfig& config, const char* name, const char* what, int ops, uint64_t bytesPerOp,
+                    const char* baseline, const std::function<void()>& rep) {
+    BenchResult result = { name, what, ops, bytesPerOp, baseline, false, {}, {} };
+    for (int i = 0; i < config.warmup + config.reps; ++i) {
+        double start = nowNs();
+        rep();
+        glFinish();
+        double ns = nowNs() - start;
+        if (i >= config.warmup) {
+            result.nsPerOp.push_back(ns / ops);
+        }
+    }
+    result.summary = summarizeRobust(result.nsPerOp);
+    return result;
+}
+
+void benchDraw(const BenchConfig& config, std::vector<BenchResult>* results) {
+    Scene scene;
+    createScene(&scene);
+    bindScene(scene);
+    results->push_back(measure(config, "draw", "glDrawArrays of one small triangle", drawsPerRep, 0, nullptr, [&] {
+        for (int i = 0; i < drawsPerRep; ++i) {
+            glDrawArrays(GL_TRIANGLES, 0, 3);
+        }
+    }));
+    deleteScene(scene);
+}
+
+// Each operation changes one piece of state between two values and draws, so
+// the driver has to validate the change every time.
+void benchState(const BenchConfig& config, std::vector<BenchResult>* results) {
+    Scene scene;
+    createScene(&scene);
+    bindScene(scene);
+    results->push_back(measure(config, "state/program", "glUseProgram between two programs, then a draw",
+                               drawsPerRep, 0, "draw", [&] {
+        for (int i = 0; i < drawsPerRep; ++i) {
+            glUseProgram(scene.programs[i & 1]);
+            glDrawArrays(GL_TRIANGLES, 0, 3);
+        }
+    }));
+    glUseProgram(scene.programs[0]);
+
+    results->push_back(measure(config, "state/texture", "glBindTexture between two textures, then a draw",
+                               drawsPerRep, 0, "draw", [&] {
+        for (int i = 0; i < drawsPerRep; ++i) {
+            glBindTexture(GL_TEXTURE_2D, scene.textures[i & 1]);
+            glDrawArrays(GL_TRIANGLES, 0, 3);
+        }
+    }));
+    glBindTexture(GL_TEXTURE_2D, scene.textures[0]);
+
+    results->push_back(measure(config, "state/vao", "glBindVertexArray between two vertex arrays, then a draw",
+                               drawsPerRep, 0, "draw", [&] {
+        for (int i = 0; i < drawsPerRep; ++i) {
+            glBindVertexArray(scene.vertexArrays[i & 1]);
+            glDrawArrays(GL_TRIANGLES, 0, 3);
+        }
+    }));
+    glBindVertexArray(scene.vertexArrays[0]);
+
+    results->push_back(measure(config, "state/texparam", "GL_TEXTURE_MIN_FILTER between nearest and linear, then a draw",
+                               drawsPerRep, 0, "draw", [&] {
+        for (int i = 0; i < drawsPerRep; ++i) {
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, (i & 1) ? GL_LINEAR : GL_NEAREST);
+            glDrawArrays(GL_TRIANGLES, 0, 3);
+        }
+    }));
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    deleteScene(scene);
+}
+
+void benchFramebuffer(const BenchConfig& config, std::vector<BenchResult>* results) {
+    Scene scene;
+    createScene(&scene);
+    bindScene(scene);
+    results->push_back(measure(config, "fbo/switch", "glBindFramebuffer between two framebuffers, then a draw",
+                               drawsPerRep, 0, "draw", [&] {
+        for (int i = 0; i < drawsPerRep; ++i) {
+            glBindFramebuffer(GL_FRAMEBUFFER, scene.targets[i & 1].framebuffer);
+            glDrawArrays(GL_TRIANGLES, 0, 3);
+        }
+    }));
+    deleteScene(scene);
+}
+
+// Each operation replaces uploadBytes of vertex data and draws the triangle at
+// its start, so the upload can't be skipped or deferred past the repetition.
+void benchUpload(const BenchConfig& config, std::vector<BenchResult>* results) {
+    Scene scene;
+    createScene(&scene);
+    bindScene(scene);
+    uint64_t bytes = config.uploadBytes;
+    std::vector<uint8_t> data(bytes);
+    for (size_t i = 0; i < data.size(); ++i) {
+        data[i] = uint8_t(i * 31);
+    }
+    memcpy(data.data(), triangle, sizeof(triangle));
+
+    GLuint buffer = glrCreate(GLR_BUFFER, "bench upload");
+    GLuint vertexArray = glrCreate(GLR_VERTEX_ARRAY, "bench upload");
+    glBindVertexArray(vertexArray);
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+    glBufferData(GL_ARRAY_BUFFER, bytes, nullptr, GL_STREAM_DRAW);
+    glrSetBytes(GLR_BUFFER, buffer, bytes);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, nullptr);
+
+    results->push_back(measure(config, "upload/bufferdata", "glBufferData of the whole buffer, then a draw from it",
+                               uploadsPerRep, bytes, nullptr, [&] {
+        for (int i = 0; i < uploadsPerRep; ++i) {
+            glBufferData(GL_ARRAY_BUFFER, bytes, data.data(), GL_STREAM_DRAW);
+            glDrawArrays(GL_TRIANGLES, 0, 3);
+        }
+    }));
+    results->push_back(measure(config, "upload/buffersubdata", "glBufferSubData of the whole buffer, then a draw from it",
+                               uploadsPerRep, bytes, nullptr, [&] {
+        for (int i = 0; i < uploadsPerRep; ++i) {
+            glBufferSubData(GL_ARRAY_BUFFER, 0, bytes, data.data());
+            glDrawArrays(GL_TRIANGLES, 0, 3);
+        }
+    }));
+
+    // Segments hold whole vertices, so a draw's first vertex finds its segment.
+    const size_t vertexSize = 2 * sizeof(float);
+    GLuint ringArray = glrCreate(GLR_VERTEX_ARRAY, "bench persistent");
+    glBindVertexArray(ringArray);
+    {
+        StreamRing ring(GL_ARRAY_BUFFER, (bytes + vertexSize - 1) / vertexSize * vertexSize);
+        // StreamRing binds its buffer through the state cache.
+        invalidateGLState();
+        glBindBuffer(GL_ARRAY_BUFFER, ring.buffer());
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, nullptr);
+        results->push_back(measure(config, "upload/persistent", "memcpy into a persistently mapped ring, then a draw from it",
+                                   uploadsPerRep, bytes, nullptr, [&] {
+            for (int i = 0; i < uploadsPerRep; ++i) {
+                memcpy(ring.beginSegment(), data.data(), bytes);
+                ring.segmentWritten(bytes);
+                glDrawArrays(GL_TRIANGLES, GLint(ring.segmentOffset() / vertexSize), 3);
+                ring.endSegment();
+            }
+        }));
+        glBindVertexArray(0);
+    }
+
+    glrDelete(GLR_VERTEX_ARRAY, ringArray);
+    glrDelete(GLR_VERTEX_ARRAY, vertexArray);
+    glrDelete(GLR_BUFFER, buffer);
+    deleteScene(scene);
+}
+
+// Each operation draws and reads the whole target back. Synchronous reads wait
+// for the draw each time; reads into the ring only wait when it's full, and the
+// pixels reach the CPU later, which the latency result measures.
+void benchReadback(const BenchConfig& config, std::vector<BenchResult>* results) {
+    Scene scene;
+    createScene(&scene);
+    int size = config.readbackSize;
+    GLRenderTarget target = glrAcquireRenderTarget(GL_RGBA8, GL_NONE, size, size, "bench readback");
+    invalidateGLState();
+    bindScene(scene);
+    glBindFramebuffer(GL_FRAMEBUFFER, target.framebuffer);
+    glViewport(0, 0, size, size);
+    uint64_t bytes = uint64_t(size) * size * 4;
+    std::vector<uint8_t> pixels(bytes);
+
+    results->push_back(measure(config, "readback/sync", "a draw, then glReadPixels into client memory",
+                               readbacksPerRep, bytes, nullptr, [&] {
+        for (int i = 0; i < readbacksPerRep; ++i) {
+            glDrawArrays(GL_TRIANGLES, 0, 3);
+            glReadPixels(0, 0, size, size, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+        }
+    }));
+
+    double submitted[readbacksPerRep];
+    double latencyNs = 0.0;
+    std::vector<double> latencies;
+    {
+        ReadbackRing ring(4, bytes, [&](uint32_t tag, const void* data, size_t) {
+            memcpy(pixels.data(), data, bytes);
+            latencyNs += nowNs() - submitted[tag];
+        });
+        results->push_back(measure(config, "readback/pbo", "a draw, then glReadPixels into a ring of 4 pixel pack buffers",
+                                   readbacksPerRep, bytes, nullptr, [&] {
+            latencyNs = 0.0;
+            for (int i = 0; i < readbacksPerRep; ++i) {
+                glDrawArrays(GL_TRIANGLES, 0, 3);
+                submitted[i] = nowNs();
+                ring.read(0, 0, size, size, GL_RGBA, GL_UNSIGNED_BYTE, i);
+                ring.poll();
+            }
+            ring.drain();
+            latencies.push_back(latencyNs / readbacksPerRep);
+        }));
+    }
+    latencies.erase(latencies.begin(), latencies.begin() + config.warmup);
+    BenchResult latency = { "readback/pbo-latency", "from queueing a ring read to its pixels reaching the CPU",
+                            readbacksPerRep, bytes, nullptr, true, latencies, summarizeRobust(latencies) };
+    results->push_back(latency);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    invalidateGLState();
+    glrReleaseRenderTarget(target);
+    deleteScene(scene);
+}
+
+// Plain GL rather than the registry, whose bookkeeping would be part of the
+// time. A counter in the source keeps the driver's shader cache from answering.
+void benchCompile(const BenchConfig& config, std::vector<BenchResult>* results) {
+    static int serial = 0;
+    results->push_back(measure(config, "compile/link", "compile a vertex and fragment shader and link them",
+                               compilesPerRep, 0, nullptr, [&] {
+        for (int i = 0; i < compilesPerRep; ++i) {
+            std::string fs = fragmentShaders[1];
+            fs += "// " + std::to_string(getpid()) + " " + std::to_string(serial++) + "\n";
+            GLuint program = glCreateProgram();
+            GLuint shaders[2] = { (GLuint)compileShader(GL_VERTEX_SHADER, vertexShader),
+                                  (GLuint)compileShader(GL_FRAGMENT_SHADER, fs.c_str()) };
+            glAttachShader(program, shaders[0]);
+            glAttachShader(program, shaders[1]);
+            glBindAttribLocation(program, 0, "p");
+            linkProgram(program);
+            glDeleteShader(shaders[0]);
+            glDeleteShader(shaders[1]);
+            glDeleteProgram(program);
+        }
+    }));
+}
+
+bool selected(const char* only, const char* group) {
+    if (only == nullptr) {
+        return true;
+    }
+    size_t length = strlen(group);
+    for (const char* p = only; *p; ) {
+        const char* end = strchr(p, ',');
+        size_t n = end ? size_t(end - p) : strlen(p);
+        if (n == length && !strncmp(p, group, n)) {
+            return true;
+        }
+        p += end ? n + 1 : n;
+    }
+    return false;
+}
+
+}  // namespace
+
+std::vector<BenchResult> runBenchmarks(const BenchConfig& config, const char* only) {
+    typedef void (*Group)(const BenchConfig&, std::vector<BenchResult>*);
+    static const Group groups[] = { benchDraw, benchState, benchFramebuffer, benchUpload, benchReadback, benchCompile };
+    std::vector<BenchResult> results;
+    invalidateGLState();
+    for (int i = 0; i < numBenchGroups; ++i) {
+        if (selected(only, benchGroups[i])) {
+            groups[i](config, &results);
+            checkError(benchGroups[i]);
+        }
+    }
+    return results;
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+#include "../common/stats.h"
+
+//-----------------------------------------------------------------------------------
+// Driver overhead microbenchmarks
+//
+// Each group sets up its objects once and then times repetitions of a fixed
+// number of operations. A repetition ends in glFinish, so the GPU work it queued
+// counts towards it and none spills into the next one; its time divided by its
+// operations is one sample. The first repetitions warm up and are dropped: they
+// pay for the driver compiling shader variants for the state in use and for
+// first-touch page faults.
+//
+// Everything draws tiny triangles into a small framebuffer object, so on
+// llvmpipe as on hardware the samples are dominated by what the driver does per
+// call rather than by rasterization.
+//-----------------------------------------------------------------------------------
+
+struct BenchConfig {
+    int warmup = 3;
+    int reps = 15;
+    uint64_t uploadBytes = 1 << 20;   // per upload operation, at least minUploadBytes
+    int readbackSize = 256;           // square, RGBA8
+};
+
+struct BenchResult {
+    const char* name;
+    const char* what;
+    int ops;                    // per repetition
+    uint64_t bytesPerOp;        // 0 unless the benchmark moves data
+    const char* baseline;       // a benchmark whose median this one adds to, or nullptr
+    bool latency;               // the samples are how long an operation took to complete, not its cost
+    std::vector<double> nsPerOp;
+    RobustSummary summary;
+};
+
+// The upload group draws a triangle out of every upload, so it needs room for one.
+extern const uint64_t minUploadBytes;
+
+// The groups, in the order they run.
+extern const char* const benchGroups[];
+extern const int numBenchGroups;
+
+// Runs the groups whose names are in the comma separated list only, or every
+// group when only is nullptr. Needs a context current with the GL functions
+// loaded. Calls checkError() after each group.
+std::vector<BenchResult> runBenchmarks(const BenchConfig& config, const char* only);
@@ -0,0 +1,200 @@
+// build: g++ -O2 *.cpp ../common/*.cpp -o main -lX11 -lGL -lEGL -lpthread
+// run: ./main --backend=egl-surfaceless
+// some groups, more repetitions: ./main --backend=egl-surfaceless --only=state,upload --reps=50
+// compare two drivers: ./main --backend=egl-surfaceless --json=/tmp/llvmpipe.json
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../common/gl_context.h"
+#include "../common/gl_debug.h"
+#include "../common/gl_loader.h"
+#include "../common/gl_resources.h"
+#include "../common/stage_timer.h"
+#include "benchmarks.h"
+
+//-----------------------------------------------------------------------------------
+// gl-bench
+//
+// Measures what the driver charges per call: draw submission, state changes,
+// buffer uploads, readbacks, framebuffer switches and shader compiles. Each
+// result is the median time per operation over the repetitions, with its median
+// absolute deviation and a 95% confidence interval for the median, so two runs
+// whose intervals don't overlap differ by more than noise. --json writes every
+// sample along with the renderer and version, for comparing Mesa versions or
+// llvmpipe against hardware.
+//-----------------------------------------------------------------------------------
+
+namespace {
+
+const BenchResult* find(const std::vector<BenchResult>& results, const char* name) {
+    for (const BenchResult& result : results) {
+        if (!strcmp(result.name, name)) {
+            return &result;
+        }
+    }
+    return nullptr;
+}
+
+// Times per operation range from nanoseconds for a draw to milliseconds for a link.
+void printTime(double ns) {
+    if (ns >= 1e6) {
+        printf("%9.3f ms", ns / 1e6);
+    } else if (ns >= 1e3) {
+        printf("%9.3f us", ns / 1e3);
+    } else {
+        printf("%9.1f ns", ns);
+    }
+}
+
+void printResults(const std::vector<BenchResult>& results) {
+    for (const BenchResult& result : results) {
+        const RobustSummary& s = result.summary;
+        printf("%-22s:", result.name);
+        printTime(s.median);
+        printf(" +-");
+        printTime(s.mad);
+        printf("  95%% CI");
+        printTime(s.ciLow);
+        printf(" -");
+        printTime(s.ciHigh);
+        if (result.latency || s.median <= 0.0) {
+            printf("%15s", "");
+        } else if (result.bytesPerOp > 0) {
+            printf("  %8.1f MB/s", result.bytesPerOp / s.median * 1e3);
+        } else {
+            printf("  %8.0f op/s", 1e9 / s.median);
+        }
+        const BenchResult* baseline = result.baseline ? find(results, result.baseline) : nullptr;
+        if (baseline) {
+            printf("  ");
+            printTime(s.median - baseline->summary.median);
+            printf(" over %s", baseline->name);
+        }
+        printf("\n");
+    }
+}
+
+void writeJSON(FILE* f, const std::vector<BenchResult>& results, const BenchConfig& config, const char* backend) {
+    fprintf(f, "{\"tool\":\"gl-bench\",\"backend\":");
+    writeJSONString(f, backend);
+    fprintf(f, ",\"vendor\":");
+    writeJSONString(f, (const char*)glGetString(GL_VENDOR));
+    fprintf(f, ",\"renderer\":");
+    writeJSONString(f, (const char*)glGetString(GL_RENDERER));
+    fprintf(f, ",\"version\":");
+    writeJSONString(f, (const char*)glGetString(GL_VERSION));
+    fprintf(f, ",\"warmup\":%d,\"reps\":%d,\"benchmarks\":[", config.warmup, config.reps);
+    for (size_t i = 0; i < results.size(); ++i) {
+        const BenchResult& result = results[i];
+        const RobustSummary& s = result.summary;
+        fprintf(f, "%s\n  {\"name\":", i ? "," : "");
+        writeJSONString(f, result.name);
+        fprintf(f, ",\"what\":");
+        writeJSONString(f, result.what);
+        fprintf(f, ",\"ops_per_rep\":%d,\"bytes_per_op\":%llu,\"latency\":%s,\"baseline\":", result.ops,
+                (unsigned long long)result.bytesPerOp, result.latency ? "true" : "false");
+        if (result.baseline) {
+            writeJSONString(f, result.baseline);
+        } else {
+            fprintf(f, "null");
+        }
+        fprintf(f, ",\"unit\":\"ns/op\",\"median\":%.3f,\"mad\":%.3f,\"ci95\":[%.3f,%.3f],\"min\":%.3f,\"max\":%.3f,"
+                "\"samples\":[", s.median, s.mad, s.ciLow, s.ciHigh, s.min, s.max);
+        for (size_t n = 0; n < result.nsPerOp.size(); ++n) {
+            fprintf(f, "%s%.3f", n ? "," : "", result.nsPerOp[n]);
+        }
+        fprintf(f, "]}");
+    }
+    fprintf(f, "\n]}\n");
+}
+
+}  // namespace
+
+int main(int argc, const char* argv[])
+{
+    const char* jsonPath = nullptr;
+    const char* only = nullptr;
+    BenchConfig config;
+    GLErrorMode errorMode = GL_ERRORS_RELEASE;
+    GLContextOptions options;
+    options.title = "gl-bench";
+    for (int i = 1; i < argc; ++i) {
+        if (!strncmp(argv[i], "--backend=", 10) && parseBackend(argv[i] + 10, &options.backend)) {
+            continue;
+        }
+        if (!strncmp(argv[i], "--warmup=", 9) && atoi(argv[i] + 9) >= 0) {
+            config.warmup = atoi(argv[i] + 9);
+            continue;
+        }
+        if (!strncmp(argv[i], "--reps=", 7) && atoi(argv[i] + 7) > 0) {
+            config.reps = atoi(argv[i] + 7);
+            continue;
+        }
+        if (!strncmp(argv[i], "--only=", 7) && argv[i][7]) {
+            only = argv[i] + 7;
+            continue;
+        }
+        if (!strncmp(argv[i], "--upload-size=", 14) && atoll(argv[i] + 14) >= (long long)minUploadBytes) {
+            config.uploadBytes = atoll(argv[i] + 14);
+            continue;
+        }
+        if (!strncmp(argv[i], "--readback-size=", 16) && atoi(argv[i] + 16) > 0) {
+            config.readbackSize = atoi(argv[i] + 16);
+            continue;
+        }
+        if (!strncmp(argv[i], "--json=", 7) && argv[i][7]) {
+            jsonPath = argv[i] + 7;
+            continue;
+        }
+        if (!strncmp(argv[i], "--gl-errors=", 12) && parseGLErrorMode(argv[i] + 12, &errorMode)) {
+            continue;
+        }
+        printf("usage: %s [--backend=glx|egl-pbuffer|egl-surfaceless] [--warmup=N] [--reps=N] [--only=GROUP,...]\n"
+               "       [--upload-size=BYTES] [--readback-size=PIXELS] [--json=FILE|-] [--gl-errors=poll|strict|release]\n"
+               "groups:", argv[0]);
+        for (int g = 0; g < numBenchGroups; ++g) {
+            printf(" %s", benchGroups[g]);
+        }
+        printf("\n");
+        return 1;
+    }
+
+    // 1. Context and functions. Everything is resolved up front so no
+    // benchmark pays for a lookup.
+    GLContext* ctx = createGLContext(options);
+    init_gl_functions(ctx, GL_LOAD_EAGER);
+    setGLErrorMode(errorMode);
+    printf("version : %s\n", glGetString(GL_VERSION));
+    printf("renderer: %s\n", glGetString(GL_RENDERER));
+    printf("config  : %d warm-up and %d timed repetitions, %llu byte uploads, %dx%d readbacks\n", config.warmup,
+           config.reps, (unsigned long long)config.uploadBytes, config.readbackSize, config.readbackSize);
+
+    // 2. Run and report. Times are per operation: median +- MAD, then the
+    // median's 95% confidence interval.
+    std::vector<BenchResult> results = runBenchmarks(config, only);
+    if (results.empty()) {
+        printf("No benchmark group matches %s\n", only);
+        return 1;
+    }
+    printResults(results);
+
+    if (jsonPath) {
+        FILE* f = strcmp(jsonPath, "-") ? fopen(jsonPath, "w") : stdout;
+        if (f == nullptr) {
+            printf("Cannot write %s\n", jsonPath);
+            return 1;
+        }
+        writeJSON(f, results, config, backendToString(options.backend));
+        if (f != stdout) {
+            fclose(f);
+        }
+    }
+
+    // 3. Cleanup
+    glrTrimPools();
+    printGLResourceReport();
+    destroyGLContext(ctx);
+    return 0;
+}
@@ -0,0 +1,87 @@
+// build: g++ *.cpp ../common/*.cpp -o main -lX11 -lGL -lEGL -lpthread
+// record a trace: ../textured-triangle/main --backend=egl-surfaceless --bench=300 --trace=/tmp/triangle.gltrace
+// replay it: ./main /tmp/triangle.gltrace --backend=egl-surfaceless
+// replay at the recorded pace: ./main /tmp/triangle.gltrace --timing=recorded
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../common/gl_context.h"
+#include "../common/gl_loader.h"
+#include "../common/stats.h"
+#include "replay.h"
+
+int main(int argc, const char* argv[])
+{
+    const char* path = nullptr;
+    bool backendSet = false;
+    GLContextOptions options;
+    GLReplayTiming timing = REPLAY_FAST;
+    for (int i = 1; i < argc; ++i) {
+        if (!strncmp(argv[i], "--backend=", 10) && parseBackend(argv[i] + 10, &options.backend)) {
+            backendSet = true;
+            continue;
+        }
+        if (!strcmp(argv[i], "--timing=fast")) {
+            timing = REPLAY_FAST;
+            continue;
+        }
+        if (!strcmp(argv[i], "--timing=recorded")) {
+            timing = REPLAY_RECORDED;
+            continue;
+        }
+        if (argv[i][0] != '-' && path == nullptr) {
+            path = argv[i];
+            continue;
+        }
+        path = nullptr;
+        break;
+    }
+    if (path == nullptr) {
+        printf("usage: %s TRACE [--backend=glx|egl-pbuffer|egl-surfaceless] [--timing=fast|recorded]\n", argv[0]);
+        return 1;
+    }
+
+    GLTraceFile trace = openGLTrace(path);
+    printf("trace   : %s, %llu records, %.1f MB, recorded on %s %dx%d",
+           path, (unsigned long long)trace.header.records, trace.header.dataSize / 1e6,
+           backendToString(GLBackend(trace.header.backend)), trace.header.width, trace.header.height);
+    if (trace.header.dropped) {
+        printf(", %llu records dropped", (unsigned long long)trace.header.dropped);
+    }
+    printf("\n");
+
+    // The recorded size, so the default framebuffer matches what the calls expect.
+    if (!backendSet) {
+        options.backend = GLBackend(trace.header.backend);
+    }
+    options.width = trace.header.width;
+    options.height = trace.header.height;
+    options.title = "gl-replay";
+    GLContext* ctx = createGLContext(options);
+    printf("context : %s %.3f ms\n", backendToString(options.backend), getContextCreationMs(ctx));
+
+    // Resolve everything now so none of it lands inside the timed replay.
+    init_gl_functions(ctx, GL_LOAD_EAGER);
+
+    GLReplayStats stats = replayGLTrace(trace, ctx, timing);
+    printf("replay  : %llu calls, %llu frames, %d contexts in %.3f ms (%.1f ns per call, %.3f Mcalls/s)%s\n",
+           (unsigned long long)stats.calls, (unsigned long long)stats.frames, stats.contexts, stats.ms,
+           stats.calls ? stats.ms * 1e6 / stats.calls : 0.0, stats.calls / (stats.ms * 1e3),
+           timing == REPLAY_RECORDED ? " at recorded timing" : "");
+    if (stats.mapWriteBytes) {
+        printf("mapped  : %.1f MB written through mappings\n", stats.mapWriteBytes / 1e6);
+    }
+    if (stats.frames > 1) {
+        // The first frame includes everything recorded before the first swap.
+        stats.frameMs.erase(stats.frameMs.begin());
+        SampleSummary summary = summarize(stats.frameMs);
+        printf("frames  : avg %.3f ms, p50 %.3f ms, p95 %.3f ms, p99 %.3f ms\n",
+               summary.mean, summary.p50, summary.p95, summary.p99);
+    }
+
+    destroyGLContext(ctx);
+    closeGLTrace(trace);
+    return 0;
+}
@@ -0,0 +1,549 @@
+#include "replay.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <tuple>
+#include <unordered_map>
+
+#include "../common/gl_loader.h"
+
+namespace {
+
+enum GLFunctionIndex {
+#define GL_FUNCTION(type, name) GLFN_##name,
+#include "../common/gl_functions.inl"
+#undef GL_FUNCTION
+    GLFN_COUNT
+};
+
+const char* const functionNames[] = {
+#define GL_FUNCTION(type, name) #name,
+#include "../common/gl_functions.inl"
+#undef GL_FUNCTION
+};
+
+size_t align8(size_t n) {
+    return (n + 7) & ~size_t(7);
+}
+
+// Reads one record's arguments and blobs in the order they were written.
+// Arguments aren't aligned, so each is copied out.
+class RecordReader {
+public:
+    explicit RecordReader(const uint8_t* record) : p_(record), pos_(sizeof(GLTraceRecord)) {}
+
+    template <typename T> T get() {
+        T value;
+        memcpy(&value, p_ + pos_, sizeof(T));
+        pos_ += sizeof(T);
+        return value;
+    }
+
+    // The blob's bytes, or fallback when the call stored GL_TRACE_NO_BLOB.
+    const void* blob(const void* fallback, uint64_t* size = nullptr) {
+        uint64_t n = get<uint64_t>();
+        if (n == GL_TRACE_NO_BLOB) {
+            return fallback;
+        }
+        const void* data = p_ + pos_;
+        pos_ += align8(n);
+        if (size) {
+            *size = n;
+        }
+        return data;
+    }
+
+private:
+    const uint8_t* p_;
+    size_t pos_;
+};
+
+struct ReplayState {
+    std::unordered_map<uint64_t, GLsync> syncs;
+    std::unordered_map<uint64_t, uint8_t*> mappings;
+    std::vector<uint8_t> scratch;
+    const char* function;
+};
+
+ReplayState state;
+
+void* scratch(size_t size) {
+    if (state.scratch.size() < size) {
+        state.scratch.resize(size);
+    }
+    return state.scratch.data();
+}
+
+void checkNames(const GLuint* recorded, const GLuint* replayed, GLsizei n) {
+    for (GLsizei i = 0; i < n; ++i) {
+        if (recorded[i] != replayed[i]) {
+            printf("%s returned %u where the trace has %u. The replay can't reuse the recorded names.\n",
+                   state.function, replayed[i], recorded[i]);
+            exit(1);
+        }
+    }
+}
+
+GLsync replayedSync(GLsync recorded) {
+    auto it = state.syncs.find(uint64_t(uintptr_t(recorded)));
+    if (it == state.syncs.end()) {
+        printf("%s uses a sync the trace never created\n", state.function);
+        exit(1);
+    }
+    return it->second;
+}
+
+typedef void (*ReplayFunction)(RecordReader& r);
+
+// Calls with nothing but plain values and buffer offsets are issued as recorded.
+template <typename T> struct Generic;
+template <typename R, typename... Args> struct Generic<R (APIENTRYP)(Args...)> {
+    template <R (APIENTRYP* Slot)(Args...)>
+    static void replay(RecordReader& r) {
+        // A braced list reads the arguments left to right.
+        std::tuple<Args...> args{r.get<Args>()...};
+        std::apply(*Slot, args);
+    }
+};
+
+//-----------------------------------------------------------------------------------
+// Calls that carry data, write through pointers or use syncs and mappings
+//-----------------------------------------------------------------------------------
+
+template <void (APIENTRYP* Gen)(GLsizei, GLuint*)>
+void replayGen(RecordReader& r) {
+    GLsizei n = r.get<GLsizei>();
+    r.get<GLuint*>();
+    const GLuint* recorded = (const GLuint*)r.blob(nullptr);
+    std::vector<GLuint> names(n);
+    (*Gen)(n, names.data());
+    checkNames(recorded, names.data(), n);
+}
+
+template <void (APIENTRYP* Delete)(GLsizei, const GLuint*)>
+void replayDelete(RecordReader& r) {
+    GLsizei n = r.get<GLsizei>();
+    r.get<const GLuint*>();
+    (*Delete)(n, (const GLuint*)r.blob(nullptr));
+}
+
+template <GLuint (APIENTRYP* Create)()>
+void replayCreateProgram(RecordReader& r) {
+    GLuint recorded = r.get<GLuint>();
+    GLuint name = (*Create)();
+    checkNames(&recorded, &name, 1);
+}
+
+void replayCreateShader(RecordReader& r) {
+    GLenum type = r.get<GLenum>();
+    GLuint recorded = r.get<GLuint>();
+    GLuint name = glCreateShader(type);
+    checkNames(&recorded, &name, 1);
+}
+
+void replayTexImage2D(RecordReader& r) {
+    GLenum target = r.get<GLenum>();
+    GLint level = r.get<GLint>();
+    GLint internalformat = r.get<GLint>();
+    GLsizei width = r.get<GLsizei>();
+    GLsizei height = r.get<GLsizei>();
+    GLint border = r.get<GLint>();
+    GLenum format = r.get<GLenum>();
+    GLenum type = r.get<GLenum>();
+    const void* pixels = r.get<const void*>();
+    glTexImage2D(target, level, internalformat, width, height, border, format, type, r.blob(pixels));
+}
+
+void replayTexSubImage2D(RecordReader& r) {
+    GLenum target = r.get<GLenum>();
+    GLint level = r.get<GLint>();
+    GLint x = r.get<GLint>();
+    GLint y = r.get<GLint>();
+    GLsizei width = r.get<GLsizei>();
+    GLsizei height = r.get<GLsizei>();
+    GLenum format = r.get<GLenum>();
+    GLenum type = r.get<GLenum>();
+    const void* pixels = r.get<const void*>();
+    glTexSubImage2D(target, level, x, y, width, height, format, type, r.blob(pixels));
+}
+
+void replayCompressedTexSubImage2D(RecordReader& r) {
+    GLenum target = r.get<GLenum>();
+    GLint level = r.get<GLint>();
+    GLint x = r.get<GLint>();
+    GLint y = r.get<GLint>();
+    GLsizei width = r.get<GLsizei>();
+    GLsizei height = r.get<GLsizei>();
+    GLenum format = r.get<GLenum>();
+    GLsizei imageSize = r.get<GLsizei>();
+    const void* data = r.get<const void*>();
+    glCompressedTexSubImage2D(target, level, x, y, width, height, format, imageSize, r.blob(data));
+}
+
+void replayReadPixels(RecordReader& r) {
+    GLint x = r.get<GLint>();
+    GLint y = r.get<GLint>();
+    GLsizei width = r.get<GLsizei>();
+    GLsizei height = r.get<GLsizei>();
+    GLenum format = r.get<GLenum>();
+    GLenum type = r.get<GLenum>();
+    void* pixels = r.get<void*>();
+    uint64_t size = r.get<uint64_t>();
+    glReadPixels(x, y, width, height, format, type, size == GL_TRACE_NO_BLOB ? pixels : scratch(size));
+}
+
+template <void (APIENTRYP* Store)(GLenum, GLsizeiptr, const void*, GLbitfield)>
+void replayBufferData(RecordReader& r) {
+    GLenum target = r.get<GLenum>();
+    GLsizeiptr size = r.get<GLsizeiptr>();
+    const void* data = r.get<const void*>();
+    GLbitfield flags = r.get<GLbitfield>();
+    (*Store)(target, size, r.blob(data), flags);
+}
+
+void replayBufferSubData(RecordReader& r) {
+    GLenum target = r.get<GLenum>();
+    GLintptr offset = r.get<GLintptr>();
+    GLsizeiptr size = r.get<GLsizeiptr>();
+    const void* data = r.get<const void*>();
+    glBufferSubData(target, offset, size, r.blob(data));
+}
+
+void replayMapBufferRange(RecordReader& r) {
+    GLenum target = r.get<GLenum>();
+    GLintptr offset = r.get<GLintptr>();
+    GLsizeiptr length = r.get<GLsizeiptr>();
+    GLbitfield access = r.get<GLbitfield>();
+    uint64_t recorded = r.get<uint64_t>();
+    state.mappings[recorded] = (uint8_t*)glMapBufferRange(target, offset, length, access);
+}
+
+void replayMultiDrawArraysIndirect(RecordReader& r) {
+    GLenum mode = r.get<GLenum>();
+    const void* indirect = r.get<const void*>();
+    GLsizei drawcount = r.get<GLsizei>();
+    GLsizei stride = r.get<GLsizei>();
+    glMultiDrawArraysIndirect(mode, r.blob(indirect), drawcount, stride);
+}
+
+void replayShaderSource(RecordReader& r) {
+    GLuint shader = r.get<GLuint>();
+    GLsizei count = r.get<GLsizei>();
+    r.get<const GLchar* const*>();
+    r.get<const GLint*>();
+    std::vector<const GLchar*> strings(count);
+    std::vector<GLint> lengths(count);
+    for (GLsizei i = 0; i < count; ++i) {
+        uint64_t length = 0;
+        strings[i] = (const GLchar*)r.blob(nullptr, &length);
+        lengths[i] = GLint(length);
+    }
+    glShaderSource(shader, count, strings.data(), lengths.data());
+}
+
+void replayBindAttribLocation(RecordReader& r) {
+    GLuint program = r.get<GLuint>();
+    GLuint index = r.get<GLuint>();
+    r.get<const GLchar*>();
+    glBindAttribLocation(program, index, (const GLchar*)r.blob(nullptr));
+}
+
+void replayProgramBinary(RecordReader& r) {
+    GLuint program = r.get<GLuint>();
+    GLenum format = r.get<GLenum>();
+    r.get<const void*>();
+    GLsizei length = r.get<GLsizei>();
+    glProgramBinary(program, format, r.blob(nullptr), length);
+}
+
+template <typename T, typename Object, void (APIENTRYP* Set)(Object, GLenum, const T*)>
+void replayParameterv(RecordReader& r) {
+    Object object = r.get<Object>();
+    GLenum pname = r.get<GLenum>();
+    r.get<const T*>();
+    (*Set)(object, pname, (const T*)r.blob(nullptr));
+}
+
+// Queries only need somewhere to write, big enough for what pname returns. The
+// format lists are as long as the driver says; no other query writes more than
+// 16 values.
+size_t queryValueCount(GLenum pname) {
+    GLint count = 16;
+    if (pname == GL_COMPRESSED_TEXTURE_FORMATS) {
+        glGetIntegerv(GL_NUM_COMPRESSED_TEXTURE_FORMATS, &count);
+    } else if (pname == GL_PROGRAM_BINARY_FORMATS) {
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &count);
+    }
+    return std::max(count, 16);
+}
+
+template <typename T, typename Object, void (APIENTRYP* Get)(Object, GLenum, T*)>
+void replayGetv(RecordReader& r) {
+    Object object = r.get<Object>();
+    GLenum pname = r.get<GLenum>();
+    r.get<T*>();
+    (*Get)(object, pname, (T*)scratch(queryValueCount(pname) * sizeof(T)));
+}
+
+void replayGetIntegerv(RecordReader& r) {
+    GLenum pname = r.get<GLenum>();
+    r.get<GLint*>();
+    glGetIntegerv(pname, (GLint*)scratch(queryValueCount(pname) * sizeof(GLint)));
+}
+
+void replayGetInteger64v(RecordReader& r) {
+    GLenum pname = r.get<GLenum>();
+    r.get<GLint64*>();
+    glGetInteger64v(pname, (GLint64*)scratch(queryValueCount(pname) * sizeof(GLint64)));
+}
+
+template <void (APIENTRYP* GetLog)(GLuint, GLsizei, GLsizei*, GLchar*)>
+void replayGetInfoLog(RecordReader& r) {
+    GLuint object = r.get<GLuint>();
+    GLsizei bufSize = r.get<GLsizei>();
+    GLsizei length;
+    (*GetLog)(object, bufSize, &length, (GLchar*)scratch(bufSize));
+}
+
+void replayGetProgramBinary(RecordReader& r) {
+    GLuint program = r.get<GLuint>();
+    GLsizei bufSize = r.get<GLsizei>();
+    GLsizei length;
+    GLenum format;
+    glGetProgramBinary(program, bufSize, &length, &format, scratch(bufSize));
+}
+
+void replayFenceSync(RecordReader& r) {
+    GLenum condition = r.get<GLenum>();
+    GLbitfield flags = r.get<GLbitfield>();
+    uint64_t recorded = r.get<uint64_t>();
+    state.syncs[recorded] = glFenceSync(condition, flags);
+}
+
+void replayClientWaitSync(RecordReader& r) {
+    GLsync sync = r.get<GLsync>();
+    GLbitfield flags = r.get<GLbitfield>();
+    GLuint64 timeout = r.get<GLuint64>();
+    glClientWaitSync(replayedSync(sync), flags, timeout);
+}
+
+void replayWaitSync(RecordReader& r) {
+    GLsync sync = r.get<GLsync>();
+    GLbitfield flags = r.get<GLbitfield>();
+    GLuint64 timeout = r.get<GLuint64>();
+    glWaitSync(replayedSync(sync), flags, timeout);
+}
+
+void replayDeleteSync(RecordReader& r) {
+    GLsync sync = r.get<GLsync>();
+    if (sync) {
+        glDeleteSync(replayedSync(sync));
+        state.syncs.erase(uint64_t(uintptr_t(sync)));
+    }
+}
+
+// The recorded callback belongs to the recorded process. Messages go to the
+// debug log instead, where nothing reads them.
+void replayDebugMessageCallback(RecordReader& r) {
+    r.get<GLDEBUGPROC>();
+    r.get<const void*>();
+    glDebugMessageCallback(nullptr, nullptr);
+}
+
+void replayDebugMessageControl(RecordReader& r) {
+    GLenum source = r.get<GLenum>();
+    GLenum type = r.get<GLenum>();
+    GLenum severity = r.get<GLenum>();
+    GLsizei count = r.get<GLsizei>();
+    r.get<const GLuint*>();
+    GLboolean enabled = r.get<GLboolean>();
+    glDebugMessageControl(source, type, severity, count, (const GLuint*)r.blob(nullptr), enabled);
+}
+
+struct ReplayFunctions {
+    ReplayFunction fn[GLFN_COUNT];
+
+    ReplayFunctions() {
+#define GL_FUNCTION(type, name) fn[GLFN_##name] = &Generic<type>::replay<&name>;
+#include "../common/gl_functions.inl"
+#undef GL_FUNCTION
+        fn[GLFN_glGenTextures] = replayGen<&glGenTextures>;
+        fn[GLFN_glGenVertexArrays] = replayGen<&glGenVertexArrays>;
+        fn[GLFN_glGenBuffers] = replayGen<&glGenBuffers>;
+        fn[GLFN_glGenSamplers] = replayGen<&glGenSamplers>;
+        fn[GLFN_glGenFramebuffers] = replayGen<&glGenFramebuffers>;
+        fn[GLFN_glGenQueries] = replayGen<&glGenQueries>;
+        fn[GLFN_glDeleteTextures] = replayDelete<&glDeleteTextures>;
+        fn[GLFN_glDeleteVertexArrays] = replayDelete<&glDeleteVertexArrays>;
+        fn[GLFN_glDeleteBuffers] = replayDelete<&glDeleteBuffers>;
+        fn[GLFN_glDeleteSamplers] = replayDelete<&glDeleteSamplers>;
+        fn[GLFN_glDeleteFramebuffers] = replayDelete<&glDeleteFramebuffers>;
+        fn[GLFN_glDeleteQueries] = replayDelete<&glDeleteQueries>;
+        fn[GLFN_glCreateProgram] = replayCreateProgram<&glCreateProgram>;
+        fn[GLFN_glCreateShader] = replayCreateShader;
+        fn[GLFN_glTexImage2D] = replayTexImage2D;
+        fn[GLFN_glTexSubImage2D] = replayTexSubImage2D;
+        fn[GLFN_glCompressedTexSubImage2D] = replayCompressedTexSubImage2D;
+        fn[GLFN_glReadPixels] = replayReadPixels;
+        fn[GLFN_glBufferData] = replayBufferData<&glBufferData>;
+        fn[GLFN_glBufferSubData] = replayBufferSubData;
+        fn[GLFN_glBufferStorage] = replayBufferData<&glBufferStorage>;
+        fn[GLFN_glMapBufferRange] = replayMapBufferRange;
+        fn[GLFN_glMultiDrawArraysIndirect] = replayMultiDrawArraysIndirect;
+        fn[GLFN_glShaderSource] = replayShaderSource;
+        fn[GLFN_glBindAttribLocation] = replayBindAttribLocation;
+        fn[GLFN_glProgramBinary] = replayProgramBinary;
+        fn[GLFN_glTexParameteriv] = replayParameterv<GLint, GLenum, &glTexParameteriv>;
+        fn[GLFN_glTexParameterfv] = replayParameterv<GLfloat, GLenum, &glTexParameterfv>;
+        fn[GLFN_glSamplerParameterfv] = replayParameterv<GLfloat, GLuint, &glSamplerParameterfv>;
+        fn[GLFN_glGetIntegerv] = replayGetIntegerv;
+        fn[GLFN_glGetInteger64v] = replayGetInteger64v;
+        fn[GLFN_glGetShaderiv] = replayGetv<GLint, GLuint, &glGetShaderiv>;
+        fn[GLFN_glGetProgramiv] = replayGetv<GLint, GLuint, &glGetProgramiv>;
+        fn[GLFN_glGetQueryObjectiv] = replayGetv<GLint, GLuint, &glGetQueryObjectiv>;
+        fn[GLFN_glGetQueryObjectui64v] = replayGetv<GLuint64, GLuint, &glGetQueryObjectui64v>;
+        fn[GLFN_glGetShaderInfoLog] = replayGetInfoLog<&glGetShaderInfoLog>;
+        fn[GLFN_glGetProgramInfoLog] = replayGetInfoLog<&glGetProgramInfoLog>;
+        fn[GLFN_glGetProgramBinary] = replayGetProgramBinary;
+        fn[GLFN_glFenceSync] = replayFenceSync;
+        fn[GLFN_glClientWaitSync] = replayClientWaitSync;
+        fn[GLFN_glWaitSync] = replayWaitSync;
+        fn[GLFN_glDeleteSync] = replayDeleteSync;
+        fn[GLFN_glDebugMessageCallback] = replayDebugMessageCallback;
+        fn[GLFN_glDebugMessageControl] = replayDebugMessageControl;
+    }
+};
+
+}  // namespace
+
+GLTraceFile openGLTrace(const char* path) {
+    GLTraceFile trace = {};
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        printf("Cannot open trace %s\n", path);
+        exit(1);
+    }
+    trace.mappingSize = st.st_size;
+    trace.mapping = trace.mappingSize >= sizeof(GLTraceHeader)
+                        ? mmap(nullptr, trace.mappingSize, PROT_READ, MAP_PRIVATE, fd, 0)
+                        : MAP_FAILED;
+    close(fd);
+    if (trace.mapping == MAP_FAILED) {
+        printf("Cannot map trace %s\n", path);
+        exit(1);
+    }
+    const uint8_t* file = (const uint8_t*)trace.mapping;
+    memcpy(&trace.header, file, sizeof(trace.header));
+    if (memcmp(trace.header.magic, "GLTRACE1", 8) != 0 ||
+        trace.header.dataOffset + trace.header.dataSize > trace.mappingSize) {
+        printf("%s is not a complete GL trace\n", path);
+        exit(1);
+    }
+    const uint8_t* names = file + sizeof(GLTraceHeader);
+    for (uint32_t i = 0; i < trace.header.numFunctions; ++i) {
+        uint16_t length;
+        memcpy(&length, names, sizeof(length));
+        trace.functions.emplace_back((const char*)names + sizeof(length), length);
+        names += sizeof(length) + length;
+    }
+    trace.data = file + trace.header.dataOffset;
+    return trace;
+}
+
+void closeGLTrace(GLTraceFile& trace) {
+    munmap((void*)trace.mapping, trace.mappingSize);
+    trace.mapping = nullptr;
+}
+
+GLReplayStats replayGLTrace(const GLTraceFile& trace, GLContext* ctx, GLReplayTiming timing) {
+    static ReplayFunctions replay;
+
+    // Trace opcodes to this build's table, by name.
+    std::vector<int> functions(trace.functions.size(), -1);
+    for (size_t i = 0; i < trace.functions.size(); ++i) {
+        for (int j = 0; j < GLFN_COUNT; ++j) {
+            if (trace.functions[i] == functionNames[j]) {
+                functions[i] = j;
+            }
+        }
+    }
+
+    GLReplayStats stats = {};
+    std::vector<GLContext*> contexts(1, ctx);
+    int current = 0;
+    state = ReplayState();
+
+    auto start = std::chrono::steady_clock::now();
+    auto lastSwap = start;
+    for (uint64_t offset = 0; offset < trace.header.dataSize;) {
+        GLTraceRecord record;
+        memcpy(&record, trace.data + offset, sizeof(record));
+        if (record.size < sizeof(record) || offset + record.size > trace.header.dataSize) {
+            printf("Trace record at %llu is corrupt\n", (unsigned long long)offset);
+            exit(1);
+        }
+        RecordReader r(trace.data + offset);
+        offset += record.size;
+
+        if (timing == REPLAY_RECORDED) {
+            std::this_thread::sleep_until(start + std::chrono::nanoseconds(record.timeNs));
+        }
+        if (record.thread != current) {
+            while (record.thread >= (int)contexts.size()) {
+                contexts.push_back(createSharedGLContext(ctx));
+            }
+            current = record.thread;
+            makeCurrent(contexts[current]);
+        }
+
+        if (record.opcode == GL_TRACE_SWAP) {
+            swapBuffers(contexts[current]);
+            auto now = std::chrono::steady_clock::now();
+            stats.frameMs.push_back(std::chrono::duration<double, std::milli>(now - lastSwap).count());
+            lastSwap = now;
+            ++stats.frames;
+        } else if (record.opcode == GL_TRACE_MAP_WRITE) {
+            uint64_t mapped = r.get<uint64_t>();
+            uint64_t at = r.get<uint64_t>();
+            uint64_t size = 0;
+            const void* bytes = r.blob(nullptr, &size);
+            auto it = state.mappings.find(mapped);
+            if (it == state.mappings.end() || it->second == nullptr) {
+                printf("Trace writes through a mapping it never made\n");
+                exit(1);
+            }
+            memcpy(it->second + at, bytes, size);
+            stats.mapWriteBytes += size;
+        } else {
+            int index = record.opcode < functions.size() ? functions[record.opcode] : -1;
+            if (index < 0) {
+                printf("Trace calls %s, which this build doesn't load\n",
+                       record.opcode < trace.functions.size() ? trace.functions[record.opcode].c_str() : "an unknown function");
+                exit(1);
+            }
+            state.function = functionNames[index];
+            replay.fn[index](r);
+            ++stats.calls;
+        }
+    }
+    glFinish();
+    stats.ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    stats.contexts = (int)contexts.size();
+
+    if (current != 0) {
+        makeCurrent(ctx);
+    }
+    for (size_t i = 1; i < contexts.size(); ++i) {
+        destroyGLContext(contexts[i]);
+    }
+    return stats;
+}
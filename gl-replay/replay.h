@@ -0,0 +1,51 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "../common/gl_context.h"
+#include "../common/gl_trace.h"
+
+//-----------------------------------------------------------------------------------
+// Reading and replaying a trace written by startGLTrace()
+//
+// Every recorded call is issued again through the loaded GL functions with the
+// recorded arguments and data. Output pointers get scratch memory, syncs and
+// mapped pointers are translated to the replay's own, and the names glGen* and
+// glCreate* return are checked against the trace since the recorded calls use
+// them as they are. Each recording thread gets its own context sharing with the
+// first, and the replay switches between them on one thread in record order.
+//-----------------------------------------------------------------------------------
+
+struct GLTraceFile {
+    GLTraceHeader header;
+    std::vector<std::string> functions;     // by opcode
+    const uint8_t* data;                    // the records
+    const void* mapping;
+    size_t mappingSize;
+};
+
+// Prints a message and exits if path isn't a trace.
+GLTraceFile openGLTrace(const char* path);
+void closeGLTrace(GLTraceFile& trace);
+
+enum GLReplayTiming {
+    REPLAY_FAST,        // every call as soon as the previous one returns
+    REPLAY_RECORDED,    // every call no earlier than its recorded time
+};
+
+struct GLReplayStats {
+    uint64_t calls;
+    uint64_t frames;
+    uint64_t mapWriteBytes;
+    int contexts;
+    double ms;                      // including a final glFinish
+    std::vector<double> frameMs;    // between consecutive swaps
+};
+
+// ctx is the context for the first recording thread and must be current, with
+// the GL functions loaded. Prints a message and exits if the trace can't be
+// replayed faithfully.
+GLReplayStats replayGLTrace(const GLTraceFile& trace, GLContext* ctx, GLReplayTiming timing);
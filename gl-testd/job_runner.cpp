@@ -0,0 +1,293 @@
+#include "job_runner.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+
+#include "../common/gl_debug.h"
+#include "../common/gl_state.h"
+#include "../common/gl_trace.h"
+#include "../common/program_cache.h"
+
+namespace {
+
+const int maxTargetSize = 4096;
+// Reads are queued in slots of this many pixels.
+const int maxReadPixels = 512 * 512;
+// Past this many textures the cache starts over.
+const size_t maxTextures = 256;
+
+struct ParamDefault {
+    GLenum pname;
+    GLint value;
+};
+
+// Every parameter a job may set. The swizzles must stay last, in order.
+const ParamDefault paramDefaults[] = {
+    { GL_TEXTURE_MIN_FILTER, GL_NEAREST },
+    { GL_TEXTURE_MAG_FILTER, GL_NEAREST },
+    { GL_TEXTURE_WRAP_S, GL_REPEAT },
+    { GL_TEXTURE_WRAP_T, GL_REPEAT },
+    { GL_TEXTURE_COMPARE_MODE, GL_NONE },
+    { GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL },
+    { GL_TEXTURE_BASE_LEVEL, 0 },
+    { GL_TEXTURE_MAX_LEVEL, 1000 },
+    { GL_TEXTURE_SWIZZLE_R, GL_RED },
+    { GL_TEXTURE_SWIZZLE_G, GL_GREEN },
+    { GL_TEXTURE_SWIZZLE_B, GL_BLUE },
+    { GL_TEXTURE_SWIZZLE_A, GL_ALPHA },
+};
+const int numParams = sizeof(paramDefaults) / sizeof(paramDefaults[0]);
+const int firstSwizzle = numParams - 4;
+
+uint64_t fnv1a(uint64_t hash, const void* data, size_t size) {
+    const uint8_t* p = (const uint8_t*)data;
+    for (size_t i = 0; i < size; ++i) {
+        hash = (hash ^ p[i]) * 1099511628211ull;
+    }
+    return hash;
+}
+
+uint64_t textureKey(const GLJob& job) {
+    uint64_t hash = 14695981039346656037ull;
+    hash = fnv1a(hash, &job.internalFormat, sizeof(job.internalFormat));
+    hash = fnv1a(hash, &job.textureWidth, sizeof(job.textureWidth));
+    hash = fnv1a(hash, &job.textureHeight, sizeof(job.textureHeight));
+    hash = fnv1a(hash, &job.format, sizeof(job.format));
+    hash = fnv1a(hash, &job.type, sizeof(job.type));
+    return fnv1a(hash, job.texels.data(), job.texels.size());
+}
+
+// Errors GL raised since the last call. In poll mode that takes glGetError,
+// otherwise the debug messages are printed as they are for checkError().
+int jobGLErrors() {
+    if (getGLErrorMode() != GL_ERRORS_POLL) {
+        return reportGLDebugMessages("job");
+    }
+    int errors = 0;
+    while (glGetError() != GL_NO_ERROR) {
+        ++errors;
+    }
+    return errors;
+}
+
+}  // namespace
+
+JobRunner::JobRunner(int readbackSlots, Done done) : done_(done) {
+    ring_ = new ReadbackRing(readbackSlots, size_t(maxReadPixels) * 4, [this](uint32_t tag, const void* data, size_t size) {
+        Pending& pending = pending_[tag - firstTag_];
+        const uint8_t* pixels = (const uint8_t*)data;
+        pending.result.pixels.assign(pixels, pixels + size);
+        pending.result.daemonMs = nowMs() - pending.startMs;
+        pending.ready = true;
+    });
+
+    resizeTarget(1, 1);
+
+    static const float quad[] = { -1,-1, 1,-1, -1,1, -1,1, 1,-1, 1,1 };
+    vertexArray_ = glrCreate(GLR_VERTEX_ARRAY, "job quad");
+    glsBindVertexArray(vertexArray_);
+    buffer_ = glrCreate(GLR_BUFFER, "job quad");
+    glsBindBuffer(GL_ARRAY_BUFFER, buffer_);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(quad), quad, GL_STATIC_DRAW);
+    glrSetBytes(GLR_BUFFER, buffer_, sizeof(quad));
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, nullptr);
+    glsActiveTexture(GL_TEXTURE0);
+    glsBindSampler(0, 0);
+}
+
+JobRunner::~JobRunner() {
+    drain();
+    delete ring_;
+    for (auto& entry : programs_) {
+        glrDelete(GLR_PROGRAM, entry.second);
+    }
+    for (auto& entry : textures_) {
+        glrDelete(GLR_TEXTURE, entry.second);
+    }
+    glrDelete(GLR_BUFFER, buffer_);
+    glrDelete(GLR_VERTEX_ARRAY, vertexArray_);
+    glrReleaseRenderTarget(target_);
+}
+
+double JobRunner::nowMs() const {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void JobRunner::run(uint32_t client, const GLJob& job) {
+    pending_.push_back({ client, false, nowMs(), GLJobResult() });
+    Pending& pending = pending_.back();
+    uint32_t tag = firstTag_ + uint32_t(pending_.size() - 1);
+    GLJobResult& result = pending.result;
+    result.id = job.id;
+    ++stats_.jobs;
+
+    std::string& error = result.error;
+    if (job.targetWidth <= 0 || job.targetHeight <= 0 || job.targetWidth > maxTargetSize ||
+        job.targetHeight > maxTargetSize) {
+        error = "target size must be 1 to " + std::to_string(maxTargetSize);
+    } else if (job.readX < 0 || job.readY < 0 || job.readWidth <= 0 || job.readHeight <= 0 ||
+               job.readWidth > job.targetWidth - job.readX || job.readHeight > job.targetHeight - job.readY) {
+        error = "read region outside the target";
+    } else if (job.readWidth * job.readHeight > maxReadPixels) {
+        error = "read region larger than " + std::to_string(maxReadPixels) + " pixels";
+    }
+
+    GLuint prog = 0;
+    GLuint tex = 0;
+    if (error.empty()) {
+        prog = program(job, &result);
+    }
+    if (prog && job.textureWidth > 0) {
+        tex = texture(job, &result);
+    }
+    if (error.empty()) {
+        resizeTarget(job.targetWidth, job.targetHeight);
+        glsBindFramebuffer(GL_FRAMEBUFFER, target_.framebuffer);
+        glsViewport(0, 0, job.targetWidth, job.targetHeight);
+        glsUseProgram(prog);
+        glsBindTexture(GL_TEXTURE_2D, tex);
+        if (tex == 0 || applyParams(job, &error)) {
+            glsBindVertexArray(vertexArray_);
+            glClear(GL_COLOR_BUFFER_BIT);
+            glDrawArrays(GL_TRIANGLES, 0, 6);
+        }
+        if (error.empty() && jobGLErrors() > 0) {
+            error = "GL errors, see the daemon's output";
+            if (!result.textureCached && tex) {
+                textures_.erase(textureKey(job));
+                glrDelete(GLR_TEXTURE, tex);
+            }
+        }
+    }
+
+    if (error.empty()) {
+        ring_->read(job.readX, job.readY, job.readWidth, job.readHeight, GL_RGBA, GL_UNSIGNED_BYTE, tag);
+        result.ok = true;
+    } else {
+        // Still delivered in order, behind the jobs before it.
+        ++stats_.failed;
+        pending.ready = true;
+        pending.result.daemonMs = nowMs() - pending.startMs;
+    }
+    poll();
+}
+
+void JobRunner::poll() {
+    ring_->poll();
+    deliver();
+}
+
+void JobRunner::drain() {
+    ring_->drain();
+    deliver();
+}
+
+void JobRunner::deliver() {
+    while (!pending_.empty() && pending_.front().ready) {
+        done_(pending_.front().client, pending_.front().result);
+        pending_.pop_front();
+        ++firstTag_;
+    }
+}
+
+GLuint JobRunner::program(const GLJob& job, GLJobResult* result) {
+    std::string key = job.vertexShader;
+    key += '\0';
+    key += job.fragmentShader;
+    auto found = programs_.find(key);
+    if (found != programs_.end()) {
+        ++stats_.programHits;
+        result->programCached = true;
+        return found->second;
+    }
+
+    ++stats_.programMisses;
+    auto start = std::chrono::steady_clock::now();
+    static const char* const attribs[] = { "p" };
+    GLuint prog = tryCreateCachedProgram(job.vertexShader.c_str(), job.fragmentShader.c_str(), attribs, 1,
+                                         &result->error);
+    stats_.compileMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    if (prog == 0 && result->error.empty()) {
+        result->error = "program failed to link";
+    }
+    if (prog) {
+        glrAdopt(GLR_PROGRAM, prog, "job program");
+        programs_[key] = prog;
+    }
+    return prog;
+}
+
+GLuint JobRunner::texture(const GLJob& job, GLJobResult* result) {
+    if (job.textureWidth > maxTargetSize || job.textureHeight <= 0 || job.textureHeight > maxTargetSize) {
+        result->error = "texture size must be 1 to " + std::to_string(maxTargetSize);
+        return 0;
+    }
+    if (!job.texels.empty() &&
+        job.texels.size() != glTraceImageSize(job.textureWidth, job.textureHeight, job.format, job.type, 4)) {
+        result->error = "texel data doesn't match the size, format and type";
+        return 0;
+    }
+    uint64_t key = textureKey(job);
+    auto found = textures_.find(key);
+    if (found != textures_.end()) {
+        ++stats_.textureHits;
+        result->textureCached = true;
+        return found->second;
+    }
+
+    ++stats_.textureMisses;
+    if (textures_.size() >= maxTextures) {
+        for (auto& entry : textures_) {
+            glrDelete(GLR_TEXTURE, entry.second);
+        }
+        textures_.clear();
+    }
+    GLuint tex = glrCreate(GLR_TEXTURE, "job texture");
+    glsBindTexture(GL_TEXTURE_2D, tex);
+    glTexImage2D(GL_TEXTURE_2D, 0, job.internalFormat, job.textureWidth, job.textureHeight, 0, job.format, job.type,
+                 job.texels.empty() ? nullptr : job.texels.data());
+    glrSetBytes(GLR_TEXTURE, tex, glrTextureBytes(job.internalFormat, job.textureWidth, job.textureHeight));
+    textures_[key] = tex;
+    return tex;
+}
+
+bool JobRunner::applyParams(const GLJob& job, std::string* error) {
+    GLint values[numParams];
+    for (int i = 0; i < numParams; ++i) {
+        values[i] = paramDefaults[i].value;
+    }
+    for (const GLJobParam& param : job.params) {
+        int i = 0;
+        while (i < numParams && paramDefaults[i].pname != param.pname) {
+            ++i;
+        }
+        if (i == numParams) {
+            char message[64];
+            snprintf(message, sizeof(message), "unsupported texture parameter 0x%x", param.pname);
+            *error = message;
+            return false;
+        }
+        values[i] = param.value;
+    }
+    for (int i = 0; i < firstSwizzle; ++i) {
+        glsTexParameteri(GL_TEXTURE_2D, paramDefaults[i].pname, values[i]);
+    }
+    glsTexSwizzle(GL_TEXTURE_2D, values[firstSwizzle], values[firstSwizzle + 1], values[firstSwizzle + 2],
+                  values[firstSwizzle + 3]);
+    return true;
+}
+
+void JobRunner::resizeTarget(int width, int height) {
+    if (width == target_.width && height == target_.height) {
+        return;
+    }
+    // Reads of the old target already queued still read the right pixels, as
+    // the GL orders them before anything later drawn into it.
+    if (target_.framebuffer) {
+        glrReleaseRenderTarget(target_);
+    }
+    target_ = glrAcquireRenderTarget(GL_RGBA8, GL_NONE, width, height, "job target");
+}
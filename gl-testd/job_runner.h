@@ -0,0 +1,81 @@
+#pragma once
+
+#include <stdint.h>
+#include <deque>
+#include <functional>
+#include <string>
+#include <unordered_map>
+
+#include "../common/gl_job.h"
+#include "../common/gl_loader.h"
+#include "../common/gl_resources.h"
+#include "../common/readback_ring.h"
+
+//-----------------------------------------------------------------------------------
+// Runs GLJobs on the daemon's warm context
+//
+// Programs stay linked, keyed on their sources, and textures stay uploaded, keyed
+// on their contents, so a repeated job only sets state and draws. State goes
+// through the gl_state cache. Texture parameters a job leaves out are set back to
+// their defaults, so a job never sees what the one before it set. The render
+// target comes from the registry's pool, so jobs that alternate between a few
+// sizes switch between framebuffers instead of reallocating one.
+//
+// run() only queues the draw and a read into a pixel pack buffer ring; results are
+// handed to the callback by poll() or drain() once the GPU is done, in the order
+// the jobs were run.
+//-----------------------------------------------------------------------------------
+
+class JobRunner {
+public:
+    typedef std::function<void(uint32_t client, const GLJobResult& result)> Done;
+
+    struct Stats {
+        uint64_t jobs = 0;
+        uint64_t failed = 0;
+        uint64_t programHits = 0;
+        uint64_t programMisses = 0;
+        uint64_t textureHits = 0;
+        uint64_t textureMisses = 0;
+        double compileMs = 0.0;       // linking programs that weren't cached
+    };
+
+    // Needs the context current.
+    JobRunner(int readbackSlots, Done done);
+    ~JobRunner();
+
+    void run(uint32_t client, const GLJob& job);
+    // Hands over the results that are ready without blocking.
+    void poll();
+    // Waits for every result.
+    void drain();
+    bool idle() const { return pending_.empty(); }
+
+    const Stats& stats() const { return stats_; }
+
+private:
+    struct Pending {
+        uint32_t client;
+        bool ready;
+        double startMs;
+        GLJobResult result;
+    };
+
+    GLuint program(const GLJob& job, GLJobResult* result);
+    GLuint texture(const GLJob& job, GLJobResult* result);
+    bool applyParams(const GLJob& job, std::string* error);
+    void resizeTarget(int width, int height);
+    void deliver();
+    double nowMs() const;
+
+    Done done_;
+    ReadbackRing* ring_;
+    std::unordered_map<std::string, GLuint> programs_;
+    std::unordered_map<uint64_t, GLuint> textures_;
+    GLRenderTarget target_ = {};
+    GLuint vertexArray_ = 0;
+    GLuint buffer_ = 0;
+    std::deque<Pending> pending_;
+    uint32_t firstTag_ = 0;       // ring tag of pending_.front()
+    Stats stats_;
+};
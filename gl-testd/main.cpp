@@ -0,0 +1,294 @@
+// build: g++ *.cpp ../common/*.cpp -o main -lX11 -lGL -lEGL -lpthread
+// run: ./main --backend=egl-surfaceless --socket=/tmp/gl-testd.sock
+// send it the gather tests: ../textureGatherCompare/main --daemon=/tmp/gl-testd.sock
+// stop it and print the stats: Ctrl-C or kill -INT
+
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <map>
+#include <vector>
+
+#include "../common/gl_context.h"
+#include "../common/gl_debug.h"
+#include "../common/gl_job.h"
+#include "../common/gl_loader.h"
+#include "../common/gl_resources.h"
+#include "../common/gl_state.h"
+#include "../common/program_cache.h"
+#include "../common/stats.h"
+#include "job_runner.h"
+
+//-----------------------------------------------------------------------------------
+// gl-testd
+//
+// Keeps one context, its functions and every program it has linked warm, and runs
+// GLJobs (see gl_job.h) sent over a Unix domain socket. Any number of clients can
+// be connected. Each job's draw and readback are queued as soon as the job has
+// arrived; results go back once the GPU has finished them, so a client that
+// sends a batch of jobs before reading keeps the GPU busy. Sockets are
+// non-blocking and output is buffered per client, so a client that's slow to
+// read never holds up the others. Once a client has maxClientOutput bytes
+// waiting, no more of its jobs are read until it takes them.
+//-----------------------------------------------------------------------------------
+
+namespace {
+
+const size_t maxClientOutput = 16 << 20;
+
+volatile sig_atomic_t quit = 0;
+
+void onSignal(int) {
+    quit = 1;
+}
+
+struct Client {
+    int fd;
+    uint64_t jobs = 0;
+    std::vector<uint8_t> in;
+    std::vector<uint8_t> out;
+    size_t outSent = 0;
+    bool closed = false;
+
+    bool outputFull() const { return out.size() - outSent >= maxClientOutput; }
+};
+
+// Sends as much of the client's output as the socket takes.
+void flush(Client& client) {
+    while (client.outSent < client.out.size()) {
+        ssize_t n = send(client.fd, client.out.data() + client.outSent, client.out.size() - client.outSent,
+                         MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return;
+        }
+        if (n <= 0) {
+            client.closed = true;
+            return;
+        }
+        client.outSent += n;
+    }
+    client.out.clear();
+    client.outSent = 0;
+}
+
+// Reads what has arrived and runs every complete job in it.
+void receive(Client& client, uint32_t id, JobRunner& runner) {
+    for (;;) {
+        uint8_t buffer[65536];
+        ssize_t n = recv(client.fd, buffer, sizeof(buffer), 0);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            break;
+        }
+        if (n <= 0) {
+            client.closed = true;
+            break;
+        }
+        client.in.insert(client.in.end(), buffer, buffer + n);
+    }
+
+    size_t pos = 0;
+    size_t size;
+    GLJob job;
+    while ((size = completeGLJobMessage(client.in.data() + pos, client.in.size() - pos)) > 0) {
+        if (!decodeGLJob(client.in.data() + pos, size, &job)) {
+            printf("client %u: malformed job, disconnecting\n", id);
+            client.closed = true;
+            break;
+        }
+        runner.run(id, job);
+        ++client.jobs;
+        pos += size;
+    }
+    client.in.erase(client.in.begin(), client.in.begin() + pos);
+}
+
+int listenOn(const char* path) {
+    sockaddr_un addr = {};
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        printf("Socket path too long: %s\n", path);
+        exit(1);
+    }
+    strcpy(addr.sun_path, path);
+    // A socket file left behind by a daemon that didn't exit cleanly.
+    unlink(path);
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0 || bind(fd, (const sockaddr*)&addr, sizeof(addr)) != 0 || listen(fd, 16) != 0) {
+        printf("Cannot listen on %s: %s\n", path, strerror(errno));
+        exit(1);
+    }
+    return fd;
+}
+
+}  // namespace
+
+int main(int argc, const char* argv[])
+{
+    const char* socketPath = "/tmp/gl-testd.sock";
+    int readbackSlots = 8;
+    GLErrorMode errorMode = GL_ERRORS_RELEASE;
+    GLenum debugSeverity = GL_DEBUG_SEVERITY_MEDIUM;
+    GLContextOptions options;
+    options.backend = BACKEND_EGL_SURFACELESS;
+    options.title = "gl-testd";
+    for (int i = 1; i < argc; ++i) {
+        if (!strncmp(argv[i], "--backend=", 10) && parseBackend(argv[i] + 10, &options.backend)) {
+            continue;
+        }
+        if (!strncmp(argv[i], "--socket=", 9) && argv[i][9]) {
+            socketPath = argv[i] + 9;
+            continue;
+        }
+        if (!strncmp(argv[i], "--readback-slots=", 17) && atoi(argv[i] + 17) > 0) {
+            readbackSlots = atoi(argv[i] + 17);
+            continue;
+        }
+        if (!strcmp(argv[i], "--no-program-cache")) {
+            setProgramCacheEnabled(false);
+            continue;
+        }
+        if (!strncmp(argv[i], "--gl-errors=", 12) && parseGLErrorMode(argv[i] + 12, &errorMode)) {
+            continue;
+        }
+        if (!strncmp(argv[i], "--gl-debug-severity=", 20) && parseGLDebugSeverity(argv[i] + 20, &debugSeverity)) {
+            continue;
+        }
+        printf("usage: %s [--backend=glx|egl-pbuffer|egl-surfaceless] [--socket=PATH] [--readback-slots=N] [--no-program-cache]\n"
+               "       [--gl-errors=poll|strict|release] [--gl-debug-severity=high|medium|low|notification]\n", argv[0]);
+        return 1;
+    }
+
+    // 1. Everything a test run would otherwise pay for, once
+    GLContext* ctx = createGLContext(options);
+    init_gl_functions(ctx, GL_LOAD_EAGER);
+    setGLErrorMode(errorMode, debugSeverity);
+    printf("context : %s %.3f ms\n", backendToString(options.backend), getContextCreationMs(ctx));
+
+    GLJobHello hello;
+    hello.renderer = (const char*)glGetString(GL_RENDERER);
+    hello.version = (const char*)glGetString(GL_VERSION);
+    glGetIntegerv(GL_CONTEXT_PROFILE_MASK, &hello.profileMask);
+    std::vector<uint8_t> helloMessage;
+    encodeGLJobHello(hello, &helloMessage);
+
+    // 2. Results go to the output buffer of the client that sent the job, if it's
+    // still connected.
+    std::map<uint32_t, Client> clients;
+    std::vector<double> jobMs;
+    JobRunner* runner = new JobRunner(readbackSlots, [&](uint32_t id, const GLJobResult& result) {
+        auto found = clients.find(id);
+        if (found != clients.end()) {
+            encodeGLJobResult(result, &found->second.out);
+        }
+        jobMs.push_back(result.daemonMs);
+    });
+
+    // 3. Listen
+    int listenFd = listenOn(socketPath);
+    struct sigaction action = {};
+    action.sa_handler = onSignal;
+    sigaction(SIGINT, &action, nullptr);
+    sigaction(SIGTERM, &action, nullptr);
+    printf("listen  : %s\n", socketPath);
+    fflush(stdout);
+
+    // 4. Serve until a signal
+    uint32_t nextId = 1;
+    uint64_t served = 0;
+    std::vector<pollfd> fds;
+    std::vector<uint32_t> ids;
+    while (!quit) {
+        fds.clear();
+        ids.clear();
+        fds.push_back({ listenFd, POLLIN, 0 });
+        for (auto& entry : clients) {
+            const Client& client = entry.second;
+            short events = short((client.outputFull() ? 0 : POLLIN) | (client.out.empty() ? 0 : POLLOUT));
+            fds.push_back({ client.fd, events, 0 });
+            ids.push_back(entry.first);
+        }
+        // With jobs in flight, only look for more input before waiting on the GPU.
+        int ready = poll(fds.data(), fds.size(), runner->idle() ? -1 : 0);
+        if (ready < 0 && errno == EINTR) {
+            continue;
+        }
+        if (ready < 0) {
+            printf("poll failed: %s\n", strerror(errno));
+            break;
+        }
+        if (ready == 0) {
+            runner->drain();
+        }
+
+        if (fds[0].revents & POLLIN) {
+            int fd;
+            while ((fd = accept4(listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+                Client& client = clients[nextId++];
+                client.fd = fd;
+                client.out = helloMessage;
+            }
+        }
+        for (size_t i = 1; i < fds.size(); ++i) {
+            Client& client = clients[ids[i - 1]];
+            // A hangup still shows up for a client that isn't being read. Its
+            // next flush() finds out.
+            if ((fds[i].revents & (POLLIN | POLLHUP | POLLERR)) && !client.outputFull()) {
+                receive(client, ids[i - 1], *runner);
+            }
+        }
+        runner->poll();
+
+        for (auto it = clients.begin(); it != clients.end(); ) {
+            Client& client = it->second;
+            flush(client);
+            if (client.closed) {
+                close(client.fd);
+                ++served;
+                it = clients.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    // 5. Cleanup
+    runner->drain();
+    for (auto& entry : clients) {
+        close(entry.second.fd);
+    }
+    close(listenFd);
+    unlink(socketPath);
+
+    JobRunner::Stats stats = runner->stats();
+    delete runner;
+    printf("\njobs    : %llu from %llu clients, %llu failed\n", (unsigned long long)stats.jobs,
+           (unsigned long long)(served + clients.size()), (unsigned long long)stats.failed);
+    printf("programs: %llu hits, %llu linked in %.3f ms\n", (unsigned long long)stats.programHits,
+           (unsigned long long)stats.programMisses, stats.compileMs);
+    printf("textures: %llu hits, %llu uploaded\n", (unsigned long long)stats.textureHits,
+           (unsigned long long)stats.textureMisses);
+    if (!jobMs.empty()) {
+        SampleSummary summary = summarize(jobMs);
+        printf("latency : in the daemon avg %.3f ms, p50 %.3f ms, p95 %.3f ms, p99 %.3f ms\n",
+               summary.mean, summary.p50, summary.p95, summary.p99);
+    }
+    printProgramCacheStats();
+    printGLStateStats();
+    printGLErrorStats();
+    glrTrimPools();
+    printGLResourceReport();
+    destroyGLContext(ctx);
+    return 0;
+}
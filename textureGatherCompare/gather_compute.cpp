@@ -0,0 +1,350 @@
+#include "gather_compute.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "../common/gl_helpers.h"
+#include "../common/gl_resources.h"
+#include "../common/gl_state.h"
+#include "../common/program_cache.h"
+#include "../common/readback_ring.h"
+#include "gather_verify.h"
+
+namespace {
+
+// Must match local_size_x in the shader.
+const int groupSize = 64;
+// The smallest GL_MAX_COMPUTE_WORK_GROUP_COUNT GL allows. Bigger dispatches go 2D.
+const int maxGroupsX = 65535;
+
+// One std430 array element. The offset is two signed bytes.
+struct ComputeCase {
+    float s;
+    float t;
+    float ref;
+    int32_t offset;
+};
+
+double msSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// The configuration is picked with a switch whose cases each name their
+// element of u_tex with a constant. Indexing with the dynamically uniform
+// config directly is what GLSL allows, but llvmpipe crashes compiling that
+// together with a non-constant gather offset.
+GLuint createGatherComputeProgram(int numConfigs) {
+    std::string src = "#version 460\n#define NUM_CONFIGS " + std::to_string(numConfigs) + "\n";
+    src +=
+    R"RAW(
+    layout(local_size_x = 64) in;
+    layout(binding = 0) uniform sampler2DShadow u_tex[NUM_CONFIGS];
+    struct Case {
+      float s;
+      float t;
+      float ref;
+      int offset;
+    };
+    layout(std430, binding = 0) readonly buffer Cases { Case cases[]; };
+    layout(std430, binding = 1) writeonly buffer Results { vec4 results[]; };
+    vec4 gather(uint config, vec2 coord, float ref, ivec2 offset) {
+      switch (config) {
+    )RAW";
+    for (int i = 0; i < numConfigs; ++i) {
+        src += "        case " + std::to_string(i) + "u: return textureGatherOffset(u_tex[" + std::to_string(i) +
+               "], coord, ref, offset);\n";
+    }
+    src +=
+    R"RAW(
+      }
+      return vec4(-1);
+    }
+    void main() {
+      uint group = gl_WorkGroupID.y * gl_NumWorkGroups.x + gl_WorkGroupID.x;
+      uint n = group * gl_WorkGroupSize.x + gl_LocalInvocationIndex;
+      if (n >= uint(cases.length())) {
+        return;
+      }
+      Case c = cases[n];
+      ivec2 offset = ivec2(bitfieldExtract(c.offset, 0, 8), bitfieldExtract(c.offset, 8, 8));
+      results[n] = gather(group % NUM_CONFIGS, vec2(c.s, c.t), c.ref, offset);
+    }
+    )RAW";
+
+    GLuint shader = compileShader(GL_COMPUTE_SHADER, src.c_str());
+    GLuint program = glrCreate(GLR_PROGRAM, "gather compute");
+    glAttachShader(program, shader);
+    linkProgram(program);
+    glDeleteShader(shader);
+    return program;
+}
+
+// The fragment path: one case per draw, its coord, ref and offset in uniforms.
+GLuint createGatherQuadProgram() {
+    const char* vs =
+    R"RAW(#version 460
+    in vec2 p;
+    void main() {
+      gl_Position = vec4(p, 0, 1);
+    }
+    )RAW";
+
+    const char* fs =
+    R"RAW(#version 460
+     layout(binding = 0) uniform sampler2DShadow u_tex;
+     layout(location = 0) uniform vec4 u_case;
+     layout(location = 1) uniform ivec2 u_offset;
+     out vec4 fragColor;
+     void main() {
+       fragColor = textureGatherOffset(u_tex, u_case.xy, u_case.z, u_offset);
+     }
+    )RAW";
+
+    static const char* const attribs[] = { "p" };
+    GLuint program = createCachedProgram(vs, fs, attribs, 1);
+    glrAdopt(GLR_PROGRAM, program, "gather quad");
+    return program;
+}
+
+void printMismatch(const GatherBatch& batch, const GatherState& state, size_t n, const uint8_t* expected,
+                   const float* actual) {
+    const GatherTexture& tex = batch.tex;
+    printf("mismatch: %dx%d format 0x%x wrap 0x%x/0x%x border %g, func 0x%x swizzle 0x%x 0x%x 0x%x 0x%x, "
+           "coord %.9g %.9g ref %.9g offset %d %d: expected %g %g %g %g got %.9g %.9g %.9g %.9g\n",
+           tex.width, tex.height, tex.format, tex.wrapS, tex.wrapT, tex.border, state.compareFunc,
+           state.swizzle[0], state.swizzle[1], state.swizzle[2], state.swizzle[3],
+           batch.cases.s[n], batch.cases.t[n], batch.cases.ref[n], batch.cases.offsetX[n], batch.cases.offsetY[n],
+           expected[0] / 255.0f, expected[1] / 255.0f, expected[2] / 255.0f, expected[3] / 255.0f,
+           actual[0], actual[1], actual[2], actual[3]);
+}
+
+}  // namespace
+
+GatherComputeResult runGatherCompute(uint64_t numCases, uint64_t fragmentCases, uint32_t seed,
+                                     const GatherState* configs, int numConfigs, int readbackSlots) {
+    GatherComputeResult result = {};
+    GLint maxUnits = 0;
+    glGetIntegerv(GL_MAX_COMPUTE_TEXTURE_IMAGE_UNITS, &maxUnits);
+    if (numConfigs > maxUnits) {
+        printf("compute : %d configurations need %d texture units, the compute stage has %d\n",
+               numConfigs, numConfigs, maxUnits);
+        exit(1);
+    }
+    uint64_t numGroups = (numCases + groupSize - 1) / groupSize;
+    if (numGroups > uint64_t(maxGroupsX) * maxGroupsX) {
+        printf("compute : %llu cases don't fit one dispatch\n", (unsigned long long)numCases);
+        exit(1);
+    }
+
+    GLint minOffset = 0;
+    GLint maxOffset = 0;
+    glGetIntegerv(GL_MIN_PROGRAM_TEXTURE_GATHER_OFFSET, &minOffset);
+    glGetIntegerv(GL_MAX_PROGRAM_TEXTURE_GATHER_OFFSET, &maxOffset);
+
+    std::mt19937 rng(seed);
+    GatherBatch batch;
+    makeRandomGatherBatch(rng, numCases, minOffset, maxOffset, configs[0].depthMode, &batch);
+    const GatherTexture& gt = batch.tex;
+
+    // The texture, then one view (for the swizzle) and one sampler (for the
+    // compare func) per configuration.
+    GLuint computeProgram = createGatherComputeProgram(numConfigs);
+    GLuint tex = glrCreate(GLR_TEXTURE, "compute depth");
+    glsActiveTexture(GL_TEXTURE0);
+    glsBindTexture(GL_TEXTURE_2D, tex);
+    storeGatherTexels(gt, batch.depths.data());
+    glrSetBytes(GLR_TEXTURE, tex, glrTextureBytes(gt.format, gt.width, gt.height));
+
+    // Views share the texture's storage, so they add nothing to the estimate.
+    std::vector<GLuint> views(numConfigs);
+    std::vector<GLuint> samplers(numConfigs);
+    for (int i = 0; i < numConfigs; ++i) {
+        views[i] = glrCreate(GLR_TEXTURE, "compute view");
+        samplers[i] = glrCreate(GLR_SAMPLER, "compute config");
+    }
+    const float border[4] = { gt.border, gt.border, gt.border, gt.border };
+    for (int i = 0; i < numConfigs; ++i) {
+        const GLenum* swizzle = configs[i].swizzle;
+        glTextureView(views[i], GL_TEXTURE_2D, tex, gt.format, 0, 1, 0, 1);
+        glsBindTexture(GL_TEXTURE_2D, views[i]);
+        glsTexSwizzle(GL_TEXTURE_2D, swizzle[0], swizzle[1], swizzle[2], swizzle[3]);
+
+        glsSamplerParameteri(samplers[i], GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glsSamplerParameteri(samplers[i], GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glsSamplerParameteri(samplers[i], GL_TEXTURE_WRAP_S, gt.wrapS);
+        glsSamplerParameteri(samplers[i], GL_TEXTURE_WRAP_T, gt.wrapT);
+        glsSamplerParameterfv(samplers[i], GL_TEXTURE_BORDER_COLOR, border);
+        glsSamplerParameteri(samplers[i], GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+        glsSamplerParameteri(samplers[i], GL_TEXTURE_COMPARE_FUNC, configs[i].compareFunc);
+    }
+    checkError("compute setup");
+
+    std::vector<ComputeCase> cases(numCases);
+    for (uint64_t n = 0; n < numCases; ++n) {
+        cases[n].s = batch.cases.s[n];
+        cases[n].t = batch.cases.t[n];
+        cases[n].ref = batch.cases.ref[n];
+        cases[n].offset = (batch.cases.offsetX[n] & 0xff) | ((batch.cases.offsetY[n] & 0xff) << 8);
+    }
+    GLuint buffers[2] = { glrCreate(GLR_BUFFER, "compute cases"), glrCreate(GLR_BUFFER, "compute results") };
+    glsBindBuffer(GL_SHADER_STORAGE_BUFFER, buffers[1]);
+    glBufferStorage(GL_SHADER_STORAGE_BUFFER, numCases * 4 * sizeof(float), nullptr, GL_MAP_READ_BIT);
+    glrSetBytes(GLR_BUFFER, buffers[1], numCases * 4 * sizeof(float));
+
+    glsBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, buffers[1]);
+    for (int i = 0; i < numConfigs; ++i) {
+        glsActiveTexture(GL_TEXTURE0 + i);
+        glsBindTexture(GL_TEXTURE_2D, views[i]);
+        glsBindSampler(i, samplers[i]);
+    }
+    glsActiveTexture(GL_TEXTURE0);
+    glsUseProgram(computeProgram);
+
+    // Drivers may only compile the program for this state on its first
+    // dispatch. One workgroup over the first cases keeps that out of the timing.
+    glsBindBuffer(GL_SHADER_STORAGE_BUFFER, buffers[0]);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, std::min<uint64_t>(numCases, groupSize) * sizeof(ComputeCase),
+                 cases.data(), GL_STREAM_DRAW);
+    glsBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, buffers[0]);
+    glDispatchCompute(1, 1, 1);
+    glFinish();
+
+    // 1. Upload the cases, evaluate them all in one dispatch and map the results
+    auto start = std::chrono::steady_clock::now();
+    glBufferData(GL_SHADER_STORAGE_BUFFER, numCases * sizeof(ComputeCase), cases.data(), GL_STREAM_DRAW);
+    glrSetBytes(GLR_BUFFER, buffers[0], numCases * sizeof(ComputeCase));
+    GLuint groupsX = GLuint(std::min<uint64_t>(numGroups, maxGroupsX));
+    glDispatchCompute(groupsX, GLuint((numGroups + groupsX - 1) / groupsX), 1);
+    glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+    glsBindBuffer(GL_SHADER_STORAGE_BUFFER, buffers[1]);
+    const float* actual = (const float*)glMapBufferRange(GL_SHADER_STORAGE_BUFFER, 0, numCases * 4 * sizeof(float),
+                                                         GL_MAP_READ_BIT);
+    result.computeMs = msSince(start);
+    checkError("compute dispatch");
+    if (actual == nullptr) {
+        printf("compute : cannot map the results\n");
+        exit(1);
+    }
+
+    // 2. The expected results, a workgroup's worth of cases at a time
+    start = std::chrono::steady_clock::now();
+    GatherImpl impl = bestGatherImpl();
+    std::vector<uint8_t> expected(numCases * 4);
+    for (uint64_t group = 0; group < numGroups; ++group) {
+        size_t first = size_t(group * groupSize);
+        size_t count = std::min<uint64_t>(groupSize, numCases - first);
+        gatherReference(impl, gt, configs[group % numConfigs], batch.cases, first, count, &expected[first * 4]);
+    }
+    result.oracleMs = msSince(start);
+
+    // Exact comparisons: every correct result is 0 or 1.
+    const int maxPrinted = 10;
+    for (uint64_t n = 0; n < numCases; ++n) {
+        const GatherState& state = configs[(n / groupSize) % numConfigs];
+        for (int c = 0; c < 4; ++c) {
+            if (actual[n * 4 + c] != expected[n * 4 + c] / 255.0f) {
+                if (result.mismatches < maxPrinted) {
+                    printMismatch(batch, state, n, &expected[n * 4], &actual[n * 4]);
+                }
+                ++result.mismatches;
+                break;
+            }
+        }
+    }
+    result.cases = numCases;
+    glUnmapBuffer(GL_SHADER_STORAGE_BUFFER);
+    checkError("compute results");
+
+    // 3. The same cases through the fragment path
+    fragmentCases = std::min(fragmentCases, numCases);
+    if (fragmentCases > 0) {
+        GLuint quadProgram = createGatherQuadProgram();
+        GLRenderTarget atlas = acquireGatherAtlas(1);
+
+        static const float quad[] = { -1,-1, 1,-1, -1,1, -1,1, 1,-1, 1,1 };
+        GLuint va = glrCreate(GLR_VERTEX_ARRAY, "gather quad");
+        glsBindVertexArray(va);
+        GLuint quadBuffer = glrCreate(GLR_BUFFER, "gather quad");
+        glsBindBuffer(GL_ARRAY_BUFFER, quadBuffer);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(quad), quad, GL_STATIC_DRAW);
+        glrSetBytes(GLR_BUFFER, quadBuffer, sizeof(quad));
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, nullptr);
+        glsViewport(0, 0, 1, 1);
+        glsUseProgram(quadProgram);
+        glsActiveTexture(GL_TEXTURE0);
+        checkError("fragment setup");
+
+        // The same warm up, once per configuration since each is different
+        // sampler state to the draw.
+        for (int i = 0; i < numConfigs; ++i) {
+            glsBindTexture(GL_TEXTURE_2D, views[i]);
+            glsBindSampler(0, samplers[i]);
+            glDrawArrays(GL_TRIANGLES, 0, 6);
+        }
+        glFinish();
+
+        std::vector<uint8_t> pixels(fragmentCases * 4);
+        start = std::chrono::steady_clock::now();
+        {
+            ReadbackRing ring(readbackSlots, 4, [&](uint32_t tag, const void* data, size_t) {
+                memcpy(&pixels[tag * 4], data, 4);
+            });
+            for (uint64_t n = 0; n < fragmentCases; ++n) {
+                int config = int((n / groupSize) % numConfigs);
+                glsBindTexture(GL_TEXTURE_2D, views[config]);
+                glsBindSampler(0, samplers[config]);
+                glUniform4f(0, batch.cases.s[n], batch.cases.t[n], batch.cases.ref[n], 0.0f);
+                glUniform2i(1, batch.cases.offsetX[n], batch.cases.offsetY[n]);
+                glDrawArrays(GL_TRIANGLES, 0, 6);
+                ring.read(0, 0, 1, 1, GL_RGBA, GL_UNSIGNED_BYTE, uint32_t(n));
+                ring.poll();
+            }
+            ring.drain();
+        }
+        result.fragmentMs = msSince(start);
+        checkError("fragment cases");
+
+        for (uint64_t n = 0; n < fragmentCases; ++n) {
+            if (memcmp(&pixels[n * 4], &expected[n * 4], 4) != 0) {
+                if (result.fragmentMismatches < maxPrinted) {
+                    float got[4] = { pixels[n * 4] / 255.0f, pixels[n * 4 + 1] / 255.0f,
+                                     pixels[n * 4 + 2] / 255.0f, pixels[n * 4 + 3] / 255.0f };
+                    printMismatch(batch, configs[(n / groupSize) % numConfigs], n, &expected[n * 4], got);
+                }
+                ++result.fragmentMismatches;
+            }
+        }
+        result.fragmentCases = fragmentCases;
+
+        glsBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glrDelete(GLR_BUFFER, quadBuffer);
+        glrDelete(GLR_VERTEX_ARRAY, va);
+        glrReleaseRenderTarget(atlas);
+        glsUseProgram(0);
+        glrDelete(GLR_PROGRAM, quadProgram);
+    }
+
+    for (int i = numConfigs - 1; i >= 0; --i) {
+        glsActiveTexture(GL_TEXTURE0 + i);
+        glsBindTexture(GL_TEXTURE_2D, 0);
+        glsBindSampler(i, 0);
+    }
+    glsUseProgram(0);
+    glrDelete(GLR_BUFFER, buffers[0]);
+    glrDelete(GLR_BUFFER, buffers[1]);
+    for (int i = 0; i < numConfigs; ++i) {
+        glrDelete(GLR_SAMPLER, samplers[i]);
+        glrDelete(GLR_TEXTURE, views[i]);
+    }
+    glrDelete(GLR_TEXTURE, tex);
+    glrDelete(GLR_PROGRAM, computeProgram);
+    checkError("compute cleanup");
+    return result;
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "gather_reference.h"
+
+//-----------------------------------------------------------------------------------
+// textureGather in a compute shader
+//
+// One glDispatchCompute evaluates every case against one random depth texture.
+// Each configuration (a compare func and swizzle) gets a texture unit of its own:
+// a sampler object carries the compare func, wrap modes and border, and a view of
+// the texture carries the swizzle, which isn't sampler state. Every workgroup
+// takes configs[workgroup % numConfigs], so the index into the shader's
+// sampler2DShadow array stays dynamically uniform as GLSL requires. Results are
+// written to a shader storage buffer as vec4 and read through one mapping, so a
+// result that isn't exactly 0 or 1 can't hide behind RGBA8 rounding.
+//
+// For comparison the first fragmentCases go through the fragment path as well: a
+// 6-vertex quad into a 1x1 framebuffer per case, read back through a ring.
+//-----------------------------------------------------------------------------------
+
+struct GatherComputeResult {
+    uint64_t cases;
+    uint64_t mismatches;
+    double computeMs;         // uploading the cases, the dispatch and mapping the results
+    double oracleMs;          // computing the expected results
+    uint64_t fragmentCases;
+    uint64_t fragmentMismatches;
+    double fragmentMs;        // drawing and reading back every case
+};
+
+// Needs numConfigs texture units in the compute stage. The configs' depth modes
+// must be the context's. Prints the first few mismatches and leaves no program,
+// texture or sampler bound.
+GatherComputeResult runGatherCompute(uint64_t numCases, uint64_t fragmentCases, uint32_t seed,
+                                     const GatherState* configs, int numConfigs, int readbackSlots);
@@ -0,0 +1,645 @@
+#include "gather_matrix.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <string>
+
+#include "../common/gl_helpers.h"
+#include "../common/gl_state.h"
+#include "gather_verify.h"
+
+namespace {
+
+const int atlasSize = 1024;
+const size_t casesPerChunk = size_t(atlasSize) * atlasSize;
+
+struct NamedEnum {
+    const char* name;
+    GLenum value;
+};
+
+const NamedEnum formatNames[] = {
+    { "16", GL_DEPTH_COMPONENT16 },
+    { "24", GL_DEPTH_COMPONENT24 },
+    { "32f", GL_DEPTH_COMPONENT32F },
+};
+
+const NamedEnum paramNames[] = {
+    { "texture", GATHER_PARAMS_TEXTURE },
+    { "sampler", GATHER_PARAMS_SAMPLER },
+};
+
+const NamedEnum wrapNames[] = {
+    { "repeat", GL_REPEAT },
+    { "edge", GL_CLAMP_TO_EDGE },
+    { "border", GL_CLAMP_TO_BORDER },
+    { "mirror", GL_MIRRORED_REPEAT },
+    { "mirror-edge", GL_MIRROR_CLAMP_TO_EDGE },
+};
+
+const NamedEnum funcNames[] = {
+    { "never", GL_NEVER },
+    { "less", GL_LESS },
+    { "equal", GL_EQUAL },
+    { "lequal", GL_LEQUAL },
+    { "greater", GL_GREATER },
+    { "notequal", GL_NOTEQUAL },
+    { "gequal", GL_GEQUAL },
+    { "always", GL_ALWAYS },
+};
+
+const NamedEnum channelNames[] = {
+    { "r", GL_RED },
+    { "g", GL_GREEN },
+    { "b", GL_BLUE },
+    { "a", GL_ALPHA },
+    { "0", GL_ZERO },
+    { "1", GL_ONE },
+};
+
+template <size_t N>
+const char* enumName(const NamedEnum (&names)[N], GLenum value) {
+    for (const NamedEnum& named : names) {
+        if (named.value == value) {
+            return named.name;
+        }
+    }
+    return "?";
+}
+
+template <size_t N>
+bool parseEnum(const NamedEnum (&names)[N], const std::string& text, GLenum* value) {
+    for (const NamedEnum& named : names) {
+        if (text == named.name) {
+            *value = named.value;
+            return true;
+        }
+    }
+    return false;
+}
+
+std::vector<std::string> split(const std::string& text, char separator) {
+    std::vector<std::string> parts;
+    size_t start = 0;
+    for (;;) {
+        size_t end = text.find(separator, start);
+        parts.push_back(text.substr(start, end == std::string::npos ? std::string::npos : end - start));
+        if (end == std::string::npos) {
+            return parts;
+        }
+        start = end + 1;
+    }
+}
+
+// Depths on odd multiples of 1/32 plus exactly 0 and 1. The default refs sit on
+// multiples of 1/4, so a ref either equals a texel exactly (0 and 1, in every
+// format) or is at least 1/32 away from it.
+float depthPattern(int x, int y) {
+    int m = (x * 5 + y * 3) % 16;
+    if (m == 0) {
+        return 0.0f;
+    }
+    if (m == 15) {
+        return 1.0f;
+    }
+    return (2 * m + 1) / 32.0f;
+}
+
+// The value the texture itself holds when a sampler object is meant to override it.
+GLenum decoyFunc(GLenum func) {
+    return GL_ALWAYS - (func - GL_NEVER);
+}
+
+GLenum decoyWrap(GLenum wrap) {
+    return wrap == GL_REPEAT ? GL_CLAMP_TO_BORDER : GL_REPEAT;
+}
+
+double msSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+struct MatrixTexture {
+    GLuint id = 0;
+    GatherTexture ref;
+};
+
+struct MatrixState {
+    int texture;
+    GatherParamSource source;
+    GLenum wrap = 0;
+    GatherState gather;
+};
+
+struct Group {
+    MatrixState state;
+    size_t first;
+    size_t count;
+};
+
+// Sets each group's state through the gl_state cache, which drops whatever
+// already has the right value.
+class MatrixRenderer {
+public:
+    explicit MatrixRenderer(const GatherMatrixSpec& spec) : spec_(spec) {
+        textures_.resize(spec.formats.size() * spec.sizes.size());
+        sampler_ = glrCreate(GLR_SAMPLER, "matrix");
+        glsSamplerParameteri(sampler_, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glsSamplerParameteri(sampler_, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    }
+
+    ~MatrixRenderer() {
+        glsBindSampler(0, 0);
+        glrDelete(GLR_SAMPLER, sampler_);
+        for (MatrixTexture& texture : textures_) {
+            if (texture.id) {
+                glrDelete(GLR_TEXTURE, texture.id);
+            }
+        }
+    }
+
+    MatrixState stateAt(const GatherMatrixCursor& cursor, GatherDepthMode depthMode) {
+        MatrixState state;
+        state.texture = cursor.digit(AXIS_FORMAT) * spec_.sizes.size() + cursor.digit(AXIS_SIZE);
+        state.source = spec_.paramSources[cursor.digit(AXIS_PARAMS)];
+        state.wrap = spec_.wraps[cursor.digit(AXIS_WRAP)];
+        state.gather.compareFunc = spec_.compareFuncs[cursor.digit(AXIS_FUNC)];
+        for (int c = 0; c < 4; ++c) {
+            state.gather.swizzle[c] = spec_.swizzleChannels[cursor.digit(GatherMatrixAxis(AXIS_SWIZZLE_R + c))];
+        }
+        state.gather.depthMode = depthMode;
+        return state;
+    }
+
+    void apply(const MatrixState& state) {
+        MatrixTexture& texture = textures_[state.texture];
+        if (texture.id == 0) {
+            create(state.texture, &texture);
+        }
+        glsBindTexture(GL_TEXTURE_2D, texture.id);
+        glsBindSampler(0, state.source == GATHER_PARAMS_SAMPLER ? sampler_ : 0);
+
+        GLenum func = state.gather.compareFunc;
+        if (state.source == GATHER_PARAMS_TEXTURE) {
+            setTextureParams(GL_COMPARE_REF_TO_TEXTURE, func, state.wrap, 1.0f);
+        } else {
+            const float border[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+            glsSamplerParameteri(sampler_, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+            glsSamplerParameteri(sampler_, GL_TEXTURE_COMPARE_FUNC, func);
+            glsSamplerParameteri(sampler_, GL_TEXTURE_WRAP_S, state.wrap);
+            glsSamplerParameteri(sampler_, GL_TEXTURE_WRAP_T, state.wrap);
+            glsSamplerParameterfv(sampler_, GL_TEXTURE_BORDER_COLOR, border);
+            setTextureParams(GL_NONE, decoyFunc(func), decoyWrap(state.wrap), 0.0f);
+        }
+        const GLenum* swizzle = state.gather.swizzle;
+        glsTexSwizzle(GL_TEXTURE_2D, swizzle[0], swizzle[1], swizzle[2], swizzle[3]);
+    }
+
+    // The reference's view of the texture a state samples. Only valid after apply().
+    GatherTexture& reference(const MatrixState& state) {
+        GatherTexture& ref = textures_[state.texture].ref;
+        ref.wrapS = state.wrap;
+        ref.wrapT = state.wrap;
+        return ref;
+    }
+
+private:
+    void create(int index, MatrixTexture* texture) {
+        GatherTexture& ref = texture->ref;
+        ref.width = spec_.sizes[index % spec_.sizes.size()].first;
+        ref.height = spec_.sizes[index % spec_.sizes.size()].second;
+        ref.format = spec_.formats[index / spec_.sizes.size()];
+        ref.wrapS = GL_REPEAT;
+        ref.wrapT = GL_REPEAT;
+        ref.border = 1.0f;
+        std::vector<float> depths(size_t(ref.width) * ref.height);
+        for (int y = 0; y < ref.height; ++y) {
+            for (int x = 0; x < ref.width; ++x) {
+                depths[y * ref.width + x] = depthPattern(x, y);
+            }
+        }
+        setGatherTexels(&ref, depths.data());
+
+        texture->id = glrCreate(GLR_TEXTURE, "matrix depth");
+        glsBindTexture(GL_TEXTURE_2D, texture->id);
+        uploadGatherTexels(ref, depths.data());
+        glrSetBytes(GLR_TEXTURE, texture->id, glrTextureBytes(ref.format, ref.width, ref.height));
+        glsTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glsTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        checkError("matrix texture");
+    }
+
+    // On the texture apply() has just bound.
+    void setTextureParams(GLenum mode, GLenum func, GLenum wrap, float border) {
+        const float color[4] = { border, border, border, border };
+        glsTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE, mode);
+        glsTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_FUNC, func);
+        glsTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, wrap);
+        glsTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, wrap);
+        glsTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, color);
+    }
+
+    const GatherMatrixSpec& spec_;
+    std::vector<MatrixTexture> textures_;
+    GLuint sampler_ = 0;
+};
+
+void fillCase(const GatherMatrixSpec& spec, const GatherMatrixCursor& cursor, GatherCases* cases, size_t n) {
+    cases->s[n] = spec.coords[cursor.digit(AXIS_COORD)].first;
+    cases->t[n] = spec.coords[cursor.digit(AXIS_COORD)].second;
+    cases->offsetX[n] = spec.offsets[cursor.digit(AXIS_OFFSET)].first;
+    cases->offsetY[n] = spec.offsets[cursor.digit(AXIS_OFFSET)].second;
+    cases->ref[n] = spec.refs[cursor.digit(AXIS_REF)];
+}
+
+}  // namespace
+
+GatherMatrixSpec defaultGatherMatrixSpec() {
+    GatherMatrixSpec spec;
+    spec.formats = { GL_DEPTH_COMPONENT16, GL_DEPTH_COMPONENT24, GL_DEPTH_COMPONENT32F };
+    spec.sizes = { { 1, 1 }, { 2, 2 }, { 16, 16 } };
+    spec.paramSources = { GATHER_PARAMS_TEXTURE, GATHER_PARAMS_SAMPLER };
+    spec.wraps = { GL_REPEAT, GL_CLAMP_TO_BORDER };
+    for (const NamedEnum& func : funcNames) {
+        spec.compareFuncs.push_back(func.value);
+    }
+    for (const NamedEnum& channel : channelNames) {
+        spec.swizzleChannels.push_back(channel.value);
+    }
+    spec.coords = { { 0.5f, 0.5f }, { 0.3f, 0.7f }, { -0.4f, 1.6f } };
+    spec.offsets = { { 0, 0 }, { 1, -1 } };
+    spec.refs = { -0.25f, 0.0f, 0.25f, 0.5f, 0.75f, 1.0f, 1.25f };
+    return spec;
+}
+
+bool parseGatherMatrixSpec(const char* text, GatherMatrixSpec* spec) {
+    GatherMatrixSpec defaults = defaultGatherMatrixSpec();
+    for (const std::string& field : split(text, ';')) {
+        if (field.empty()) {
+            continue;
+        }
+        size_t equals = field.find('=');
+        std::string key = field.substr(0, equals);
+        std::string value = equals == std::string::npos ? "" : field.substr(equals + 1);
+        bool all = value == "all";
+        std::vector<std::string> values = split(value, ',');
+        bool ok = !value.empty();
+
+        if (key == "formats") {
+            spec->formats = defaults.formats;
+            if (!all) {
+                spec->formats.clear();
+                for (const std::string& v : values) {
+                    GLenum format = 0;
+                    ok = ok && parseEnum(formatNames, v, &format);
+                    spec->formats.push_back(format);
+                }
+            }
+        } else if (key == "sizes") {
+            spec->sizes = defaults.sizes;
+            if (!all) {
+                spec->sizes.clear();
+                for (const std::string& v : values) {
+                    int width = 0, height = 0;
+                    int end = 0;
+                    bool parsed = sscanf(v.c_str(), "%dx%d%n", &width, &height, &end) == 2 && end == (int)v.size();
+                    if (!parsed) {
+                        end = 0;
+                        parsed = sscanf(v.c_str(), "%d%n", &width, &end) == 1 && end == (int)v.size();
+                        height = width;
+                    }
+                    ok = ok && parsed && isGatherTextureSize(width) && isGatherTextureSize(height);
+                    spec->sizes.push_back({ width, height });
+                }
+            }
+        } else if (key == "params") {
+            spec->paramSources = defaults.paramSources;
+            if (!all) {
+                spec->paramSources.clear();
+                for (const std::string& v : values) {
+                    GLenum source = 0;
+                    ok = ok && parseEnum(paramNames, v, &source);
+                    spec->paramSources.push_back(GatherParamSource(source));
+                }
+            }
+        } else if (key == "wraps") {
+            spec->wraps = defaults.wraps;
+            if (!all) {
+                spec->wraps.clear();
+                for (const std::string& v : values) {
+                    GLenum wrap = 0;
+                    ok = ok && parseEnum(wrapNames, v, &wrap);
+                    spec->wraps.push_back(wrap);
+                }
+            }
+        } else if (key == "funcs") {
+            spec->compareFuncs = defaults.compareFuncs;
+            if (!all) {
+                spec->compareFuncs.clear();
+                for (const std::string& v : values) {
+                    GLenum func = 0;
+                    ok = ok && parseEnum(funcNames, v, &func);
+                    spec->compareFuncs.push_back(func);
+                }
+            }
+        } else if (key == "swizzles") {
+            spec->swizzleChannels = defaults.swizzleChannels;
+            if (!all) {
+                spec->swizzleChannels.clear();
+                for (char c : value) {
+                    GLenum channel = 0;
+                    ok = ok && parseEnum(channelNames, std::string(1, c), &channel);
+                    spec->swizzleChannels.push_back(channel);
+                }
+            }
+        } else if (key == "coords") {
+            spec->coords = defaults.coords;
+            if (!all) {
+                spec->coords.clear();
+                for (const std::string& v : values) {
+                    float s, t;
+                    int end = 0;
+                    ok = ok && sscanf(v.c_str(), "%f/%f%n", &s, &t, &end) == 2 && end == (int)v.size();
+                    spec->coords.push_back({ s, t });
+                }
+            }
+        } else if (key == "offsets") {
+            spec->offsets = defaults.offsets;
+            if (!all) {
+                spec->offsets.clear();
+                for (const std::string& v : values) {
+                    int x, y;
+                    int end = 0;
+                    ok = ok && sscanf(v.c_str(), "%d/%d%n", &x, &y, &end) == 2 && end == (int)v.size();
+                    spec->offsets.push_back({ x, y });
+                }
+            }
+        } else if (key == "refs") {
+            spec->refs = defaults.refs;
+            if (!all) {
+                spec->refs.clear();
+                for (const std::string& v : values) {
+                    char* end;
+                    spec->refs.push_back(strtof(v.c_str(), &end));
+                    ok = ok && *end == '\0' && end != v.c_str();
+                }
+            }
+        } else {
+            printf("unknown matrix axis '%s'\n", key.c_str());
+            return false;
+        }
+        if (!ok) {
+            printf("bad values for matrix axis '%s': %s\n", key.c_str(), value.c_str());
+            return false;
+        }
+    }
+    return true;
+}
+
+uint64_t gatherMatrixSize(const GatherMatrixSpec& spec) {
+    uint64_t swizzles = spec.swizzleChannels.size();
+    return uint64_t(spec.formats.size()) * spec.sizes.size() * spec.paramSources.size() * spec.wraps.size() *
+           spec.compareFuncs.size() * swizzles * swizzles * swizzles * swizzles *
+           spec.coords.size() * spec.offsets.size() * spec.refs.size();
+}
+
+GatherMatrixCursor::GatherMatrixCursor(const GatherMatrixSpec& spec, uint64_t begin, uint64_t end)
+    : changedAxis_(AXIS_FORMAT), position_(begin), end_(end), started_(false) {
+    radix_[AXIS_FORMAT] = spec.formats.size();
+    radix_[AXIS_SIZE] = spec.sizes.size();
+    radix_[AXIS_PARAMS] = spec.paramSources.size();
+    radix_[AXIS_WRAP] = spec.wraps.size();
+    radix_[AXIS_FUNC] = spec.compareFuncs.size();
+    for (int c = 0; c < 4; ++c) {
+        radix_[AXIS_SWIZZLE_R + c] = spec.swizzleChannels.size();
+    }
+    radix_[AXIS_COORD] = spec.coords.size();
+    radix_[AXIS_OFFSET] = spec.offsets.size();
+    radix_[AXIS_REF] = spec.refs.size();
+
+    uint64_t index = begin;
+    for (int axis = NUM_AXES - 1; axis >= 0; --axis) {
+        digits_[axis] = radix_[axis] ? int(index % radix_[axis]) : 0;
+        index = radix_[axis] ? index / radix_[axis] : 0;
+    }
+}
+
+bool GatherMatrixCursor::next() {
+    if (position_ >= end_) {
+        return false;
+    }
+    if (started_) {
+        for (int axis = NUM_AXES - 1; axis >= 0; --axis) {
+            if (++digits_[axis] < radix_[axis]) {
+                changedAxis_ = axis;
+                break;
+            }
+            digits_[axis] = 0;
+        }
+    }
+    started_ = true;
+    ++position_;
+    return true;
+}
+
+struct GatherMatrixRunner::Resources {
+    GLuint program;
+    GLuint buffer;
+    GLuint vertexArray;
+    GLRenderTarget atlas;
+    GatherImpl impl;
+    MatrixRenderer* renderer;
+    std::vector<Group> groups;
+    std::vector<float> vertices;
+    GatherCases cases;
+    std::vector<uint8_t> actual;
+    std::vector<uint8_t> expected;
+};
+
+GatherMatrixRunner::GatherMatrixRunner(const GatherMatrixSpec& spec) : spec_(spec), stats_() {
+    // Whatever ran before may have changed bindings without the state cache.
+    invalidateGLState();
+    depthMode_ = queryGatherDepthMode();
+
+    GLint minOffset = 0;
+    GLint maxOffset = 0;
+    glGetIntegerv(GL_MIN_PROGRAM_TEXTURE_GATHER_OFFSET, &minOffset);
+    glGetIntegerv(GL_MAX_PROGRAM_TEXTURE_GATHER_OFFSET, &maxOffset);
+    for (const std::pair<int, int>& offset : spec.offsets) {
+        if (std::min(offset.first, offset.second) < minOffset || std::max(offset.first, offset.second) > maxOffset) {
+            printf("Gather offset %d/%d is outside the supported range [%d, %d]\n",
+                   offset.first, offset.second, minOffset, maxOffset);
+            exit(1);
+        }
+    }
+
+    res_ = new Resources;
+    res_->impl = bestGatherImpl();
+    res_->program = createGatherPointProgram();
+    res_->vertexArray = createGatherPointVertexArray(&res_->buffer);
+    res_->atlas = acquireGatherAtlas(atlasSize);
+    glUseProgram(res_->program);
+    glViewport(0, 0, atlasSize, atlasSize);
+    checkError("matrix setup");
+    res_->renderer = new MatrixRenderer(spec);
+}
+
+GatherMatrixRunner::~GatherMatrixRunner() {
+    delete res_->renderer;
+    glUseProgram(0);
+    glBindVertexArray(0);
+    glsBindTexture(GL_TEXTURE_2D, 0);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    invalidateGLState();
+    glrDelete(GLR_BUFFER, res_->buffer);
+    glrDelete(GLR_VERTEX_ARRAY, res_->vertexArray);
+    glrReleaseRenderTarget(res_->atlas);
+    glrDelete(GLR_PROGRAM, res_->program);
+    checkError("matrix cleanup");
+    delete res_;
+}
+
+void GatherMatrixRunner::run(uint64_t begin, uint64_t end, uint8_t* results, int maxPrinted,
+                             std::vector<uint64_t>* mismatches) {
+    auto start = std::chrono::steady_clock::now();
+    GLStateStats stateBefore = getGLStateStats();
+    MatrixRenderer& renderer = *res_->renderer;
+    GatherCases& cases = res_->cases;
+    std::vector<Group>& groups = res_->groups;
+    std::vector<float>& vertices = res_->vertices;
+    std::vector<uint8_t>& actual = res_->actual;
+    std::vector<uint8_t>& expected = res_->expected;
+    if (end > begin && cases.size() < std::min<uint64_t>(casesPerChunk, end - begin)) {
+        cases.resize(std::min<uint64_t>(casesPerChunk, end - begin));
+        vertices.resize(cases.size() * gatherPointFloats);
+        // Whole rows are read back.
+        actual.resize((cases.size() + atlasSize - 1) / atlasSize * atlasSize * 4);
+        expected.resize(cases.size() * 4);
+    }
+
+    GatherMatrixCursor cursor(spec_, begin, end);
+    bool more = cursor.next();
+    uint64_t chunkBegin = begin;
+    while (more) {
+        // Enumerate a chunk, starting a new group whenever the GL state changes.
+        groups.clear();
+        size_t count = 0;
+        while (more && count < cases.size()) {
+            bool newState = cursor.changedAxis() < AXIS_COORD;
+            if (groups.empty() || newState) {
+                groups.push_back({ renderer.stateAt(cursor, depthMode_), count, 0 });
+                stats_.states += newState || cursor.position() == begin;
+            }
+            fillCase(spec_, cursor, &cases, count);
+            writeGatherPoint(&vertices[count * gatherPointFloats], count, atlasSize, cases, count);
+            ++groups.back().count;
+            ++count;
+            more = cursor.next();
+        }
+
+        glBufferData(GL_ARRAY_BUFFER, count * gatherPointFloats * sizeof(float), vertices.data(), GL_STREAM_DRAW);
+        glrSetBytes(GLR_BUFFER, res_->buffer, count * gatherPointFloats * sizeof(float));
+        for (Group& group : groups) {
+            renderer.apply(group.state);
+            glDrawArrays(GL_POINTS, (GLint)group.first, (GLsizei)group.count);
+            ++stats_.draws;
+        }
+        int rows = int((count + atlasSize - 1) / atlasSize);
+        glReadPixels(0, 0, atlasSize, rows, GL_RGBA, GL_UNSIGNED_BYTE, actual.data());
+        checkError("matrix chunk");
+
+        for (Group& group : groups) {
+            GatherTexture& ref = renderer.reference(group.state);
+            gatherReference(res_->impl, ref, group.state.gather, cases, group.first, group.count, &expected[group.first * 4]);
+        }
+        if (results) {
+            memcpy(results + (chunkBegin - begin) * 4, actual.data(), count * 4);
+        }
+        if (memcmp(actual.data(), expected.data(), count * 4) != 0) {
+            for (size_t n = 0; n < count; ++n) {
+                if (memcmp(&actual[n * 4], &expected[n * 4], 4) == 0) {
+                    continue;
+                }
+                if (mismatches && mismatches->size() < (size_t)maxPrinted) {
+                    mismatches->push_back(chunkBegin + n);
+                } else if (!mismatches && stats_.mismatches < (uint64_t)maxPrinted) {
+                    printGatherMismatch(spec_, chunkBegin + n, &expected[n * 4], &actual[n * 4]);
+                }
+                ++stats_.mismatches;
+            }
+        }
+        stats_.cases += count;
+        chunkBegin += count;
+    }
+    GLStateStats stateAfter = getGLStateStats();
+    stats_.stateCalls += stateAfter.issued - stateBefore.issued;
+    stats_.stateCallsElided += stateAfter.elided - stateBefore.elided;
+    stats_.ms += msSince(start);
+}
+
+GatherMatrixStats runGatherMatrix(const GatherMatrixSpec& spec, uint64_t begin, uint64_t end,
+                                  uint8_t* results, int maxPrinted) {
+    GatherMatrixRunner runner(spec);
+    runner.run(begin, end, results, maxPrinted);
+    return runner.stats();
+}
+
+void gatherMatrixExpected(const GatherMatrixSpec& spec, uint64_t index, GatherDepthMode depthMode, uint8_t* expected) {
+    GatherMatrixCursor cursor(spec, index, index + 1);
+    cursor.next();
+
+    GatherTexture tex;
+    tex.width = spec.sizes[cursor.digit(AXIS_SIZE)].first;
+    tex.height = spec.sizes[cursor.digit(AXIS_SIZE)].second;
+    tex.format = spec.formats[cursor.digit(AXIS_FORMAT)];
+    tex.wrapS = spec.wraps[cursor.digit(AXIS_WRAP)];
+    tex.wrapT = tex.wrapS;
+    tex.border = 1.0f;
+    std::vector<float> depths(size_t(tex.width) * tex.height);
+    for (int y = 0; y < tex.height; ++y) {
+        for (int x = 0; x < tex.width; ++x) {
+            depths[y * tex.width + x] = depthPattern(x, y);
+        }
+    }
+    setGatherTexels(&tex, depths.data());
+
+    GatherState state;
+    state.compareFunc = spec.compareFuncs[cursor.digit(AXIS_FUNC)];
+    for (int c = 0; c < 4; ++c) {
+        state.swizzle[c] = spec.swizzleChannels[cursor.digit(GatherMatrixAxis(AXIS_SWIZZLE_R + c))];
+    }
+    state.depthMode = depthMode;
+
+    GatherCases cases;
+    cases.resize(1);
+    fillCase(spec, cursor, &cases, 0);
+    gatherReference(GATHER_IMPL_SCALAR, tex, state, cases, 0, 1, expected);
+}
+
+void describeGatherCase(const GatherMatrixSpec& spec, uint64_t index, char* buf, size_t size) {
+    GatherMatrixCursor cursor(spec, index, index + 1);
+    cursor.next();
+    const std::pair<int, int>& texSize = spec.sizes[cursor.digit(AXIS_SIZE)];
+    snprintf(buf, size, "#%llu depth%s %dx%d %s params, wrap %s, func %s, swizzle %s%s%s%s, coord %g/%g offset %d/%d ref %g",
+             (unsigned long long)index,
+             enumName(formatNames, spec.formats[cursor.digit(AXIS_FORMAT)]), texSize.first, texSize.second,
+             enumName(paramNames, spec.paramSources[cursor.digit(AXIS_PARAMS)]),
+             enumName(wrapNames, spec.wraps[cursor.digit(AXIS_WRAP)]),
+             enumName(funcNames, spec.compareFuncs[cursor.digit(AXIS_FUNC)]),
+             enumName(channelNames, spec.swizzleChannels[cursor.digit(AXIS_SWIZZLE_R)]),
+             enumName(channelNames, spec.swizzleChannels[cursor.digit(AXIS_SWIZZLE_G)]),
+             enumName(channelNames, spec.swizzleChannels[cursor.digit(AXIS_SWIZZLE_B)]),
+             enumName(channelNames, spec.swizzleChannels[cursor.digit(AXIS_SWIZZLE_A)]),
+             spec.coords[cursor.digit(AXIS_COORD)].first, spec.coords[cursor.digit(AXIS_COORD)].second,
+             spec.offsets[cursor.digit(AXIS_OFFSET)].first, spec.offsets[cursor.digit(AXIS_OFFSET)].second,
+             spec.refs[cursor.digit(AXIS_REF)]);
+}
+
+void printGatherMismatch(const GatherMatrixSpec& spec, uint64_t index, const uint8_t* expected, const uint8_t* actual) {
+    char description[256];
+    describeGatherCase(spec, index, description, sizeof(description));
+    printf("mismatch: %s: expected %d %d %d %d got %d %d %d %d\n", description,
+           expected[0], expected[1], expected[2], expected[3], actual[0], actual[1], actual[2], actual[3]);
+}
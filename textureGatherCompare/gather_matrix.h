@@ -0,0 +1,142 @@
+#pragma once
+
+#include <stdint.h>
+#include <utility>
+#include <vector>
+
+#include "gather_reference.h"
+
+//-----------------------------------------------------------------------------------
+// Conformance matrix for textureGather with depth compare
+//
+// A GatherMatrixSpec lists the values to test along each axis and the matrix is
+// their full cross product, enumerated lazily in axis order with the last axis
+// varying fastest. The axes up to and including the swizzle are GL state; the
+// coord, offset and ref axes only change vertex data, so every run of cases
+// sharing a state becomes one draw of points into a large atlas. Adjacent states
+// usually differ in a single parameter and only that parameter is set.
+//-----------------------------------------------------------------------------------
+
+// Where the compare func and wrap modes come from. With GATHER_PARAMS_SAMPLER
+// the texture itself holds different values, which the sampler object must
+// override.
+enum GatherParamSource {
+    GATHER_PARAMS_TEXTURE,
+    GATHER_PARAMS_SAMPLER,
+};
+
+enum GatherMatrixAxis {
+    AXIS_FORMAT,
+    AXIS_SIZE,
+    AXIS_PARAMS,
+    AXIS_WRAP,
+    AXIS_FUNC,
+    AXIS_SWIZZLE_R,
+    AXIS_SWIZZLE_G,
+    AXIS_SWIZZLE_B,
+    AXIS_SWIZZLE_A,
+    AXIS_COORD,         // first per case axis
+    AXIS_OFFSET,
+    AXIS_REF,
+    NUM_AXES,
+};
+
+struct GatherMatrixSpec {
+    std::vector<GLenum> formats;
+    std::vector<std::pair<int, int>> sizes;         // width and height, powers of two
+    std::vector<GatherParamSource> paramSources;
+    std::vector<GLenum> wraps;                      // used for s and t
+    std::vector<GLenum> compareFuncs;
+    std::vector<GLenum> swizzleChannels;            // choices for each of the four components
+    std::vector<std::pair<float, float>> coords;
+    std::vector<std::pair<int, int>> offsets;
+    std::vector<float> refs;
+};
+
+// Every format, all eight compare funcs, both parameter sources and the full
+// 6^4 swizzle cross product.
+GatherMatrixSpec defaultGatherMatrixSpec();
+
+// Overrides axes of spec from text like "formats=16,32f;funcs=less,equal;swizzles=r01".
+// Keys: formats (16 24 32f), sizes (N for NxN, or WxH), params (texture sampler),
+// wraps (repeat edge border mirror mirror-edge), funcs (never less equal lequal
+// greater notequal gequal always), swizzles (letters from rgba01), coords (s/t),
+// offsets (x/y) and refs. "all" restores an axis' default, which for wraps is
+// repeat and border only. Prints a message and returns false on a parse error.
+bool parseGatherMatrixSpec(const char* text, GatherMatrixSpec* spec);
+
+// Total number of cases.
+uint64_t gatherMatrixSize(const GatherMatrixSpec& spec);
+
+// Walks [begin, end) of the matrix without materializing it.
+class GatherMatrixCursor {
+public:
+    GatherMatrixCursor(const GatherMatrixSpec& spec, uint64_t begin, uint64_t end);
+
+    // Moves to the next case. Returns false past the end.
+    bool next();
+
+    uint64_t position() const { return position_ - 1; }
+    int digit(GatherMatrixAxis axis) const { return digits_[axis]; }
+    // The outermost axis that changed in the last next(), AXIS_FORMAT on the first.
+    int changedAxis() const { return changedAxis_; }
+
+private:
+    int radix_[NUM_AXES];
+    int digits_[NUM_AXES];
+    int changedAxis_;
+    uint64_t position_;
+    uint64_t end_;
+    bool started_;
+};
+
+struct GatherMatrixStats {
+    uint64_t cases;
+    uint64_t mismatches;
+    uint64_t states;            // distinct runs of GL state
+    uint64_t draws;
+    uint64_t stateCalls;        // GL state setting calls made
+    uint64_t stateCallsElided;  // state settings skipped because nothing changed
+    double ms;
+};
+
+// Keeps the program, atlas, textures and shadowed GL state between runs over
+// parts of one matrix. Needs the same current context for its whole lifetime.
+class GatherMatrixRunner {
+public:
+    explicit GatherMatrixRunner(const GatherMatrixSpec& spec);
+    ~GatherMatrixRunner();
+
+    // Renders cases [begin, end) and checks each against gatherReference(). If
+    // results isn't null the rendered RGBA8 value of case i is written to
+    // results[(i - begin) * 4]. The first maxPrinted mismatches are printed, or
+    // when mismatches isn't null, appended to it until it holds maxPrinted.
+    void run(uint64_t begin, uint64_t end, uint8_t* results, int maxPrinted,
+             std::vector<uint64_t>* mismatches = nullptr);
+
+    // Totals over every run().
+    const GatherMatrixStats& stats() const { return stats_; }
+    GatherDepthMode depthMode() const { return depthMode_; }
+
+private:
+    struct Resources;
+
+    const GatherMatrixSpec& spec_;
+    GatherMatrixStats stats_;
+    GatherDepthMode depthMode_;
+    Resources* res_;
+};
+
+// Renders cases [begin, end) and checks each against gatherReference(). Needs a
+// current context. If results isn't null the rendered RGBA8 value of case i is
+// written to results[(i - begin) * 4]. Prints the first maxPrinted mismatches.
+GatherMatrixStats runGatherMatrix(const GatherMatrixSpec& spec, uint64_t begin, uint64_t end,
+                                  uint8_t* results = nullptr, int maxPrinted = 10);
+
+// The reference result for one case.
+void gatherMatrixExpected(const GatherMatrixSpec& spec, uint64_t index, GatherDepthMode depthMode, uint8_t* expected);
+
+// One line description of a case, for mismatch reports.
+void describeGatherCase(const GatherMatrixSpec& spec, uint64_t index, char* buf, size_t size);
+
+void printGatherMismatch(const GatherMatrixSpec& spec, uint64_t index, const uint8_t* expected, const uint8_t* actual);
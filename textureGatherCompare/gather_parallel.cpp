@@ -0,0 +1,136 @@
+#include "gather_parallel.h"
+
+#include <stdio.h>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "../common/gl_trace.h"
+#include "../common/worker_pool.h"
+
+namespace {
+
+// Small enough that stealing can even out the last few chunks, large enough
+// that each one still fills a good part of the atlas.
+const uint64_t casesPerChunk = 65536;
+
+struct WorkerSlot {
+    GatherMatrixStats stats;
+    GatherDepthMode depthMode;
+    bool finished;              // stats and depthMode are set
+};
+
+// Everything the workers write. The pointers are set before the fork and refer
+// to shared memory.
+struct ParallelRun {
+    const GatherMatrixSpec* spec;
+    GLContextOptions options;
+    GatherWorkerGLOptions glOptions;
+    int maxPrinted;
+    SharedWorkQueue* queue;
+    uint8_t* results;
+    WorkerSlot* slots;
+    // Per chunk, the number of recorded mismatches followed by room for maxPrinted indices.
+    uint64_t* chunkMismatches;
+};
+
+int runWorker(int worker, void* user) {
+    ParallelRun& run = *(ParallelRun*)user;
+    GLContext* ctx = createGLContext(run.options);
+    init_gl_functions(ctx, run.glOptions.loadMode);
+    if (run.glOptions.tracePath) {
+        std::string path = std::string(run.glOptions.tracePath) + "." + std::to_string(worker);
+        startGLTrace(ctx, run.options, path.c_str());
+    }
+    setGLErrorMode(run.glOptions.errorMode, run.glOptions.debugSeverity);
+    {
+        GatherMatrixRunner runner(*run.spec);
+        std::vector<uint64_t> mismatches;
+        uint64_t begin;
+        uint64_t end;
+        while (run.queue->take(worker, &begin, &end)) {
+            mismatches.clear();
+            runner.run(begin, end, run.results + begin * 4, run.maxPrinted, &mismatches);
+            uint64_t* record = run.chunkMismatches + run.queue->chunkIndex(begin) * (run.maxPrinted + 1);
+            record[0] = mismatches.size();
+            for (size_t i = 0; i < mismatches.size(); ++i) {
+                record[i + 1] = mismatches[i];
+            }
+        }
+        run.slots[worker].stats = runner.stats();
+        run.slots[worker].depthMode = runner.depthMode();
+        run.slots[worker].finished = true;
+    }
+    if (run.glOptions.tracePath) {
+        stopGLTrace();
+    }
+    destroyGLContext(ctx);
+    return 0;
+}
+
+}  // namespace
+
+GatherParallelResult runGatherMatrixParallel(const GatherMatrixSpec& spec, const GLContextOptions& options,
+                                             const GatherWorkerGLOptions& glOptions, int numWorkers,
+                                             int maxPrinted) {
+    auto start = std::chrono::steady_clock::now();
+    uint64_t numCases = gatherMatrixSize(spec);
+
+    ParallelRun run;
+    run.spec = &spec;
+    run.options = options;
+    run.glOptions = glOptions;
+    run.maxPrinted = maxPrinted;
+    run.queue = SharedWorkQueue::create(numWorkers, numCases, casesPerChunk);
+    size_t resultsSize = numCases * 4;
+    size_t slotsSize = numWorkers * sizeof(WorkerSlot);
+    size_t mismatchesSize = run.queue->numChunks() * (maxPrinted + 1) * sizeof(uint64_t);
+    run.results = (uint8_t*)allocShared(resultsSize);
+    run.slots = (WorkerSlot*)allocShared(slotsSize);
+    run.chunkMismatches = (uint64_t*)allocShared(mismatchesSize);
+
+    GatherParallelResult result = {};
+    result.workers = numWorkers;
+    result.failedWorkers = runWorkerProcesses(numWorkers, runWorker, &run);
+
+    for (int i = 0; i < numWorkers; ++i) {
+        const GatherMatrixStats& stats = run.slots[i].stats;
+        result.stats.cases += stats.cases;
+        result.stats.mismatches += stats.mismatches;
+        result.stats.states += stats.states;
+        result.stats.draws += stats.draws;
+        result.stats.stateCalls += stats.stateCalls;
+        result.stats.stateCallsElided += stats.stateCallsElided;
+        result.chunks += run.queue->workerStats(i).chunks;
+        result.stolenChunks += run.queue->workerStats(i).stolen;
+    }
+
+    // Merge in case order. Every worker sees the same depth mode since they
+    // all create their contexts the same way, but only one that finished is
+    // known to have recorded it. Without one there is nothing to compare against.
+    const WorkerSlot* finished = nullptr;
+    for (int i = 0; i < numWorkers && !finished; ++i) {
+        finished = run.slots[i].finished ? &run.slots[i] : nullptr;
+    }
+    int printed = finished ? 0 : maxPrinted;
+    for (uint64_t chunk = 0; chunk < run.queue->numChunks() && printed < maxPrinted; ++chunk) {
+        const uint64_t* record = run.chunkMismatches + chunk * (maxPrinted + 1);
+        for (uint64_t i = 0; i < record[0] && printed < maxPrinted; ++i, ++printed) {
+            uint8_t expected[4];
+            gatherMatrixExpected(spec, record[i + 1], finished->depthMode, expected);
+            printGatherMismatch(spec, record[i + 1], expected, run.results + record[i + 1] * 4);
+        }
+    }
+    uint64_t hash = 14695981039346656037ull;
+    for (size_t i = 0; i < resultsSize; ++i) {
+        hash = (hash ^ run.results[i]) * 1099511628211ull;
+    }
+    result.resultsHash = hash;
+
+    freeShared(run.chunkMismatches, mismatchesSize);
+    freeShared(run.slots, slotsSize);
+    freeShared(run.results, resultsSize);
+    SharedWorkQueue::destroy(run.queue);
+    result.stats.ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    return result;
+}
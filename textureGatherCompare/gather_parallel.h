@@ -0,0 +1,42 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "../common/gl_context.h"
+#include "../common/gl_debug.h"
+#include "../common/gl_loader.h"
+#include "gather_matrix.h"
+
+//-----------------------------------------------------------------------------------
+// The conformance matrix split across forked worker processes
+//
+// Each worker creates its own context from the same options, loads and checks
+// GL the way a single-process run would, and runs a
+// GatherMatrixRunner over chunks taken from a SharedWorkQueue. Rendered results
+// go to one shared array indexed by case and each chunk records its first
+// mismatches, so the parent reports the same mismatches in the same order, and
+// the same results hash, whatever the number of workers.
+//-----------------------------------------------------------------------------------
+
+// How each worker sets up GL after creating its context.
+struct GatherWorkerGLOptions {
+    GLLoadMode loadMode = GL_LOAD_LAZY;
+    GLErrorMode errorMode = GL_ERRORS_POLL;
+    GLenum debugSeverity = GL_DEBUG_SEVERITY_MEDIUM;
+    const char* tracePath = nullptr;    // worker N traces to tracePath.N
+};
+
+struct GatherParallelResult {
+    GatherMatrixStats stats;    // summed over the workers, except ms which is wall time
+    int workers;
+    int failedWorkers;
+    uint64_t chunks;
+    uint64_t stolenChunks;
+    uint64_t resultsHash;       // FNV-1a of every rendered result in case order
+};
+
+// Call before this process creates a context. Prints the first maxPrinted
+// mismatches in case order.
+GatherParallelResult runGatherMatrixParallel(const GatherMatrixSpec& spec, const GLContextOptions& options,
+                                             const GatherWorkerGLOptions& glOptions, int numWorkers,
+                                             int maxPrinted = 10);
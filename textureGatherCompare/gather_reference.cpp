@@ -0,0 +1,415 @@
+#include "gather_reference.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+
+#if defined(__SSE2__)
+#define GATHER_X86 1
+#include <immintrin.h>
+#endif
+
+void GatherCases::resize(size_t n) {
+    s.resize(n);
+    t.resize(n);
+    ref.resize(n);
+    offsetX.resize(n);
+    offsetY.resize(n);
+}
+
+float quantizeDepth(GLenum format, float depth) {
+    switch (format) {
+        case GL_DEPTH_COMPONENT16:
+            depth = std::min(std::max(depth, 0.0f), 1.0f);
+            return float(nearbyint(depth * 65535.0) / 65535.0);
+        case GL_DEPTH_COMPONENT24:
+            depth = std::min(std::max(depth, 0.0f), 1.0f);
+            return float(nearbyint(depth * 16777215.0) / 16777215.0);
+        case GL_DEPTH_COMPONENT32F:
+            return depth;
+        default:
+            printf("quantizeDepth: unsupported format 0x%x\n", format);
+            exit(1);
+    }
+}
+
+bool isGatherTextureSize(int size) {
+    return size >= 1 && size <= 1024 && (size & (size - 1)) == 0;
+}
+
+void setGatherTexels(GatherTexture* tex, const float* depths) {
+    if (!isGatherTextureSize(tex->width) || !isGatherTextureSize(tex->height)) {
+        printf("setGatherTexels: %dx%d isn't a supported size\n", tex->width, tex->height);
+        exit(1);
+    }
+    // Room for the texels plus one border texel on each side.
+    tex->strideShift = 2;
+    while ((1 << tex->strideShift) < tex->width + 2) {
+        ++tex->strideShift;
+    }
+    float border = quantizeDepth(tex->format, tex->border);
+    tex->texels.assign(size_t(tex->height + 2) << tex->strideShift, border);
+    for (int y = 0; y < tex->height; ++y) {
+        for (int x = 0; x < tex->width; ++x) {
+            tex->texels[(size_t(y + 1) << tex->strideShift) + x + 1] =
+                quantizeDepth(tex->format, depths[y * tex->width + x]);
+        }
+    }
+}
+
+namespace {
+
+// Everything about a call that doesn't change per case.
+struct Setup {
+    const float* texels;
+    int shift;
+    float width;
+    float height;
+    int width1;         // width - 1
+    int height1;
+    GLenum wrapS;
+    GLenum wrapT;
+    bool clampRef;
+    bool lt;            // the compare function's "ref < texel" bit
+    bool eq;
+    bool gt;
+    uint8_t resultMask; // 0xFF if the swizzled red channel is the comparison result
+    uint8_t constant;   // otherwise the channel's constant value
+};
+
+Setup makeSetup(const GatherTexture& tex, const GatherState& state) {
+    if (tex.texels.empty()) {
+        printf("gatherReference: call setGatherTexels first\n");
+        exit(1);
+    }
+    Setup setup;
+    setup.texels = tex.texels.data();
+    setup.shift = tex.strideShift;
+    setup.width = (float)tex.width;
+    setup.height = (float)tex.height;
+    setup.width1 = tex.width - 1;
+    setup.height1 = tex.height - 1;
+    setup.wrapS = tex.wrapS;
+    setup.wrapT = tex.wrapT;
+    setup.clampRef = tex.format != GL_DEPTH_COMPONENT32F;
+
+    // GL_NEVER through GL_ALWAYS are 0x200 + (gt << 2 | eq << 1 | lt).
+    if (state.compareFunc < GL_NEVER || state.compareFunc > GL_ALWAYS) {
+        printf("gatherReference: bad compare func 0x%x\n", state.compareFunc);
+        exit(1);
+    }
+    int bits = state.compareFunc - GL_NEVER;
+    setup.lt = bits & 1;
+    setup.eq = bits & 2;
+    setup.gt = bits & 4;
+
+    bool luminance = state.depthMode == GATHER_DEPTH_LUMINANCE;
+    switch (state.swizzle[0]) {
+        case GL_RED:   setup.resultMask = 0xFF; setup.constant = 0; break;
+        case GL_GREEN:
+        case GL_BLUE:  setup.resultMask = luminance ? 0xFF : 0; setup.constant = 0; break;
+        case GL_ALPHA:
+        case GL_ONE:   setup.resultMask = 0; setup.constant = 0xFF; break;
+        case GL_ZERO:  setup.resultMask = 0; setup.constant = 0; break;
+        default:
+            printf("gatherReference: bad swizzle 0x%x\n", state.swizzle[0]);
+            exit(1);
+    }
+    return setup;
+}
+
+int wrapIndex(GLenum wrap, int i, int size1) {
+    switch (wrap) {
+        case GL_REPEAT:
+            return i & size1;
+        case GL_CLAMP_TO_EDGE:
+            return std::min(std::max(i, 0), size1);
+        case GL_CLAMP_TO_BORDER:
+            return std::min(std::max(i, -1), size1 + 1);
+        case GL_MIRRORED_REPEAT: {
+            // Fold into [0, 2 * size) and reflect the upper half.
+            int period1 = size1 * 2 + 1;
+            int k = i & period1;
+            return k > size1 ? k ^ period1 : k;
+        }
+        case GL_MIRROR_CLAMP_TO_EDGE:
+            return std::min(i < 0 ? ~i : i, size1);
+        default:
+            printf("gatherReference: bad wrap mode 0x%x\n", wrap);
+            exit(1);
+    }
+}
+
+void gatherScalar(const Setup& setup, const GatherCases& cases, size_t first, size_t count, uint8_t* out) {
+    for (size_t n = first; n < first + count; ++n) {
+        int i0 = (int)floorf(cases.s[n] * setup.width - 0.5f) + cases.offsetX[n];
+        int j0 = (int)floorf(cases.t[n] * setup.height - 0.5f) + cases.offsetY[n];
+        int i[2] = { wrapIndex(setup.wrapS, i0, setup.width1), wrapIndex(setup.wrapS, i0 + 1, setup.width1) };
+        int j[2] = { wrapIndex(setup.wrapT, j0, setup.height1), wrapIndex(setup.wrapT, j0 + 1, setup.height1) };
+
+        float ref = cases.ref[n];
+        if (setup.clampRef) {
+            ref = std::min(std::max(ref, 0.0f), 1.0f);
+        }
+
+        static const int footprint[4][2] = { { 0, 1 }, { 1, 1 }, { 1, 0 }, { 0, 0 } };
+        for (int c = 0; c < 4; ++c) {
+            float texel = setup.texels[((j[footprint[c][1]] + 1) << setup.shift) + i[footprint[c][0]] + 1];
+            bool pass = (setup.lt && ref < texel) || (setup.eq && ref == texel) || (setup.gt && ref > texel);
+            out[(n - first) * 4 + c] = ((pass ? 0xFF : 0) & setup.resultMask) | setup.constant;
+        }
+    }
+}
+
+#if GATHER_X86
+
+//-----------------------------------------------------------------------------------
+// SSE2, four cases at a time
+//-----------------------------------------------------------------------------------
+
+__m128i select128(__m128i mask, __m128i a, __m128i b) {
+    return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+}
+
+// SSE2 has no 32 bit integer min/max.
+__m128i clamp128(__m128i v, int lo, int hi) {
+    __m128i vlo = _mm_set1_epi32(lo);
+    __m128i vhi = _mm_set1_epi32(hi);
+    v = select128(_mm_cmplt_epi32(v, vlo), vlo, v);
+    return select128(_mm_cmpgt_epi32(v, vhi), vhi, v);
+}
+
+__m128i floor128(__m128 v) {
+    __m128i truncated = _mm_cvttps_epi32(v);
+    // Adds -1 where truncation rounded up.
+    return _mm_add_epi32(truncated, _mm_castps_si128(_mm_cmplt_ps(v, _mm_cvtepi32_ps(truncated))));
+}
+
+__m128i wrap128(GLenum wrap, __m128i i, int size1) {
+    switch (wrap) {
+        case GL_REPEAT:
+            return _mm_and_si128(i, _mm_set1_epi32(size1));
+        case GL_CLAMP_TO_EDGE:
+            return clamp128(i, 0, size1);
+        case GL_CLAMP_TO_BORDER:
+            return clamp128(i, -1, size1 + 1);
+        case GL_MIRRORED_REPEAT: {
+            __m128i period1 = _mm_set1_epi32(size1 * 2 + 1);
+            __m128i k = _mm_and_si128(i, period1);
+            return _mm_xor_si128(k, _mm_and_si128(_mm_cmpgt_epi32(k, _mm_set1_epi32(size1)), period1));
+        }
+        case GL_MIRROR_CLAMP_TO_EDGE: {
+            __m128i m = _mm_xor_si128(i, _mm_srai_epi32(i, 31));
+            return select128(_mm_cmpgt_epi32(m, _mm_set1_epi32(size1)), _mm_set1_epi32(size1), m);
+        }
+        default:
+            // Validated by gatherReference() before getting here.
+            return i;
+    }
+}
+
+__m128 fetch128(const float* texels, __m128i index) {
+    alignas(16) int32_t lanes[4];
+    _mm_store_si128((__m128i*)lanes, index);
+    return _mm_setr_ps(texels[lanes[0]], texels[lanes[1]], texels[lanes[2]], texels[lanes[3]]);
+}
+
+void gatherSSE2(const Setup& setup, const GatherCases& cases, size_t first, size_t count, uint8_t* out) {
+    const __m128 width = _mm_set1_ps(setup.width);
+    const __m128 height = _mm_set1_ps(setup.height);
+    const __m128 half = _mm_set1_ps(0.5f);
+    const __m128 lt = _mm_castsi128_ps(_mm_set1_epi32(setup.lt ? -1 : 0));
+    const __m128 eq = _mm_castsi128_ps(_mm_set1_epi32(setup.eq ? -1 : 0));
+    const __m128 gt = _mm_castsi128_ps(_mm_set1_epi32(setup.gt ? -1 : 0));
+    const __m128i one = _mm_set1_epi32(1);
+    const __m128i resultMask = _mm_set1_epi8((char)setup.resultMask);
+    const __m128i constant = _mm_set1_epi8((char)setup.constant);
+    const __m128i shift = _mm_cvtsi32_si128(setup.shift);
+
+    size_t n = first;
+    for (; n + 4 <= first + count; n += 4) {
+        __m128i i0 = _mm_add_epi32(floor128(_mm_sub_ps(_mm_mul_ps(_mm_loadu_ps(&cases.s[n]), width), half)),
+                                   _mm_loadu_si128((const __m128i*)&cases.offsetX[n]));
+        __m128i j0 = _mm_add_epi32(floor128(_mm_sub_ps(_mm_mul_ps(_mm_loadu_ps(&cases.t[n]), height), half)),
+                                   _mm_loadu_si128((const __m128i*)&cases.offsetY[n]));
+        __m128i i1 = _mm_add_epi32(wrap128(setup.wrapS, _mm_add_epi32(i0, one), setup.width1), one);
+        __m128i j1 = _mm_add_epi32(wrap128(setup.wrapT, _mm_add_epi32(j0, one), setup.height1), one);
+        i0 = _mm_add_epi32(wrap128(setup.wrapS, i0, setup.width1), one);
+        j0 = _mm_add_epi32(wrap128(setup.wrapT, j0, setup.height1), one);
+        j0 = _mm_sll_epi32(j0, shift);
+        j1 = _mm_sll_epi32(j1, shift);
+
+        __m128 ref = _mm_loadu_ps(&cases.ref[n]);
+        if (setup.clampRef) {
+            ref = _mm_min_ps(_mm_max_ps(ref, _mm_setzero_ps()), _mm_set1_ps(1.0f));
+        }
+
+        __m128 pass[4];
+        const __m128i texelIndex[4] = {
+            _mm_add_epi32(j1, i0), _mm_add_epi32(j1, i1), _mm_add_epi32(j0, i1), _mm_add_epi32(j0, i0),
+        };
+        for (int c = 0; c < 4; ++c) {
+            __m128 texel = fetch128(setup.texels, texelIndex[c]);
+            pass[c] = _mm_or_ps(_mm_or_ps(_mm_and_ps(lt, _mm_cmplt_ps(ref, texel)),
+                                          _mm_and_ps(eq, _mm_cmpeq_ps(ref, texel))),
+                                _mm_and_ps(gt, _mm_cmpgt_ps(ref, texel)));
+        }
+
+        // Rows of cases, then all-ones lanes saturate to 0xFF bytes.
+        _MM_TRANSPOSE4_PS(pass[0], pass[1], pass[2], pass[3]);
+        __m128i bytes = _mm_packs_epi16(
+            _mm_packs_epi32(_mm_castps_si128(pass[0]), _mm_castps_si128(pass[1])),
+            _mm_packs_epi32(_mm_castps_si128(pass[2]), _mm_castps_si128(pass[3])));
+        bytes = _mm_or_si128(_mm_and_si128(bytes, resultMask), constant);
+        _mm_storeu_si128((__m128i*)(out + (n - first) * 4), bytes);
+    }
+    gatherScalar(setup, cases, n, first + count - n, out + (n - first) * 4);
+}
+
+//-----------------------------------------------------------------------------------
+// AVX2, eight cases at a time. Built for AVX2 regardless of the compiler flags and
+// only called when the CPU has it.
+//-----------------------------------------------------------------------------------
+
+#define GATHER_AVX2 __attribute__((target("avx2")))
+
+GATHER_AVX2 __m256i wrap256(GLenum wrap, __m256i i, int size1) {
+    __m256i vsize1 = _mm256_set1_epi32(size1);
+    switch (wrap) {
+        case GL_REPEAT:
+            return _mm256_and_si256(i, vsize1);
+        case GL_CLAMP_TO_EDGE:
+            return _mm256_min_epi32(_mm256_max_epi32(i, _mm256_setzero_si256()), vsize1);
+        case GL_CLAMP_TO_BORDER:
+            return _mm256_min_epi32(_mm256_max_epi32(i, _mm256_set1_epi32(-1)), _mm256_set1_epi32(size1 + 1));
+        case GL_MIRRORED_REPEAT: {
+            __m256i period1 = _mm256_set1_epi32(size1 * 2 + 1);
+            __m256i k = _mm256_and_si256(i, period1);
+            return _mm256_xor_si256(k, _mm256_and_si256(_mm256_cmpgt_epi32(k, vsize1), period1));
+        }
+        case GL_MIRROR_CLAMP_TO_EDGE:
+            return _mm256_min_epi32(_mm256_xor_si256(i, _mm256_srai_epi32(i, 31)), vsize1);
+        default:
+            // Validated by gatherReference() before getting here.
+            return i;
+    }
+}
+
+GATHER_AVX2 void gatherAVX2(const Setup& setup, const GatherCases& cases, size_t first, size_t count, uint8_t* out) {
+    const __m256 width = _mm256_set1_ps(setup.width);
+    const __m256 height = _mm256_set1_ps(setup.height);
+    const __m256 half = _mm256_set1_ps(0.5f);
+    const __m256 lt = _mm256_castsi256_ps(_mm256_set1_epi32(setup.lt ? -1 : 0));
+    const __m256 eq = _mm256_castsi256_ps(_mm256_set1_epi32(setup.eq ? -1 : 0));
+    const __m256 gt = _mm256_castsi256_ps(_mm256_set1_epi32(setup.gt ? -1 : 0));
+    const __m256i one = _mm256_set1_epi32(1);
+    const __m256i resultMask = _mm256_set1_epi8((char)setup.resultMask);
+    const __m256i constant = _mm256_set1_epi8((char)setup.constant);
+    const __m128i shift = _mm_cvtsi32_si128(setup.shift);
+    // Within each 128 bit lane: x0-3 y0-3 z0-3 w0-3 -> x0 y0 z0 w0 x1 ...
+    const __m256i transpose = _mm256_setr_epi8(0, 4, 8, 12, 1, 5, 9, 13, 2, 6, 10, 14, 3, 7, 11, 15,
+                                               0, 4, 8, 12, 1, 5, 9, 13, 2, 6, 10, 14, 3, 7, 11, 15);
+
+    size_t n = first;
+    for (; n + 8 <= first + count; n += 8) {
+        __m256i i0 = _mm256_add_epi32(
+            _mm256_cvttps_epi32(_mm256_floor_ps(_mm256_sub_ps(_mm256_mul_ps(_mm256_loadu_ps(&cases.s[n]), width), half))),
+            _mm256_loadu_si256((const __m256i*)&cases.offsetX[n]));
+        __m256i j0 = _mm256_add_epi32(
+            _mm256_cvttps_epi32(_mm256_floor_ps(_mm256_sub_ps(_mm256_mul_ps(_mm256_loadu_ps(&cases.t[n]), height), half))),
+            _mm256_loadu_si256((const __m256i*)&cases.offsetY[n]));
+        __m256i i1 = _mm256_add_epi32(wrap256(setup.wrapS, _mm256_add_epi32(i0, one), setup.width1), one);
+        __m256i j1 = _mm256_add_epi32(wrap256(setup.wrapT, _mm256_add_epi32(j0, one), setup.height1), one);
+        i0 = _mm256_add_epi32(wrap256(setup.wrapS, i0, setup.width1), one);
+        j0 = _mm256_add_epi32(wrap256(setup.wrapT, j0, setup.height1), one);
+        j0 = _mm256_sll_epi32(j0, shift);
+        j1 = _mm256_sll_epi32(j1, shift);
+
+        __m256 ref = _mm256_loadu_ps(&cases.ref[n]);
+        if (setup.clampRef) {
+            ref = _mm256_min_ps(_mm256_max_ps(ref, _mm256_setzero_ps()), _mm256_set1_ps(1.0f));
+        }
+
+        __m256i pass[4];
+        const __m256i texelIndex[4] = {
+            _mm256_add_epi32(j1, i0), _mm256_add_epi32(j1, i1), _mm256_add_epi32(j0, i1), _mm256_add_epi32(j0, i0),
+        };
+        for (int c = 0; c < 4; ++c) {
+            __m256 texel = _mm256_i32gather_ps(setup.texels, texelIndex[c], 4);
+            pass[c] = _mm256_castps_si256(_mm256_or_ps(
+                _mm256_or_ps(_mm256_and_ps(lt, _mm256_cmp_ps(ref, texel, _CMP_LT_OQ)),
+                             _mm256_and_ps(eq, _mm256_cmp_ps(ref, texel, _CMP_EQ_OQ))),
+                _mm256_and_ps(gt, _mm256_cmp_ps(ref, texel, _CMP_GT_OQ))));
+        }
+
+        __m256i bytes = _mm256_packs_epi16(_mm256_packs_epi32(pass[0], pass[1]), _mm256_packs_epi32(pass[2], pass[3]));
+        bytes = _mm256_shuffle_epi8(bytes, transpose);
+        bytes = _mm256_or_si256(_mm256_and_si256(bytes, resultMask), constant);
+        _mm256_storeu_si256((__m256i*)(out + (n - first) * 4), bytes);
+    }
+    gatherScalar(setup, cases, n, first + count - n, out + (n - first) * 4);
+}
+
+#endif  // GATHER_X86
+
+}  // namespace
+
+void gatherReference(GatherImpl impl, const GatherTexture& tex, const GatherState& state,
+                     const GatherCases& cases, size_t first, size_t count, uint8_t* out) {
+    Setup setup = makeSetup(tex, state);
+    // Validates the wrap modes once so the vector versions don't have to.
+    wrapIndex(tex.wrapS, 0, setup.width1);
+    wrapIndex(tex.wrapT, 0, setup.height1);
+
+    switch (impl) {
+#if GATHER_X86
+        case GATHER_IMPL_SSE2:
+            gatherSSE2(setup, cases, first, count, out);
+            return;
+        case GATHER_IMPL_AVX2:
+            if (gatherImplSupported(GATHER_IMPL_AVX2)) {
+                gatherAVX2(setup, cases, first, count, out);
+                return;
+            }
+            break;
+#endif
+        default:
+            break;
+    }
+    gatherScalar(setup, cases, first, count, out);
+}
+
+bool gatherImplSupported(GatherImpl impl) {
+    switch (impl) {
+        case GATHER_IMPL_SCALAR:
+            return true;
+#if GATHER_X86
+        case GATHER_IMPL_SSE2:
+            return __builtin_cpu_supports("sse2");
+        case GATHER_IMPL_AVX2:
+            return __builtin_cpu_supports("avx2");
+#endif
+        default:
+            return false;
+    }
+}
+
+GatherImpl bestGatherImpl() {
+    if (gatherImplSupported(GATHER_IMPL_AVX2)) {
+        return GATHER_IMPL_AVX2;
+    }
+    if (gatherImplSupported(GATHER_IMPL_SSE2)) {
+        return GATHER_IMPL_SSE2;
+    }
+    return GATHER_IMPL_SCALAR;
+}
+
+const char* gatherImplToString(GatherImpl impl) {
+    switch (impl) {
+        case GATHER_IMPL_SCALAR: return "scalar";
+        case GATHER_IMPL_SSE2: return "sse2";
+        case GATHER_IMPL_AVX2: return "avx2";
+        default: return "unknown";
+    }
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+#include "../common/gl_loader.h"
+
+//-----------------------------------------------------------------------------------
+// CPU reference for textureGather on a depth texture with compare
+//
+// Computes what textureGatherOffset(sampler2DShadow, vec2(s, t), ref, offset)
+// should render into an RGBA8 target, following the GL 4.6 rules: the 2x2 texel
+// footprint is floor(coord * size - 0.5) + offset, each texel index is wrapped
+// on its own, the comparison is "ref <func> texel" with ref and texel clamped
+// to [0, 1] for fixed point formats, and the gathered component is the swizzled
+// red channel of the comparison result. Component x is texel (i0, j1), y (i1, j1),
+// z (i1, j0) and w (i0, j0).
+//
+// Cases are stored as structures of arrays and evaluated four (SSE2) or eight
+// (AVX2) at a time. The scalar version is the one to read; the others must
+// produce the same bytes.
+//-----------------------------------------------------------------------------------
+
+// What a depth texture's comparison result looks like before swizzling. Core
+// profiles return (D, 0, 0, 1); compatibility profiles default to
+// GL_DEPTH_TEXTURE_MODE GL_LUMINANCE, which returns (D, D, D, 1).
+enum GatherDepthMode {
+    GATHER_DEPTH_RED,
+    GATHER_DEPTH_LUMINANCE,
+};
+
+enum GatherImpl {
+    GATHER_IMPL_SCALAR,
+    GATHER_IMPL_SSE2,
+    GATHER_IMPL_AVX2,
+};
+
+struct GatherTexture {
+    int width;          // powers of two, at most 1024
+    int height;
+    GLenum format;      // GL_DEPTH_COMPONENT16, GL_DEPTH_COMPONENT24 or GL_DEPTH_COMPONENT32F
+    GLenum wrapS;
+    GLenum wrapT;
+    float border;       // depth compared against outside a GL_CLAMP_TO_BORDER edge
+
+    // Filled in by setGatherTexels(): the quantized depths surrounded by a ring
+    // of border texels, with rows 1 << strideShift apart.
+    int strideShift;
+    std::vector<float> texels;
+};
+
+struct GatherState {
+    GLenum compareFunc;
+    GLenum swizzle[4];
+    GatherDepthMode depthMode;
+};
+
+struct GatherCases {
+    std::vector<float> s;
+    std::vector<float> t;
+    std::vector<float> ref;
+    std::vector<int32_t> offsetX;
+    std::vector<int32_t> offsetY;
+
+    size_t size() const { return s.size(); }
+    void resize(size_t n);
+};
+
+// The value a depth of the given format actually stores.
+float quantizeDepth(GLenum format, float depth);
+
+// depths holds width * height values, rows bottom to top. Call again after
+// changing the size, format or border.
+void setGatherTexels(GatherTexture* tex, const float* depths);
+
+// Whether a width or height can be used: a power of two, at most 1024.
+bool isGatherTextureSize(int size);
+
+// Writes 4 bytes per case to out, the RGBA8 value the gather renders.
+void gatherReference(GatherImpl impl, const GatherTexture& tex, const GatherState& state,
+                     const GatherCases& cases, size_t first, size_t count, uint8_t* out);
+
+bool gatherImplSupported(GatherImpl impl);
+GatherImpl bestGatherImpl();
+const char* gatherImplToString(GatherImpl impl);
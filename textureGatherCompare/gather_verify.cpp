@@ -0,0 +1,389 @@
+#include "gather_verify.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+
+#include "../common/gl_helpers.h"
+#include "../common/gl_state.h"
+#include "../common/program_cache.h"
+
+namespace {
+
+const int atlasSize = 256;
+const size_t casesPerBatch = atlasSize * atlasSize;
+
+double msSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+template <typename T, size_t N>
+T pick(std::mt19937& rng, const T (&choices)[N]) {
+    return choices[rng() % N];
+}
+
+float uniform(std::mt19937& rng, float lo, float hi) {
+    return std::uniform_real_distribution<float>(lo, hi)(rng);
+}
+
+const char* formatToString(GLenum format) {
+    switch (format) {
+        case GL_DEPTH_COMPONENT16: return "depth16";
+        case GL_DEPTH_COMPONENT24: return "depth24";
+        case GL_DEPTH_COMPONENT32F: return "depth32f";
+        default: return "unknown";
+    }
+}
+
+const char* wrapToString(GLenum wrap) {
+    switch (wrap) {
+        case GL_REPEAT: return "repeat";
+        case GL_CLAMP_TO_EDGE: return "clamp-to-edge";
+        case GL_CLAMP_TO_BORDER: return "clamp-to-border";
+        case GL_MIRRORED_REPEAT: return "mirrored-repeat";
+        case GL_MIRROR_CLAMP_TO_EDGE: return "mirror-clamp-to-edge";
+        default: return "unknown";
+    }
+}
+
+void printMismatch(const GatherBatch& batch, size_t n, const uint8_t* expected, const uint8_t* actual) {
+    const GatherTexture& tex = batch.tex;
+    printf("mismatch: %dx%d %s wrap %s/%s border %g, func 0x%x swizzle.r 0x%x, coord %.9g %.9g ref %.9g offset %d %d: "
+           "expected %d %d %d %d got %d %d %d %d\n",
+           tex.width, tex.height, formatToString(tex.format), wrapToString(tex.wrapS), wrapToString(tex.wrapT),
+           tex.border, batch.state.compareFunc, batch.state.swizzle[0],
+           batch.cases.s[n], batch.cases.t[n], batch.cases.ref[n], batch.cases.offsetX[n], batch.cases.offsetY[n],
+           expected[0], expected[1], expected[2], expected[3], actual[0], actual[1], actual[2], actual[3]);
+}
+
+}  // namespace
+
+void makeRandomGatherBatch(std::mt19937& rng, size_t numCases, int minOffset, int maxOffset,
+                           GatherDepthMode depthMode, GatherBatch* batch) {
+    static const int sizes[] = { 1, 2, 4, 8, 16 };
+    static const GLenum formats[] = { GL_DEPTH_COMPONENT16, GL_DEPTH_COMPONENT24, GL_DEPTH_COMPONENT32F };
+    static const GLenum wraps[] = {
+        GL_REPEAT, GL_CLAMP_TO_EDGE, GL_CLAMP_TO_BORDER, GL_MIRRORED_REPEAT, GL_MIRROR_CLAMP_TO_EDGE,
+    };
+    static const GLenum channels[] = { GL_RED, GL_GREEN, GL_BLUE, GL_ALPHA, GL_ONE, GL_ZERO };
+
+    GatherTexture& tex = batch->tex;
+    tex.width = pick(rng, sizes);
+    tex.height = pick(rng, sizes);
+    tex.format = pick(rng, formats);
+    tex.wrapS = pick(rng, wraps);
+    tex.wrapT = pick(rng, wraps);
+    // Only 0 and 1 so the border doesn't depend on how the driver quantizes it.
+    tex.border = float(rng() % 2);
+
+    GatherState& state = batch->state;
+    state.compareFunc = GL_NEVER + rng() % 8;
+    for (int c = 0; c < 4; ++c) {
+        state.swizzle[c] = pick(rng, channels);
+    }
+    // Only the red swizzle matters to a gather. Half the time make it the
+    // comparison result so most batches check more than a constant.
+    if (rng() % 2) {
+        state.swizzle[0] = GL_RED;
+    }
+    state.depthMode = depthMode;
+
+    // Fixed point texels sit on multiples of 4 quantization steps; refs sit
+    // halfway between them. Even depth24 steps are finer than a float near 1.
+    bool fixed = tex.format != GL_DEPTH_COMPONENT32F;
+    double maxValue = tex.format == GL_DEPTH_COMPONENT16 ? 65535.0 : 16777215.0;
+    uint32_t numSteps = uint32_t(maxValue) / 4;
+    size_t numTexels = size_t(tex.width) * tex.height;
+    batch->depths.resize(numTexels);
+    for (size_t i = 0; i < numTexels; ++i) {
+        if (fixed) {
+            batch->depths[i] = float((rng() % (numSteps + 1)) * 4 / maxValue);
+        } else {
+            batch->depths[i] = uniform(rng, 0.0f, 1.0f);
+        }
+    }
+    setGatherTexels(&tex, batch->depths.data());
+
+    GatherCases& cases = batch->cases;
+    cases.resize(numCases);
+    for (size_t n = 0; n < numCases; ++n) {
+        // Texel n + f with f in [0.25, 0.75] as the footprint's lower left, up to
+        // two texture sizes outside [0, 1] to exercise the wrap modes.
+        int i = int(rng() % (5 * tex.width)) - 2 * tex.width;
+        int j = int(rng() % (5 * tex.height)) - 2 * tex.height;
+        cases.s[n] = (i + 0.5f + uniform(rng, 0.25f, 0.75f)) / tex.width;
+        cases.t[n] = (j + 0.5f + uniform(rng, 0.25f, 0.75f)) / tex.height;
+        cases.offsetX[n] = minOffset + int(rng() % (maxOffset - minOffset + 1));
+        cases.offsetY[n] = minOffset + int(rng() % (maxOffset - minOffset + 1));
+
+        int kind = rng() % 8;
+        if (kind == 0) {
+            cases.ref[n] = uniform(rng, -0.25f, 0.0f);
+        } else if (kind == 1) {
+            cases.ref[n] = uniform(rng, 1.0f, 1.25f);
+        } else if (kind == 2) {
+            cases.ref[n] = float(rng() % 2);
+        } else if (fixed) {
+            cases.ref[n] = float(((rng() % numSteps) * 4 + 2) / maxValue);
+        } else if (kind < 6) {
+            // Exactly a texel's depth, for the equal paths of the compare funcs.
+            cases.ref[n] = batch->depths[rng() % numTexels];
+        } else {
+            cases.ref[n] = uniform(rng, 0.0f, 1.0f);
+        }
+    }
+}
+
+GLuint createGatherPointProgram() {
+    // One point per case. The offset is non-constant, which GLSL 4.00 allows for gathers.
+    const char* vs =
+    R"RAW(#version 460
+    in vec2 pos;
+    in vec3 params;
+    in vec2 offset;
+    flat out vec3 v_params;
+    flat out ivec2 v_offset;
+    void main() {
+      gl_Position = vec4(pos, 0, 1);
+      v_params = params;
+      v_offset = ivec2(offset);
+    }
+    )RAW";
+
+    const char* fs =
+    R"RAW(#version 460
+     uniform sampler2DShadow u_tex;
+     flat in vec3 v_params;
+     flat in ivec2 v_offset;
+     out vec4 fragColor;
+     void main() {
+       fragColor = textureGatherOffset(u_tex, v_params.xy, v_params.z, v_offset);
+     }
+    )RAW";
+
+    static const char* const attribs[] = { "pos", "params", "offset" };
+    GLuint program = createCachedProgram(vs, fs, attribs, 3);
+    glrAdopt(GLR_PROGRAM, program, "gather points");
+    return program;
+}
+
+GLuint createGatherPointVertexArray(GLuint* buffer) {
+    GLuint va = glrCreate(GLR_VERTEX_ARRAY, "gather points");
+    glBindVertexArray(va);
+    *buffer = glrCreate(GLR_BUFFER, "gather points");
+    glBindBuffer(GL_ARRAY_BUFFER, *buffer);
+    const int stride = gatherPointFloats * sizeof(float);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, stride, (void*)0);
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, stride, (void*)(2 * sizeof(float)));
+    glEnableVertexAttribArray(2);
+    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, stride, (void*)(5 * sizeof(float)));
+    return va;
+}
+
+void writeGatherPoint(float* v, size_t slot, int atlasWidth, const GatherCases& cases, size_t n) {
+    v[0] = ((slot % atlasWidth) + 0.5f) * 2.0f / atlasWidth - 1.0f;
+    v[1] = ((slot / atlasWidth) + 0.5f) * 2.0f / atlasWidth - 1.0f;
+    v[2] = cases.s[n];
+    v[3] = cases.t[n];
+    v[4] = cases.ref[n];
+    v[5] = (float)cases.offsetX[n];
+    v[6] = (float)cases.offsetY[n];
+}
+
+namespace {
+
+// Fixed point depths go up as integers so the driver can't round them
+// differently from quantizeDepth(). 24 bit depths go in the top bits of an
+// unsigned int. Immutable textures get glTexStorage2D and glTexSubImage2D.
+void specifyGatherTexels(const GatherTexture& tex, const float* depths, bool immutable) {
+    size_t numTexels = size_t(tex.width) * tex.height;
+    std::vector<uint16_t> texels16;
+    std::vector<uint32_t> texels24;
+    GLenum type = GL_FLOAT;
+    const void* data = depths;
+    if (tex.format == GL_DEPTH_COMPONENT16) {
+        texels16.resize(numTexels);
+        for (size_t i = 0; i < numTexels; ++i) {
+            texels16[i] = (uint16_t)nearbyint(quantizeDepth(tex.format, depths[i]) * 65535.0);
+        }
+        type = GL_UNSIGNED_SHORT;
+        data = texels16.data();
+    } else if (tex.format == GL_DEPTH_COMPONENT24) {
+        texels24.resize(numTexels);
+        for (size_t i = 0; i < numTexels; ++i) {
+            texels24[i] = (uint32_t)nearbyint(quantizeDepth(tex.format, depths[i]) * 16777215.0) << 8;
+        }
+        type = GL_UNSIGNED_INT;
+        data = texels24.data();
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    if (immutable) {
+        glTexStorage2D(GL_TEXTURE_2D, 1, tex.format, tex.width, tex.height);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, tex.width, tex.height, GL_DEPTH_COMPONENT, type, data);
+    } else {
+        glTexImage2D(GL_TEXTURE_2D, 0, tex.format, tex.width, tex.height, 0, GL_DEPTH_COMPONENT, type, data);
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+}
+
+}  // namespace
+
+void uploadGatherTexels(const GatherTexture& tex, const float* depths) {
+    specifyGatherTexels(tex, depths, false);
+}
+
+void storeGatherTexels(const GatherTexture& tex, const float* depths) {
+    specifyGatherTexels(tex, depths, true);
+}
+
+GLRenderTarget acquireGatherAtlas(int size) {
+    return glrAcquireRenderTarget(GL_RGBA8, GL_NONE, size, size, "gather atlas");
+}
+
+GatherDepthMode queryGatherDepthMode() {
+    GLint profile = 0;
+    glGetIntegerv(GL_CONTEXT_PROFILE_MASK, &profile);
+    return (profile & GL_CONTEXT_COMPATIBILITY_PROFILE_BIT) ? GATHER_DEPTH_LUMINANCE : GATHER_DEPTH_RED;
+}
+
+GatherVerifyResult verifyGatherOnGPU(uint64_t numCases, uint32_t seed) {
+    GatherVerifyResult result = {};
+    GatherDepthMode depthMode = queryGatherDepthMode();
+    GatherImpl impl = bestGatherImpl();
+
+    GLint minOffset = 0;
+    GLint maxOffset = 0;
+    glGetIntegerv(GL_MIN_PROGRAM_TEXTURE_GATHER_OFFSET, &minOffset);
+    glGetIntegerv(GL_MAX_PROGRAM_TEXTURE_GATHER_OFFSET, &maxOffset);
+
+    GLuint program = createGatherPointProgram();
+
+    GLuint tex = glrCreate(GLR_TEXTURE, "verify depth");
+    glBindTexture(GL_TEXTURE_2D, tex);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+
+    GLRenderTarget atlas = acquireGatherAtlas(atlasSize);
+
+    GLuint buf;
+    GLuint va = createGatherPointVertexArray(&buf);
+    checkError("verify setup");
+
+    glUseProgram(program);
+    glViewport(0, 0, atlasSize, atlasSize);
+
+    std::mt19937 rng(seed);
+    GatherBatch batch;
+    std::vector<float> vertices;
+    std::vector<uint8_t> actual(casesPerBatch * 4);
+    std::vector<uint8_t> expected(casesPerBatch * 4);
+    const int maxPrinted = 10;
+
+    while (result.cases < numCases) {
+        size_t count = std::min<uint64_t>(casesPerBatch, numCases - result.cases);
+        makeRandomGatherBatch(rng, count, minOffset, maxOffset, depthMode, &batch);
+        const GatherTexture& gt = batch.tex;
+
+        auto start = std::chrono::steady_clock::now();
+        glBindTexture(GL_TEXTURE_2D, tex);
+        uploadGatherTexels(gt, batch.depths.data());
+        glrSetBytes(GLR_TEXTURE, tex, glrTextureBytes(gt.format, gt.width, gt.height));
+        const float border[4] = { gt.border, gt.border, gt.border, gt.border };
+        glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, border);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, gt.wrapS);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, gt.wrapT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_FUNC, batch.state.compareFunc);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_R, batch.state.swizzle[0]);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_G, batch.state.swizzle[1]);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_B, batch.state.swizzle[2]);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_A, batch.state.swizzle[3]);
+
+        vertices.resize(count * gatherPointFloats);
+        for (size_t n = 0; n < count; ++n) {
+            writeGatherPoint(&vertices[n * gatherPointFloats], n, atlasSize, batch.cases, n);
+        }
+        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), vertices.data(), GL_STREAM_DRAW);
+        glrSetBytes(GLR_BUFFER, buf, vertices.size() * sizeof(float));
+        glDrawArrays(GL_POINTS, 0, (GLsizei)count);
+
+        int rows = int((count + atlasSize - 1) / atlasSize);
+        glReadPixels(0, 0, atlasSize, rows, GL_RGBA, GL_UNSIGNED_BYTE, actual.data());
+        checkError("verify batch");
+        result.gpuMs += msSince(start);
+
+        start = std::chrono::steady_clock::now();
+        gatherReference(impl, gt, batch.state, batch.cases, 0, count, expected.data());
+        result.oracleMs += msSince(start);
+
+        if (memcmp(actual.data(), expected.data(), count * 4) != 0) {
+            for (size_t n = 0; n < count; ++n) {
+                if (memcmp(&actual[n * 4], &expected[n * 4], 4) != 0) {
+                    if (result.mismatches < maxPrinted) {
+                        printMismatch(batch, n, &expected[n * 4], &actual[n * 4]);
+                    }
+                    ++result.mismatches;
+                }
+            }
+        }
+        result.cases += count;
+        ++result.batches;
+    }
+
+    glUseProgram(0);
+    glBindVertexArray(0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    // Everything above bound with plain GL.
+    invalidateGLState();
+    glrDelete(GLR_BUFFER, buf);
+    glrDelete(GLR_VERTEX_ARRAY, va);
+    glrReleaseRenderTarget(atlas);
+    glrDelete(GLR_TEXTURE, tex);
+    glrDelete(GLR_PROGRAM, program);
+    checkError("verify cleanup");
+    return result;
+}
+
+void benchmarkGatherReference(uint64_t numCases, uint32_t seed) {
+    std::mt19937 rng(seed);
+    std::vector<GatherBatch> batches((numCases + casesPerBatch - 1) / casesPerBatch);
+    uint64_t remaining = numCases;
+    for (GatherBatch& batch : batches) {
+        size_t count = std::min<uint64_t>(casesPerBatch, remaining);
+        makeRandomGatherBatch(rng, count, -8, 7, GATHER_DEPTH_RED, &batch);
+        remaining -= count;
+    }
+
+    std::vector<uint8_t> scalarOut(numCases * 4);
+    std::vector<uint8_t> out(numCases * 4);
+    const GatherImpl impls[] = { GATHER_IMPL_SCALAR, GATHER_IMPL_SSE2, GATHER_IMPL_AVX2 };
+    for (GatherImpl impl : impls) {
+        if (!gatherImplSupported(impl)) {
+            printf("oracle  : %-6s not supported on this CPU\n", gatherImplToString(impl));
+            continue;
+        }
+        std::vector<uint8_t>& dst = impl == GATHER_IMPL_SCALAR ? scalarOut : out;
+        auto start = std::chrono::steady_clock::now();
+        size_t offset = 0;
+        for (const GatherBatch& batch : batches) {
+            gatherReference(impl, batch.tex, batch.state, batch.cases, 0, batch.cases.size(), &dst[offset * 4]);
+            offset += batch.cases.size();
+        }
+        double ms = msSince(start);
+
+        uint64_t mismatches = 0;
+        if (impl != GATHER_IMPL_SCALAR) {
+            for (uint64_t n = 0; n < numCases; ++n) {
+                mismatches += memcmp(&out[n * 4], &scalarOut[n * 4], 4) != 0;
+            }
+        }
+        printf("oracle  : %-6s %llu cases in %.3f ms, %.1f Mcases/s, %llu differ from scalar\n",
+               gatherImplToString(impl), (unsigned long long)numCases, ms, numCases / ms / 1e3,
+               (unsigned long long)mismatches);
+    }
+}
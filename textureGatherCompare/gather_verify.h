@@ -0,0 +1,63 @@
+#pragma once
+
+#include <stdint.h>
+#include <random>
+#include <vector>
+
+#include "../common/gl_resources.h"
+#include "gather_reference.h"
+
+//-----------------------------------------------------------------------------------
+// Randomized checks of the driver's textureGather against gather_reference
+//
+// Each batch draws a random depth texture (size, format, wrap modes, border),
+// compare func and swizzle, then up to 65536 cases with random coordinates,
+// refs and offsets. Coordinates keep a quarter texel away from footprint
+// boundaries and fixed point refs stay two quantization steps away from any
+// texel so a correct driver can't legitimately disagree with the reference.
+//-----------------------------------------------------------------------------------
+
+struct GatherBatch {
+    GatherTexture tex;
+    GatherState state;
+    GatherCases cases;
+    std::vector<float> depths;      // width * height, what setGatherTexels() was given
+};
+
+void makeRandomGatherBatch(std::mt19937& rng, size_t numCases, int minOffset, int maxOffset,
+                           GatherDepthMode depthMode, GatherBatch* batch);
+
+// Point rendering shared with gather_matrix. Each case is one point carrying
+// gatherPointFloats floats: its atlas position, coord, ref and offset. The
+// program samples texture unit 0. Both are made through the resource registry.
+const int gatherPointFloats = 7;
+GLuint createGatherPointProgram();
+GLuint createGatherPointVertexArray(GLuint* buffer);
+void writeGatherPoint(float* vertex, size_t slot, int atlasWidth, const GatherCases& cases, size_t n);
+// Specifies level 0 of the bound GL_TEXTURE_2D from tex's size and format.
+void uploadGatherTexels(const GatherTexture& tex, const float* depths);
+// The same as immutable storage, for textures that get views.
+void storeGatherTexels(const GatherTexture& tex, const float* depths);
+// A size x size RGBA8 framebuffer from the render target pool, released with
+// glrReleaseRenderTarget(). Leaves it bound.
+GLRenderTarget acquireGatherAtlas(int size);
+
+// Which depth mode the current context's depth textures use.
+GatherDepthMode queryGatherDepthMode();
+
+struct GatherVerifyResult {
+    uint64_t cases;
+    uint64_t mismatches;
+    int batches;
+    double gpuMs;       // drawing and reading back every batch
+    double oracleMs;    // computing the expected results
+};
+
+// Renders numCases random cases and compares every result with the reference.
+// Prints the first few mismatches. Leaves framebuffer 0, and no program, vertex
+// array or texture bound.
+GatherVerifyResult verifyGatherOnGPU(uint64_t numCases, uint32_t seed);
+
+// Times every gatherReference() implementation this CPU supports over numCases
+// random cases and checks the vector ones against the scalar one.
+void benchmarkGatherReference(uint64_t numCases, uint32_t seed);
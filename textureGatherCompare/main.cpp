@@ -1,115 +1,36 @@
-// build: g++ main.cpp -o main -lX11 -lGL
+// build: g++ *.cpp ../common/*.cpp -o main -lX11 -lGL -lEGL -lpthread
 // run: ./main
+// run without X: ./main --backend=egl-surfaceless
+// random cases against the CPU reference: ./main --verify=1000000 --oracle-bench=10000000
+// one compute dispatch against the fragment path: ./main --compute=1000000
+// conformance matrix: ./main --matrix or ./main --matrix="formats=16;funcs=less,gequal;swizzles=r01"
+// matrix in 4 processes, timed with 1, 2 and 4: ./main --matrix --workers=4 --scaling
+// GL trace for ../gl-replay: ./main --trace=/tmp/gather.gltrace (with --workers=N worker i also writes /tmp/gather.gltrace.i)
+// the compare/swizzle tests on a warm ../gl-testd: ./main --daemon=/tmp/gl-testd.sock
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <chrono>
 #include <vector>
 
-#include <X11/Xlib.h>
-#include <GL/gl.h>
-#include <GL/glx.h>
-#include <GL/glext.h>
-
-//-----------------------------------------------------------------------------------
-// OpenGL Function Pointers
-//-----------------------------------------------------------------------------------
-
-PFNGLCREATESHADERPROC glCreateShader;
-PFNGLSHADERSOURCEPROC glShaderSource;
-PFNGLCOMPILESHADERPROC glCompileShader;
-PFNGLGETSHADERIVPROC glGetShaderiv;
-PFNGLGETSHADERINFOLOGPROC glGetShaderInfoLog;
-PFNGLCREATEPROGRAMPROC glCreateProgram;
-PFNGLATTACHSHADERPROC glAttachShader;
-PFNGLLINKPROGRAMPROC glLinkProgram;
-PFNGLGETPROGRAMIVPROC glGetProgramiv;
-PFNGLGETPROGRAMINFOLOGPROC glGetProgramInfoLog;
-PFNGLUSEPROGRAMPROC glUseProgram;
-PFNGLGENVERTEXARRAYSPROC glGenVertexArrays;
-PFNGLBINDVERTEXARRAYPROC glBindVertexArray;
-PFNGLGENBUFFERSPROC glGenBuffers;
-PFNGLBINDBUFFERPROC glBindBuffer;
-PFNGLBUFFERDATAPROC glBufferData;
-PFNGLENABLEVERTEXATTRIBARRAYPROC glEnableVertexAttribArray;
-PFNGLVERTEXATTRIBPOINTERPROC glVertexAttribPointer;
-PFNGLBINDATTRIBLOCATIONPROC glBindAttribLocation;
-PFNGLGENFRAMEBUFFERSPROC glGenFramebuffers;
-PFNGLBINDFRAMEBUFFERPROC glBindFramebuffer;
-PFNGLFRAMEBUFFERTEXTURE2DPROC glFramebufferTexture2D;
-PFNGLCHECKFRAMEBUFFERSTATUSPROC glCheckFramebufferStatus;
-
-void init_gl_functions() {
-    glCreateShader = (PFNGLCREATESHADERPROC)glXGetProcAddress((const GLubyte*)"glCreateShader");
-    glShaderSource = (PFNGLSHADERSOURCEPROC)glXGetProcAddress((const GLubyte*)"glShaderSource");
-    glCompileShader = (PFNGLCOMPILESHADERPROC)glXGetProcAddress((const GLubyte*)"glCompileShader");
-    glGetShaderiv = (PFNGLGETSHADERIVPROC)glXGetProcAddress((const GLubyte*)"glGetShaderiv");
-    glGetShaderInfoLog = (PFNGLGETSHADERINFOLOGPROC)glXGetProcAddress((const GLubyte*)"glGetShaderInfoLog");
-    glCreateProgram = (PFNGLCREATEPROGRAMPROC)glXGetProcAddress((const GLubyte*)"glCreateProgram");
-    glAttachShader = (PFNGLATTACHSHADERPROC)glXGetProcAddress((const GLubyte*)"glAttachShader");
-    glLinkProgram = (PFNGLLINKPROGRAMPROC)glXGetProcAddress((const GLubyte*)"glLinkProgram");
-    glGetProgramiv = (PFNGLGETPROGRAMIVPROC)glXGetProcAddress((const GLubyte*)"glGetProgramiv");
-    glGetProgramInfoLog = (PFNGLGETPROGRAMINFOLOGPROC)glXGetProcAddress((const GLubyte*)"glGetProgramInfoLog");
-    glUseProgram = (PFNGLUSEPROGRAMPROC)glXGetProcAddress((const GLubyte*)"glUseProgram");
-    glGenVertexArrays = (PFNGLGENVERTEXARRAYSPROC)glXGetProcAddress((const GLubyte*)"glGenVertexArrays");
-    glBindVertexArray = (PFNGLBINDVERTEXARRAYPROC)glXGetProcAddress((const GLubyte*)"glBindVertexArray");
-    glGenBuffers = (PFNGLGENBUFFERSPROC)glXGetProcAddress((const GLubyte*)"glGenBuffers");
-    glBindBuffer = (PFNGLBINDBUFFERPROC)glXGetProcAddress((const GLubyte*)"glBindBuffer");
-    glBufferData = (PFNGLBUFFERDATAPROC)glXGetProcAddress((const GLubyte*)"glBufferData");
-    glEnableVertexAttribArray = (PFNGLENABLEVERTEXATTRIBARRAYPROC)glXGetProcAddress((const GLubyte*)"glEnableVertexAttribArray");
-    glVertexAttribPointer = (PFNGLVERTEXATTRIBPOINTERPROC)glXGetProcAddress((const GLubyte*)"glVertexAttribPointer");
-    glBindAttribLocation = (PFNGLBINDATTRIBLOCATIONPROC)glXGetProcAddress((const GLubyte*)"glBindAttribLocation");
-    glGenFramebuffers = (PFNGLGENFRAMEBUFFERSPROC)glXGetProcAddress((const GLubyte*)"glGenFramebuffers");
-    glBindFramebuffer = (PFNGLBINDFRAMEBUFFERPROC)glXGetProcAddress((const GLubyte*)"glBindFramebuffer");
-    glFramebufferTexture2D = (PFNGLFRAMEBUFFERTEXTURE2DPROC)glXGetProcAddress((const GLubyte*)"glFramebufferTexture2D");
-    glCheckFramebufferStatus = (PFNGLCHECKFRAMEBUFFERSTATUSPROC)glXGetProcAddress((const GLubyte*)"glCheckFramebufferStatus");
-}
-
-//-----------------------------------------------------------------------------------
-// OpenGL Helpers
-//-----------------------------------------------------------------------------------
-
-void checkError(const char *msg) {
-  GLenum err = glGetError();
-  if (err) {
-      printf("Err %s: %x\n", msg, err);
-      exit(1);
-  }
-}
-
-GLint compileShader(GLenum type, const char* src)
-{
-    auto shader = glCreateShader(type);
-    glShaderSource(shader, 1, &src, nullptr);
-    glCompileShader(shader);
-    GLint success = 0;
-    glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
-    if (!success) {
-        GLint len;
-        glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &len);
-        GLchar *log = (GLchar*)malloc(len);
-        glGetShaderInfoLog(shader, len, nullptr, log);
-        printf("Failed to compile!: %s\n", log);
-        free(log);
-    }
-    checkError("compiling");
-    return shader;
-}
-
-void linkProgram(GLuint program) {
-  glLinkProgram(program);
-  GLint success = 0;
-  glGetProgramiv(program, GL_LINK_STATUS, &success);
-  if (!success) {
-      GLint len;
-      glGetProgramiv(program, GL_INFO_LOG_LENGTH, &len);
-      GLchar *log = (GLchar*)malloc(len);
-      glGetProgramInfoLog(program, len, &len, log);
-      printf("Failed to link!: %s\n", log);
-      free(log);
-      exit(1);
-  }
-}
+#include "../common/gl_context.h"
+#include "../common/gl_debug.h"
+#include "../common/gl_helpers.h"
+#include "../common/gl_job.h"
+#include "../common/gl_loader.h"
+#include "../common/gl_resources.h"
+#include "../common/gl_state.h"
+#include "../common/gl_trace.h"
+#include "../common/program_cache.h"
+#include "../common/readback_ring.h"
+#include "../common/stage_timer.h"
+#include "../common/stats.h"
+#include "gather_compute.h"
+#include "gather_matrix.h"
+#include "gather_parallel.h"
+#include "gather_reference.h"
+#include "gather_verify.h"
 
 #define ARRAY_SIZE(A) (sizeof(A)/sizeof(A[0]))
 GLenum swizzles[][4] = {
@@ -147,47 +68,328 @@ const char* swizzleToString(GLenum sw) {
   }
 }
 
+void printResult(const uint8_t* pixel, const GLenum* swizzle) {
+  printf("%g %g %g %g : swizzle: %s %s %s %s\n",
+        float(pixel[0]) / 255.0f, float(pixel[1]) / 255.0f, float(pixel[2]) / 255.0f, float(pixel[3]) / 255.0f,
+        swizzleToString(swizzle[0]),
+        swizzleToString(swizzle[1]),
+        swizzleToString(swizzle[2]),
+        swizzleToString(swizzle[3])
+        );
+}
+
+// Compares a result with the CPU reference for textureGather(u_tex, vec2(0.5), 0.5)
+// on the 2x2 texture filled in step 7. Returns true if they differ.
+bool differsFromReference(const uint8_t* pixel, GLenum compare, const GLenum* swizzle, GatherDepthMode depthMode) {
+  static GatherTexture tex;
+  static GatherCases cases;
+  if (tex.texels.empty()) {
+    static const float depths[] = { 0.2f, 0.4f, 0.6f, 0.8f };
+    tex.width = 2;
+    tex.height = 2;
+    tex.format = GL_DEPTH_COMPONENT16;
+    tex.wrapS = GL_REPEAT;
+    tex.wrapT = GL_REPEAT;
+    tex.border = 0.0f;
+    setGatherTexels(&tex, depths);
+    cases.resize(1);
+    cases.s[0] = 0.5f;
+    cases.t[0] = 0.5f;
+    cases.ref[0] = 0.5f;
+    cases.offsetX[0] = 0;
+    cases.offsetY[0] = 0;
+  }
+  GatherState state = { compare, { swizzle[0], swizzle[1], swizzle[2], swizzle[3] }, depthMode };
+  uint8_t expected[4];
+  gatherReference(GATHER_IMPL_SCALAR, tex, state, cases, 0, 1, expected);
+  if (memcmp(pixel, expected, 4) == 0) {
+    return false;
+  }
+  printf("  ^ reference: %g %g %g %g\n",
+         expected[0] / 255.0f, expected[1] / 255.0f, expected[2] / 255.0f, expected[3] / 255.0f);
+  return true;
+}
+
+void setCompareAndSwizzle(GLenum compare, const GLenum* swizzle) {
+  glsTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_FUNC, compare);
+  glsTexSwizzle(GL_TEXTURE_2D, swizzle[0], swizzle[1], swizzle[2], swizzle[3]);
+}
+
+void printMatrixStats(const GatherMatrixStats& stats) {
+    printf("matrix  : %llu cases, %llu mismatches, %llu states in %llu draws, %.3f ms (%.2f Mcases/s)\n",
+           (unsigned long long)stats.cases, (unsigned long long)stats.mismatches, (unsigned long long)stats.states,
+           (unsigned long long)stats.draws, stats.ms, stats.cases / (stats.ms * 1000.0));
+    printf("          state calls %llu issued, %llu elided\n",
+           (unsigned long long)stats.stateCalls, (unsigned long long)stats.stateCallsElided);
+}
+
+//-----------------------------------------------------------------------------------
+// The same tests as jobs for gl-testd
+//-----------------------------------------------------------------------------------
+
+// Sends every compare/swizzle combination before reading any result, so the
+// daemon has them all in flight at once. Returns the exit code.
+int runOnDaemon(const char* socketPath) {
+    auto start = std::chrono::steady_clock::now();
+    auto msSince = [](std::chrono::steady_clock::time_point from) {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - from).count();
+    };
+    GLJobClient client;
+    if (!client.connect(socketPath)) {
+        return 1;
+    }
+    double connectMs = msSince(start);
+    printf("daemon  : %s, %s\n", client.hello().renderer.c_str(), client.hello().version.c_str());
+
+    // The depth texture from steps 6 and 7, uploaded instead of cleared.
+    GLJob job;
+    job.vertexShader =
+        R"RAW(#version 460
+        in vec2 p;
+        void main() {
+          gl_Position = vec4(p, 0, 1);
+        }
+        )RAW";
+    job.fragmentShader =
+        R"RAW(#version 460
+         #extension GL_ARB_texture_gather : require
+         uniform sampler2DShadow u_tex;
+         out vec4 fragColor;
+         void main() {
+           fragColor = textureGather(u_tex, vec2(0.5), 0.5);
+         }
+        )RAW";
+    static const float depths[] = { 0.2f, 0.4f, 0.6f, 0.8f };
+    job.internalFormat = GL_DEPTH_COMPONENT16;
+    job.textureWidth = 2;
+    job.textureHeight = 2;
+    job.format = GL_DEPTH_COMPONENT;
+    job.type = GL_FLOAT;
+    job.texels.assign((const uint8_t*)depths, (const uint8_t*)depths + sizeof(depths));
+
+    const int numJobs = ARRAY_SIZE(compares) * ARRAY_SIZE(swizzles);
+    std::vector<std::chrono::steady_clock::time_point> sent(numJobs);
+    start = std::chrono::steady_clock::now();
+    for (int cmp = 0; cmp < ARRAY_SIZE(compares); ++cmp) {
+        for (int sw = 0; sw < ARRAY_SIZE(swizzles); ++sw) {
+            job.id = cmp * ARRAY_SIZE(swizzles) + sw;
+            job.params = {
+                { GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE },
+                { GL_TEXTURE_COMPARE_FUNC, GLint(compares[cmp]) },
+                { GL_TEXTURE_SWIZZLE_R, GLint(swizzles[sw][0]) },
+                { GL_TEXTURE_SWIZZLE_G, GLint(swizzles[sw][1]) },
+                { GL_TEXTURE_SWIZZLE_B, GLint(swizzles[sw][2]) },
+                { GL_TEXTURE_SWIZZLE_A, GLint(swizzles[sw][3]) },
+            };
+            sent[job.id] = std::chrono::steady_clock::now();
+            if (!client.submit(job)) {
+                return 1;
+            }
+        }
+    }
+
+    std::vector<uint8_t> results(numJobs * 4);
+    std::vector<double> latencyMs;
+    std::vector<double> daemonMs;
+    int cached = 0;
+    for (int i = 0; i < numJobs; ++i) {
+        GLJobResult result;
+        if (!client.receive(&result)) {
+            return 1;
+        }
+        if (!result.ok || result.id >= (uint64_t)numJobs || result.pixels.size() != 4) {
+            printf("job %llu failed: %s\n", (unsigned long long)result.id, result.error.c_str());
+            return 1;
+        }
+        latencyMs.push_back(msSince(sent[result.id]));
+        daemonMs.push_back(result.daemonMs);
+        cached += result.programCached;
+        memcpy(&results[result.id * 4], result.pixels.data(), 4);
+    }
+    double totalMs = msSince(start);
+
+    GatherDepthMode depthMode = (client.hello().profileMask & GL_CONTEXT_COMPATIBILITY_PROFILE_BIT)
+                                    ? GATHER_DEPTH_LUMINANCE : GATHER_DEPTH_RED;
+    int mismatches = 0;
+    for (int cmp = 0; cmp < ARRAY_SIZE(compares); ++cmp) {
+        printf("compare: %s\n", glEnumToString(compares[cmp]));
+        for (int sw = 0; sw < ARRAY_SIZE(swizzles); ++sw) {
+            printResult(&results[(cmp * ARRAY_SIZE(swizzles) + sw) * 4], swizzles[sw]);
+            mismatches += differsFromReference(&results[(cmp * ARRAY_SIZE(swizzles) + sw) * 4], compares[cmp], swizzles[sw], depthMode);
+        }
+    }
+    printf("oracle  : %d of %d results differ from the CPU reference\n", mismatches, numJobs);
+
+    SampleSummary latency = summarize(latencyMs);
+    SampleSummary inDaemon = summarize(daemonMs);
+    printf("jobs    : %d in %.3f ms (%.3f ms per job), connect %.3f ms, %d with the program already linked\n",
+           numJobs, totalMs, totalMs / numJobs, connectMs, cached);
+    printf("latency : round trip p50 %.3f ms, max %.3f ms; in the daemon p50 %.3f ms, max %.3f ms\n",
+           latency.p50, latency.max, inDaemon.p50, inDaemon.max);
+    return 0;
+}
+
 //-----------------------------------------------------------------------------------
 // main
 //-----------------------------------------------------------------------------------
 
 int main(int argc, const char* argv[])
 {
-    // 1. Open a connection to the X server
-    Display *dpy = XOpenDisplay(NULL);
-    if (dpy == NULL) {
-        printf("Cannot connect to X server\n");
+    bool batched = false;
+    int readbackSlots = 4;
+    GLLoadMode loadMode = GL_LOAD_LAZY;
+    const char* timingsPath = nullptr;
+    uint64_t verifyCases = 0;
+    uint64_t oracleBenchCases = 0;
+    uint64_t computeCases = 0;
+    uint32_t seed = 1;
+    bool matrix = false;
+    const char* tracePath = nullptr;
+    GLErrorMode errorMode = GL_ERRORS_POLL;
+    GLenum debugSeverity = GL_DEBUG_SEVERITY_MEDIUM;
+    int workers = 0;
+    bool scaling = false;
+    const char* daemonPath = nullptr;
+    GatherMatrixSpec matrixSpec = defaultGatherMatrixSpec();
+    GLContextOptions options;
+    options.width = 100;
+    options.height = 100;
+    options.title = "OpenGL Test";
+    for (int i = 1; i < argc; ++i) {
+        if (!strncmp(argv[i], "--backend=", 10) && parseBackend(argv[i] + 10, &options.backend)) {
+            continue;
+        }
+        if (!strcmp(argv[i], "--batched")) {
+            batched = true;
+            continue;
+        }
+        if (!strncmp(argv[i], "--readback-slots=", 17) && atoi(argv[i] + 17) > 0) {
+            readbackSlots = atoi(argv[i] + 17);
+            continue;
+        }
+        if (!strcmp(argv[i], "--eager-gl")) {
+            loadMode = GL_LOAD_EAGER;
+            continue;
+        }
+        if (!strcmp(argv[i], "--no-program-cache")) {
+            setProgramCacheEnabled(false);
+            continue;
+        }
+        if (!strncmp(argv[i], "--timings=", 10)) {
+            timingsPath = argv[i] + 10;
+            continue;
+        }
+        if (!strncmp(argv[i], "--verify=", 9) && atoll(argv[i] + 9) > 0) {
+            verifyCases = atoll(argv[i] + 9);
+            continue;
+        }
+        if (!strncmp(argv[i], "--oracle-bench=", 15) && atoll(argv[i] + 15) > 0) {
+            oracleBenchCases = atoll(argv[i] + 15);
+            continue;
+        }
+        if (!strncmp(argv[i], "--compute=", 10) && atoll(argv[i] + 10) > 0) {
+            computeCases = atoll(argv[i] + 10);
+            continue;
+        }
+        if (!strncmp(argv[i], "--seed=", 7)) {
+            seed = strtoul(argv[i] + 7, nullptr, 10);
+            continue;
+        }
+        if (!strcmp(argv[i], "--matrix")) {
+            matrix = true;
+            continue;
+        }
+        if (!strncmp(argv[i], "--matrix=", 9)) {
+            if (!parseGatherMatrixSpec(argv[i] + 9, &matrixSpec)) {
+                return 1;
+            }
+            matrix = true;
+            continue;
+        }
+        if (!strncmp(argv[i], "--workers=", 10) && atoi(argv[i] + 10) > 0) {
+            workers = atoi(argv[i] + 10);
+            continue;
+        }
+        if (!strcmp(argv[i], "--scaling")) {
+            scaling = true;
+            continue;
+        }
+        if (!strncmp(argv[i], "--daemon=", 9)) {
+            daemonPath = argv[i] + 9;
+            continue;
+        }
+        if (!strncmp(argv[i], "--trace=", 8)) {
+            tracePath = argv[i] + 8;
+            continue;
+        }
+        if (!strncmp(argv[i], "--gl-errors=", 12) && parseGLErrorMode(argv[i] + 12, &errorMode)) {
+            continue;
+        }
+        if (!strncmp(argv[i], "--gl-debug-severity=", 20) && parseGLDebugSeverity(argv[i] + 20, &debugSeverity)) {
+            continue;
+        }
+        printf("usage: %s [--backend=glx|egl-pbuffer|egl-surfaceless] [--eager-gl] [--no-program-cache] [--timings=FILE|-] [--batched] [--readback-slots=N]\n"
+               "       [--verify=CASES] [--oracle-bench=CASES] [--compute=CASES] [--seed=N] [--matrix[=AXIS=V,V;...]] [--workers=N] [--scaling]\n"
+               "       [--trace=FILE] [--gl-errors=poll|strict|release] [--gl-debug-severity=high|medium|low|notification] [--daemon=SOCKET]\n", argv[0]);
         return 1;
     }
 
-    // 2. Choose a suitable visual
-    static int visual_attribs[] = {
-        GLX_RGBA,
-        GLX_DEPTH_SIZE, 24,
-        GLX_DOUBLEBUFFER,
-        None
-    };
-    XVisualInfo *vi = glXChooseVisual(dpy, DefaultScreen(dpy), visual_attribs);
-    if (vi == NULL) {
-        printf("No appropriate visual found\n");
-        return 1;
+    // No context of our own at all, the daemon's is already warm.
+    if (daemonPath) {
+        return runOnDaemon(daemonPath);
     }
 
-    // 3. Create a window
-    Colormap cmap = XCreateColormap(dpy, DefaultRootWindow(dpy), vi->visual, AllocNone);
-    XSetWindowAttributes swa;
-    swa.colormap = cmap;
-    swa.event_mask = ExposureMask | KeyPressMask;
-    Window win = XCreateWindow(dpy, DefaultRootWindow(dpy), 0, 0, 100, 100, 0, vi->depth, InputOutput, vi->visual, CWColormap | CWEventMask, &swa);
-    XMapWindow(dpy, win);
-    XStoreName(dpy, win, "OpenGL Test");
+    // The matrix in worker processes. They fork before this process has a
+    // context of its own, which they couldn't safely inherit.
+    if (matrix && workers > 0) {
+        ScopedStage stage("matrix");
+        GatherWorkerGLOptions workerGLOptions;
+        workerGLOptions.loadMode = loadMode;
+        workerGLOptions.errorMode = errorMode;
+        workerGLOptions.debugSeverity = debugSeverity;
+        workerGLOptions.tracePath = tracePath;
+        std::vector<int> workerCounts;
+        for (int n = 1; scaling && n < workers; n *= 2) {
+            workerCounts.push_back(n);
+        }
+        workerCounts.push_back(workers);
+        double oneWorkerMs = 0.0;
+        for (int n : workerCounts) {
+            GatherParallelResult run = runGatherMatrixParallel(matrixSpec, options, workerGLOptions, n);
+            if (n == 1) {
+                oneWorkerMs = run.stats.ms;
+            }
+            printf("workers : %d, %.3f ms (%.2f Mcases/s), %llu chunks, %llu stolen, results hash %016llx",
+                   n, run.stats.ms, run.stats.cases / (run.stats.ms * 1000.0), (unsigned long long)run.chunks,
+                   (unsigned long long)run.stolenChunks, (unsigned long long)run.resultsHash);
+            if (scaling && oneWorkerMs > 0.0) {
+                printf(", speedup %.2fx, efficiency %.0f%%", oneWorkerMs / run.stats.ms,
+                       100.0 * oneWorkerMs / (run.stats.ms * n));
+            }
+            printf("\n");
+            if (run.failedWorkers > 0) {
+                printf("%d of %d workers failed\n", run.failedWorkers, n);
+                return 1;
+            }
+            if (n == workers) {
+                printMatrixStats(run.stats);
+            }
+        }
+        matrix = false;
+    }
 
-    // 4. Create an OpenGL context and make it current
-    GLXContext glc = glXCreateContext(dpy, vi, NULL, GL_TRUE);
-    glXMakeCurrent(dpy, win, glc);
+    // 1-4. Open the display, create a window or pbuffer, create a context and make it current
+    GLContext* ctx = createGLContext(options);
+    printf("context : %s %.3f ms\n", backendToString(options.backend), getContextCreationMs(ctx));
 
     // Initialize GL functions
-    init_gl_functions();
+    beginStage("load functions");
+    init_gl_functions(ctx, loadMode);
+    if (tracePath) {
+        startGLTrace(ctx, options, tracePath);
+    }
+    setGLErrorMode(errorMode, debugSeverity);
+    enableGPUStageTimers();
 
     printf("version : %s\n", glGetString(GL_VERSION));
     printf("vendor  : %s\n", glGetString(GL_VENDOR));
@@ -196,18 +398,19 @@ int main(int argc, const char* argv[])
 
     checkError("setup");
 
-    // 5. Compile and link shaders
-    GLuint texProgram = glCreateProgram();
+    // 5. Compile and link shaders, or load them from the program cache
+    beginStage("compile");
+    GLuint texProgram;
     {
-        GLuint vs = compileShader(GL_VERTEX_SHADER,
+        const char* vs =
         R"RAW(#version 460
         in vec2 p;
         void main() {
           gl_Position = vec4(p, 0, 1);
         }
-        )RAW");
+        )RAW";
 
-        GLuint fs = compileShader(GL_FRAGMENT_SHADER,
+        const char* fs =
         R"RAW(#version 460
          #extension GL_ARB_texture_gather : require
          uniform sampler2DShadow u_tex;
@@ -215,40 +418,37 @@ int main(int argc, const char* argv[])
          void main() {
            fragColor = textureGather(u_tex, vec2(0.5), 0.5);
          }
-        )RAW");
+        )RAW";
 
-        glAttachShader(texProgram, vs);
-        glAttachShader(texProgram, fs);
-        glBindAttribLocation(texProgram, 0, "p");
-        linkProgram(texProgram);
+        static const char* const attribs[] = { "p" };
+        texProgram = createCachedProgram(vs, fs, attribs, 1);
+        glrAdopt(GLR_PROGRAM, texProgram, "texProgram");
     }
     checkError("programs");
 
     // 6. Create depth texture
-    GLuint tex;
-    glGenTextures(1, &tex);
-    glBindTexture(GL_TEXTURE_2D, tex);
+    beginStage("texture");
+    GLuint tex = glrCreate(GLR_TEXTURE, "tex");
+    glsBindTexture(GL_TEXTURE_2D, tex);
     glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT16, 2, 2, 0, GL_DEPTH_COMPONENT, GL_UNSIGNED_SHORT, nullptr);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_FUNC, GL_LESS);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_R, GL_ONE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_G, GL_ONE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_B, GL_ONE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_A, GL_ONE);
+    glrSetBytes(GLR_TEXTURE, tex, glrTextureBytes(GL_DEPTH_COMPONENT16, 2, 2));
+    glsTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glsTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glsTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+    glsTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_FUNC, GL_LESS);
+    glsTexSwizzle(GL_TEXTURE_2D, GL_ONE, GL_ONE, GL_ONE, GL_ONE);
     checkError("texture1");
 
     // 7. Create color texture and framebuffer to fill the depth texture
-    GLuint tex2;
-    glGenTextures(1, &tex2);
-    glBindTexture(GL_TEXTURE_2D, tex2);
+    beginStage("fill");
+    GLuint tex2 = glrCreate(GLR_TEXTURE, "tex2");
+    glsBindTexture(GL_TEXTURE_2D, tex2);
     glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, 2, 2, 0, GL_RGBA, GL_UNSIGNED_SHORT, nullptr);
+    glrSetBytes(GLR_TEXTURE, tex2, glrTextureBytes(GL_RGBA8, 2, 2));
     checkError("texture2");
 
-    GLuint fb;
-    glGenFramebuffers(1, &fb);
-    glBindFramebuffer(GL_FRAMEBUFFER, fb);
+    GLuint fb = glrCreate(GLR_FRAMEBUFFER, "fb");
+    glsBindFramebuffer(GL_FRAMEBUFFER, fb);
     glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, tex2, 0);
     glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, tex, 0);
     if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
@@ -256,83 +456,191 @@ int main(int argc, const char* argv[])
       exit(1);
     }
 
-    glEnable(GL_SCISSOR_TEST);
+    glsEnable(GL_SCISSOR_TEST);
     for (int i = 0; i < 4; ++i) {
         int x = i % 2;
         int y = i / 2;
-        glViewport(x, y, 1, 1);
-        glScissor(x, y, 1, 1);
+        glsViewport(x, y, 1, 1);
+        glsScissor(x, y, 1, 1);
         glClearDepth(i * 0.2 + 0.2);
         glClear(GL_DEPTH_BUFFER_BIT);
     }
-    glDisable(GL_SCISSOR_TEST);
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glsDisable(GL_SCISSOR_TEST);
+    glsBindFramebuffer(GL_FRAMEBUFFER, 0);
     checkError("fill");
 
     // 8. Create vertex array for drawing a quad
-    GLuint va;
-    glGenVertexArrays(1, &va);
-    glBindVertexArray(va);
+    beginStage("va");
+    GLuint va = glrCreate(GLR_VERTEX_ARRAY, "va");
+    glsBindVertexArray(va);
 
-    GLuint buf;
-    glGenBuffers(1, &buf);
+    GLuint buf = glrCreate(GLR_BUFFER, "buf");
     static const float quad[] = { -1,-1, 1,-1, -1,1, -1,1, 1,-1, 1,1 };
-    glBindBuffer(GL_ARRAY_BUFFER, buf);
+    glsBindBuffer(GL_ARRAY_BUFFER, buf);
     glBufferData(GL_ARRAY_BUFFER, sizeof(quad), quad, GL_STATIC_DRAW);
+    glrSetBytes(GLR_BUFFER, buf, sizeof(quad));
     glEnableVertexAttribArray(0);
     glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, nullptr);
     checkError("va");
 
-    // 9. Create a framebuffer for reading results
-    GLuint tex3;
-    glGenTextures(1, &tex3);
-    glBindTexture(GL_TEXTURE_2D, tex3);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
-
-    GLuint fb2;
-    glGenFramebuffers(1, &fb2);
-    glBindFramebuffer(GL_FRAMEBUFFER, fb2);
+    beginStage("result framebuffer");
+    // 9. Create a framebuffer for reading results. In batched mode every
+    // compare/swizzle combination gets its own texel so the whole matrix can
+    // be read back at once.
+    int resultWidth = batched ? ARRAY_SIZE(swizzles) : 1;
+    int resultHeight = batched ? ARRAY_SIZE(compares) : 1;
+    GLuint tex3 = glrCreate(GLR_TEXTURE, "tex3");
+    glsBindTexture(GL_TEXTURE_2D, tex3);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, resultWidth, resultHeight, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    glrSetBytes(GLR_TEXTURE, tex3, glrTextureBytes(GL_RGBA8, resultWidth, resultHeight));
+
+    GLuint fb2 = glrCreate(GLR_FRAMEBUFFER, "fb2");
+    glsBindFramebuffer(GL_FRAMEBUFFER, fb2);
     glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, tex3, 0);
     if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
       printf("Framebuffer2 incomplete\n");
       exit(1);
     }
-    glViewport(0, 0, 1, 1);
+    glsViewport(0, 0, 1, 1);
+
+    // 10. Run tests and check them against the CPU reference
+    beginStage("tests");
+    GatherDepthMode depthMode = queryGatherDepthMode();
+    int mismatches = 0;
+    glsUseProgram(texProgram);
+    glsBindTexture(GL_TEXTURE_2D, tex);
+    if (batched) {
+        // Draw every combination into its texel, then read them all back with a single sync.
+        for (int cmp = 0; cmp < ARRAY_SIZE(compares); ++cmp) {
+            for (int sw = 0; sw < ARRAY_SIZE(swizzles); ++sw) {
+                setCompareAndSwizzle(compares[cmp], swizzles[sw]);
+                glsViewport(sw, cmp, 1, 1);
+                glDrawArrays(GL_TRIANGLES, 0, 6);
+            }
+        }
 
-    // 10. Run tests
-    glUseProgram(texProgram);
-    glBindTexture(GL_TEXTURE_2D, tex);
-    for (int cmp = 0; cmp < ARRAY_SIZE(compares); ++cmp) {
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_FUNC, compares[cmp]);
-        printf("compare: %s\n", glEnumToString(compares[cmp]));
+        std::vector<uint8_t> atlas(resultWidth * resultHeight * 4);
+        glReadPixels(0, 0, resultWidth, resultHeight, GL_RGBA, GL_UNSIGNED_BYTE, &atlas[0]);
+        checkError("read");
 
-        for (int sw = 0; sw < ARRAY_SIZE(swizzles); ++sw) {
-          glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_R, swizzles[sw][0]);
-          glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_G, swizzles[sw][1]);
-          glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_B, swizzles[sw][2]);
-          glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_A, swizzles[sw][3]);
-
-          glDrawArrays(GL_TRIANGLES, 0, 6);
-
-          std::vector<uint8_t> pixel(4);
-          glReadPixels(0, 0, 1, 1, GL_RGBA, GL_UNSIGNED_BYTE, &pixel[0]);
-          checkError("read");
-
-          printf("%g %g %g %g : swizzle: %s %s %s %s\n",
-                float(pixel[0]) / 255.0f, float(pixel[1]) / 255.0f, float(pixel[2]) / 255.0f, float(pixel[3]) / 255.0f,
-                swizzleToString(swizzles[sw][0]),
-                swizzleToString(swizzles[sw][1]),
-                swizzleToString(swizzles[sw][2]),
-                swizzleToString(swizzles[sw][3])
-                );
+        for (int cmp = 0; cmp < ARRAY_SIZE(compares); ++cmp) {
+            printf("compare: %s\n", glEnumToString(compares[cmp]));
+            for (int sw = 0; sw < ARRAY_SIZE(swizzles); ++sw) {
+                printResult(&atlas[(cmp * resultWidth + sw) * 4], swizzles[sw]);
+                mismatches += differsFromReference(&atlas[(cmp * resultWidth + sw) * 4], compares[cmp], swizzles[sw], depthMode);
+            }
+        }
+    } else {
+        // One draw and one read per combination. The reads go through a ring of
+        // pixel pack buffers so the GPU keeps working while earlier results are
+        // collected.
+        std::vector<uint8_t> results(ARRAY_SIZE(compares) * ARRAY_SIZE(swizzles) * 4);
+        {
+            ReadbackRing ring(readbackSlots, 4, [&](uint32_t tag, const void* data, size_t) {
+                memcpy(&results[tag * 4], data, 4);
+            });
+
+            for (int cmp = 0; cmp < ARRAY_SIZE(compares); ++cmp) {
+                for (int sw = 0; sw < ARRAY_SIZE(swizzles); ++sw) {
+                  setCompareAndSwizzle(compares[cmp], swizzles[sw]);
+
+                  glDrawArrays(GL_TRIANGLES, 0, 6);
+
+                  ring.read(0, 0, 1, 1, GL_RGBA, GL_UNSIGNED_BYTE, cmp * ARRAY_SIZE(swizzles) + sw);
+                  ring.poll();
+                }
+            }
+            ring.drain();
+            checkError("read");
+
+            const ReadbackRing::Stats& stats = ring.stats();
+            printf("readback: %llu reads, %llu stalls on a full ring (%.3f ms)\n",
+                   (unsigned long long)stats.reads, (unsigned long long)stats.fullStalls, stats.stallMs);
+        }
+
+        for (int cmp = 0; cmp < ARRAY_SIZE(compares); ++cmp) {
+            printf("compare: %s\n", glEnumToString(compares[cmp]));
+            for (int sw = 0; sw < ARRAY_SIZE(swizzles); ++sw) {
+                printResult(&results[(cmp * ARRAY_SIZE(swizzles) + sw) * 4], swizzles[sw]);
+                mismatches += differsFromReference(&results[(cmp * ARRAY_SIZE(swizzles) + sw) * 4], compares[cmp], swizzles[sw], depthMode);
+            }
         }
     }
 
-    // 11. Cleanup
-    glXMakeCurrent(dpy, None, NULL);
-    glXDestroyContext(dpy, glc);
-    XDestroyWindow(dpy, win);
-    XCloseDisplay(dpy);
+    printf("oracle  : %d of %d results differ from the CPU reference\n",
+           mismatches, (int)(ARRAY_SIZE(compares) * ARRAY_SIZE(swizzles)));
+
+    // Randomized cases over every compare func, format and wrap mode
+    if (verifyCases > 0) {
+        ScopedStage stage("verify");
+        GatherVerifyResult verify = verifyGatherOnGPU(verifyCases, seed);
+        printf("verify  : %llu cases in %d batches, %llu mismatches, seed %u, gpu %.3f ms, reference (%s) %.3f ms\n",
+               (unsigned long long)verify.cases, verify.batches, (unsigned long long)verify.mismatches, seed,
+               verify.gpuMs, gatherImplToString(bestGatherImpl()), verify.oracleMs);
+    }
+    // The compare/swizzle combinations above as one compute dispatch, and the
+    // first few thousand cases one quad at a time for comparison
+    if (computeCases > 0) {
+        ScopedStage stage("compute");
+        std::vector<GatherState> configs;
+        for (int cmp = 0; cmp < ARRAY_SIZE(compares); ++cmp) {
+            for (int sw = 0; sw < ARRAY_SIZE(swizzles); ++sw) {
+                configs.push_back({ compares[cmp], { swizzles[sw][0], swizzles[sw][1], swizzles[sw][2], swizzles[sw][3] },
+                                    depthMode });
+            }
+        }
+        GatherComputeResult compute = runGatherCompute(computeCases, std::min<uint64_t>(computeCases, 4096), seed,
+                                                       configs.data(), (int)configs.size(), readbackSlots);
+        double computeRate = compute.cases / (compute.computeMs * 1000.0);
+        printf("compute : %llu cases, %d configurations in 1 dispatch, %llu mismatches, seed %u, %.3f ms (%.2f Mcases/s), reference %.3f ms\n",
+               (unsigned long long)compute.cases, (int)configs.size(), (unsigned long long)compute.mismatches, seed,
+               compute.computeMs, computeRate, compute.oracleMs);
+        double fragmentRate = compute.fragmentCases / (compute.fragmentMs * 1000.0);
+        printf("fragment: %llu cases one quad each, %llu mismatches, %.3f ms (%.4f Mcases/s), compute %.0fx faster\n",
+               (unsigned long long)compute.fragmentCases, (unsigned long long)compute.fragmentMismatches,
+               compute.fragmentMs, fragmentRate, computeRate / fragmentRate);
+    }
+    if (oracleBenchCases > 0) {
+        ScopedStage stage("oracle bench");
+        benchmarkGatherReference(oracleBenchCases, seed);
+    }
+    if (matrix) {
+        ScopedStage stage("matrix");
+        uint64_t size = gatherMatrixSize(matrixSpec);
+        printMatrixStats(runGatherMatrix(matrixSpec, 0, size));
+    }
+
+    resolveStageTimers();
+    printGLLoaderStats();
+    printProgramCacheStats();
+    printGLStateStats();
+    printGLErrorStats();
+    if (tracePath) {
+        stopGLTrace();
+        printGLTraceStats();
+    }
+
+    // 11. Cleanup. Whatever the report still lists leaked.
+    beginStage("cleanup");
+    glsUseProgram(0);
+    glsBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glrDelete(GLR_FRAMEBUFFER, fb2);
+    glrDelete(GLR_TEXTURE, tex3);
+    glrDelete(GLR_BUFFER, buf);
+    glrDelete(GLR_VERTEX_ARRAY, va);
+    glrDelete(GLR_FRAMEBUFFER, fb);
+    glrDelete(GLR_TEXTURE, tex2);
+    glrDelete(GLR_TEXTURE, tex);
+    glrDelete(GLR_PROGRAM, texProgram);
+    glrTrimPools();
+    printGLResourceReport();
+    destroyGLContext(ctx);
+    endStage();
+
+    if (timingsPath && !writeStageTimingsJSON(timingsPath, "textureGatherCompare", backendToString(options.backend))) {
+        printf("Cannot write %s\n", timingsPath);
+        return 1;
+    }
 
     return 0;
 }
\ No newline at end of file
@@ -1,106 +1,185 @@
-// build: g++ main.cpp -o main -lX11 -lGL
+// build: g++ *.cpp ../common/*.cpp -o main -lX11 -lGL -lEGL -lpthread
 // run: DISPLAY=:0 ./main
+// run without X: ./main --backend=egl-surfaceless
+// benchmark: ./main --bench=1000 --swap-interval=0
+// compressed texture: ./main --texture=FILE.ktx2
+// GL trace for ../gl-replay: ./main --bench=300 --trace=/tmp/triangle.gltrace
+// errors from KHR_debug instead of glGetError: ./main --gl-errors=strict
+// shader hot reload: ./main --watch-shaders=/tmp/shaders, then edit /tmp/shaders/triangle.frag while it runs
+// golden image check: ./main --render-size=3840x2160 --capture=golden.png, then ./main --render-size=3840x2160 --golden=golden.png --heatmap=heat.png
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <string>
 #include <vector>
 
-#include <X11/Xlib.h>
-#include <GL/gl.h>
-#include <GL/glx.h>
-#include <GL/glext.h>
+#include "../common/gl_context.h"
+#include "../common/gl_debug.h"
+#include "../common/gl_helpers.h"
+#include "../common/gl_loader.h"
+#include "../common/gl_resources.h"
+#include "../common/gl_state.h"
+#include "../common/gl_trace.h"
+#include "../common/image.h"
+#include "../common/image_diff.h"
+#include "../common/offscreen.h"
+#include "../common/program_cache.h"
+#include "../common/shader_reloader.h"
+#include "../common/stage_timer.h"
+#include "../common/stats.h"
+#include "../common/texture_file.h"
+#include "../common/texture_uploader.h"
+#include "stress.h"
 
 //-----------------------------------------------------------------------------------
-// OpenGL Function Pointers
+// Benchmark
 //-----------------------------------------------------------------------------------
 
-PFNGLCREATESHADERPROC glCreateShader;
-PFNGLSHADERSOURCEPROC glShaderSource;
-PFNGLCOMPILESHADERPROC glCompileShader;
-PFNGLGETSHADERIVPROC glGetShaderiv;
-PFNGLGETSHADERINFOLOGPROC glGetShaderInfoLog;
-PFNGLCREATEPROGRAMPROC glCreateProgram;
-PFNGLATTACHSHADERPROC glAttachShader;
-PFNGLLINKPROGRAMPROC glLinkProgram;
-PFNGLGETPROGRAMIVPROC glGetProgramiv;
-PFNGLGETPROGRAMINFOLOGPROC glGetProgramInfoLog;
-PFNGLUSEPROGRAMPROC glUseProgram;
-PFNGLGENVERTEXARRAYSPROC glGenVertexArrays;
-PFNGLBINDVERTEXARRAYPROC glBindVertexArray;
-PFNGLGENBUFFERSPROC glGenBuffers;
-PFNGLBINDBUFFERPROC glBindBuffer;
-PFNGLBUFFERDATAPROC glBufferData;
-PFNGLENABLEVERTEXATTRIBARRAYPROC glEnableVertexAttribArray;
-PFNGLVERTEXATTRIBPOINTERPROC glVertexAttribPointer;
-PFNGLBINDATTRIBLOCATIONPROC glBindAttribLocation;
-
-void init_gl_functions() {
-    glCreateShader = (PFNGLCREATESHADERPROC)glXGetProcAddress((const GLubyte*)"glCreateShader");
-    glShaderSource = (PFNGLSHADERSOURCEPROC)glXGetProcAddress((const GLubyte*)"glShaderSource");
-    glCompileShader = (PFNGLCOMPILESHADERPROC)glXGetProcAddress((const GLubyte*)"glCompileShader");
-    glGetShaderiv = (PFNGLGETSHADERIVPROC)glXGetProcAddress((const GLubyte*)"glGetShaderiv");
-    glGetShaderInfoLog = (PFNGLGETSHADERINFOLOGPROC)glXGetProcAddress((const GLubyte*)"glGetShaderInfoLog");
-    glCreateProgram = (PFNGLCREATEPROGRAMPROC)glXGetProcAddress((const GLubyte*)"glCreateProgram");
-    glAttachShader = (PFNGLATTACHSHADERPROC)glXGetProcAddress((const GLubyte*)"glAttachShader");
-    glLinkProgram = (PFNGLLINKPROGRAMPROC)glXGetProcAddress((const GLubyte*)"glLinkProgram");
-    glGetProgramiv = (PFNGLGETPROGRAMIVPROC)glXGetProcAddress((const GLubyte*)"glGetProgramiv");
-    glGetProgramInfoLog = (PFNGLGETPROGRAMINFOLOGPROC)glXGetProcAddress((const GLubyte*)"glGetProgramInfoLog");
-    glUseProgram = (PFNGLUSEPROGRAMPROC)glXGetProcAddress((const GLubyte*)"glUseProgram");
-    glGenVertexArrays = (PFNGLGENVERTEXARRAYSPROC)glXGetProcAddress((const GLubyte*)"glGenVertexArrays");
-    glBindVertexArray = (PFNGLBINDVERTEXARRAYPROC)glXGetProcAddress((const GLubyte*)"glBindVertexArray");
-    glGenBuffers = (PFNGLGENBUFFERSPROC)glXGetProcAddress((const GLubyte*)"glGenBuffers");
-    glBindBuffer = (PFNGLBINDBUFFERPROC)glXGetProcAddress((const GLubyte*)"glBindBuffer");
-    glBufferData = (PFNGLBUFFERDATAPROC)glXGetProcAddress((const GLubyte*)"glBufferData");
-    glEnableVertexAttribArray = (PFNGLENABLEVERTEXATTRIBARRAYPROC)glXGetProcAddress((const GLubyte*)"glEnableVertexAttribArray");
-    glVertexAttribPointer = (PFNGLVERTEXATTRIBPOINTERPROC)glXGetProcAddress((const GLubyte*)"glVertexAttribPointer");
-    glBindAttribLocation = (PFNGLBINDATTRIBLOCATIONPROC)glXGetProcAddress((const GLubyte*)"glBindAttribLocation");
+void printSummary(const char* label, const std::vector<double>& samples) {
+    SampleSummary summary = summarize(samples);
+    printf("%-13s: avg %.3f ms, p50 %.3f ms, p95 %.3f ms, p99 %.3f ms\n",
+           label, summary.mean, summary.p50, summary.p95, summary.p99);
 }
 
-//-----------------------------------------------------------------------------------
-// OpenGL Helpers
-//-----------------------------------------------------------------------------------
+struct BenchmarkResult {
+    int frames;
+    double totalMs;
+};
 
-void checkError(const char *msg) {
-  GLenum err = glGetError();
-  if (err) {
-      printf("Err %s: %x\n", msg, err);
-      exit(1);
-  }
-}
+// Renders numFrames frames back to back, polling for events instead of waiting
+// for Expose. After each frame a GL_TIMESTAMP query records when the GPU finished
+// it and a fence tells the CPU when that result can be read, so three times are
+// kept per frame: when the CPU finished submitting it, when the GPU finished it,
+// and when the CPU saw the fence signal. At most maxInFlight frames are queued
+// before the CPU waits for the oldest.
+BenchmarkResult runBenchmark(GLContext* ctx, int numFrames, const std::function<void()>& drawFrame) {
+    const size_t maxInFlight = 3;
+    struct InFlight {
+        GLsync fence;
+        GLuint query;
+        double startMs;
+    };
+    std::deque<InFlight> inFlight;
+    std::vector<GLuint> freeQueries(maxInFlight + 1);
+    glGenQueries((GLsizei)freeQueries.size(), freeQueries.data());
+    std::vector<double> frameMs;
+    std::vector<double> submitMs;
+    std::vector<double> gpuMs;
+    std::vector<double> fenceMs;
+    GLStateStats stateBefore = getGLStateStats();
 
-GLint compileShader(GLenum type, const char* src)
-{
-    auto shader = glCreateShader(type);
-    glShaderSource(shader, 1, &src, nullptr);
-    glCompileShader(shader);
-    GLint success = 0;
-    glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
-    if (!success) {
-        GLint len;
-        glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &len);
-        GLchar *log = (GLchar*)malloc(len);
-        glGetShaderInfoLog(shader, len, nullptr, log);
-        printf("Failed to compile!: %s\n", log);
-        free(log);
-    }
-    checkError("compiling");
-    return shader;
+    auto begin = std::chrono::steady_clock::now();
+    auto elapsedMs = [&]() {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+    };
+    // GPU timestamps are on the GPU's clock. Reading it once lines the two up
+    // closely enough for a run of a few seconds.
+    GLint64 gpuBeginNs = 0;
+    glGetInteger64v(GL_TIMESTAMP, &gpuBeginNs);
+    double cpuBeginMs = elapsedMs();
+
+    // Collects finished frames. Blocks on the oldest one while more than maxQueued are queued.
+    auto collect = [&](size_t maxQueued) {
+        while (!inFlight.empty()) {
+            InFlight& oldest = inFlight.front();
+            GLuint64 timeout = inFlight.size() > maxQueued ? 1000000000 : 0;
+            GLenum status = glClientWaitSync(oldest.fence, GL_SYNC_FLUSH_COMMANDS_BIT, timeout);
+            if (status == GL_WAIT_FAILED) {
+                printf("glClientWaitSync failed\n");
+                exit(1);
+            }
+            if (status == GL_TIMEOUT_EXPIRED) {
+                if (timeout) {
+                    continue;
+                }
+                break;
+            }
+            fenceMs.push_back(elapsedMs() - oldest.startMs);
+            // The query was issued before the fence, so its result is ready.
+            GLuint64 doneNs = 0;
+            glGetQueryObjectui64v(oldest.query, GL_QUERY_RESULT, &doneNs);
+            gpuMs.push_back(cpuBeginMs + (GLint64)(doneNs - gpuBeginNs) / 1e6 - oldest.startMs);
+            freeQueries.push_back(oldest.query);
+            glDeleteSync(oldest.fence);
+            inFlight.pop_front();
+        }
+    };
+
+    int frame = 0;
+    double prevStartMs = 0.0;
+    for (; frame < numFrames; ++frame) {
+        bool quit = false;
+        for (GLContextEvent event; (event = pollEvent(ctx)) != EVENT_NONE;) {
+            quit = quit || event == EVENT_KEY_PRESS;
+        }
+        if (quit) {
+            break;
+        }
+
+        double startMs = elapsedMs();
+        drawFrame();
+        swapBuffers(ctx);
+        GLuint query = freeQueries.back();
+        freeQueries.pop_back();
+        glQueryCounter(query, GL_TIMESTAMP);
+        GLsync fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        submitMs.push_back(elapsedMs() - startMs);
+        if (frame > 0) {
+            frameMs.push_back(startMs - prevStartMs);
+        }
+        prevStartMs = startMs;
+
+        inFlight.push_back({fence, query, startMs});
+        collect(maxInFlight);
+    }
+    collect(0);
+    double totalMs = elapsedMs();
+    glDeleteQueries((GLsizei)freeQueries.size(), freeQueries.data());
+    checkError("benchmark");
+
+    printf("benchmark    : %d frames in %.3f ms, %.1f fps\n", frame, totalMs, frame * 1000.0 / totalMs);
+    printSummary("frame time", frameMs);
+    printSummary("cpu submit", submitMs);
+    printSummary("gpu complete", gpuMs);
+    printSummary("fence seen", fenceMs);
+    if (frame > 0) {
+        GLStateStats stateAfter = getGLStateStats();
+        printf("state calls  : %.1f issued, %.1f elided per frame\n",
+               double(stateAfter.issued - stateBefore.issued) / frame,
+               double(stateAfter.elided - stateBefore.elided) / frame);
+    }
+    return { frame, totalMs };
 }
 
-void linkProgram(GLuint program) {
-  glLinkProgram(program);
-  GLint success = 0;
-  glGetProgramiv(program, GL_LINK_STATUS, &success);
-  if (!success) {
-      GLint len;
-      glGetProgramiv(program, GL_INFO_LOG_LENGTH, &len);
-      GLchar *log = (GLchar*)malloc(len);
-      glGetProgramInfoLog(program, len, &len, log);
-      printf("Failed to link!: %s\n", log);
-      free(log);
-      exit(1);
-  }
+//-----------------------------------------------------------------------------------
+// Shader files
+//-----------------------------------------------------------------------------------
+
+// Reads a watched shader. A missing one is written with the built-in source first
+// so there is something to edit.
+bool readShaderFile(const std::string& path, const char* builtIn, std::string* src) {
+    FILE* f = fopen(path.c_str(), "rb");
+    if (f == nullptr) {
+        f = fopen(path.c_str(), "wb");
+        if (f == nullptr || fputs(builtIn, f) < 0 || fclose(f) != 0) {
+            printf("Cannot write %s\n", path.c_str());
+            return false;
+        }
+        *src = builtIn;
+        return true;
+    }
+    src->clear();
+    char buffer[4096];
+    size_t n;
+    while ((n = fread(buffer, 1, sizeof(buffer), f)) > 0) {
+        src->append(buffer, n);
+    }
+    fclose(f);
+    return true;
 }
 
 //-----------------------------------------------------------------------------------
@@ -109,46 +188,146 @@ void linkProgram(GLuint program) {
 
 int main(int argc, const char* argv[])
 {
-    // 1. Open a connection to the X server
-    Display *dpy = XOpenDisplay(NULL);
-    if (dpy == NULL) {
-        printf("Cannot connect to X server\n");
-        return 1;
-    }
-
-    // 2. Choose a suitable visual
-    static int visual_attribs[] = {
-        GLX_RGBA,
-        GLX_DEPTH_SIZE, 24,
-        GLX_DOUBLEBUFFER,
-        None
-    };
-    XVisualInfo *vi = glXChooseVisual(dpy, DefaultScreen(dpy), visual_attribs);
-    if (vi == NULL) {
-        printf("No appropriate visual found\n");
+    GLLoadMode loadMode = GL_LOAD_LAZY;
+    const char* timingsPath = nullptr;
+    int benchFrames = 0;
+    int swapInterval = -1;
+    int stressTriangles = 0;
+    int streamTextures = 0;
+    int streamSize = 1024;
+    const char* texturePath = nullptr;
+    bool textureHeap = false;
+    bool textureTranscode = false;
+    const char* tracePath = nullptr;
+    GLErrorMode errorMode = GL_ERRORS_POLL;
+    GLenum debugSeverity = GL_DEBUG_SEVERITY_MEDIUM;
+    int renderWidth = 0;
+    int renderHeight = 0;
+    int maxTile = 0;
+    const char* capturePath = nullptr;
+    const char* goldenPath = nullptr;
+    const char* heatmapPath = nullptr;
+    uint8_t tolerance[4] = {0, 0, 0, 0};
+    const char* shaderDir = nullptr;
+    GLContextOptions options;
+    options.width = 256;
+    options.height = 256;
+    options.title = "Textured Triangle";
+    for (int i = 1; i < argc; ++i) {
+        if (!strncmp(argv[i], "--backend=", 10) && parseBackend(argv[i] + 10, &options.backend)) {
+            continue;
+        }
+        if (!strcmp(argv[i], "--eager-gl")) {
+            loadMode = GL_LOAD_EAGER;
+            continue;
+        }
+        if (!strcmp(argv[i], "--no-program-cache")) {
+            setProgramCacheEnabled(false);
+            continue;
+        }
+        if (!strncmp(argv[i], "--timings=", 10)) {
+            timingsPath = argv[i] + 10;
+            continue;
+        }
+        if (!strncmp(argv[i], "--bench=", 8) && atoi(argv[i] + 8) > 0) {
+            benchFrames = atoi(argv[i] + 8);
+            continue;
+        }
+        if (!strncmp(argv[i], "--swap-interval=", 16)) {
+            swapInterval = atoi(argv[i] + 16);
+            continue;
+        }
+        if (!strncmp(argv[i], "--stress=", 9) && atoi(argv[i] + 9) > 0) {
+            stressTriangles = atoi(argv[i] + 9);
+            continue;
+        }
+        if (!strncmp(argv[i], "--stream-textures=", 18) && atoi(argv[i] + 18) > 0) {
+            streamTextures = atoi(argv[i] + 18);
+            continue;
+        }
+        if (!strncmp(argv[i], "--stream-size=", 14) && atoi(argv[i] + 14) > 0) {
+            streamSize = atoi(argv[i] + 14);
+            continue;
+        }
+        if (!strncmp(argv[i], "--texture=", 10)) {
+            texturePath = argv[i] + 10;
+            continue;
+        }
+        if (!strcmp(argv[i], "--texture-heap")) {
+            textureHeap = true;
+            continue;
+        }
+        if (!strncmp(argv[i], "--trace=", 8)) {
+            tracePath = argv[i] + 8;
+            continue;
+        }
+        if (!strncmp(argv[i], "--gl-errors=", 12) && parseGLErrorMode(argv[i] + 12, &errorMode)) {
+            continue;
+        }
+        if (!strncmp(argv[i], "--gl-debug-severity=", 20) && parseGLDebugSeverity(argv[i] + 20, &debugSeverity)) {
+            continue;
+        }
+        if (!strcmp(argv[i], "--texture-transcode")) {
+            textureTranscode = true;
+            continue;
+        }
+        if (!strncmp(argv[i], "--render-size=", 14) && sscanf(argv[i] + 14, "%dx%d", &renderWidth, &renderHeight) == 2 &&
+            renderWidth > 0 && renderHeight > 0) {
+            continue;
+        }
+        if (!strncmp(argv[i], "--tile=", 7) && atoi(argv[i] + 7) > 0) {
+            maxTile = atoi(argv[i] + 7);
+            continue;
+        }
+        if (!strncmp(argv[i], "--capture=", 10)) {
+            capturePath = argv[i] + 10;
+            continue;
+        }
+        if (!strncmp(argv[i], "--golden=", 9)) {
+            goldenPath = argv[i] + 9;
+            continue;
+        }
+        if (!strncmp(argv[i], "--heatmap=", 10)) {
+            heatmapPath = argv[i] + 10;
+            continue;
+        }
+        if (!strncmp(argv[i], "--tolerance=", 12) && parseTolerance(argv[i] + 12, tolerance)) {
+            continue;
+        }
+        if (!strncmp(argv[i], "--watch-shaders=", 16) && argv[i][16]) {
+            shaderDir = argv[i] + 16;
+            continue;
+        }
+        printf("usage: %s [--backend=glx|egl-pbuffer|egl-surfaceless] [--eager-gl] [--no-program-cache] [--timings=FILE|-] [--bench=FRAMES] [--swap-interval=N] [--stress=TRIANGLES]\n"
+               "       [--stream-textures=N] [--stream-size=PIXELS] [--texture=FILE.dds|FILE.ktx2] [--texture-heap] [--texture-transcode]\n"
+               "       [--trace=FILE] [--gl-errors=poll|strict|release] [--gl-debug-severity=high|medium|low|notification]\n"
+               "       [--render-size=WxH] [--tile=PIXELS] [--capture=FILE.ppm|FILE.png] [--golden=FILE] [--heatmap=FILE] [--tolerance=N|R,G,B,A]\n"
+               "       [--watch-shaders=DIR]\n", argv[0]);
         return 1;
     }
 
-    // 3. Create a window
-    Colormap cmap = XCreateColormap(dpy, DefaultRootWindow(dpy), vi->visual, AllocNone);
-    XSetWindowAttributes swa;
-    swa.colormap = cmap;
-    swa.event_mask = ExposureMask | KeyPressMask;
-    Window win = XCreateWindow(dpy, DefaultRootWindow(dpy), 0, 0, 256, 256, 0, vi->depth, InputOutput, vi->visual, CWColormap | CWEventMask, &swa);
-    XMapWindow(dpy, win);
-    XStoreName(dpy, win, "Textured Triangle");
-
-    // 4. Create an OpenGL context and make it current
-    GLXContext glc = glXCreateContext(dpy, vi, NULL, GL_TRUE);
-    glXMakeCurrent(dpy, win, glc);
+    // 1-4. Open the display, create a window or pbuffer, create a context and make it current
+    GLContext* ctx = createGLContext(options);
+    printf("context: %s %.3f ms\n", backendToString(options.backend), getContextCreationMs(ctx));
 
     // Initialize GL functions
-    init_gl_functions();
+    beginStage("load functions");
+    init_gl_functions(ctx, loadMode);
+    if (tracePath) {
+        startGLTrace(ctx, options, tracePath);
+    }
+    setGLErrorMode(errorMode, debugSeverity);
+    enableGPUStageTimers();
 
-    // 5. Compile and link shaders
-    GLuint program = glCreateProgram();
+    // 5. Compile and link shaders, or load them from the program cache. With
+    // --watch-shaders they come from DIR/triangle.vert and DIR/triangle.frag.
+    beginStage("compile");
+    GLuint program;
+    static const char* const attribs[] = { "p", "uv" };
+    std::string vsPath;
+    std::string fsPath;
     {
-        GLuint vs = compileShader(GL_VERTEX_SHADER,
+        const char* vs =
         R"RAW(#version 460
         in vec2 p;
         in vec2 uv;
@@ -157,9 +336,9 @@ int main(int argc, const char* argv[])
           gl_Position = vec4(p, 0, 1);
           v_uv = uv;
         }
-        )RAW");
+        )RAW";
 
-        GLuint fs = compileShader(GL_FRAGMENT_SHADER,
+        const char* fs =
         R"RAW(#version 460
          uniform sampler2D u_tex;
          in vec2 v_uv;
@@ -167,72 +346,348 @@ int main(int argc, const char* argv[])
          void main() {
            fragColor = texture(u_tex, v_uv);
          }
-        )RAW");
+        )RAW";
 
-        glAttachShader(program, vs);
-        glAttachShader(program, fs);
-        glBindAttribLocation(program, 0, "p");
-        glBindAttribLocation(program, 1, "uv");
-        linkProgram(program);
+        std::string vsFile;
+        std::string fsFile;
+        if (shaderDir) {
+            vsPath = std::string(shaderDir) + "/triangle.vert";
+            fsPath = std::string(shaderDir) + "/triangle.frag";
+            if (!readShaderFile(vsPath, vs, &vsFile) || !readShaderFile(fsPath, fs, &fsFile)) {
+                exit(1);
+            }
+            vs = vsFile.c_str();
+            fs = fsFile.c_str();
+        }
+        program = createCachedProgram(vs, fs, attribs, 2);
+        glrAdopt(GLR_PROGRAM, program, "program");
     }
     checkError("programs");
 
+    // Saved shaders are compiled on a watcher thread with its own shared context
+    // and swapped in between frames once they have linked.
+    ShaderReloader* reloader = nullptr;
+    if (shaderDir) {
+        init_gl_functions(ctx, GL_LOAD_EAGER);
+        reloader = new ShaderReloader(ctx, vsPath.c_str(), fsPath.c_str(), attribs, 2);
+        printf("shaders      : watching %s and %s, %s\n", vsPath.c_str(), fsPath.c_str(),
+               reloader->parallelCompile() ? "GL_KHR_parallel_shader_compile" : "no parallel compile");
+    }
+
     // 6. Create texture
+    beginStage("texture");
     GLuint tex;
-    glGenTextures(1, &tex);
-    glBindTexture(GL_TEXTURE_2D, tex);
-    GLubyte pixels[] = {
-        255, 0, 0, 255,    0, 255, 0, 255,
-        0, 0, 255, 255,    255, 255, 0, 255
-    };
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 2, 2, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    if (texturePath) {
+        // Compressed blocks go from the file mapping straight to the driver.
+        size_t residentBefore = residentBytes();
+        auto start = std::chrono::steady_clock::now();
+        TextureFile file;
+        if (!openTextureFile(texturePath, textureHeap, &file)) {
+            exit(1);
+        }
+        double loadMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+        start = std::chrono::steady_clock::now();
+        bool transcoded;
+        tex = uploadTextureFile(file, textureTranscode, &transcoded);
+        if (tex == 0) {
+            exit(1);
+        }
+        glFinish();
+        double uploadMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        size_t residentAfter = residentBytes();
+        printf("texture: %s %dx%d, %d levels, %s, %s, load %.3f ms, upload %.3f ms, resident +%.1f KB\n",
+               file.formatName, file.width, file.height, (int)file.levels.size(),
+               textureHeap ? "heap" : "mmap", transcoded ? "transcoded to RGBA8" : "compressed upload",
+               loadMs, uploadMs, (residentAfter - (double)residentBefore) / 1024.0);
+        closeTextureFile(&file);
+    } else {
+        tex = glrCreate(GLR_TEXTURE, "tex");
+        glsBindTexture(GL_TEXTURE_2D, tex);
+        GLubyte pixels[] = {
+            255, 0, 0, 255,    0, 255, 0, 255,
+            0, 0, 255, 255,    255, 255, 0, 255
+        };
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 2, 2, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+        glrSetBytes(GLR_TEXTURE, tex, glrTextureBytes(GL_RGBA8, 2, 2));
+        glsTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glsTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    }
     checkError("texture");
 
     // 7. Create vertex array
-    GLuint va;
-    glGenVertexArrays(1, &va);
-    glBindVertexArray(va);
+    beginStage("va");
+    GLuint va = glrCreate(GLR_VERTEX_ARRAY, "va");
+    glsBindVertexArray(va);
 
-    GLuint buf;
-    glGenBuffers(1, &buf);
+    GLuint buf = glrCreate(GLR_BUFFER, "buf");
     static const float data[] = {
         // positions     // uvs
         -0.5f, -0.5f,    0.0f, 0.0f,
          0.5f, -0.5f,    1.0f, 0.0f,
          0.0f,  0.5f,    0.5f, 1.0f
     };
-    glBindBuffer(GL_ARRAY_BUFFER, buf);
+    glsBindBuffer(GL_ARRAY_BUFFER, buf);
     glBufferData(GL_ARRAY_BUFFER, sizeof(data), data, GL_STATIC_DRAW);
+    glrSetBytes(GLR_BUFFER, buf, sizeof(data));
     glEnableVertexAttribArray(0);
     glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(float), (void*)0);
     glEnableVertexAttribArray(1);
     glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(float), (void*)(2*sizeof(float)));
     checkError("va");
 
-    // 8. Main loop
-    while (1) {
-        XEvent xev;
-        XNextEvent(dpy, &xev);
-        if (xev.type == Expose) {
-            glViewport(0, 0, 256, 256);
-            glClear(GL_COLOR_BUFFER_BIT);
-            glUseProgram(program);
-            glBindTexture(GL_TEXTURE_2D, tex);
-            glBindVertexArray(va);
-            glDrawArrays(GL_TRIANGLES, 0, 3);
-            glXSwapBuffers(dpy, win);
-        } else if (xev.type == KeyPress) {
-            break;
+    // 8. Main loop. Without a surface there is no default framebuffer so draw
+    // into a texture instead.
+    beginStage("main loop");
+    GLuint colorTex = 0;
+    GLuint fb = 0;
+    if (!hasDefaultFramebuffer(ctx)) {
+        colorTex = glrCreate(GLR_TEXTURE, "colorTex");
+        glsBindTexture(GL_TEXTURE_2D, colorTex);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, 256, 256, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        glrSetBytes(GLR_TEXTURE, colorTex, glrTextureBytes(GL_RGBA8, 256, 256));
+
+        fb = glrCreate(GLR_FRAMEBUFFER, "fb");
+        glsBindFramebuffer(GL_FRAMEBUFFER, fb);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, colorTex, 0);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+            printf("Framebuffer incomplete\n");
+            exit(1);
+        }
+    }
+
+    // The stress scene replaces the single triangle with thousands of instanced
+    // ones and only makes sense as a benchmark.
+    StressScene* stress = nullptr;
+    if (stressTriangles > 0) {
+        stress = new StressScene(stressTriangles, tex);
+        if (benchFrames == 0) {
+            benchFrames = 300;
+        }
+    }
+
+    // Streamed textures are generated and uploaded on a loader thread with its own
+    // shared context. Each one replaces the triangle's texture when it arrives.
+    TextureUploader* uploader = nullptr;
+    GLuint initialTex = tex;
+    if (streamTextures > 0) {
+        init_gl_functions(ctx, GL_LOAD_EAGER);
+        uploader = new TextureUploader(ctx);
+        for (int i = 0; i < streamTextures; ++i) {
+            uploader->request(streamSize, streamSize, [i](uint8_t* pixels, int width, int height) {
+                // A checkerboard with a different color per texture
+                uint8_t r = (i * 97) & 255, g = (i * 57 + 128) & 255, b = (i * 31 + 64) & 255;
+                for (int y = 0; y < height; ++y) {
+                    for (int x = 0; x < width; ++x) {
+                        bool on = ((x >> 5) ^ (y >> 5)) & 1;
+                        uint8_t* p = pixels + (y * width + x) * 4;
+                        p[0] = on ? r : 255 - r;
+                        p[1] = on ? g : 255 - g;
+                        p[2] = on ? b : 255 - b;
+                        p[3] = 255;
+                    }
+                }
+            });
+        }
+        if (benchFrames == 0) {
+            benchFrames = 300;
+        }
+    }
+
+    auto pollBackground = [&]() {
+        ShaderReloader::Reload reload;
+        if (reloader && reloader->poll(&reload)) {
+            glsUseProgram(reload.program);
+            glrDelete(GLR_PROGRAM, program);
+            program = reload.program;
+            printf("reload       : program %u, compile and link %.3f ms, %.3f ms from the save to the swap\n",
+                   program, reload.compileMs, reload.latencyMs);
+        }
+
+        uint32_t id;
+        GLuint streamed;
+        while (uploader && uploader->poll(&id, &streamed)) {
+            if (tex != initialTex) {
+                glrDelete(GLR_TEXTURE, tex);
+            }
+            tex = streamed;
+            if (stress) {
+                stress->setTexture(tex);
+            }
+        }
+    };
+
+    // Everything but the viewport, so the offscreen renderer can draw it in tiles.
+    auto drawScene = [&]() {
+        glClear(GL_COLOR_BUFFER_BIT);
+        if (stress) {
+            stress->draw();
+            return;
         }
+        glsUseProgram(program);
+        glsBindTexture(GL_TEXTURE_2D, tex);
+        glsBindVertexArray(va);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+    };
+
+    std::function<void()> drawFrame = [&]() {
+        pollBackground();
+        // Through the state cache, so redrawing an unchanged frame sets nothing.
+        glsViewport(0, 0, 256, 256);
+        drawScene();
+    };
+
+    // Offscreen at any size. Each frame can be compared against a golden image,
+    // and the last one is written out.
+    OffscreenRenderer* offscreen = nullptr;
+    Image golden;
+    Image frameImage;
+    Image heatmap;
+    std::vector<double> diffMs;
+    uint64_t failedFrames = 0;
+    ImageDiff lastDiff = {};
+    if (renderWidth > 0 || capturePath || goldenPath) {
+        if (goldenPath && !readImage(goldenPath, &golden)) {
+            exit(1);
+        }
+        if (renderWidth == 0) {
+            renderWidth = goldenPath ? golden.width : 256;
+            renderHeight = goldenPath ? golden.height : 256;
+        }
+        offscreen = new OffscreenRenderer(renderWidth, renderHeight, maxTile);
+        printf("offscreen    : %dx%d in %d tiles of up to %d\n", renderWidth, renderHeight, offscreen->numTiles(),
+               offscreen->tileSize());
+        drawFrame = [&]() {
+            pollBackground();
+            offscreen->render(drawScene, &frameImage);
+            if (goldenPath) {
+                if (!diffImages(frameImage, golden, tolerance, &lastDiff, heatmapPath ? &heatmap : nullptr)) {
+                    exit(1);
+                }
+                diffMs.push_back(lastDiff.ms);
+                failedFrames += lastDiff.failed > 0;
+            }
+        };
+    }
+
+    if (benchFrames > 0) {
+        if (swapInterval >= 0 && !setSwapInterval(ctx, swapInterval)) {
+            printf("Can't set the swap interval, no swap control extension\n");
+        }
+        BenchmarkResult result = runBenchmark(ctx, benchFrames, drawFrame);
+        if (stress) {
+            double seconds = result.totalMs / 1000.0;
+            const StreamRing::Stats& ringStats = stress->ring().stats();
+            printf("stress       : %d triangles/frame, %.3f Mtri/s, %.3f MB/s streamed, %llu waits on the ring (%.3f ms)\n",
+                   stress->numTriangles(),
+                   (double)result.frames * stress->numTriangles() / seconds / 1e6,
+                   (double)result.frames * stress->bytesPerFrame() / seconds / 1e6,
+                   (unsigned long long)ringStats.waits, ringStats.waitMs);
+            delete stress;
+        }
+        if (uploader) {
+            TextureUploader::Stats uploadStats = uploader->stats();
+            // Nothing may have finished uploading in a short benchmark.
+            double uploadRate = uploadStats.uploadMs > 0.0 ? uploadStats.bytes / 1e3 / uploadStats.uploadMs : 0.0;
+            printf("uploads      : %llu of %llu textures, %.1f MB, %.1f MB/s upload, %.3f ms generating, max queue depth %d\n",
+                   (unsigned long long)uploadStats.completed, (unsigned long long)uploadStats.requested,
+                   uploadStats.bytes / 1e6, uploadRate,
+                   uploadStats.generateMs, uploadStats.maxQueueDepth);
+            delete uploader;
+        }
+    } else if (offscreen) {
+        drawFrame();
+        checkError("draw");
+    } else if (hasWindow(ctx)) {
+        // Watched shaders can change at any time, so keep drawing instead of
+        // waiting for Expose.
+        while (1) {
+            GLContextEvent event = reloader ? pollEvent(ctx) : waitEvent(ctx);
+            if (event == EVENT_EXPOSE || (reloader && event == EVENT_NONE)) {
+                drawFrame();
+                swapBuffers(ctx);
+            } else if (event == EVENT_KEY_PRESS) {
+                break;
+            }
+        }
+    } else {
+        // No window so draw one frame and show what ended up in the middle of the triangle.
+        drawFrame();
+
+        GLubyte pixel[4];
+        glReadPixels(128, 96, 1, 1, GL_RGBA, GL_UNSIGNED_BYTE, pixel);
+        checkError("draw");
+        printf("pixel at 128,96: %d %d %d %d\n", pixel[0], pixel[1], pixel[2], pixel[3]);
     }
 
-    // 9. Cleanup
-    glXMakeCurrent(dpy, None, NULL);
-    glXDestroyContext(dpy, glc);
-    XDestroyWindow(dpy, win);
-    XCloseDisplay(dpy);
+    bool goldenFailed = false;
+    if (offscreen) {
+        const OffscreenRenderer::Stats& offscreenStats = offscreen->stats();
+        printf("offscreen    : %llu frames, %.3f ms drawing, %.3f ms reading back per frame\n",
+               (unsigned long long)offscreenStats.frames, offscreenStats.drawMs / offscreenStats.frames,
+               offscreenStats.readbackMs / offscreenStats.frames);
+        if (capturePath && writeImage(capturePath, frameImage)) {
+            printf("captured     : %s\n", capturePath);
+        }
+        if (goldenPath) {
+            printImageDiff("golden       ", lastDiff);
+            if (diffMs.size() > 1) {
+                printSummary("image diff", diffMs);
+                printf("golden       : %llu of %d frames over tolerance\n", (unsigned long long)failedFrames,
+                       (int)diffMs.size());
+            }
+            if (heatmapPath && writeImage(heatmapPath, heatmap)) {
+                printf("heatmap      : %s\n", heatmapPath);
+            }
+            goldenFailed = failedFrames > 0;
+        }
+        delete offscreen;
+    }
+
+    if (reloader) {
+        ShaderReloader::Stats reloadStats = reloader->stats();
+        printf("shaders      : %llu saves, %llu linked (%.3f ms each), %llu swapped in, %llu failed, %llu abandoned\n",
+               (unsigned long long)reloadStats.saves, (unsigned long long)reloadStats.linked,
+               reloadStats.linked ? reloadStats.compileMs / reloadStats.linked : 0.0,
+               (unsigned long long)reloadStats.reloads, (unsigned long long)reloadStats.failed,
+               (unsigned long long)reloadStats.abandoned);
+        delete reloader;
+    }
+
+    resolveStageTimers();
+    printGLLoaderStats();
+    printProgramCacheStats();
+    printGLStateStats();
+    printGLErrorStats();
+    if (tracePath) {
+        stopGLTrace();
+        printGLTraceStats();
+    }
+
+    // 9. Cleanup. Whatever the report still lists leaked.
+    beginStage("cleanup");
+    glsUseProgram(0);
+    glsBindFramebuffer(GL_FRAMEBUFFER, 0);
+    if (fb) {
+        glrDelete(GLR_FRAMEBUFFER, fb);
+        glrDelete(GLR_TEXTURE, colorTex);
+    }
+    glrDelete(GLR_BUFFER, buf);
+    glrDelete(GLR_VERTEX_ARRAY, va);
+    if (tex != initialTex) {
+        glrDelete(GLR_TEXTURE, tex);
+    }
+    glrDelete(GLR_TEXTURE, initialTex);
+    glrDelete(GLR_PROGRAM, program);
+    glrTrimPools();
+    printGLResourceReport();
+    destroyGLContext(ctx);
+    endStage();
+
+    if (timingsPath && !writeStageTimingsJSON(timingsPath, "textured-triangle", backendToString(options.backend))) {
+        printf("Cannot write %s\n", timingsPath);
+        return 1;
+    }
 
-    return 0;
+    return goldenFailed ? 1 : 0;
 }
\ No newline at end of file
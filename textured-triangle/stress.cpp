@@ -0,0 +1,136 @@
+#include "stress.h"
+
+#include <math.h>
+#include <algorithm>
+#include <vector>
+
+#include "../common/gl_helpers.h"
+#include "../common/gl_resources.h"
+#include "../common/gl_state.h"
+#include "../common/program_cache.h"
+
+namespace {
+
+struct DrawArraysIndirectCommand {
+    GLuint count;
+    GLuint instanceCount;
+    GLuint first;
+    GLuint baseInstance;
+};
+
+const int numSegments = 3;
+const int instancesPerCommand = 16384;
+
+}  // namespace
+
+StressScene::StressScene(int numTriangles, GLuint texture)
+    : numTriangles_(numTriangles), texture_(texture) {
+    const char* vs =
+    R"RAW(#version 460
+    in vec2 p;
+    in vec2 uv;
+    in vec4 inst;
+    out vec2 v_uv;
+    void main() {
+      gl_Position = vec4(p * inst.z + inst.xy, 0, 1);
+      v_uv = uv;
+    }
+    )RAW";
+
+    const char* fs =
+    R"RAW(#version 460
+     uniform sampler2D u_tex;
+     in vec2 v_uv;
+     out vec4 fragColor;
+     void main() {
+       fragColor = texture(u_tex, v_uv);
+     }
+    )RAW";
+
+    static const char* const attribs[] = { "p", "uv", "inst" };
+    program_ = createCachedProgram(vs, fs, attribs, 3);
+    glrAdopt(GLR_PROGRAM, program_, "stress");
+
+    va_ = glrCreate(GLR_VERTEX_ARRAY, "stress");
+    glsBindVertexArray(va_);
+
+    static const float data[] = {
+        // positions     // uvs
+        -0.5f, -0.5f,    0.0f, 0.0f,
+         0.5f, -0.5f,    1.0f, 0.0f,
+         0.0f,  0.5f,    0.5f, 1.0f
+    };
+    vertexBuffer_ = glrCreate(GLR_BUFFER, "stress triangle");
+    glsBindBuffer(GL_ARRAY_BUFFER, vertexBuffer_);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(data), data, GL_STATIC_DRAW);
+    glrSetBytes(GLR_BUFFER, vertexBuffer_, sizeof(data));
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(float), (void*)0);
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(float), (void*)(2*sizeof(float)));
+
+    // The instance attribute covers every segment. baseInstance picks the segment.
+    ring_ = new StreamRing(GL_ARRAY_BUFFER, bytesPerFrame(), numSegments);
+    glsBindBuffer(GL_ARRAY_BUFFER, ring_->buffer());
+    glEnableVertexAttribArray(2);
+    glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, sizeof(Instance), (void*)0);
+    glVertexAttribDivisor(2, 1);
+
+    numCommands_ = (numTriangles + instancesPerCommand - 1) / instancesPerCommand;
+    std::vector<DrawArraysIndirectCommand> commands;
+    for (int segment = 0; segment < numSegments; ++segment) {
+        for (int first = 0; first < numTriangles; first += instancesPerCommand) {
+            DrawArraysIndirectCommand command;
+            command.count = 3;
+            command.instanceCount = std::min(instancesPerCommand, numTriangles - first);
+            command.first = 0;
+            command.baseInstance = segment * numTriangles + first;
+            commands.push_back(command);
+        }
+    }
+    indirectBuffer_ = glrCreate(GLR_BUFFER, "stress commands");
+    glsBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectBuffer_);
+    glBufferData(GL_DRAW_INDIRECT_BUFFER, commands.size() * sizeof(commands[0]), commands.data(), GL_STATIC_DRAW);
+    glrSetBytes(GLR_BUFFER, indirectBuffer_, commands.size() * sizeof(commands[0]));
+
+    columns_ = (int)ceil(sqrt((double)numTriangles));
+    checkError("stress setup");
+}
+
+StressScene::~StressScene() {
+    delete ring_;
+    glrDelete(GLR_BUFFER, indirectBuffer_);
+    glrDelete(GLR_BUFFER, vertexBuffer_);
+    glrDelete(GLR_VERTEX_ARRAY, va_);
+    glrDelete(GLR_PROGRAM, program_);
+}
+
+size_t StressScene::bytesPerFrame() const {
+    return numTriangles_ * sizeof(Instance);
+}
+
+void StressScene::draw() {
+    // Lay the triangles out on a grid that drifts a little every frame so each
+    // frame's data really is new.
+    Instance* instances = (Instance*)ring_->beginSegment();
+    float cell = 2.0f / columns_;
+    float drift = (frame_++ % 16) * cell * (1.0f / 64.0f);
+    for (int i = 0; i < numTriangles_; ++i) {
+        int col = i % columns_;
+        int row = i / columns_;
+        instances[i].x = -1.0f + (col + 0.5f) * cell + drift;
+        instances[i].y = -1.0f + (row + 0.5f) * cell;
+        instances[i].scale = cell;
+        instances[i].pad = 0.0f;
+    }
+    ring_->segmentWritten(bytesPerFrame());
+
+    // Only the first frame, or a new texture, actually changes any of these.
+    glsUseProgram(program_);
+    glsBindTexture(GL_TEXTURE_2D, texture_);
+    glsBindVertexArray(va_);
+    glsBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectBuffer_);
+    size_t commandOffset = ring_->segmentIndex() * numCommands_ * sizeof(DrawArraysIndirectCommand);
+    glMultiDrawArraysIndirect(GL_TRIANGLES, (void*)commandOffset, numCommands_, 0);
+    ring_->endSegment();
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <stddef.h>
+
+#include "../common/gl_loader.h"
+#include "../common/stream_ring.h"
+
+//-----------------------------------------------------------------------------------
+// Geometry stress scene
+//
+// Draws numTriangles copies of the textured triangle per frame, one instance each,
+// with glMultiDrawArraysIndirect. Each frame's per-instance offsets and scales are
+// written into a triple-buffered persistently mapped StreamRing; baseInstance in
+// the indirect commands selects the segment being drawn.
+//-----------------------------------------------------------------------------------
+
+class StressScene {
+public:
+    StressScene(int numTriangles, GLuint texture);
+    ~StressScene();
+
+    // Streams this frame's instance data and draws it.
+    void draw();
+
+    void setTexture(GLuint texture) { texture_ = texture; }
+
+    int numTriangles() const { return numTriangles_; }
+    size_t bytesPerFrame() const;
+    const StreamRing& ring() const { return *ring_; }
+
+private:
+    struct Instance {
+        float x;
+        float y;
+        float scale;
+        float pad;
+    };
+
+    int numTriangles_;
+    int numCommands_;
+    int columns_;
+    unsigned frame_ = 0;
+    GLuint texture_;
+    GLuint program_;
+    GLuint va_;
+    GLuint vertexBuffer_;
+    GLuint indirectBuffer_;
+    StreamRing* ring_;
+};